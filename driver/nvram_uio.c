@@ -3,45 +3,891 @@
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
 #include <linux/uio_driver.h>
+#include <linux/platform_device.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/dmaengine.h>
+#include <linux/dmapool.h>
+#include <linux/interrupt.h>
+#include <linux/scatterlist.h>
 
 #include "umem.h"
 
+static unsigned long dma_buffer_size = 4 * 1024 * 1024 - PAGE_SIZE;
+module_param (dma_buffer_size, ulong, S_IRUGO);
+MODULE_PARM_DESC (dma_buffer_size, "Size in bytes of the DMA buffer allocated for each open file of the device");
+
+static unsigned int mock_devices = 0;
+module_param (mock_devices, uint, S_IRUGO);
+MODULE_PARM_DESC (mock_devices, "Number of mock devices to create, emulated in host memory without PCI hardware");
+
+static unsigned int mock_memory_mb = 128;
+module_param (mock_memory_mb, uint, S_IRUGO);
+MODULE_PARM_DESC (mock_memory_mb, "Memory size in MB of each mock device, one of 128, 256, 512, 1024 or 2048");
+
+static unsigned int mock_spin_us = 1000;
+module_param (mock_spin_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC (mock_spin_us, "Time the mock DMA engine polls for the next chain without sleeping after a chain");
+
+static unsigned int mock_sleep_us = 50;
+module_param (mock_sleep_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC (mock_sleep_us, "Time the idle mock DMA engine sleeps between polls for a chain");
+
+static bool dmaengine = false;
+module_param (dmaengine, bool, S_IRUGO);
+MODULE_PARM_DESC (dmaengine, "Register the DMA engine of each card as a dmaengine device, instead of userspace DMA");
+
+/** The DMA mapping allocated for one open file of the device */
+struct nvram_uio_file_dma {
+    struct list_head list;
+    struct nvram_uio_device *nvram;
+    /** The file which the DMA mapping is for */
+    struct file *file;
+    /** The number of vmas which map the DMA mapping */
+    unsigned int num_mappings;
+    struct page *pages;
+    unsigned int order;
+    size_t size;
+    dma_addr_t bus_addr;
+};
+
+/** The driver state for one device */
+struct nvram_uio_device {
+    struct uio_info info;
+    /** The PCI device, or NULL for a mock device */
+    struct pci_dev *pdev;
+    /** The device used for DMA mappings, of either the PCI device or the mock platform device */
+    struct device *dev;
+    /** Holds a reference for the device and one for each file DMA mapping, which may outlive the device */
+    struct kref kref;
+    /** Protects file_dmas */
+    struct mutex file_dma_lock;
+    struct list_head file_dmas;
+    /** The enum nvram_uio_recovery_state of PCI error recovery, and the number of recoveries completed */
+    atomic_t recovery_state;
+    atomic_t recovery_count;
+    /** For a mock device, the emulated device memory and the thread which emulates the DMA engine */
+    void *mock_memory;
+    size_t mock_memory_size;
+    struct task_struct *mock_dma_thread;
+    /** When the dmaengine module parameter is set, the dmaengine channel which owns the DMA engine */
+    struct nvram_uio_dma_chan *dma_chan;
+};
+
+/* The maximum number of scatterlist entries in one dmaengine transfer, which fills a page with card descriptors */
+#define NVRAM_UIO_DMAENGINE_MAX_SG (PAGE_SIZE / sizeof (struct mm_dma_desc))
+
+/* How long releasing the dmaengine channel waits for a transfer in progress on the card to complete */
+#define NVRAM_UIO_DMAENGINE_IDLE_TIMEOUT_MS 1000
+
+/* The number of the most recent failed cookies remembered for the tx_status of the channel */
+#define NVRAM_UIO_DMAENGINE_FAILED_COOKIES 64
+
+/** One transfer submitted by a dmaengine client, which is performed as one chain of card descriptors */
+struct nvram_uio_dma_txd {
+    struct dma_async_tx_descriptor txd;
+    struct list_head node;
+    enum dma_transfer_direction direction;
+    struct mm_dma_desc *hw_descs;
+    dma_addr_t hw_descs_bus_addr;
+    bool failed;
+    /** Set when the transfer was abandoned by PCI error recovery, rather than failed by the card */
+    bool aborted;
+};
+
+/** The single dmaengine channel of a card */
+struct nvram_uio_dma_chan {
+    struct dma_device dma_dev;
+    struct dma_chan chan;
+    struct nvram_uio_device *nvram;
+    uint64_t memory_size;
+    struct dma_pool *desc_pool;
+    /** Protects the fields below, and the cookies of the channel */
+    spinlock_t lock;
+    /** Gives the card offset of slave transfers */
+    struct dma_slave_config config;
+    /** Transfers which have been submitted, issued, are in progress on the card, and have completed */
+    struct list_head submitted;
+    struct list_head issued;
+    struct nvram_uio_dma_txd *active;
+    struct list_head completed;
+    /**
+     * The cookies of the most recent failed transfers, as a ring indexed by next_failed_cookie. A zero entry is
+     * unused, since cookies start at DMA_MIN_COOKIE.
+     */
+    dma_cookie_t failed_cookies[NVRAM_UIO_DMAENGINE_FAILED_COOKIES];
+    unsigned int next_failed_cookie;
+    /** Set while PCI error recovery is in progress, when issued transfers aren't started on the card */
+    bool stopped;
+    /** Runs the completion callbacks */
+    struct tasklet_struct tasklet;
+};
+
+/* The maximum number of mock devices, and the longest DMA chain the mock DMA engine follows */
+#define NVRAM_UIO_MAX_MOCK_DEVICES 8
+#define NVRAM_UIO_MOCK_MAX_CHAIN 4096
+
+static struct platform_device *nvram_uio_mock_pdevs[NVRAM_UIO_MAX_MOCK_DEVICES];
+
+static void nvram_uio_configure_pci (struct pci_dev *dev);
+static const struct attribute_group nvram_uio_recovery_group;
+
 static struct pci_device_id nvram_uio_pci_ids[] =
 {
     {PCI_DEVICE(PCI_VENDOR_ID_MICRO_MEMORY, PCI_DEVICE_ID_MICRO_MEMORY_5425CN)},
     { 0, }
 };
 
+static void nvram_uio_release_device (struct kref *kref)
+{
+    struct nvram_uio_device *nvram = container_of (kref, struct nvram_uio_device, kref);
+
+    kfree (nvram);
+}
+
+/* Decode the MEMCTRLSTATUS_MEMORY register into the memory size in bytes, or zero if not recognised */
+static uint64_t nvram_uio_memory_size (u8 memctrlstatus_memory)
+{
+    switch (memctrlstatus_memory)
+    {
+    case MEM_128_MB: return 128ULL << 20;
+    case MEM_256_MB: return 256ULL << 20;
+    case MEM_512_MB: return 512ULL << 20;
+    case MEM_1_GB:   return 1ULL << 30;
+    case MEM_2_GB:   return 2ULL << 30;
+    default:         return 0;
+    }
+}
+
+static struct nvram_uio_dma_chan *to_nvram_uio_dma_chan (struct dma_chan *chan)
+{
+    return container_of (chan, struct nvram_uio_dma_chan, chan);
+}
+
+static struct nvram_uio_dma_txd *to_nvram_uio_dma_txd (struct dma_async_tx_descriptor *txd)
+{
+    return container_of (txd, struct nvram_uio_dma_txd, txd);
+}
+
+static void nvram_uio_dmaengine_free_txd (struct nvram_uio_dma_chan *dc, struct nvram_uio_dma_txd *txd)
+{
+    dma_pool_free (dc->desc_pool, txd->hw_descs, txd->hw_descs_bus_addr);
+    kfree (txd);
+}
+
+/* Start the next issued transfer on the card if it is idle, with the lock held. The card interrupts at the end. */
+static void nvram_uio_dmaengine_start_next (struct nvram_uio_dma_chan *dc)
+{
+    void __iomem *csr = dc->nvram->info.mem[CSR_MAPPING_INDEX].internal_addr;
+
+    if (dc->stopped || (dc->active != NULL) || list_empty (&dc->issued))
+    {
+        return;
+    }
+
+    dc->active = list_first_entry (&dc->issued, struct nvram_uio_dma_txd, node);
+    list_del (&dc->active->node);
+    writel (lower_32_bits (dc->active->hw_descs_bus_addr), csr + DMA_DESCRIPTOR_ADDR);
+    writel (upper_32_bits (dc->active->hw_descs_bus_addr), csr + DMA_DESCRIPTOR_ADDR + 4);
+    writel (DMASCR_GO | DMASCR_CHAIN_EN | DMASCR_READMULTI, csr + DMA_STATUS_CTRL);
+}
+
+/*
+ * Handle the interrupt at the end of the chain of the transfer in progress, or on an error. The error status is
+ * cleared, which stops the engine, and the next issued transfer is started before the callbacks run.
+ */
+static irqreturn_t nvram_uio_dmaengine_interrupt (struct nvram_uio_dma_chan *dc)
+{
+    void __iomem *csr = dc->nvram->info.mem[CSR_MAPPING_INDEX].internal_addr;
+    u32 dma_status;
+    bool failed;
+
+    /* The registers of a device in PCI error recovery can't be trusted, and the transfers have been aborted */
+    if (READ_ONCE (dc->stopped))
+    {
+        return IRQ_NONE;
+    }
+    dma_status = readl (csr + DMA_STATUS_CTRL);
+    failed = (dma_status & DMASCR_ERROR_MASK) != 0;
+    if ((dma_status & (DMASCR_ERROR_MASK | DMASCR_CHAIN_COMPLETE)) == 0)
+    {
+        return IRQ_NONE;
+    }
+
+    if (failed)
+    {
+        dev_printk (KERN_ERR, dc->nvram->dev, "DMA error, status 0x%08x\n", dma_status);
+        writel (dma_status & DMASCR_ERROR_MASK, csr + DMA_STATUS_CTRL);
+    }
+    else
+    {
+        writeb ((DMASCR_DMA_COMPLETE | DMASCR_CHAIN_COMPLETE) >> 16, csr + DMA_STATUS_CTRL + 2);
+    }
+
+    spin_lock (&dc->lock);
+    if (dc->active != NULL)
+    {
+        dc->active->failed = failed;
+        list_add_tail (&dc->active->node, &dc->completed);
+        dc->active = NULL;
+    }
+    nvram_uio_dmaengine_start_next (dc);
+    spin_unlock (&dc->lock);
+    tasklet_schedule (&dc->tasklet);
+
+    return IRQ_HANDLED;
+}
+
+/* Complete the cookies of the transfers which have completed, and run their callbacks */
+static void nvram_uio_dmaengine_tasklet (unsigned long data)
+{
+    struct nvram_uio_dma_chan *dc = (struct nvram_uio_dma_chan *) data;
+    struct nvram_uio_dma_txd *txd;
+    struct nvram_uio_dma_txd *next;
+    struct dmaengine_result result;
+    unsigned long flags;
+    LIST_HEAD (completed);
+
+    spin_lock_irqsave (&dc->lock, flags);
+    list_splice_tail_init (&dc->completed, &completed);
+    list_for_each_entry (txd, &completed, node)
+    {
+        dc->chan.completed_cookie = txd->txd.cookie;
+        if (txd->failed)
+        {
+            dc->failed_cookies[dc->next_failed_cookie] = txd->txd.cookie;
+            dc->next_failed_cookie = (dc->next_failed_cookie + 1) % NVRAM_UIO_DMAENGINE_FAILED_COOKIES;
+        }
+    }
+    spin_unlock_irqrestore (&dc->lock, flags);
+
+    list_for_each_entry_safe (txd, next, &completed, node)
+    {
+        result.residue = 0;
+        if (!txd->failed)
+        {
+            result.result = DMA_TRANS_NOERROR;
+        }
+        else if (txd->aborted)
+        {
+            result.result = DMA_TRANS_ABORTED;
+        }
+        else
+        {
+            result.result = (txd->direction == DMA_MEM_TO_DEV) ? DMA_TRANS_READ_FAILED : DMA_TRANS_WRITE_FAILED;
+        }
+        if (txd->txd.callback_result != NULL)
+        {
+            txd->txd.callback_result (txd->txd.callback_param, &result);
+        }
+        else if (txd->txd.callback != NULL)
+        {
+            txd->txd.callback (txd->txd.callback_param);
+        }
+        dma_run_dependencies (&txd->txd);
+        list_del (&txd->node);
+        nvram_uio_dmaengine_free_txd (dc, txd);
+    }
+}
+
+static dma_cookie_t nvram_uio_dmaengine_tx_submit (struct dma_async_tx_descriptor *tx)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (tx->chan);
+    unsigned long flags;
+    dma_cookie_t cookie;
+
+    spin_lock_irqsave (&dc->lock, flags);
+    cookie = dc->chan.cookie + 1;
+    if (cookie < DMA_MIN_COOKIE)
+    {
+        cookie = DMA_MIN_COOKIE;
+    }
+    dc->chan.cookie = cookie;
+    tx->cookie = cookie;
+    list_add_tail (&to_nvram_uio_dma_txd (tx)->node, &dc->submitted);
+    spin_unlock_irqrestore (&dc->lock, flags);
+
+    return cookie;
+}
+
+/*
+ * Prepare a transfer between a scatterlist in host memory and a contiguous range of the card memory, which starts
+ * at the dst_addr (DMA_MEM_TO_DEV) or src_addr (DMA_DEV_TO_MEM) of the slave configuration as an offset in the
+ * card memory. Each scatterlist entry is one card descriptor, and only the last interrupts.
+ */
+static struct dma_async_tx_descriptor *nvram_uio_dmaengine_prep_slave_sg (struct dma_chan *chan,
+        struct scatterlist *sgl, unsigned int sg_len, enum dma_transfer_direction direction, unsigned long flags,
+        void *context)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (chan);
+    struct nvram_uio_dma_txd *txd;
+    struct scatterlist *sg;
+    struct mm_dma_desc *desc;
+    const u32 control_bits = DMASCR_GO | DMASCR_CHAIN_EN | DMASCR_ERR_INT_EN | DMASCR_PARITY_INT_EN |
+            DMASCR_READMULTI | ((direction == DMA_MEM_TO_DEV) ? DMASCR_TRANSFER_READ : 0);
+    unsigned long lock_flags;
+    uint64_t card_addr;
+    unsigned int i;
+
+    if (((direction != DMA_MEM_TO_DEV) && (direction != DMA_DEV_TO_MEM)) || (sg_len == 0) ||
+        (sg_len > NVRAM_UIO_DMAENGINE_MAX_SG))
+    {
+        return NULL;
+    }
+    spin_lock_irqsave (&dc->lock, lock_flags);
+    card_addr = (direction == DMA_MEM_TO_DEV) ? dc->config.dst_addr : dc->config.src_addr;
+    spin_unlock_irqrestore (&dc->lock, lock_flags);
+
+    txd = kzalloc (sizeof (struct nvram_uio_dma_txd), GFP_NOWAIT);
+    if (txd == NULL)
+    {
+        return NULL;
+    }
+    txd->hw_descs = dma_pool_alloc (dc->desc_pool, GFP_NOWAIT, &txd->hw_descs_bus_addr);
+    if (txd->hw_descs == NULL)
+    {
+        kfree (txd);
+        return NULL;
+    }
+    txd->direction = direction;
+
+    for_each_sg (sgl, sg, sg_len, i)
+    {
+        if ((card_addr + sg_dma_len (sg)) > dc->memory_size)
+        {
+            nvram_uio_dmaengine_free_txd (dc, txd);
+            return NULL;
+        }
+        desc = &txd->hw_descs[i];
+        memset (desc, 0, sizeof (struct mm_dma_desc));
+        desc->pci_addr = cpu_to_le64 (sg_dma_address (sg));
+        desc->local_addr = cpu_to_le64 (card_addr);
+        desc->transfer_size = cpu_to_le32 (sg_dma_len (sg));
+        desc->next_desc_addr = cpu_to_le64 (txd->hw_descs_bus_addr + ((i + 1) * sizeof (struct mm_dma_desc)));
+        desc->control_bits = cpu_to_le32 (control_bits);
+        card_addr += sg_dma_len (sg);
+    }
+
+    /* Make the last descriptor end the chain, and interrupt on completion */
+    desc = &txd->hw_descs[sg_len - 1];
+    desc->control_bits = cpu_to_le32 ((control_bits & ~DMASCR_CHAIN_EN) | DMASCR_CHAIN_COMP_EN);
+    desc->next_desc_addr = 0;
+
+    dma_async_tx_descriptor_init (&txd->txd, chan);
+    txd->txd.tx_submit = nvram_uio_dmaengine_tx_submit;
+    txd->txd.flags = flags;
+
+    return &txd->txd;
+}
+
+static int nvram_uio_dmaengine_config (struct dma_chan *chan, struct dma_slave_config *config)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (chan);
+    unsigned long flags;
+
+    spin_lock_irqsave (&dc->lock, flags);
+    dc->config = *config;
+    spin_unlock_irqrestore (&dc->lock, flags);
+
+    return 0;
+}
+
+static void nvram_uio_dmaengine_issue_pending (struct dma_chan *chan)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (chan);
+    unsigned long flags;
+
+    spin_lock_irqsave (&dc->lock, flags);
+    list_splice_tail_init (&dc->submitted, &dc->issued);
+    nvram_uio_dmaengine_start_next (dc);
+    spin_unlock_irqrestore (&dc->lock, flags);
+}
+
+/*
+ * Return the status of a transfer. A completed transfer is reported as DMA_ERROR if it is one of the last
+ * NVRAM_UIO_DMAENGINE_FAILED_COOKIES transfers which failed. The result of an older failure is no longer known, so
+ * clients which poll for the status of many transfers should use the callback_result of each transfer instead.
+ */
+static enum dma_status nvram_uio_dmaengine_tx_status (struct dma_chan *chan, dma_cookie_t cookie,
+                                                      struct dma_tx_state *txstate)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (chan);
+    dma_cookie_t last_complete;
+    dma_cookie_t last_used;
+    enum dma_status status;
+    unsigned long flags;
+    unsigned int i;
+
+    spin_lock_irqsave (&dc->lock, flags);
+    last_complete = dc->chan.completed_cookie;
+    last_used = dc->chan.cookie;
+    status = dma_async_is_complete (cookie, last_complete, last_used);
+    if (status == DMA_COMPLETE)
+    {
+        for (i = 0; i < NVRAM_UIO_DMAENGINE_FAILED_COOKIES; i++)
+        {
+            if (dc->failed_cookies[i] == cookie)
+            {
+                status = DMA_ERROR;
+            }
+        }
+    }
+    spin_unlock_irqrestore (&dc->lock, flags);
+    dma_set_tx_state (txstate, last_complete, last_used, 0);
+
+    return status;
+}
+
+/* Discard the transfers which haven't been started. The card can't abort a chain, so one in progress completes. */
+static int nvram_uio_dmaengine_terminate_all (struct dma_chan *chan)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (chan);
+    struct nvram_uio_dma_txd *txd;
+    struct nvram_uio_dma_txd *next;
+    unsigned long flags;
+    LIST_HEAD (discarded);
+
+    spin_lock_irqsave (&dc->lock, flags);
+    list_splice_tail_init (&dc->submitted, &discarded);
+    list_splice_tail_init (&dc->issued, &discarded);
+    spin_unlock_irqrestore (&dc->lock, flags);
+
+    list_for_each_entry_safe (txd, next, &discarded, node)
+    {
+        list_del (&txd->node);
+        nvram_uio_dmaengine_free_txd (dc, txd);
+    }
+
+    return 0;
+}
+
+/* Wait for the transfer in progress on the card to complete, and its callback to have run */
+static void nvram_uio_dmaengine_synchronize (struct dma_chan *chan)
+{
+    struct nvram_uio_dma_chan *dc = to_nvram_uio_dma_chan (chan);
+    const unsigned long timeout = jiffies + msecs_to_jiffies (NVRAM_UIO_DMAENGINE_IDLE_TIMEOUT_MS);
+
+    while ((READ_ONCE (dc->active) != NULL) && time_before (jiffies, timeout))
+    {
+        msleep (1);
+    }
+    if (READ_ONCE (dc->active) != NULL)
+    {
+        dev_printk (KERN_WARNING, dc->nvram->dev, "Timeout waiting for a DMA chain to complete\n");
+    }
+    tasklet_kill (&dc->tasklet);
+}
+
+static void nvram_uio_dmaengine_free_chan_resources (struct dma_chan *chan)
+{
+    nvram_uio_dmaengine_terminate_all (chan);
+    nvram_uio_dmaengine_synchronize (chan);
+}
+
+/*
+ * On a PCI error stop starting transfers, and fail the transfer in progress and those issued with an aborted result,
+ * as the device may be reset before completing them. The callbacks run from the tasklet.
+ */
+static void nvram_uio_dmaengine_abort (struct nvram_uio_dma_chan *dc)
+{
+    struct nvram_uio_dma_txd *txd;
+    unsigned long flags;
+
+    spin_lock_irqsave (&dc->lock, flags);
+    WRITE_ONCE (dc->stopped, true);
+    if (dc->active != NULL)
+    {
+        list_add_tail (&dc->active->node, &dc->completed);
+        dc->active = NULL;
+    }
+    list_splice_tail_init (&dc->issued, &dc->completed);
+    list_for_each_entry (txd, &dc->completed, node)
+    {
+        if (!txd->failed)
+        {
+            txd->failed = true;
+            txd->aborted = true;
+        }
+    }
+    spin_unlock_irqrestore (&dc->lock, flags);
+    tasklet_schedule (&dc->tasklet);
+}
+
+/* Once the device has recovered from a PCI error, start the transfers issued during recovery */
+static void nvram_uio_dmaengine_restart (struct nvram_uio_dma_chan *dc)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave (&dc->lock, flags);
+    WRITE_ONCE (dc->stopped, false);
+    nvram_uio_dmaengine_start_next (dc);
+    spin_unlock_irqrestore (&dc->lock, flags);
+}
+
+/*
+ * Free the channel once the interrupt handler can no longer use it. Clearing the channel of the device stops new
+ * invocations of the handler using it, synchronize_irq() waits for one already running, and then the tasklet it may
+ * have scheduled is run to completion.
+ */
+static void nvram_uio_dmaengine_free (struct nvram_uio_device *nvram, struct nvram_uio_dma_chan *dc)
+{
+    struct nvram_uio_dma_txd *txd;
+    struct nvram_uio_dma_txd *next;
+
+    WRITE_ONCE (nvram->dma_chan, NULL);
+    if (nvram->info.irq > 0)
+    {
+        synchronize_irq (nvram->info.irq);
+    }
+    tasklet_kill (&dc->tasklet);
+
+    /* A chain which didn't complete within the timeout of the synchronize is abandoned */
+    if (dc->active != NULL)
+    {
+        nvram_uio_dmaengine_free_txd (dc, dc->active);
+        dc->active = NULL;
+    }
+    list_for_each_entry_safe (txd, next, &dc->completed, node)
+    {
+        list_del (&txd->node);
+        nvram_uio_dmaengine_free_txd (dc, txd);
+    }
+    if (dc->desc_pool != NULL)
+    {
+        dma_pool_destroy (dc->desc_pool);
+    }
+    kfree (dc);
+}
+
+/*
+ * Register the DMA engine of a card as a dmaengine device with one slave channel. The channel is private, so it is
+ * only used by clients which request it, e.g. with dma_request_channel() and a filter on the device. The card
+ * memory isn't in the host address space, so memcpy isn't offered.
+ */
+static int nvram_uio_register_dmaengine (struct nvram_uio_device *nvram)
+{
+    struct nvram_uio_dma_chan *dc;
+    struct dma_device *dma_dev;
+    int rc;
+
+    dc = kzalloc (sizeof (struct nvram_uio_dma_chan), GFP_KERNEL);
+    if (dc == NULL)
+    {
+        return -ENOMEM;
+    }
+    dc->nvram = nvram;
+    dc->memory_size = nvram_uio_memory_size (readb (nvram->info.mem[CSR_MAPPING_INDEX].internal_addr +
+                                                    MEMCTRLSTATUS_MEMORY));
+    spin_lock_init (&dc->lock);
+    INIT_LIST_HEAD (&dc->submitted);
+    INIT_LIST_HEAD (&dc->issued);
+    INIT_LIST_HEAD (&dc->completed);
+    tasklet_init (&dc->tasklet, nvram_uio_dmaengine_tasklet, (unsigned long) dc);
+    dc->desc_pool = dma_pool_create (DRIVER_NAME, nvram->dev,
+                                     NVRAM_UIO_DMAENGINE_MAX_SG * sizeof (struct mm_dma_desc), 64, 0);
+    if (dc->desc_pool == NULL)
+    {
+        nvram_uio_dmaengine_free (nvram, dc);
+        return -ENOMEM;
+    }
+
+    dma_dev = &dc->dma_dev;
+    dma_dev->dev = nvram->dev;
+    INIT_LIST_HEAD (&dma_dev->channels);
+    dma_cap_set (DMA_SLAVE, dma_dev->cap_mask);
+    dma_cap_set (DMA_PRIVATE, dma_dev->cap_mask);
+    dma_dev->src_addr_widths = BIT (DMA_SLAVE_BUSWIDTH_8_BYTES);
+    dma_dev->dst_addr_widths = BIT (DMA_SLAVE_BUSWIDTH_8_BYTES);
+    dma_dev->directions = BIT (DMA_MEM_TO_DEV) | BIT (DMA_DEV_TO_MEM);
+    dma_dev->residue_granularity = DMA_RESIDUE_GRANULARITY_DESCRIPTOR;
+    dma_dev->device_free_chan_resources = nvram_uio_dmaengine_free_chan_resources;
+    dma_dev->device_prep_slave_sg = nvram_uio_dmaengine_prep_slave_sg;
+    dma_dev->device_config = nvram_uio_dmaengine_config;
+    dma_dev->device_issue_pending = nvram_uio_dmaengine_issue_pending;
+    dma_dev->device_tx_status = nvram_uio_dmaengine_tx_status;
+    dma_dev->device_terminate_all = nvram_uio_dmaengine_terminate_all;
+    dma_dev->device_synchronize = nvram_uio_dmaengine_synchronize;
+
+    dc->chan.device = dma_dev;
+    dc->chan.cookie = DMA_MIN_COOKIE;
+    dc->chan.completed_cookie = DMA_MIN_COOKIE;
+    list_add_tail (&dc->chan.device_node, &dma_dev->channels);
+
+    /* Set first, as the interrupt handler may run as soon as the device is registered */
+    WRITE_ONCE (nvram->dma_chan, dc);
+    rc = dma_async_device_register (dma_dev);
+    if (rc != 0)
+    {
+        nvram_uio_dmaengine_free (nvram, dc);
+    }
+
+    return rc;
+}
+
+/* Unregister the dmaengine device, once clients have released the channel */
+static void nvram_uio_unregister_dmaengine (struct nvram_uio_device *nvram)
+{
+    struct nvram_uio_dma_chan *dc = nvram->dma_chan;
+
+    if (dc == NULL)
+    {
+        return;
+    }
+    dma_async_device_unregister (&dc->dma_dev);
+    nvram_uio_dmaengine_free_chan_resources (&dc->chan);
+    nvram_uio_dmaengine_free (nvram, dc);
+}
+
 static irqreturn_t nvram_uio_handler (int irq, struct uio_info *dev_info)
 {
+    struct nvram_uio_device *nvram = container_of (dev_info, struct nvram_uio_device, info);
+    struct nvram_uio_dma_chan *dc = READ_ONCE (nvram->dma_chan);
+
+    if (dc != NULL)
+    {
+        return nvram_uio_dmaengine_interrupt (dc);
+    }
+
     return IRQ_NONE;
 }
 
+static void nvram_uio_free_file_dma (struct nvram_uio_file_dma *file_dma)
+{
+    struct nvram_uio_device *nvram = file_dma->nvram;
+
+    dma_unmap_page (nvram->dev, file_dma->bus_addr, file_dma->size, DMA_BIDIRECTIONAL);
+    __free_pages (file_dma->pages, file_dma->order);
+    kfree (file_dma);
+    put_device (nvram->dev);
+    kref_put (&nvram->kref, nvram_uio_release_device);
+}
+
+static void nvram_uio_file_dma_vma_open (struct vm_area_struct *vma)
+{
+    struct nvram_uio_file_dma *file_dma = vma->vm_private_data;
+
+    mutex_lock (&file_dma->nvram->file_dma_lock);
+    file_dma->num_mappings++;
+    mutex_unlock (&file_dma->nvram->file_dma_lock);
+}
+
+static void nvram_uio_file_dma_vma_close (struct vm_area_struct *vma)
+{
+    struct nvram_uio_file_dma *file_dma = vma->vm_private_data;
+    struct nvram_uio_device *nvram = file_dma->nvram;
+    bool free_file_dma;
+
+    mutex_lock (&nvram->file_dma_lock);
+    file_dma->num_mappings--;
+    free_file_dma = file_dma->num_mappings == 0;
+    if (free_file_dma)
+    {
+        list_del (&file_dma->list);
+    }
+    mutex_unlock (&nvram->file_dma_lock);
+
+    if (free_file_dma)
+    {
+        nvram_uio_free_file_dma (file_dma);
+    }
+}
+
+static const struct vm_operations_struct nvram_uio_file_dma_vm_ops = {
+    .open = nvram_uio_file_dma_vma_open,
+    .close = nvram_uio_file_dma_vma_close,
+};
+
+/*
+ * Allocate the DMA mapping for a file, on the NUMA node of the calling thread. Since x86 DMA is cache coherent
+ * the pages are mapped into userspace as cached memory.
+ */
+static struct nvram_uio_file_dma *nvram_uio_alloc_file_dma (struct nvram_uio_device *nvram, struct file *file)
+{
+    struct nvram_uio_file_dma *file_dma;
+    struct nvram_uio_dma_info *dma_info;
+
+    file_dma = kzalloc (sizeof (struct nvram_uio_file_dma), GFP_KERNEL);
+    if (file_dma == NULL)
+    {
+        return NULL;
+    }
+
+    file_dma->size = PAGE_SIZE + dma_buffer_size;
+    file_dma->order = get_order (file_dma->size);
+    file_dma->pages = alloc_pages_node (numa_node_id (), GFP_KERNEL | __GFP_ZERO, file_dma->order);
+    if (file_dma->pages == NULL)
+    {
+        goto out_free;
+    }
+
+    file_dma->bus_addr = dma_map_page (nvram->dev, file_dma->pages, 0, file_dma->size, DMA_BIDIRECTIONAL);
+    if (dma_mapping_error (nvram->dev, file_dma->bus_addr))
+    {
+        goto out_free_pages;
+    }
+
+    dma_info = page_address (file_dma->pages);
+    dma_info->info_bus_addr = file_dma->bus_addr;
+    dma_info->buffer_bus_addr = file_dma->bus_addr + PAGE_SIZE;
+    dma_info->buffer_size = dma_buffer_size;
+    dma_info->numa_node = page_to_nid (file_dma->pages);
+
+    file_dma->nvram = nvram;
+    file_dma->file = file;
+    kref_get (&nvram->kref);
+    get_device (nvram->dev);
+    list_add (&file_dma->list, &nvram->file_dmas);
+
+    return file_dma;
+
+    out_free_pages:
+        __free_pages (file_dma->pages, file_dma->order);
+    out_free:
+        kfree (file_dma);
+        return NULL;
+}
+
+static int nvram_uio_mmap_file_dma (struct nvram_uio_device *nvram, struct vm_area_struct *vma)
+{
+    struct nvram_uio_file_dma *file_dma = NULL;
+    struct nvram_uio_file_dma *entry;
+    int rc;
+
+    mutex_lock (&nvram->file_dma_lock);
+    list_for_each_entry (entry, &nvram->file_dmas, list)
+    {
+        if (entry->file == vma->vm_file)
+        {
+            file_dma = entry;
+            break;
+        }
+    }
+    if (file_dma == NULL)
+    {
+        file_dma = nvram_uio_alloc_file_dma (nvram, vma->vm_file);
+    }
+    if (file_dma != NULL)
+    {
+        file_dma->num_mappings++;
+    }
+    mutex_unlock (&nvram->file_dma_lock);
+    if (file_dma == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    vma->vm_private_data = file_dma;
+    vma->vm_ops = &nvram_uio_file_dma_vm_ops;
+    rc = remap_pfn_range (vma, vma->vm_start, page_to_pfn (file_dma->pages), vma->vm_end - vma->vm_start,
+                          vma->vm_page_prot);
+    if (rc != 0)
+    {
+        /* The vma isn't created, so its close operation won't be called */
+        nvram_uio_file_dma_vma_close (vma);
+    }
+
+    return rc;
+}
+
+static int nvram_uio_mmap_physical (struct uio_info *info, struct vm_area_struct *vma, int mi)
+{
+    struct nvram_uio_device *nvram = container_of (info, struct nvram_uio_device, info);
+
+    /* The registers of a mock device are host memory, which is mapped cached to match the kernel mapping */
+    if (nvram->pdev == NULL)
+    {
+        return remap_pfn_range (vma, vma->vm_start, page_to_pfn (virt_to_page (info->mem[mi].internal_addr)),
+                                vma->vm_end - vma->vm_start, vma->vm_page_prot);
+    }
+
+    vma->vm_page_prot = pgprot_noncached (vma->vm_page_prot);
+
+    return remap_pfn_range (vma, vma->vm_start, info->mem[mi].addr >> PAGE_SHIFT, vma->vm_end - vma->vm_start,
+                            vma->vm_page_prot);
+}
+
+static int nvram_uio_mmap_window (struct uio_info *info, struct vm_area_struct *vma, int mi)
+{
+    struct nvram_uio_device *nvram = container_of (info, struct nvram_uio_device, info);
+
+    /* The window of a mock device is all of its memory, so window zero is always selected */
+    if (nvram->pdev == NULL)
+    {
+        return remap_vmalloc_range (vma, nvram->mock_memory, 0);
+    }
+
+    vma->vm_page_prot = pgprot_writecombine (vma->vm_page_prot);
+
+    return io_remap_pfn_range (vma, vma->vm_start, info->mem[mi].addr >> PAGE_SHIFT, vma->vm_end - vma->vm_start,
+                               vma->vm_page_prot);
+}
+
+/* The UIO core has already validated the map index in vm_pgoff, and the size of the mapping */
+static int nvram_uio_mmap (struct uio_info *info, struct vm_area_struct *vma)
+{
+    struct nvram_uio_device *nvram = container_of (info, struct nvram_uio_device, info);
+    const int mi = (int) vma->vm_pgoff;
+
+    switch (mi)
+    {
+    case CSR_MAPPING_INDEX:
+        return nvram_uio_mmap_physical (info, vma, mi);
+
+    case DMA_MAPPING_INDEX:
+        /* The DMA engine can't be shared with userspace while it is owned by the dmaengine channel */
+        if (nvram->dma_chan != NULL)
+        {
+            return -EBUSY;
+        }
+        return nvram_uio_mmap_file_dma (nvram, vma);
+
+    case WINDOW_MAPPING_INDEX:
+        return nvram_uio_mmap_window (info, vma, mi);
+
+    default:
+        return -EINVAL;
+    }
+}
+
 static int nvram_uio_pci_probe (struct pci_dev *dev,
                                 const struct pci_device_id *id)
 {
+    struct nvram_uio_device *nvram;
     struct uio_info *info;
     unsigned long csr_base;
     unsigned long csr_len;
+    unsigned long window_base;
+    unsigned long window_len;
     int magic_number;
     int magic_numbers[MAGIC_NUMBERS_PER_DEV + 1];
     int magic_number_ok = 0;
     int i;
 
-    info = kzalloc (sizeof(struct uio_info), GFP_KERNEL);
-    if (info == NULL)
+    nvram = kzalloc (sizeof(struct nvram_uio_device), GFP_KERNEL);
+    if (nvram == NULL)
     {
         return -ENOMEM;
     }
+    info = &nvram->info;
+    nvram->pdev = dev;
+    nvram->dev = &dev->dev;
+    kref_init (&nvram->kref);
+    mutex_init (&nvram->file_dma_lock);
+    INIT_LIST_HEAD (&nvram->file_dmas);
 
     if (pci_enable_device(dev))
     {
         goto out_free;
     }
 
-    pci_write_config_byte (dev, PCI_LATENCY_TIMER, 0xF8);
-    pci_set_master (dev);
+    nvram_uio_configure_pci (dev);
 
     dev_printk (KERN_INFO, &dev->dev,
       "Curtiss Wright controller found (PCI Mem Module (Battery Backup))\n");
@@ -82,6 +928,24 @@ static int nvram_uio_pci_probe (struct pci_dev *dev,
     dev_printk (KERN_INFO, &dev->dev, "CSR 0x%08llx -> 0x%p (0x%llx)\n",
             info->mem[CSR_MAPPING_INDEX].addr, info->mem[CSR_MAPPING_INDEX].internal_addr, info->mem[CSR_MAPPING_INDEX].size);
 
+    /* The DMA mapping has no fixed address, as it is allocated for each file by nvram_uio_mmap() */
+    info->mem[DMA_MAPPING_INDEX].addr = 0;
+    info->mem[DMA_MAPPING_INDEX].size = PAGE_SIZE + dma_buffer_size;
+    info->mem[DMA_MAPPING_INDEX].memtype = UIO_MEM_NONE;
+    info->mem[DMA_MAPPING_INDEX].name = "dma";
+
+    /* The memory window is optional, and is mapped write-combining by nvram_uio_mmap() */
+    window_base = pci_resource_start (dev, WINDOW_BAR);
+    window_len = pci_resource_len (dev, WINDOW_BAR);
+    if (window_base && window_len && (pci_resource_flags (dev, WINDOW_BAR) & IORESOURCE_MEM))
+    {
+        info->mem[WINDOW_MAPPING_INDEX].addr = window_base;
+        info->mem[WINDOW_MAPPING_INDEX].size = ((window_len + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+        info->mem[WINDOW_MAPPING_INDEX].memtype = UIO_MEM_PHYS;
+        info->mem[WINDOW_MAPPING_INDEX].name = "window";
+        dev_printk (KERN_INFO, &dev->dev, "Memory window 0x%08lx (0x%lx)\n", window_base, window_len);
+    }
+
     switch (dev->device) {
     case 0x5415:
         magic_numbers[0] = 0x59;
@@ -122,13 +986,26 @@ static int nvram_uio_pci_probe (struct pci_dev *dev,
     info->irq = dev->irq;
     info->irq_flags = IRQF_SHARED;
     info->handler = nvram_uio_handler;
+    info->mmap = nvram_uio_mmap;
 
     if (uio_register_device (&dev->dev, info))
     {
         goto out_unmap;
     }
 
-    pci_set_drvdata (dev, info);
+    pci_set_drvdata (dev, nvram);
+
+    if (dmaengine && (nvram_uio_register_dmaengine (nvram) != 0))
+    {
+        dev_printk (KERN_WARNING, &dev->dev, "Unable to register dmaengine device, DMA is left to userspace\n");
+    }
+
+    /* Saved for restoring after a slot reset during PCI error recovery */
+    pci_save_state (dev);
+    if (sysfs_create_group (&dev->dev.kobj, &nvram_uio_recovery_group))
+    {
+        dev_printk (KERN_WARNING, &dev->dev, "Unable to create recovery sysfs attributes\n");
+    }
 
     return 0;
 
@@ -139,21 +1016,138 @@ static int nvram_uio_pci_probe (struct pci_dev *dev,
     out_disable:
         pci_disable_device (dev);
     out_free:
-        kfree (info);
+        kref_put (&nvram->kref, nvram_uio_release_device);
         return -ENODEV;
 }
 
+/* Apply the PCI configuration which the driver sets on top of the saved state */
+static void nvram_uio_configure_pci (struct pci_dev *dev)
+{
+    pci_write_config_byte (dev, PCI_LATENCY_TIMER, 0xF8);
+    pci_set_master (dev);
+}
+
+static ssize_t recovery_state_show (struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct nvram_uio_device *nvram = dev_get_drvdata (dev);
+
+    return sprintf (buf, "%d\n", atomic_read (&nvram->recovery_state));
+}
+static DEVICE_ATTR_RO (recovery_state);
+
+static ssize_t recovery_count_show (struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct nvram_uio_device *nvram = dev_get_drvdata (dev);
+
+    return sprintf (buf, "%d\n", atomic_read (&nvram->recovery_count));
+}
+static DEVICE_ATTR_RO (recovery_count);
+
+static struct attribute *nvram_uio_recovery_attrs[] = {
+    &dev_attr_recovery_state.attr,
+    &dev_attr_recovery_count.attr,
+    NULL,
+};
+
+static const struct attribute_group nvram_uio_recovery_group = {
+    .attrs = nvram_uio_recovery_attrs,
+};
+
+/* Change the recovery state, and wake userspace clients waiting on the UIO event */
+static void nvram_uio_set_recovery_state (struct nvram_uio_device *nvram, enum nvram_uio_recovery_state state)
+{
+    atomic_set (&nvram->recovery_state, state);
+    uio_event_notify (&nvram->info);
+}
+
+static pci_ers_result_t nvram_uio_error_detected (struct pci_dev *dev, pci_channel_state_t state)
+{
+    struct nvram_uio_device *nvram = pci_get_drvdata (dev);
+
+    dev_printk (KERN_WARNING, &dev->dev, "PCI error detected, channel state %d\n", state);
+    if (nvram->dma_chan != NULL)
+    {
+        nvram_uio_dmaengine_abort (nvram->dma_chan);
+    }
+    if (state == pci_channel_io_perm_failure)
+    {
+        nvram_uio_set_recovery_state (nvram, NVRAM_UIO_RECOVERY_FAILED);
+        return PCI_ERS_RESULT_DISCONNECT;
+    }
+
+    nvram_uio_set_recovery_state (nvram, NVRAM_UIO_RECOVERY_FROZEN);
+    if (state == pci_channel_io_normal)
+    {
+        return PCI_ERS_RESULT_CAN_RECOVER;
+    }
+    pci_disable_device (dev);
+
+    return PCI_ERS_RESULT_NEED_RESET;
+}
+
+static pci_ers_result_t nvram_uio_slot_reset (struct pci_dev *dev)
+{
+    struct nvram_uio_device *nvram = pci_get_drvdata (dev);
+    int magic_number;
+
+    if (pci_enable_device (dev))
+    {
+        dev_printk (KERN_ERR, &dev->dev, "Unable to re-enable device after reset\n");
+        nvram_uio_set_recovery_state (nvram, NVRAM_UIO_RECOVERY_FAILED);
+        return PCI_ERS_RESULT_DISCONNECT;
+    }
+    pci_restore_state (dev);
+    pci_save_state (dev);
+    nvram_uio_configure_pci (dev);
+
+    /* A device which still doesn't respond reads as all ones */
+    magic_number = readb (nvram->info.mem[CSR_MAPPING_INDEX].internal_addr + MEMCTRLSTATUS_MAGIC);
+    if (magic_number == 0xFF)
+    {
+        dev_printk (KERN_ERR, &dev->dev, "Device not responding after reset\n");
+        nvram_uio_set_recovery_state (nvram, NVRAM_UIO_RECOVERY_FAILED);
+        return PCI_ERS_RESULT_DISCONNECT;
+    }
+
+    nvram_uio_set_recovery_state (nvram, NVRAM_UIO_RECOVERY_RESET);
+
+    return PCI_ERS_RESULT_RECOVERED;
+}
+
+static void nvram_uio_resume (struct pci_dev *dev)
+{
+    struct nvram_uio_device *nvram = pci_get_drvdata (dev);
+
+    atomic_inc (&nvram->recovery_count);
+    if (nvram->dma_chan != NULL)
+    {
+        nvram_uio_dmaengine_restart (nvram->dma_chan);
+    }
+    nvram_uio_set_recovery_state (nvram, NVRAM_UIO_RECOVERY_NORMAL);
+    dev_printk (KERN_INFO, &dev->dev, "Recovered from PCI error\n");
+}
+
+static const struct pci_error_handlers nvram_uio_err_handler = {
+    .error_detected = nvram_uio_error_detected,
+    .slot_reset = nvram_uio_slot_reset,
+    .resume = nvram_uio_resume,
+};
+
 static void nvram_uio_pci_remove (struct pci_dev *dev)
 {
-    struct uio_info *info = pci_get_drvdata(dev);
+    struct nvram_uio_device *nvram = pci_get_drvdata(dev);
+    struct uio_info *info = &nvram->info;
 
+    sysfs_remove_group (&dev->dev.kobj, &nvram_uio_recovery_group);
+    nvram_uio_unregister_dmaengine (nvram);
     uio_unregister_device (info);
     pci_release_regions (dev);
     pci_disable_device (dev);
     pci_set_drvdata (dev, NULL);
     iounmap (info->mem[0].internal_addr);
 
-    kfree (info);
+    /* Any file DMA mappings still mapped by userspace hold their own reference */
+    kref_put (&nvram->kref, nvram_uio_release_device);
 }
 
 static struct pci_driver nvram_uio_pci_driver = {
@@ -161,15 +1155,367 @@ static struct pci_driver nvram_uio_pci_driver = {
     .id_table = nvram_uio_pci_ids,
     .probe = nvram_uio_pci_probe,
     .remove = nvram_uio_pci_remove,
+    .err_handler = &nvram_uio_err_handler,
+};
+/*
+ * Translate a bus address from a DMA descriptor of a mock device into the kernel address of a file DMA mapping.
+ * Called with file_dma_lock held, so the mapping can't be freed while the mock DMA engine accesses it.
+ */
+static void *nvram_uio_mock_host_addr (struct nvram_uio_device *nvram, u64 bus_addr, size_t len)
+{
+    struct nvram_uio_file_dma *file_dma;
+
+    list_for_each_entry (file_dma, &nvram->file_dmas, list)
+    {
+        if ((bus_addr >= file_dma->bus_addr) && (len <= file_dma->size) &&
+            ((bus_addr - file_dma->bus_addr) <= (file_dma->size - len)))
+        {
+            return page_address (file_dma->pages) + (bus_addr - file_dma->bus_addr);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Perform the chain of DMA descriptors started by userspace, in the same way as the card: each descriptor copies
+ * between a DMA buffer and the device memory, and writes its semaphore if enabled. A descriptor with an address
+ * outside the DMA mappings or the device memory ends the chain with a master abort.
+ */
+static void nvram_uio_mock_run_chain (struct nvram_uio_device *nvram)
+{
+    u8 *const csr = nvram->info.mem[CSR_MAPPING_INDEX].internal_addr;
+    __le32 *const status_ctrl = (__le32 *) (csr + DMA_STATUS_CTRL);
+    const __le32 *const descriptor_addr = (const __le32 *) (csr + DMA_DESCRIPTOR_ADDR);
+    u64 desc_addr = le32_to_cpu (READ_ONCE (descriptor_addr[0])) |
+            ((u64) le32_to_cpu (READ_ONCE (descriptor_addr[1])) << 32);
+    u32 status = DMASCR_DMA_COMPLETE | DMASCR_CHAIN_COMPLETE;
+    struct mm_dma_desc *desc;
+    __le64 *semaphore;
+    u8 *host;
+    u64 local_addr;
+    u32 transfer_size;
+    u32 control_bits = 0;
+    unsigned int num_descs = 0;
+
+    /* The descriptors were written before the chain was started */
+    smp_rmb ();
+    mutex_lock (&nvram->file_dma_lock);
+    do
+    {
+        desc = nvram_uio_mock_host_addr (nvram, desc_addr, sizeof (struct mm_dma_desc));
+        if (desc == NULL)
+        {
+            status = DMASCR_MASTER_ABT | DMASCR_ANY_ERR;
+            break;
+        }
+        control_bits = le32_to_cpu (desc->control_bits);
+        local_addr = le64_to_cpu (desc->local_addr);
+        transfer_size = le32_to_cpu (desc->transfer_size);
+        host = nvram_uio_mock_host_addr (nvram, le64_to_cpu (desc->pci_addr), transfer_size);
+        if (host == NULL)
+        {
+            status = DMASCR_MASTER_ABT | DMASCR_ANY_ERR;
+            break;
+        }
+        if ((local_addr > nvram->mock_memory_size) || (transfer_size > (nvram->mock_memory_size - local_addr)))
+        {
+            status = DMASCR_TARGET_ABT | DMASCR_ANY_ERR;
+            break;
+        }
+
+        if ((control_bits & DMASCR_TRANSFER_READ) != 0)
+        {
+            memcpy (nvram->mock_memory + local_addr, host, transfer_size);
+        }
+        else
+        {
+            memcpy (host, nvram->mock_memory + local_addr, transfer_size);
+        }
+
+        if ((control_bits & DMASCR_SEM_EN) != 0)
+        {
+            semaphore = nvram_uio_mock_host_addr (nvram, le64_to_cpu (desc->sem_addr), sizeof (__le64));
+            if (semaphore != NULL)
+            {
+                /* The data must be visible before the semaphore which userspace polls */
+                smp_wmb ();
+                WRITE_ONCE (*semaphore, cpu_to_le64 ((control_bits & ~DMASCR_GO) | DMASCR_DMA_COMPLETE));
+            }
+        }
+        desc_addr = le64_to_cpu (desc->next_desc_addr);
+        num_descs++;
+        cond_resched ();
+    } while (((control_bits & DMASCR_CHAIN_EN) != 0) && (num_descs < NVRAM_UIO_MOCK_MAX_CHAIN));
+    mutex_unlock (&nvram->file_dma_lock);
+
+    if (((control_bits & DMASCR_CHAIN_EN) != 0) && (num_descs == NVRAM_UIO_MOCK_MAX_CHAIN))
+    {
+        status = DMASCR_MASTER_ABT | DMASCR_ANY_ERR;
+    }
+    smp_wmb ();
+    WRITE_ONCE (*status_ctrl, cpu_to_le32 (status));
+}
+
+/*
+ * Emulates the DMA engine of a mock device, by polling the DMA status register for userspace starting a chain.
+ * After a chain the thread keeps polling for mock_spin_us, so back-to-back transfers don't wait for a sleep.
+ */
+static int nvram_uio_mock_dma_thread (void *data)
+{
+    struct nvram_uio_device *nvram = data;
+    const __le32 *const status_ctrl =
+            (const __le32 *) ((u8 *) nvram->info.mem[CSR_MAPPING_INDEX].internal_addr + DMA_STATUS_CTRL);
+    u64 last_chain_ns = 0;
+
+    while (!kthread_should_stop ())
+    {
+        if ((le32_to_cpu (READ_ONCE (*status_ctrl)) & DMASCR_GO) != 0)
+        {
+            nvram_uio_mock_run_chain (nvram);
+            last_chain_ns = ktime_get_ns ();
+        }
+        else if ((ktime_get_ns () - last_chain_ns) < ((u64) READ_ONCE (mock_spin_us) * NSEC_PER_USEC))
+        {
+            cpu_relax ();
+            cond_resched ();
+        }
+        else
+        {
+            usleep_range (READ_ONCE (mock_sleep_us), READ_ONCE (mock_sleep_us) * 2 + 1);
+        }
+    }
+
+    return 0;
+}
+
+/* Encode the memory size of a mock device in the MEMCTRLSTATUS_MEMORY register, or return zero if not valid */
+static u8 nvram_uio_mock_memory_code (unsigned int memory_mb)
+{
+    switch (memory_mb)
+    {
+    case 128:  return MEM_128_MB;
+    case 256:  return MEM_256_MB;
+    case 512:  return MEM_512_MB;
+    case 1024: return MEM_1_GB;
+    case 2048: return MEM_2_GB;
+    default:   return 0;
+    }
+}
+
+/*
+ * Create a mock device, with the same UIO maps as the card: a page of registers in host memory, the per-file DMA
+ * mappings, and a window over all of the emulated memory. The memory is zeroed, and is lost when the device is
+ * removed. Interrupts aren't emulated.
+ */
+static int nvram_uio_mock_probe (struct platform_device *pdev)
+{
+    struct nvram_uio_device *nvram;
+    struct uio_info *info;
+    u8 *csr;
+
+    nvram = kzalloc (sizeof (struct nvram_uio_device), GFP_KERNEL);
+    if (nvram == NULL)
+    {
+        return -ENOMEM;
+    }
+    info = &nvram->info;
+    nvram->dev = &pdev->dev;
+    kref_init (&nvram->kref);
+    mutex_init (&nvram->file_dma_lock);
+    INIT_LIST_HEAD (&nvram->file_dmas);
+
+    if (dma_coerce_mask_and_coherent (&pdev->dev, DMA_BIT_MASK (64)))
+    {
+        dev_printk (KERN_WARNING, &pdev->dev, "NO suitable DMA found\n");
+        goto out_free;
+    }
+
+    nvram->mock_memory_size = (size_t) mock_memory_mb << 20;
+    nvram->mock_memory = vmalloc_user (nvram->mock_memory_size);
+    if (nvram->mock_memory == NULL)
+    {
+        dev_printk (KERN_ERR, &pdev->dev, "Unable to allocate %u MB of mock memory\n", mock_memory_mb);
+        goto out_free;
+    }
+
+    csr = (u8 *) get_zeroed_page (GFP_KERNEL);
+    if (csr == NULL)
+    {
+        goto out_free_memory;
+    }
+    csr[MEMCTRLSTATUS_MAGIC] = 0x5C;
+    csr[MEMCTRLSTATUS_MEMORY] = nvram_uio_mock_memory_code (mock_memory_mb);
+
+    info->mem[CSR_MAPPING_INDEX].addr = virt_to_phys (csr);
+    info->mem[CSR_MAPPING_INDEX].internal_addr = csr;
+    info->mem[CSR_MAPPING_INDEX].size = PAGE_SIZE;
+    info->mem[CSR_MAPPING_INDEX].memtype = UIO_MEM_LOGICAL;
+    info->mem[CSR_MAPPING_INDEX].name = "csr";
+
+    info->mem[DMA_MAPPING_INDEX].addr = 0;
+    info->mem[DMA_MAPPING_INDEX].size = PAGE_SIZE + dma_buffer_size;
+    info->mem[DMA_MAPPING_INDEX].memtype = UIO_MEM_NONE;
+    info->mem[DMA_MAPPING_INDEX].name = "dma";
+
+    info->mem[WINDOW_MAPPING_INDEX].addr = (phys_addr_t) (uintptr_t) nvram->mock_memory;
+    info->mem[WINDOW_MAPPING_INDEX].size = nvram->mock_memory_size;
+    info->mem[WINDOW_MAPPING_INDEX].memtype = UIO_MEM_VIRTUAL;
+    info->mem[WINDOW_MAPPING_INDEX].name = "window";
+
+    info->name = DRIVER_NAME;
+    info->version = "0.0.1";
+    info->irq = UIO_IRQ_CUSTOM;
+    info->handler = nvram_uio_handler;
+    info->mmap = nvram_uio_mmap;
+
+    nvram->mock_dma_thread = kthread_run (nvram_uio_mock_dma_thread, nvram, "nvram_uio_mock%d", pdev->id);
+    if (IS_ERR (nvram->mock_dma_thread))
+    {
+        goto out_free_csr;
+    }
+
+    if (uio_register_device (&pdev->dev, info))
+    {
+        goto out_stop_thread;
+    }
+
+    platform_set_drvdata (pdev, nvram);
+    if (sysfs_create_group (&pdev->dev.kobj, &nvram_uio_recovery_group))
+    {
+        dev_printk (KERN_WARNING, &pdev->dev, "Unable to create recovery sysfs attributes\n");
+    }
+    dev_printk (KERN_INFO, &pdev->dev, "Mock device with %u MB of memory\n", mock_memory_mb);
+
+    return 0;
+
+    out_stop_thread:
+        kthread_stop (nvram->mock_dma_thread);
+    out_free_csr:
+        free_page ((unsigned long) csr);
+    out_free_memory:
+        vfree (nvram->mock_memory);
+    out_free:
+        kref_put (&nvram->kref, nvram_uio_release_device);
+        return -ENODEV;
+}
+
+/*
+ * The module can't be unloaded while userspace has the device open, so the registers and memory are no longer
+ * mapped. Any file DMA mappings are freed by the release of the files.
+ */
+static int nvram_uio_mock_remove (struct platform_device *pdev)
+{
+    struct nvram_uio_device *nvram = platform_get_drvdata (pdev);
+    struct uio_info *info = &nvram->info;
+
+    sysfs_remove_group (&pdev->dev.kobj, &nvram_uio_recovery_group);
+    uio_unregister_device (info);
+    kthread_stop (nvram->mock_dma_thread);
+    platform_set_drvdata (pdev, NULL);
+    free_page ((unsigned long) info->mem[CSR_MAPPING_INDEX].internal_addr);
+    vfree (nvram->mock_memory);
+    kref_put (&nvram->kref, nvram_uio_release_device);
+
+    return 0;
+}
+
+static struct platform_driver nvram_uio_mock_driver = {
+    .driver = {
+        .name = DRIVER_NAME "_mock",
+    },
+    .probe = nvram_uio_mock_probe,
+    .remove = nvram_uio_mock_remove,
 };
+
+static void nvram_uio_unregister_mock_devices (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < NVRAM_UIO_MAX_MOCK_DEVICES; i++)
+    {
+        if (nvram_uio_mock_pdevs[i] != NULL)
+        {
+            platform_device_unregister (nvram_uio_mock_pdevs[i]);
+            nvram_uio_mock_pdevs[i] = NULL;
+        }
+    }
+}
+
+/* Register the mock devices requested by the mock_devices module parameter */
+static int nvram_uio_register_mock_devices (void)
+{
+    unsigned int i;
+    int rc;
+
+    if (mock_devices == 0)
+    {
+        return 0;
+    }
+    if ((mock_devices > NVRAM_UIO_MAX_MOCK_DEVICES) || (nvram_uio_mock_memory_code (mock_memory_mb) == 0))
+    {
+        pr_err (DRIVER_NAME ": mock_devices must be at most %d, and mock_memory_mb a size the card can have\n",
+                NVRAM_UIO_MAX_MOCK_DEVICES);
+        return -EINVAL;
+    }
+
+    rc = platform_driver_register (&nvram_uio_mock_driver);
+    if (rc != 0)
+    {
+        return rc;
+    }
+    for (i = 0; i < mock_devices; i++)
+    {
+        nvram_uio_mock_pdevs[i] = platform_device_register_simple (DRIVER_NAME "_mock", i, NULL, 0);
+        if (IS_ERR (nvram_uio_mock_pdevs[i]))
+        {
+            rc = PTR_ERR (nvram_uio_mock_pdevs[i]);
+            nvram_uio_mock_pdevs[i] = NULL;
+            nvram_uio_unregister_mock_devices ();
+            platform_driver_unregister (&nvram_uio_mock_driver);
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
 static int __init nvram_uio_init_module(void)
 {
-    return pci_register_driver(&nvram_uio_pci_driver);
+    int rc;
+
+    if ((dma_buffer_size == 0) || ((dma_buffer_size % PAGE_SIZE) != 0) ||
+        (get_order (PAGE_SIZE + dma_buffer_size) >= MAX_ORDER))
+    {
+        pr_err (DRIVER_NAME ": dma_buffer_size %lu must be a non-zero multiple of the page size, and less than 2^(MAX_ORDER-1) pages\n",
+                dma_buffer_size);
+        return -EINVAL;
+    }
+
+    rc = nvram_uio_register_mock_devices ();
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    rc = pci_register_driver(&nvram_uio_pci_driver);
+    if ((rc != 0) && (mock_devices > 0))
+    {
+        nvram_uio_unregister_mock_devices ();
+        platform_driver_unregister (&nvram_uio_mock_driver);
+    }
+
+    return rc;
 }
 
 static void __exit nvram_uio_exit_module(void)
 {
     pci_unregister_driver(&nvram_uio_pci_driver);
+    if (mock_devices > 0)
+    {
+        nvram_uio_unregister_mock_devices ();
+        platform_driver_unregister (&nvram_uio_mock_driver);
+    }
 }
 
 module_init(nvram_uio_init_module);
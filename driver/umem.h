@@ -14,6 +14,14 @@
 
 #define DRIVER_NAME "nvram_uio"
 #define CSR_MAPPING_INDEX 0
+#define DMA_MAPPING_INDEX 1
+#define WINDOW_MAPPING_INDEX 2
+
+/*
+ * Cards which provide a memory window do so in BAR 1, with WINDOWMAP_WINNUM selecting which window-sized part of
+ * the device memory is visible.
+ */
+#define WINDOW_BAR 1
 
 #define IRQ_TIMEOUT (1 * HZ)
 
@@ -129,6 +137,36 @@ struct mm_dma_desc {
 	__le64	sem_control_bits;
 } __attribute__((aligned(8)));
 
+/*
+ * Each open file of the device gets its own DMA mapping, allocated on the first mmap of DMA_MAPPING_INDEX and freed
+ * once the file has no mappings left. The first page of the mapping contains a struct nvram_uio_dma_info, followed
+ * by space for DMA descriptors from NVRAM_UIO_DMA_DESC_OFFSET. The remaining pages are the data buffer.
+ */
+struct nvram_uio_dma_info {
+	/* The bus address of the first page of the mapping, to locate descriptors */
+	__u64	info_bus_addr;
+	/* The bus address and size of the data buffer */
+	__u64	buffer_bus_addr;
+	__u64	buffer_size;
+	/* The NUMA node the mapping was allocated on */
+	__u32	numa_node;
+	__u32	reserved;
+};
+
+#define NVRAM_UIO_DMA_DESC_OFFSET	64
+
+/*
+ * The PCI error recovery state of the device, read from the recovery_state sysfs attribute of the PCI device.
+ * The recovery_count attribute counts completed recoveries. The UIO event count is incremented on each change
+ * of the recovery state.
+ */
+enum nvram_uio_recovery_state {
+	NVRAM_UIO_RECOVERY_NORMAL,	/* I/O is possible */
+	NVRAM_UIO_RECOVERY_FROZEN,	/* An error was detected, and I/O is blocked until the slot is reset */
+	NVRAM_UIO_RECOVERY_RESET,	/* The slot has been reset and configuration restored, waiting to resume */
+	NVRAM_UIO_RECOVERY_FAILED	/* The device couldn't be recovered */
+};
+
 /* bits for card->flags */
 #define UM_FLAG_DMA_IN_REGS		1
 #define UM_FLAG_NO_BYTE_STATUS		2
@@ -0,0 +1,14 @@
+/*
+ * @file libpmem.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Allows code written against libpmem to be built unchanged to use the NVRAM device
+ * @details Add this directory to the include path, and link with libnvram_pmem.a in place of -lpmem.
+ */
+
+#ifndef NVRAM_UIO_LIBPMEM_H_
+#define NVRAM_UIO_LIBPMEM_H_
+
+#include "nvram_uio_pmem.h"
+
+#endif /* NVRAM_UIO_LIBPMEM_H_ */
@@ -0,0 +1,330 @@
+/*
+ * @file nvram_async_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the latency of asynchronous DMA reads and of running their completion callbacks on the executor
+ * @details
+ *   Each submitting thread is pinned to its own CPU and keeps a number of DMA reads in flight, each into its own
+ *   part of the DMA buffer. The completion callback of each read checks the data read, as a callback verifying a
+ *   checksum would, and records:
+ *   - The DMA latency, from submission until the harvester saw the chain complete.
+ *   - The callback latency, from the harvester seeing the completion until the callback started on a worker.
+ *   - Whether the callback ran on the CPU of the submitting thread.
+ *   Usage:
+ *     nvram_async_bench [-t <threads>] [-c <reads_per_thread>] [-s <transfer_size>] [-d <depth>] [-w <workers>] [-u]
+ *   -w sets the number of executor workers, by default one per CPU, and -u leaves the workers unpinned.
+ *   The device memory is only read.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_bench.h"
+#include "nvram_uio_executor.h"
+#include "nvram_uio_async.h"
+
+struct submit_thread;
+
+/** One read kept in flight by a submitting thread */
+typedef struct
+{
+    dma_async_request request;
+    struct submit_thread *thread;
+    /** The index of the read currently using the slot */
+    unsigned int read_index;
+    /** Posted by the callback once the slot can be reused */
+    sem_t done;
+} read_slot;
+
+/** One submitting thread */
+typedef struct submit_thread
+{
+    nvram_uio_context *context;
+    dma_async_queue *queue;
+    int cpu;
+    unsigned int num_reads;
+    unsigned int depth;
+    size_t transfer_size;
+    size_t buffer_offset;
+    uint64_t card_offset;
+    uint64_t card_span;
+    pthread_t thread;
+    read_slot *slots;
+    /** Indexed by the read index, written by the callbacks */
+    uint64_t *dma_latencies_ns;
+    uint64_t *callback_latencies_ns;
+    unsigned int num_on_submitter_cpu;
+    unsigned int num_errors;
+    uint64_t check;
+} submit_thread;
+
+/**
+ * @brief Completion callback for a read, run on an executor worker
+ */
+static void read_complete (dma_async_request *const request)
+{
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    read_slot *const slot = request->arg;
+    submit_thread *const thread = slot->thread;
+    const uint64_t *const words =
+            (const uint64_t *) &thread->context->dma_buffer[request->element.buffer_offset];
+    uint64_t check = 0;
+    size_t word_index;
+
+    /* The work of the callback, which depends upon the data just read */
+    for (word_index = 0; word_index < (request->element.num_bytes / sizeof (words[0])); word_index++)
+    {
+        check = (check ^ words[word_index]) * 0x100000001b3ULL;
+    }
+
+    thread->dma_latencies_ns[slot->read_index] = request->latency_ns;
+    thread->callback_latencies_ns[slot->read_index] = start_ns - (request->submit_ns + request->latency_ns);
+    if (sched_getcpu () == request->task.cpu_hint)
+    {
+        __atomic_add_fetch (&thread->num_on_submitter_cpu, 1, __ATOMIC_RELAXED);
+    }
+    if (!request->success)
+    {
+        __atomic_add_fetch (&thread->num_errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_xor_fetch (&thread->check, check, __ATOMIC_RELAXED);
+    sem_post (&slot->done);
+}
+
+/**
+ * @brief Thread which submits reads from one CPU, keeping the configured number in flight
+ */
+static void *submit_thread_entry (void *arg)
+{
+    submit_thread *const thread = arg;
+    unsigned int read_index;
+    read_slot *slot;
+    cpu_set_t cpus;
+
+    CPU_ZERO (&cpus);
+    CPU_SET (thread->cpu, &cpus);
+    (void) sched_setaffinity (0, sizeof (cpus), &cpus);
+
+    for (read_index = 0; read_index < thread->num_reads; read_index++)
+    {
+        slot = &thread->slots[read_index % thread->depth];
+        if (read_index >= thread->depth)
+        {
+            sem_wait (&slot->done);
+        }
+        slot->read_index = read_index;
+        slot->request.direction = DMA_WRITE_TO_HOST;
+        slot->request.element.card_offset = thread->card_offset +
+                (((uint64_t) read_index * thread->transfer_size) % thread->card_span);
+        slot->request.element.buffer_offset = thread->buffer_offset +
+                ((read_index % thread->depth) * thread->transfer_size);
+        slot->request.element.num_bytes = thread->transfer_size;
+        slot->request.callback = read_complete;
+        slot->request.arg = slot;
+        dma_async_submit (thread->queue, &slot->request);
+    }
+
+    /* Wait for the reads still in flight */
+    for (read_index = 0; read_index < thread->depth; read_index++)
+    {
+        if (read_index < thread->num_reads)
+        {
+            sem_wait (&thread->slots[read_index].done);
+        }
+    }
+
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    dma_async_queue queue;
+    executor *pool;
+    executor_statistics statistics;
+    submit_thread *threads;
+    const long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    unsigned int num_threads = 1;
+    unsigned int reads_per_thread = 10000;
+    unsigned int depth = 8;
+    unsigned int num_workers = 0;
+    unsigned int thread_index;
+    unsigned int slot_index;
+    unsigned int total_on_submitter_cpu = 0;
+    unsigned int total_errors = 0;
+    size_t transfer_size = 4096;
+    size_t thread_buffer_size;
+    uint64_t *dma_latencies_ns;
+    uint64_t *callback_latencies_ns;
+    uint64_t card_span;
+    uint64_t total_reads;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    bool pin_workers = true;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "t:c:s:d:w:u")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            num_threads = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'c':
+            reads_per_thread = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 's':
+            transfer_size = strtoul (optarg, NULL, 0);
+            break;
+
+        case 'd':
+            depth = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'w':
+            num_workers = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'u':
+            pin_workers = false;
+            break;
+
+        default:
+            printf ("Usage: %s [-t <threads>] [-c <reads_per_thread>] [-s <transfer_size>] [-d <depth>]\n"
+                    "         [-w <workers>] [-u]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if ((num_threads == 0) || (reads_per_thread == 0) || (depth == 0) || (transfer_size == 0) ||
+        ((transfer_size % sizeof (uint64_t)) != 0))
+    {
+        printf ("The threads, reads, depth and transfer size must be non-zero, and the size a multiple of 8\n");
+        exit (EXIT_FAILURE);
+    }
+
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+
+    /* Each thread's reads in flight use their own part of the DMA buffer */
+    thread_buffer_size = context.dma_buffer_size / num_threads;
+    if ((depth * transfer_size) > thread_buffer_size)
+    {
+        printf ("%u threads with %u reads of %zu bytes in flight need more than the 0x%zx byte DMA buffer\n",
+                num_threads, depth, transfer_size, context.dma_buffer_size);
+        exit (EXIT_FAILURE);
+    }
+    card_span = (context.memory_size_bytes != 0) ? (context.memory_size_bytes / num_threads) : thread_buffer_size;
+    card_span -= card_span % transfer_size;
+    if (card_span == 0)
+    {
+        printf ("The transfer size is larger than the device memory\n");
+        exit (EXIT_FAILURE);
+    }
+
+    threads = calloc (num_threads, sizeof (threads[0]));
+    dma_latencies_ns = calloc ((size_t) num_threads * reads_per_thread, sizeof (uint64_t));
+    callback_latencies_ns = calloc ((size_t) num_threads * reads_per_thread, sizeof (uint64_t));
+    if ((threads == NULL) || (dma_latencies_ns == NULL) || (callback_latencies_ns == NULL))
+    {
+        printf ("Failed to allocate threads\n");
+        exit (EXIT_FAILURE);
+    }
+    for (thread_index = 0; thread_index < num_threads; thread_index++)
+    {
+        submit_thread *const thread = &threads[thread_index];
+
+        thread->context = &context;
+        thread->queue = &queue;
+        thread->cpu = (int) (thread_index % (unsigned int) num_cpus);
+        thread->num_reads = reads_per_thread;
+        thread->depth = depth;
+        thread->transfer_size = transfer_size;
+        thread->buffer_offset = thread_index * thread_buffer_size;
+        thread->card_offset = thread_index * card_span;
+        thread->card_span = card_span;
+        thread->dma_latencies_ns = &dma_latencies_ns[(size_t) thread_index * reads_per_thread];
+        thread->callback_latencies_ns = &callback_latencies_ns[(size_t) thread_index * reads_per_thread];
+        thread->slots = calloc (depth, sizeof (thread->slots[0]));
+        if (thread->slots == NULL)
+        {
+            printf ("Failed to allocate read slots\n");
+            exit (EXIT_FAILURE);
+        }
+        for (slot_index = 0; slot_index < depth; slot_index++)
+        {
+            thread->slots[slot_index].thread = thread;
+            sem_init (&thread->slots[slot_index].done, 0, 0);
+        }
+    }
+
+    pool = executor_create (num_workers, pin_workers);
+    dma_async_start (&queue, &context, pool);
+
+    start_ns = get_monotonic_time_ns ();
+    for (thread_index = 0; thread_index < num_threads; thread_index++)
+    {
+        if (pthread_create (&threads[thread_index].thread, NULL, submit_thread_entry, &threads[thread_index]) != 0)
+        {
+            printf ("Failed to create submit thread\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+    for (thread_index = 0; thread_index < num_threads; thread_index++)
+    {
+        pthread_join (threads[thread_index].thread, NULL);
+        total_on_submitter_cpu += threads[thread_index].num_on_submitter_cpu;
+        total_errors += threads[thread_index].num_errors;
+    }
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+
+    dma_async_stop (&queue);
+    executor_get_statistics (pool, &statistics);
+    executor_destroy (pool);
+
+    total_reads = (uint64_t) num_threads * reads_per_thread;
+    printf ("%lu reads of %zu bytes by %u threads with %u in flight each: %.0f reads/sec %.1f MB/sec, %u errors\n",
+            (unsigned long) total_reads, transfer_size, num_threads, depth,
+            (double) total_reads * 1E9 / (double) elapsed_ns,
+            (double) (total_reads * transfer_size) * 1E3 / (double) elapsed_ns, total_errors);
+    printf ("DMA latency      p50 %8lu ns  p99 %8lu ns\n",
+            (unsigned long) bench_latency_percentile (dma_latencies_ns, total_reads, 50.0),
+            (unsigned long) bench_latency_percentile (dma_latencies_ns, total_reads, 99.0));
+    printf ("Callback latency p50 %8lu ns  p99 %8lu ns\n",
+            (unsigned long) bench_latency_percentile (callback_latencies_ns, total_reads, 50.0),
+            (unsigned long) bench_latency_percentile (callback_latencies_ns, total_reads, 99.0));
+    printf ("Callbacks on the submitting CPU %.1f%%, posted to the preferred worker %.1f%%, to overflow %lu,"
+            " run stolen %lu\n",
+            100.0 * total_on_submitter_cpu / (double) total_reads,
+            100.0 * (double) statistics.posted_to_preferred / (double) statistics.posted,
+            (unsigned long) statistics.posted_to_overflow, (unsigned long) statistics.run_stolen);
+
+    for (thread_index = 0; thread_index < num_threads; thread_index++)
+    {
+        for (slot_index = 0; slot_index < depth; slot_index++)
+        {
+            sem_destroy (&threads[thread_index].slots[slot_index].done);
+        }
+        free (threads[thread_index].slots);
+    }
+    free (callback_latencies_ns);
+    free (dma_latencies_ns);
+    free (threads);
+    close_uio_device (&context);
+
+    return (total_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
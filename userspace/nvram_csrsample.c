@@ -0,0 +1,497 @@
+/*
+ * @file nvram_csrsample.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Record the DMA engine registers of a NVRAM device at a high rate, or decode a recording into a timeline
+ * @details
+ *   To record, a sampler thread on an isolated CPU samples the registers into a file while this process optionally
+ *   runs DMA reads of the device memory, marking the start and end of each chain as a request. Usage:
+ *     nvram_csrsample -o <file> [-c <cpu>] [-r <rate_hz>] [-t <seconds>] [-s <semaphore_index>]
+ *                     [-w <transfer_size>] [-e <chain_elements>] [-d <device_name>]
+ *   A rate of zero samples as fast as possible. The DMA reads don't change the device memory.
+ *
+ *   To decode a recording into a timeline in microseconds from the start of sampling:
+ *     nvram_csrsample -i <file> [-l <request_log>]
+ *   Each line of the optional request log is a TSC value followed by text, which is merged into the timeline so the
+ *   register transitions can be related to the requests of an application.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_csrsample.h"
+
+/** One entry in the decoded timeline */
+typedef struct
+{
+    uint64_t tsc;
+    /** The order the entry was added, to keep entries with the same TSC in order */
+    size_t sequence;
+    /** The text of the entry, for entries from the request log */
+    char *text;
+    uint8_t record_type;
+    bool end;
+    uint32_t request_id;
+    uint64_t repeat_count;
+    uint32_t status;
+    uint8_t errcnt;
+    uint32_t semaphore;
+} timeline_entry;
+
+/** The decoded timeline, which grows as entries are added */
+typedef struct
+{
+    timeline_entry *entries;
+    size_t num_entries;
+    size_t allocated_entries;
+} timeline;
+
+/**
+ * @brief Append an entry to the timeline
+ */
+static void add_entry (timeline *const line, const timeline_entry *const entry)
+{
+    if (line->num_entries == line->allocated_entries)
+    {
+        line->allocated_entries = (line->allocated_entries == 0) ? 4096 : (2 * line->allocated_entries);
+        line->entries = realloc (line->entries, line->allocated_entries * sizeof (line->entries[0]));
+        if (line->entries == NULL)
+        {
+            printf ("Failed to allocate the timeline\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+    line->entries[line->num_entries] = *entry;
+    line->entries[line->num_entries].sequence = line->num_entries;
+    line->num_entries++;
+}
+
+/**
+ * @brief Order timeline entries by TSC, keeping the order of entries with the same TSC
+ */
+static int compare_entries (const void *const a, const void *const b)
+{
+    const timeline_entry *const entry_a = a;
+    const timeline_entry *const entry_b = b;
+
+    if (entry_a->tsc != entry_b->tsc)
+    {
+        return (entry_a->tsc < entry_b->tsc) ? -1 : 1;
+    }
+    return (entry_a->sequence < entry_b->sequence) ? -1 : (entry_a->sequence > entry_b->sequence);
+}
+
+/**
+ * @brief Record the registers of a device while optionally running DMA reads as the requests
+ */
+static void record_samples (const char *const pathname, const char *const device_name, const int cpu,
+                            const uint64_t rate_hz, const double duration_secs, uint32_t semaphore_index,
+                            const size_t transfer_size, const unsigned int chain_elements)
+{
+    static csrsample_sampler sampler;
+    nvram_uio_context context;
+    dma_chain_element elements[chain_elements];
+    unsigned int element_index;
+    uint64_t card_offset = 0;
+    uint64_t end_time;
+    uint32_t request_id = 0;
+    bool success = true;
+
+    if (device_name != NULL)
+    {
+        memset (&context, 0, sizeof (context));
+        snprintf (context.device_name, sizeof (context.device_name), "%s", device_name);
+    }
+    else
+    {
+        find_uio_device (&context);
+    }
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+    if ((transfer_size > 0) && ((chain_elements > context.max_dma_chain_length) ||
+                                ((transfer_size * chain_elements) > context.dma_buffer_size) ||
+                                ((transfer_size * chain_elements) > context.memory_size_bytes)))
+    {
+        printf ("A chain of %u transfers of %zu bytes doesn't fit in the DMA buffer or device memory\n",
+                chain_elements, transfer_size);
+        exit (EXIT_FAILURE);
+    }
+    if (semaphore_index == UINT32_MAX)
+    {
+        /* The completion of a chain is polled on the semaphore of its last descriptor */
+        semaphore_index = chain_elements - 1;
+    }
+    if (!csrsample_cpu_isolated (cpu))
+    {
+        printf ("Warning: CPU %d isn't isolated, so the sampler may be descheduled\n", cpu);
+    }
+
+    if (!csrsample_start (&sampler, &context, pathname, cpu, (rate_hz > 0) ? (1000000000ULL / rate_hz) : 0,
+                          semaphore_index))
+    {
+        printf ("Failed to start sampling into %s\n", pathname);
+        exit (EXIT_FAILURE);
+    }
+    end_time = get_monotonic_time_ns () + (uint64_t) (duration_secs * 1E9);
+    if (transfer_size > 0)
+    {
+        while (success && (get_monotonic_time_ns () < end_time))
+        {
+            for (element_index = 0; element_index < chain_elements; element_index++)
+            {
+                if ((card_offset + transfer_size) > context.memory_size_bytes)
+                {
+                    card_offset = 0;
+                }
+                elements[element_index].card_offset = card_offset;
+                elements[element_index].buffer_offset = element_index * transfer_size;
+                elements[element_index].num_bytes = transfer_size;
+                card_offset += transfer_size;
+            }
+            csrsample_request (&sampler, request_id, false);
+            success = dma_transfer_chain (&context, DMA_WRITE_TO_HOST, elements, chain_elements);
+            csrsample_request (&sampler, request_id, true);
+            request_id++;
+        }
+    }
+    else
+    {
+        usleep ((useconds_t) (duration_secs * 1E6));
+    }
+    if (!csrsample_stop (&sampler))
+    {
+        printf ("Failed to write %s\n", pathname);
+        success = false;
+    }
+
+    printf ("%lu samples in %.3f seconds (%.0f Hz) on CPU %d into %s\n", (unsigned long) sampler.header.num_samples,
+            (double) (sampler.header.end_tsc - sampler.header.start_tsc) / (double) sampler.header.tsc_hz,
+            (double) sampler.header.num_samples * (double) sampler.header.tsc_hz /
+            (double) (sampler.header.end_tsc - sampler.header.start_tsc), cpu, pathname);
+    if (transfer_size > 0)
+    {
+        printf ("%u DMA requests, %lu request events dropped\n", request_id,
+                (unsigned long) sampler.header.requests_dropped);
+    }
+    unmap_dma_buffer (&context);
+    close_uio_device (&context);
+    if (!success)
+    {
+        exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Read the lines of a request log into the timeline
+ */
+static void read_request_log (timeline *const line, const char *const pathname)
+{
+    FILE *log_file;
+    char text[1024];
+    timeline_entry entry;
+    int text_start;
+    unsigned long long tsc;
+
+    log_file = fopen (pathname, "r");
+    if (log_file == NULL)
+    {
+        printf ("Failed to open %s\n", pathname);
+        exit (EXIT_FAILURE);
+    }
+    while (fgets (text, sizeof (text), log_file) != NULL)
+    {
+        text[strcspn (text, "\n")] = '\0';
+        if (sscanf (text, "%llu %n", &tsc, &text_start) == 1)
+        {
+            memset (&entry, 0, sizeof (entry));
+            entry.tsc = tsc;
+            entry.text = strdup (&text[text_start]);
+            add_entry (line, &entry);
+        }
+    }
+    fclose (log_file);
+}
+
+/**
+ * @brief Decode a recording into the timeline
+ * @return The number of samples decoded, including those in runs of repeats
+ */
+static uint64_t decode_samples (timeline *const line, const csrsample_header *const header, const uint8_t *const data,
+                                const size_t data_size)
+{
+    timeline_entry entry;
+    uint64_t values[4];
+    size_t offset = 0;
+    size_t num_bytes;
+    unsigned int num_values;
+    unsigned int value_index;
+    uint64_t tsc = header->start_tsc;
+    uint32_t status = 0;
+    uint8_t errcnt = 0;
+    uint32_t semaphore = 0;
+    uint64_t num_samples = 0;
+    uint8_t type;
+
+    while (offset < data_size)
+    {
+        type = data[offset++];
+        switch (type & CSRSAMPLE_RECORD_TYPE_MASK)
+        {
+        case CSRSAMPLE_RECORD_SAMPLE:
+            num_values = 1 + (((type & CSRSAMPLE_FIELD_STATUS) != 0) + ((type & CSRSAMPLE_FIELD_ERRCNT) != 0) +
+                              ((type & CSRSAMPLE_FIELD_SEMAPHORE) != 0));
+            break;
+
+        case CSRSAMPLE_RECORD_REPEAT:
+        case CSRSAMPLE_RECORD_REQUEST:
+            num_values = 2;
+            break;
+
+        default:
+            printf ("Invalid record type 0x%02x at offset %zu\n", type, offset - 1);
+            return num_samples;
+        }
+        for (value_index = 0; value_index < num_values; value_index++)
+        {
+            num_bytes = csrsample_decode_varint (&data[offset], data_size - offset, &values[value_index]);
+            if (num_bytes == 0)
+            {
+                printf ("Truncated record at offset %zu\n", offset);
+                return num_samples;
+            }
+            offset += num_bytes;
+        }
+
+        memset (&entry, 0, sizeof (entry));
+        entry.record_type = type & CSRSAMPLE_RECORD_TYPE_MASK;
+        switch (entry.record_type)
+        {
+        case CSRSAMPLE_RECORD_SAMPLE:
+            tsc += values[0];
+            value_index = 1;
+            if ((type & CSRSAMPLE_FIELD_STATUS) != 0)
+            {
+                status ^= (uint32_t) values[value_index++];
+            }
+            if ((type & CSRSAMPLE_FIELD_ERRCNT) != 0)
+            {
+                errcnt ^= (uint8_t) values[value_index++];
+            }
+            if ((type & CSRSAMPLE_FIELD_SEMAPHORE) != 0)
+            {
+                semaphore ^= (uint32_t) values[value_index++];
+            }
+            entry.tsc = tsc;
+            num_samples++;
+            break;
+
+        case CSRSAMPLE_RECORD_REPEAT:
+            tsc += values[1];
+            entry.tsc = tsc;
+            entry.repeat_count = values[0];
+            num_samples += values[0];
+            break;
+
+        case CSRSAMPLE_RECORD_REQUEST:
+            entry.tsc = header->start_tsc + values[0];
+            entry.request_id = (uint32_t) values[1];
+            entry.end = (type & CSRSAMPLE_REQUEST_END) != 0;
+            break;
+        }
+        entry.status = status;
+        entry.errcnt = errcnt;
+        entry.semaphore = semaphore;
+        add_entry (line, &entry);
+    }
+
+    return num_samples;
+}
+
+/**
+ * @brief Decode a recording, merged with an optional request log, and print the timeline
+ */
+static void decode_recording (const char *const pathname, const char *const request_log)
+{
+    FILE *recording;
+    csrsample_header header;
+    timeline line = {0};
+    uint8_t *data;
+    size_t data_size;
+    long file_size;
+    uint64_t num_samples;
+    size_t entry_index;
+    double duration_secs;
+
+    recording = fopen (pathname, "rb");
+    if ((recording == NULL) || (fread (&header, sizeof (header), 1, recording) != 1) ||
+        (header.magic != CSRSAMPLE_MAGIC) || (header.version != CSRSAMPLE_VERSION) || (header.tsc_hz == 0))
+    {
+        printf ("%s isn't a CSR sample recording\n", pathname);
+        exit (EXIT_FAILURE);
+    }
+    fseek (recording, 0, SEEK_END);
+    file_size = ftell (recording);
+    data_size = (size_t) file_size - sizeof (header);
+    data = malloc (data_size + 1);
+    fseek (recording, sizeof (header), SEEK_SET);
+    if ((data == NULL) || (fread (data, 1, data_size, recording) != data_size))
+    {
+        printf ("Failed to read %s\n", pathname);
+        exit (EXIT_FAILURE);
+    }
+    fclose (recording);
+
+    num_samples = decode_samples (&line, &header, data, data_size);
+    if (request_log != NULL)
+    {
+        read_request_log (&line, request_log);
+    }
+    qsort (line.entries, line.num_entries, sizeof (line.entries[0]), compare_entries);
+
+    printf ("%12s  %-10s  %10s  %6s  %10s\n", "Time (us)", "Event", "Status", "ErrCnt", "Semaphore");
+    for (entry_index = 0; entry_index < line.num_entries; entry_index++)
+    {
+        const timeline_entry *const entry = &line.entries[entry_index];
+        const double time_us = (double) (int64_t) (entry->tsc - header.start_tsc) * 1E6 / (double) header.tsc_hz;
+
+        if (entry->text != NULL)
+        {
+            printf ("%12.3f  log %s\n", time_us, entry->text);
+            free (entry->text);
+        }
+        else if (entry->record_type == CSRSAMPLE_RECORD_REQUEST)
+        {
+            printf ("%12.3f  request %u %s\n", time_us, entry->request_id, entry->end ? "end" : "start");
+        }
+        else if (entry->record_type == CSRSAMPLE_RECORD_REPEAT)
+        {
+            printf ("%12.3f  unchanged for %lu samples\n", time_us, (unsigned long) entry->repeat_count);
+        }
+        else
+        {
+            printf ("%12.3f  %-10s  0x%08x  %6u  0x%08x\n", time_us, "sample", entry->status, entry->errcnt,
+                    entry->semaphore);
+        }
+    }
+
+    duration_secs = (double) (header.end_tsc - header.start_tsc) / (double) header.tsc_hz;
+    printf ("\nDevice %s sampled on CPU %u", header.device_name, header.cpu);
+    if (header.semaphore_index != UINT32_MAX)
+    {
+        printf (" with the semaphore of descriptor %u", header.semaphore_index);
+    }
+    printf ("\n%lu samples in %.3f seconds (%.0f Hz), %lu requests (%lu dropped), %zu bytes (%.3f bits per sample)\n",
+            (unsigned long) num_samples, duration_secs, (double) num_samples / duration_secs,
+            (unsigned long) header.num_requests, (unsigned long) header.requests_dropped, data_size,
+            (num_samples > 0) ? ((double) data_size * 8.0 / (double) num_samples) : 0.0);
+    if (num_samples != header.num_samples)
+    {
+        printf ("Decoded %lu samples, but the header records %lu\n", (unsigned long) num_samples,
+                (unsigned long) header.num_samples);
+        exit (EXIT_FAILURE);
+    }
+    free (line.entries);
+    free (data);
+}
+
+int main (int argc, char *argv[])
+{
+    const char *output_pathname = NULL;
+    const char *input_pathname = NULL;
+    const char *request_log = NULL;
+    const char *device_name = NULL;
+    int cpu = -1;
+    uint64_t rate_hz = 1000000;
+    double duration_secs = 1.0;
+    uint32_t semaphore_index = UINT32_MAX;
+    size_t transfer_size = 0;
+    unsigned int chain_elements = 1;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "o:c:r:t:s:w:e:d:i:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o':
+            output_pathname = optarg;
+            break;
+
+        case 'c':
+            cpu = atoi (optarg);
+            break;
+
+        case 'r':
+            rate_hz = strtoull (optarg, NULL, 0);
+            break;
+
+        case 't':
+            duration_secs = atof (optarg);
+            break;
+
+        case 's':
+            semaphore_index = (uint32_t) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'w':
+            transfer_size = strtoul (optarg, NULL, 0);
+            break;
+
+        case 'e':
+            chain_elements = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'd':
+            device_name = optarg;
+            break;
+
+        case 'i':
+            input_pathname = optarg;
+            break;
+
+        case 'l':
+            request_log = optarg;
+            break;
+
+        default:
+            printf ("Usage: %s -o <file> [-c <cpu>] [-r <rate_hz>] [-t <seconds>] [-s <semaphore_index>]\n"
+                    "         [-w <transfer_size>] [-e <chain_elements>] [-d <device_name>]\n"
+                    "   or: %s -i <file> [-l <request_log>]\n", argv[0], argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    if (input_pathname != NULL)
+    {
+        decode_recording (input_pathname, request_log);
+    }
+    else if (output_pathname != NULL)
+    {
+        if (chain_elements == 0)
+        {
+            printf ("A chain must have at least one element\n");
+            exit (EXIT_FAILURE);
+        }
+        if (cpu < 0)
+        {
+            /* Default to the last CPU, which is the one most often isolated */
+            cpu = (int) sysconf (_SC_NPROCESSORS_ONLN) - 1;
+        }
+        record_samples (output_pathname, device_name, cpu, rate_hz, duration_secs, semaphore_index, transfer_size,
+                        chain_elements);
+    }
+    else
+    {
+        printf ("Either -o to record or -i to decode must be given\n");
+        exit (EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/*
+ * @file nvram_flightrec.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Decode the flight recorder rings in the NVRAM device memory, e.g. after a host crash
+ * @details
+ *   The recorder region is read by DMA, so decoding doesn't disturb the window selection. Usage:
+ *     nvram_flightrec (-r <offset>:<size> | -R <region_file>) [-g <generation>] [-n <max_events>]
+ *   With -R the region named "flightrec" in the region file is used. By default the events of all generations
+ *   still in the rings are displayed, ordered by generation then time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_flightrec.h"
+#include "nvram_uio_regions.h"
+
+/** One event found in the rings */
+typedef struct
+{
+    const flightrec_event *event;
+    /** The text of the event, or NULL if none */
+    const flightrec_text *text;
+} decoded_event;
+
+/**
+ * @brief qsort comparison function to order events by generation, then time, then ring and sequence
+ */
+static int compare_events (const void *const a, const void *const b)
+{
+    const flightrec_event *const event_a = ((const decoded_event *) a)->event;
+    const flightrec_event *const event_b = ((const decoded_event *) b)->event;
+
+    if (event_a->generation != event_b->generation)
+    {
+        return (event_a->generation < event_b->generation) ? -1 : 1;
+    }
+    if (event_a->tsc != event_b->tsc)
+    {
+        return (event_a->tsc < event_b->tsc) ? -1 : 1;
+    }
+    if (event_a->ring != event_b->ring)
+    {
+        return (event_a->ring < event_b->ring) ? -1 : 1;
+    }
+
+    return (event_a->sequence < event_b->sequence) ? -1 : ((event_a->sequence > event_b->sequence) ? 1 : 0);
+}
+
+/**
+ * @brief Find the valid events in all rings
+ * @param[in] header The recorder header, followed by the rings
+ * @param[in] generation Only return events of this generation, or zero for all generations
+ * @param[out] events The events found
+ * @return The number of events found
+ */
+static size_t find_events (const flightrec_header *const header, const unsigned int generation,
+                           decoded_event *const events)
+{
+    const uint8_t *const rings = (const uint8_t *) &header[1];
+    const flightrec_event *event;
+    const flightrec_text *text;
+    unsigned int ring;
+    uint32_t line;
+    size_t num_events = 0;
+
+    for (ring = 0; ring < header->num_rings; ring++)
+    {
+        const uint8_t *const ring_lines = &rings[(size_t) ring * header->lines_per_ring * FLIGHTREC_LINE_SIZE];
+
+        for (line = 0; line < header->lines_per_ring; line++)
+        {
+            event = (const flightrec_event *) &ring_lines[(size_t) line * FLIGHTREC_LINE_SIZE];
+            if ((event->sequence != 0) && (event->ring == ring) && (event->check == flightrec_event_check (event)) &&
+                ((generation == 0) || (event->generation == generation)))
+            {
+                events[num_events].event = event;
+                events[num_events].text = NULL;
+                if ((event->flags & FLIGHTREC_FLAG_TEXT) != 0)
+                {
+                    text = (const flightrec_text *)
+                            &ring_lines[(size_t) ((line + 1) % header->lines_per_ring) * FLIGHTREC_LINE_SIZE];
+                    if (text->check == ~event->sequence)
+                    {
+                        events[num_events].text = text;
+                    }
+                }
+                num_events++;
+            }
+        }
+    }
+
+    return num_events;
+}
+
+/**
+ * @brief Display one event
+ * @details Times are only meaningful for the generation in the header, since the TSC restarts on a reboot, so
+ *          other generations are shown relative to their first event.
+ */
+static void print_event (const flightrec_header *const header, const decoded_event *const decoded,
+                         const uint64_t generation_first_tsc)
+{
+    const flightrec_event *const event = decoded->event;
+    const double tsc_per_us = (double) header->tsc_hz / 1E6;
+    unsigned int arg_index;
+    uint64_t realtime_ns;
+
+    if ((event->generation == header->generation) && (event->tsc >= header->open_tsc))
+    {
+        realtime_ns = header->open_realtime_ns +
+                (uint64_t) ((double) (event->tsc - header->open_tsc) * 1E3 / tsc_per_us);
+        printf ("%5u %10lu.%06lu", event->generation, (unsigned long) (realtime_ns / 1000000000ULL),
+                (unsigned long) ((realtime_ns % 1000000000ULL) / 1000));
+    }
+    else
+    {
+        printf ("%5u %+17.3f", event->generation, (double) (event->tsc - generation_first_tsc) / tsc_per_us);
+    }
+    printf (" %4u %10u %5u", event->ring, event->sequence, event->event_id);
+    if (decoded->text != NULL)
+    {
+        printf (" 0x%lx \"%.*s\"\n", (unsigned long) event->args[0], FLIGHTREC_TEXT_LEN, decoded->text->text);
+    }
+    else
+    {
+        for (arg_index = 0; arg_index < FLIGHTREC_NUM_ARGS; arg_index++)
+        {
+            printf (" 0x%lx", (unsigned long) event->args[arg_index]);
+        }
+        printf ("\n");
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    nvram_region_table regions;
+    const nvram_region *region;
+    unsigned long long region_offset = 0;
+    unsigned long long region_size = 0;
+    unsigned int generation = 0;
+    size_t max_events = SIZE_MAX;
+    flightrec_header *header;
+    decoded_event *events;
+    size_t num_events;
+    size_t event_index;
+    uint64_t generation_first_tsc = 0;
+    int opt;
+
+    memset (&regions, 0, sizeof (regions));
+    while ((opt = getopt (argc, argv, "r:R:g:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            if (sscanf (optarg, "%lli:%lli", &region_offset, &region_size) != 2)
+            {
+                printf ("Invalid region %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 'R':
+            if (!load_region_file (&regions, optarg))
+            {
+                exit (EXIT_FAILURE);
+            }
+            region = find_region (&regions, "flightrec");
+            if (region == NULL)
+            {
+                printf ("No flightrec region in %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            region_offset = region->offset;
+            region_size = region->size;
+            break;
+
+        case 'g':
+            generation = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'n':
+            max_events = strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s (-r <offset>:<size> | -R <region_file>) [-g <generation>] [-n <max_events>]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (region_size <= sizeof (flightrec_header))
+    {
+        printf ("The flight recorder region must be specified\n");
+        exit (EXIT_FAILURE);
+    }
+
+    header = malloc (region_size);
+    if (header == NULL)
+    {
+        printf ("Failed to allocate %llu bytes for the region\n", region_size);
+        exit (EXIT_FAILURE);
+    }
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+    if (!dma_read_to_host (&context, region_offset, header, region_size))
+    {
+        printf ("Failed to read the flight recorder region\n");
+        exit (EXIT_FAILURE);
+    }
+    close_uio_device (&context);
+
+    if ((header->magic != FLIGHTREC_MAGIC) || (header->version != FLIGHTREC_VERSION) || (header->num_rings == 0) ||
+        ((sizeof (flightrec_header) + ((uint64_t) header->num_rings * header->lines_per_ring * FLIGHTREC_LINE_SIZE)) >
+         region_size))
+    {
+        printf ("No valid flight recorder header in the region\n");
+        exit (EXIT_FAILURE);
+    }
+    printf ("Generation %u, %u rings of %u lines, TSC %.3f MHz\n", header->generation, header->num_rings,
+            header->lines_per_ring, (double) header->tsc_hz / 1E6);
+
+    events = calloc ((size_t) header->num_rings * header->lines_per_ring, sizeof (decoded_event));
+    if (events == NULL)
+    {
+        printf ("Failed to allocate events\n");
+        exit (EXIT_FAILURE);
+    }
+    num_events = find_events (header, generation, events);
+    qsort (events, num_events, sizeof (events[0]), compare_events);
+
+    printf ("%5s %17s %4s %10s %5s %s\n", "Gen", "Time", "Ring", "Sequence", "Event", "Arguments");
+    for (event_index = (num_events > max_events) ? (num_events - max_events) : 0; event_index < num_events;
+         event_index++)
+    {
+        if ((event_index == 0) || (events[event_index].event->generation != events[event_index - 1].event->generation))
+        {
+            generation_first_tsc = events[event_index].event->tsc;
+        }
+        print_event (header, &events[event_index], generation_first_tsc);
+    }
+
+    free (events);
+    free (header);
+
+    return EXIT_SUCCESS;
+}
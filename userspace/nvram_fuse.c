@@ -0,0 +1,510 @@
+/*
+ * @file nvram_fuse.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief FUSE filesystem which presents named regions of the NVRAM device memory as files
+ * @details
+ *   Each region is a fixed-size file in the root directory, with reads and writes performed by DMA. Usage:
+ *     nvram_fuse [FUSE options] [--region=<name>=<offset>:<size>] ... [--regions=<region_file>] <mountpoint>
+ *   With no regions specified a single file "card" presents all of the device memory.
+ *
+ *   For throughput:
+ *   - Files are opened direct_io, so requests go straight to DMA without passing through the page cache.
+ *   - max_read and max_write are set to the size of a DMA buffer slot, and st_blksize reports the same size so
+ *     that cp uses that I/O size.
+ *   - Requests are handled by multiple threads, each using its own slot of the DMA buffer. The DMA engine itself
+ *     is serialised by lock_device().
+ *   - Splice from the FUSE device is used for writes, so the data is copied from the kernel pipe straight into the
+ *     DMA buffer slot. Replies to reads can't be spliced from the DMA buffer, since vmsplice() can't reference the
+ *     pages of a PFN mapping, so they are written from the slot.
+ */
+
+#define FUSE_USE_VERSION 34
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fuse_lowlevel.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_regions.h"
+
+/* The largest DMA buffer slot, which sets max_read and max_write */
+#define MAX_SLOT_SIZE (1024 * 1024)
+
+/* The inode of the first region, with the following regions numbered consecutively */
+#define FIRST_REGION_INO (FUSE_ROOT_ID + 1)
+
+/* How long the kernel may cache attributes and names, which don't change while mounted */
+#define ATTR_TIMEOUT_SECS 3600.0
+
+/** The state of the filesystem */
+typedef struct
+{
+    nvram_region_table regions;
+    nvram_uio_context context;
+    /** The DMA buffer is divided into slots, one per request being handled */
+    size_t slot_size;
+    unsigned int num_slots;
+    unsigned int num_free_slots;
+    unsigned int *free_slots;
+    pthread_mutex_t slot_lock;
+    pthread_cond_t slot_freed;
+} nvram_fuse_state;
+
+static nvram_fuse_state fs;
+
+enum
+{
+    KEY_REGION,
+    KEY_REGION_FILE
+};
+
+static const struct fuse_opt nvram_fuse_opts[] =
+{
+    FUSE_OPT_KEY ("--region=", KEY_REGION),
+    FUSE_OPT_KEY ("--regions=", KEY_REGION_FILE),
+    FUSE_OPT_END
+};
+
+/**
+ * @brief Take a free DMA buffer slot, waiting until one is available
+ * @return The index of the slot
+ */
+static unsigned int acquire_slot (void)
+{
+    unsigned int slot;
+
+    pthread_mutex_lock (&fs.slot_lock);
+    while (fs.num_free_slots == 0)
+    {
+        pthread_cond_wait (&fs.slot_freed, &fs.slot_lock);
+    }
+    slot = fs.free_slots[--fs.num_free_slots];
+    pthread_mutex_unlock (&fs.slot_lock);
+
+    return slot;
+}
+
+/**
+ * @brief Return a DMA buffer slot taken by acquire_slot()
+ */
+static void release_slot (const unsigned int slot)
+{
+    pthread_mutex_lock (&fs.slot_lock);
+    fs.free_slots[fs.num_free_slots++] = slot;
+    pthread_cond_signal (&fs.slot_freed);
+    pthread_mutex_unlock (&fs.slot_lock);
+}
+
+/**
+ * @brief Return the region for an inode, or NULL if the inode isn't a region
+ */
+static const nvram_region *region_for_ino (const fuse_ino_t ino)
+{
+    return ((ino >= FIRST_REGION_INO) && ((ino - FIRST_REGION_INO) < fs.regions.num_regions)) ?
+            &fs.regions.regions[ino - FIRST_REGION_INO] : NULL;
+}
+
+/**
+ * @brief Fill in the attributes of an inode
+ * @return Returns true if the inode exists
+ */
+static bool fill_attr (const fuse_ino_t ino, struct stat *const st)
+{
+    const nvram_region *const region = region_for_ino (ino);
+
+    memset (st, 0, sizeof (*st));
+    st->st_ino = ino;
+    st->st_uid = getuid ();
+    st->st_gid = getgid ();
+    st->st_blksize = (blksize_t) fs.slot_size;
+    if (ino == FUSE_ROOT_ID)
+    {
+        st->st_mode = S_IFDIR | 0755;
+        st->st_nlink = 2;
+    }
+    else if (region != NULL)
+    {
+        st->st_mode = S_IFREG | 0644;
+        st->st_nlink = 1;
+        st->st_size = (off_t) region->size;
+        st->st_blocks = (blkcnt_t) ((region->size + 511) / 512);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static void nvram_fuse_init (void *userdata, struct fuse_conn_info *conn)
+{
+    unsigned int slot;
+
+    /* Opened here rather than before mounting, so the process which owns the device is the one after daemonising */
+    find_uio_device (&fs.context);
+    get_uio_device_parameters (&fs.context);
+    open_uio_device (&fs.context);
+    map_dma_buffer (&fs.context);
+
+    fs.slot_size = (fs.context.dma_buffer_size < MAX_SLOT_SIZE) ? fs.context.dma_buffer_size : MAX_SLOT_SIZE;
+    fs.num_slots = (unsigned int) (fs.context.dma_buffer_size / fs.slot_size);
+    fs.free_slots = calloc (fs.num_slots, sizeof (fs.free_slots[0]));
+    if (fs.free_slots == NULL)
+    {
+        printf ("Failed to allocate DMA buffer slots\n");
+        exit (EXIT_FAILURE);
+    }
+    for (slot = 0; slot < fs.num_slots; slot++)
+    {
+        fs.free_slots[fs.num_free_slots++] = slot;
+    }
+
+    conn->max_write = (unsigned int) fs.slot_size;
+    conn->max_read = (unsigned int) fs.slot_size;
+    if ((conn->capable & FUSE_CAP_SPLICE_READ) != 0)
+    {
+        conn->want |= FUSE_CAP_SPLICE_READ;
+    }
+    conn->want &= ~(FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+}
+
+static void nvram_fuse_destroy (void *userdata)
+{
+    close_uio_device (&fs.context);
+    free (fs.free_slots);
+    fs.free_slots = NULL;
+}
+
+static void nvram_fuse_lookup (fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    struct fuse_entry_param entry;
+    unsigned int region_index;
+
+    if (parent != FUSE_ROOT_ID)
+    {
+        fuse_reply_err (req, ENOENT);
+        return;
+    }
+    for (region_index = 0; region_index < fs.regions.num_regions; region_index++)
+    {
+        if (strcmp (fs.regions.regions[region_index].name, name) == 0)
+        {
+            memset (&entry, 0, sizeof (entry));
+            entry.ino = FIRST_REGION_INO + region_index;
+            entry.attr_timeout = ATTR_TIMEOUT_SECS;
+            entry.entry_timeout = ATTR_TIMEOUT_SECS;
+            fill_attr (entry.ino, &entry.attr);
+            fuse_reply_entry (req, &entry);
+            return;
+        }
+    }
+
+    fuse_reply_err (req, ENOENT);
+}
+
+static void nvram_fuse_getattr (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    struct stat st;
+
+    if (fill_attr (ino, &st))
+    {
+        fuse_reply_attr (req, &st, ATTR_TIMEOUT_SECS);
+    }
+    else
+    {
+        fuse_reply_err (req, ENOENT);
+    }
+}
+
+static void nvram_fuse_setattr (fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+                                struct fuse_file_info *fi)
+{
+    /* Regions have a fixed size, so a truncate from an open with O_TRUNC leaves the contents unchanged */
+    nvram_fuse_getattr (req, ino, fi);
+}
+
+static void nvram_fuse_readdir (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    const off_t num_entries = 2 + (off_t) fs.regions.num_regions;
+    char *buffer;
+    size_t used = 0;
+    size_t entry_size;
+    off_t entry_index;
+    struct stat st;
+    const char *name;
+
+    if (ino != FUSE_ROOT_ID)
+    {
+        fuse_reply_err (req, ENOTDIR);
+        return;
+    }
+    buffer = malloc (size);
+    if (buffer == NULL)
+    {
+        fuse_reply_err (req, ENOMEM);
+        return;
+    }
+
+    for (entry_index = off; entry_index < num_entries; entry_index++)
+    {
+        memset (&st, 0, sizeof (st));
+        if (entry_index < 2)
+        {
+            name = (entry_index == 0) ? "." : "..";
+            st.st_ino = FUSE_ROOT_ID;
+            st.st_mode = S_IFDIR;
+        }
+        else
+        {
+            name = fs.regions.regions[entry_index - 2].name;
+            st.st_ino = FIRST_REGION_INO + (fuse_ino_t) (entry_index - 2);
+            st.st_mode = S_IFREG;
+        }
+        entry_size = fuse_add_direntry (req, &buffer[used], size - used, name, &st, entry_index + 1);
+        if (entry_size > (size - used))
+        {
+            break;
+        }
+        used += entry_size;
+    }
+
+    fuse_reply_buf (req, buffer, used);
+    free (buffer);
+}
+
+static void nvram_fuse_open (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    if (region_for_ino (ino) == NULL)
+    {
+        fuse_reply_err (req, (ino == FUSE_ROOT_ID) ? EISDIR : ENOENT);
+        return;
+    }
+    fi->direct_io = 1;
+    fi->keep_cache = 0;
+    fuse_reply_open (req, fi);
+}
+
+static void nvram_fuse_read (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    const nvram_region *const region = region_for_ino (ino);
+    unsigned int slot;
+
+    if (region == NULL)
+    {
+        fuse_reply_err (req, ENOENT);
+        return;
+    }
+    if ((uint64_t) off >= region->size)
+    {
+        fuse_reply_buf (req, NULL, 0);
+        return;
+    }
+    if (size > (region->size - (uint64_t) off))
+    {
+        size = (size_t) (region->size - (uint64_t) off);
+    }
+    if (size > fs.slot_size)
+    {
+        size = fs.slot_size;
+    }
+
+    slot = acquire_slot ();
+    if (dma_transfer (&fs.context, DMA_WRITE_TO_HOST, region->offset + (uint64_t) off, slot * fs.slot_size, size))
+    {
+        fuse_reply_buf (req, (const char *) &fs.context.dma_buffer[slot * fs.slot_size], size);
+    }
+    else
+    {
+        fuse_reply_err (req, EIO);
+    }
+    release_slot (slot);
+}
+
+static void nvram_fuse_write_buf (fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *in_buf, off_t off,
+                                  struct fuse_file_info *fi)
+{
+    const nvram_region *const region = region_for_ino (ino);
+    size_t size = fuse_buf_size (in_buf);
+    struct fuse_bufvec slot_buf;
+    unsigned int slot;
+    ssize_t copied;
+
+    if (region == NULL)
+    {
+        fuse_reply_err (req, ENOENT);
+        return;
+    }
+    if ((uint64_t) off >= region->size)
+    {
+        fuse_reply_err (req, ENOSPC);
+        return;
+    }
+    if (size > (region->size - (uint64_t) off))
+    {
+        size = (size_t) (region->size - (uint64_t) off);
+    }
+    if (size > fs.slot_size)
+    {
+        size = fs.slot_size;
+    }
+
+    slot = acquire_slot ();
+    slot_buf = FUSE_BUFVEC_INIT (size);
+    slot_buf.buf[0].mem = &fs.context.dma_buffer[slot * fs.slot_size];
+    copied = fuse_buf_copy (&slot_buf, in_buf, 0);
+    if (copied < 0)
+    {
+        fuse_reply_err (req, (int) -copied);
+    }
+    else if ((copied > 0) &&
+             !dma_transfer (&fs.context, DMA_READ_FROM_HOST, region->offset + (uint64_t) off, slot * fs.slot_size,
+                            (size_t) copied))
+    {
+        fuse_reply_err (req, EIO);
+    }
+    else
+    {
+        fuse_reply_write (req, (size_t) copied);
+    }
+    release_slot (slot);
+}
+
+static void nvram_fuse_statfs (fuse_req_t req, fuse_ino_t ino)
+{
+    struct statvfs st;
+    unsigned int region_index;
+
+    memset (&st, 0, sizeof (st));
+    st.f_bsize = fs.slot_size;
+    st.f_frsize = 512;
+    for (region_index = 0; region_index < fs.regions.num_regions; region_index++)
+    {
+        st.f_blocks += (fs.regions.regions[region_index].size + 511) / 512;
+    }
+    st.f_files = fs.regions.num_regions;
+    st.f_namemax = NVRAM_REGION_MAX_NAME_LEN;
+    fuse_reply_statfs (req, &st);
+}
+
+static const struct fuse_lowlevel_ops nvram_fuse_ops =
+{
+    .init = nvram_fuse_init,
+    .destroy = nvram_fuse_destroy,
+    .lookup = nvram_fuse_lookup,
+    .getattr = nvram_fuse_getattr,
+    .setattr = nvram_fuse_setattr,
+    .readdir = nvram_fuse_readdir,
+    .open = nvram_fuse_open,
+    .read = nvram_fuse_read,
+    .write_buf = nvram_fuse_write_buf,
+    .statfs = nvram_fuse_statfs
+};
+
+/**
+ * @brief Handle the region options, which are removed from the arguments passed to FUSE
+ */
+static int nvram_fuse_opt_proc (void *data, const char *arg, int key, struct fuse_args *outargs)
+{
+    switch (key)
+    {
+    case KEY_REGION:
+        if (!add_region_spec (&fs.regions, strchr (arg, '=') + 1))
+        {
+            exit (EXIT_FAILURE);
+        }
+        return 0;
+
+    case KEY_REGION_FILE:
+        if (!load_region_file (&fs.regions, strchr (arg, '=') + 1))
+        {
+            exit (EXIT_FAILURE);
+        }
+        return 0;
+
+    default:
+        return 1;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT (argc, argv);
+    struct fuse_cmdline_opts opts;
+    struct fuse_loop_config loop_config;
+    struct fuse_session *se;
+    nvram_uio_context probe_context;
+    char max_read_arg[64];
+    int rc = EXIT_FAILURE;
+
+    pthread_mutex_init (&fs.slot_lock, NULL);
+    pthread_cond_init (&fs.slot_freed, NULL);
+    if (fuse_opt_parse (&args, NULL, nvram_fuse_opts, nvram_fuse_opt_proc) != 0)
+    {
+        exit (EXIT_FAILURE);
+    }
+    if (fuse_parse_cmdline (&args, &opts) != 0)
+    {
+        exit (EXIT_FAILURE);
+    }
+    if (opts.show_help || (opts.mountpoint == NULL))
+    {
+        printf ("Usage: %s [options] [--region=<name>=<offset>:<size>] ... [--regions=<region_file>] <mountpoint>\n\n",
+                argv[0]);
+        fuse_cmdline_help ();
+        fuse_lowlevel_help ();
+        exit (opts.show_help ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    /* Validate the regions against the device memory size before mounting */
+    find_uio_device (&probe_context);
+    get_uio_device_parameters (&probe_context);
+    open_uio_device (&probe_context);
+    if (!validate_region_table (&fs.regions, probe_context.memory_size_bytes))
+    {
+        exit (EXIT_FAILURE);
+    }
+    close_uio_device (&probe_context);
+
+    snprintf (max_read_arg, sizeof (max_read_arg), "-omax_read=%u", MAX_SLOT_SIZE);
+    fuse_opt_add_arg (&args, max_read_arg);
+
+    se = fuse_session_new (&args, &nvram_fuse_ops, sizeof (nvram_fuse_ops), NULL);
+    if (se != NULL)
+    {
+        if (fuse_set_signal_handlers (se) == 0)
+        {
+            if (fuse_session_mount (se, opts.mountpoint) == 0)
+            {
+                fuse_daemonize (opts.foreground);
+                if (opts.singlethread)
+                {
+                    rc = fuse_session_loop (se);
+                }
+                else
+                {
+                    loop_config.clone_fd = opts.clone_fd;
+                    loop_config.max_idle_threads = opts.max_idle_threads;
+                    rc = fuse_session_loop_mt (se, &loop_config);
+                }
+                fuse_session_unmount (se);
+            }
+            fuse_remove_signal_handlers (se);
+        }
+        fuse_session_destroy (se);
+    }
+
+    free (opts.mountpoint);
+    fuse_opt_free_args (&args);
+
+    return (rc == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,295 @@
+/*
+ * @file nvram_heatmap.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Render a heatmap file recorded by the sampling profiler in nvram_uio_heatmap.c
+ * @details
+ *   Usage:
+ *     nvram_heatmap [-c <columns>] [-s <slices_per_row>] [-d read|write|both] [-t <num_hottest>] <heatmap_file>
+ *   Each row is a period of time, and each column a range of the device memory. The density character in each cell
+ *   is on a log scale relative to the busiest cell.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "nvram_uio_heatmap.h"
+
+/** The characters used for increasing access density */
+static const char density_chars[] = " .:-=+*#%@";
+#define NUM_DENSITY_LEVELS (sizeof (density_chars) - 1)
+
+/** One time slice read from the heatmap file */
+typedef struct
+{
+    uint64_t end_time_ns;
+    uint32_t num_entries;
+    heatmap_slice_entry *entries;
+} heatmap_slice;
+
+/** The total sampled accesses for one region, used to report the hottest regions */
+typedef struct
+{
+    uint32_t region;
+    uint64_t accesses[HEATMAP_NUM_DIRECTIONS];
+} region_total;
+
+/**
+ * @brief qsort comparison function to sort regions by descending total accesses
+ */
+static int compare_region_totals (const void *const a, const void *const b)
+{
+    const region_total *const region_a = a;
+    const region_total *const region_b = b;
+    const uint64_t total_a = region_a->accesses[HEATMAP_READ] + region_a->accesses[HEATMAP_WRITE];
+    const uint64_t total_b = region_b->accesses[HEATMAP_READ] + region_b->accesses[HEATMAP_WRITE];
+
+    return (total_a < total_b) ? 1 : ((total_a > total_b) ? -1 : 0);
+}
+
+/**
+ * @brief Read all the time slices from a heatmap file
+ * @param[in] filename The heatmap file to read
+ * @param[out] header The header of the file
+ * @param[out] num_slices The number of slices read
+ * @return The array of slices read
+ */
+static heatmap_slice *read_heatmap_file (const char *const filename, heatmap_file_header *const header,
+                                         uint32_t *const num_slices)
+{
+    FILE *heatmap_file;
+    heatmap_slice *slices = NULL;
+    uint32_t allocated_slices = 0;
+    heatmap_slice_header slice_header;
+    heatmap_slice *slice;
+
+    heatmap_file = fopen (filename, "rb");
+    if (heatmap_file == NULL)
+    {
+        printf ("Failed to open %s\n", filename);
+        exit (EXIT_FAILURE);
+    }
+    if ((fread (header, sizeof (*header), 1, heatmap_file) != 1) ||
+        (header->magic != HEATMAP_FILE_MAGIC) || (header->version != HEATMAP_FILE_VERSION) ||
+        (header->num_regions == 0))
+    {
+        printf ("%s is not a heatmap file\n", filename);
+        exit (EXIT_FAILURE);
+    }
+
+    *num_slices = 0;
+    while (fread (&slice_header, sizeof (slice_header), 1, heatmap_file) == 1)
+    {
+        if (*num_slices == allocated_slices)
+        {
+            allocated_slices = (allocated_slices == 0) ? 64 : (allocated_slices * 2);
+            slices = realloc (slices, allocated_slices * sizeof (slices[0]));
+            if (slices == NULL)
+            {
+                printf ("Failed to allocate slices\n");
+                exit (EXIT_FAILURE);
+            }
+        }
+
+        slice = &slices[*num_slices];
+        slice->end_time_ns = slice_header.end_time_ns;
+        slice->num_entries = slice_header.num_entries;
+        slice->entries = malloc (((size_t) slice->num_entries + 1) * sizeof (slice->entries[0]));
+        if (slice->entries == NULL)
+        {
+            printf ("Failed to allocate slice entries\n");
+            exit (EXIT_FAILURE);
+        }
+        if (fread (slice->entries, sizeof (slice->entries[0]), slice->num_entries, heatmap_file) != slice->num_entries)
+        {
+            /* The last slice is incomplete if the recording process was killed while writing it */
+            free (slice->entries);
+            break;
+        }
+        (*num_slices)++;
+    }
+    fclose (heatmap_file);
+
+    return slices;
+}
+
+int main (int argc, char *argv[])
+{
+    uint32_t num_columns = 64;
+    uint32_t slices_per_row = 1;
+    uint32_t num_hottest = 10;
+    bool include_direction[HEATMAP_NUM_DIRECTIONS] = {true, true};
+    heatmap_file_header header;
+    heatmap_slice *slices;
+    uint32_t num_slices;
+    uint32_t regions_per_column;
+    uint32_t num_rows;
+    uint64_t *cells;
+    uint64_t max_cell = 0;
+    region_total *totals;
+    uint32_t slice_index;
+    uint32_t entry_index;
+    uint32_t row;
+    uint32_t column;
+    uint32_t direction;
+    unsigned int level;
+    const heatmap_slice_entry *entry;
+    uint64_t cell;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "c:s:d:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            num_columns = (uint32_t) strtoul (optarg, NULL, 0);
+            break;
+
+        case 's':
+            slices_per_row = (uint32_t) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'd':
+            include_direction[HEATMAP_READ] = strcmp (optarg, "write") != 0;
+            include_direction[HEATMAP_WRITE] = strcmp (optarg, "read") != 0;
+            break;
+
+        case 't':
+            num_hottest = (uint32_t) strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if ((optind != (argc - 1)) || (num_columns == 0) || (slices_per_row == 0))
+    {
+        printf ("Usage: %s [-c <columns>] [-s <slices_per_row>] [-d read|write|both] [-t <num_hottest>] <heatmap_file>\n",
+                argv[0]);
+        exit (EXIT_FAILURE);
+    }
+
+    slices = read_heatmap_file (argv[optind], &header, &num_slices);
+    if (num_slices == 0)
+    {
+        printf ("No time slices recorded\n");
+        return EXIT_SUCCESS;
+    }
+
+    if (num_columns > header.num_regions)
+    {
+        num_columns = header.num_regions;
+    }
+    regions_per_column = (header.num_regions + num_columns - 1) / num_columns;
+    num_rows = (num_slices + slices_per_row - 1) / slices_per_row;
+    cells = calloc ((size_t) num_rows * num_columns, sizeof (cells[0]));
+    totals = calloc (header.num_regions, sizeof (totals[0]));
+    if ((cells == NULL) || (totals == NULL))
+    {
+        printf ("Failed to allocate heatmap\n");
+        exit (EXIT_FAILURE);
+    }
+    for (entry_index = 0; entry_index < header.num_regions; entry_index++)
+    {
+        totals[entry_index].region = entry_index;
+    }
+
+    for (slice_index = 0; slice_index < num_slices; slice_index++)
+    {
+        row = slice_index / slices_per_row;
+        for (entry_index = 0; entry_index < slices[slice_index].num_entries; entry_index++)
+        {
+            entry = &slices[slice_index].entries[entry_index];
+            if (entry->region < header.num_regions)
+            {
+                for (direction = 0; direction < HEATMAP_NUM_DIRECTIONS; direction++)
+                {
+                    if (include_direction[direction])
+                    {
+                        cells[((size_t) row * num_columns) + (entry->region / regions_per_column)] +=
+                                entry->accesses[direction];
+                        totals[entry->region].accesses[direction] += entry->accesses[direction];
+                    }
+                }
+            }
+        }
+    }
+    for (row = 0; row < num_rows; row++)
+    {
+        for (column = 0; column < num_columns; column++)
+        {
+            if (cells[((size_t) row * num_columns) + column] > max_cell)
+            {
+                max_cell = cells[((size_t) row * num_columns) + column];
+            }
+        }
+    }
+
+    printf ("%u regions of %u KB, 1 in %u accesses sampled, %u ms slices\n",
+            header.num_regions, header.region_size / 1024, header.sample_rate, header.merge_interval_ms);
+    printf ("Each column is %u KB, each row %u slice(s), busiest cell %lu sampled accesses\n\n",
+            (regions_per_column * header.region_size) / 1024, slices_per_row, (unsigned long) max_cell);
+    printf ("%9s |", "time (s)");
+    for (column = 0; column < num_columns; column += 16)
+    {
+        printf ("%-16lu", (unsigned long) ((uint64_t) column * regions_per_column * header.region_size) >> 20);
+    }
+    printf (" (MB)\n");
+
+    for (row = 0; row < num_rows; row++)
+    {
+        slice_index = ((row + 1) * slices_per_row) - 1;
+        if (slice_index >= num_slices)
+        {
+            slice_index = num_slices - 1;
+        }
+        printf ("%9.2f |", (double) (slices[slice_index].end_time_ns - slices[0].end_time_ns) / 1E9);
+        for (column = 0; column < num_columns; column++)
+        {
+            cell = cells[((size_t) row * num_columns) + column];
+            level = 0;
+            if (cell > 0)
+            {
+                level = (max_cell > 1) ?
+                        (1 + (unsigned int) ((NUM_DENSITY_LEVELS - 2) * log ((double) cell) / log ((double) max_cell))) :
+                        (NUM_DENSITY_LEVELS - 1);
+            }
+            putchar (density_chars[(level < NUM_DENSITY_LEVELS) ? level : (NUM_DENSITY_LEVELS - 1)]);
+        }
+        printf ("|\n");
+    }
+
+    qsort (totals, header.num_regions, sizeof (totals[0]), compare_region_totals);
+    printf ("\nHottest regions (estimated accesses = sampled * sample rate):\n");
+    printf ("%-25s %14s %14s\n", "card offset", "reads", "writes");
+    for (entry_index = 0; (entry_index < num_hottest) && (entry_index < header.num_regions); entry_index++)
+    {
+        const region_total *const total = &totals[entry_index];
+
+        if ((total->accesses[HEATMAP_READ] + total->accesses[HEATMAP_WRITE]) == 0)
+        {
+            break;
+        }
+        printf ("0x%09lx-0x%09lx %14lu %14lu\n",
+                (unsigned long) total->region * header.region_size,
+                ((unsigned long) (total->region + 1) * header.region_size) - 1,
+                (unsigned long) (total->accesses[HEATMAP_READ] * header.sample_rate),
+                (unsigned long) (total->accesses[HEATMAP_WRITE] * header.sample_rate));
+    }
+
+    for (slice_index = 0; slice_index < num_slices; slice_index++)
+    {
+        free (slices[slice_index].entries);
+    }
+    free (slices);
+    free (cells);
+    free (totals);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,342 @@
+/*
+ * @file nvram_image.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Save, compare and restore images of the NVRAM device memory, transferring only the blocks which differ
+ * @details
+ *   Each image file has a manifest file <image>.manifest holding the hash of each block of the image.
+ *   The device memory is hashed while streaming it by DMA, and compared against the manifest. Usage:
+ *     nvram_image save <image>     Save the device memory to the image. If the image and its manifest already
+ *                                  exist with the same size, only the blocks which differ from the manifest are
+ *                                  written to the file.
+ *     nvram_image diff <image>     List the blocks of the device memory which differ from the image.
+ *     nvram_image restore <image>  Write the blocks of the image which differ to the device memory.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_blockhash.h"
+
+/** Used to write the blocks which differ to the image file while the device memory is hashed */
+typedef struct
+{
+    int image_fd;
+    const uint64_t *hashes;
+    /** The manifest of the existing image, or NULL if every block is to be written */
+    const blockhash_manifest *previous;
+    uint64_t blocks_written;
+} save_state;
+
+/**
+ * @brief Chunk callback which writes the blocks of the chunk which differ from the previous image
+ */
+static bool save_chunk (void *const arg, const uint64_t card_offset, const void *const data, const size_t num_bytes)
+{
+    save_state *const state = arg;
+    const uint8_t *const bytes = data;
+    size_t block_offset;
+    size_t block_bytes;
+    uint64_t block;
+
+    for (block_offset = 0; block_offset < num_bytes; block_offset += block_bytes)
+    {
+        block = (card_offset + block_offset) / BLOCKHASH_BLOCK_SIZE;
+        block_bytes = ((num_bytes - block_offset) < BLOCKHASH_BLOCK_SIZE) ? (num_bytes - block_offset) :
+                BLOCKHASH_BLOCK_SIZE;
+        if ((state->previous == NULL) || (state->previous->hashes[block] != state->hashes[block]))
+        {
+            if (pwrite (state->image_fd, &bytes[block_offset], block_bytes, (off_t) (card_offset + block_offset)) !=
+                (ssize_t) block_bytes)
+            {
+                perror ("Failed to write image");
+                return false;
+            }
+            state->blocks_written++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Save the device memory to an image, writing only the blocks which differ from an existing image
+ * @details The save is only incremental when both the manifest and the image file exist with the size of the device
+ *          memory, as otherwise the unwritten blocks of the image wouldn't hold the contents the manifest describes.
+ */
+static bool save_image (nvram_uio_context *const context, const char *const image_pathname,
+                        const char *const manifest_pathname)
+{
+    blockhash_manifest manifest;
+    blockhash_manifest previous;
+    save_state state;
+    struct stat image_stat;
+    bool previous_read;
+    bool incremental;
+    bool success;
+
+    if (!blockhash_manifest_alloc (&manifest, context->memory_size_bytes))
+    {
+        printf ("Failed to allocate manifest\n");
+        return false;
+    }
+    previous_read = blockhash_manifest_read (&previous, manifest_pathname);
+
+    memset (&state, 0, sizeof (state));
+    state.image_fd = open (image_pathname, O_RDWR | O_CREAT, 0644);
+    if (state.image_fd < 0)
+    {
+        perror (image_pathname);
+        if (previous_read)
+        {
+            blockhash_manifest_free (&previous);
+        }
+        blockhash_manifest_free (&manifest);
+        return false;
+    }
+    incremental = previous_read && (previous.header.image_size == manifest.header.image_size) &&
+            (fstat (state.image_fd, &image_stat) == 0) && ((uint64_t) image_stat.st_size == manifest.header.image_size);
+    if (previous_read && !incremental)
+    {
+        printf ("Image doesn't match its manifest, saving all blocks\n");
+    }
+    state.hashes = manifest.hashes;
+    state.previous = incremental ? &previous : NULL;
+
+    /* Remove the manifest until the image is consistent with the new manifest */
+    (void) unlink (manifest_pathname);
+    success = blockhash_device (context, 0, manifest.header.image_size, manifest.hashes, save_chunk, &state) &&
+            (ftruncate (state.image_fd, (off_t) manifest.header.image_size) == 0) &&
+            (fsync (state.image_fd) == 0);
+    success = (close (state.image_fd) == 0) && success;
+    success = success && blockhash_manifest_write (&manifest, manifest_pathname);
+
+    printf ("Save %s: wrote %lu of %lu blocks\n", success ? "complete" : "FAILED", (unsigned long) state.blocks_written,
+            (unsigned long) manifest.header.num_blocks);
+    if (previous_read)
+    {
+        blockhash_manifest_free (&previous);
+    }
+    blockhash_manifest_free (&manifest);
+
+    return success;
+}
+
+/**
+ * @brief Hash the device memory, and compare it against the manifest of an image
+ * @param[in,out] context The open NVRAM UIO device
+ * @param[in] manifest_pathname The manifest of the image
+ * @param[out] manifest The manifest read
+ * @param[out] differs Allocated and set for each block which differs
+ * @return The number of blocks which differ
+ */
+static uint64_t compare_with_image (nvram_uio_context *const context, const char *const manifest_pathname,
+                                    blockhash_manifest *const manifest, bool **const differs)
+{
+    uint64_t *hashes;
+    uint64_t block;
+    uint64_t num_differ = 0;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+
+    if (!blockhash_manifest_read (manifest, manifest_pathname))
+    {
+        printf ("Failed to read manifest %s\n", manifest_pathname);
+        exit (EXIT_FAILURE);
+    }
+    if (manifest->header.image_size != context->memory_size_bytes)
+    {
+        printf ("Image size %lu doesn't match the device memory size %lu\n",
+                (unsigned long) manifest->header.image_size, (unsigned long) context->memory_size_bytes);
+        exit (EXIT_FAILURE);
+    }
+
+    hashes = calloc (manifest->header.num_blocks, sizeof (hashes[0]));
+    *differs = calloc (manifest->header.num_blocks, sizeof ((*differs)[0]));
+    if ((hashes == NULL) || (*differs == NULL))
+    {
+        printf ("Failed to allocate hashes\n");
+        exit (EXIT_FAILURE);
+    }
+
+    start_ns = get_monotonic_time_ns ();
+    if (!blockhash_device (context, 0, manifest->header.image_size, hashes, NULL, NULL))
+    {
+        printf ("Failed to read the device memory\n");
+        exit (EXIT_FAILURE);
+    }
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+
+    for (block = 0; block < manifest->header.num_blocks; block++)
+    {
+        (*differs)[block] = hashes[block] != manifest->hashes[block];
+        if ((*differs)[block])
+        {
+            num_differ++;
+        }
+    }
+    printf ("Hashed %lu blocks using %s in %.3f s (%.1f MB/s), %lu differ\n",
+            (unsigned long) manifest->header.num_blocks, blockhash_implementation (), (double) elapsed_ns / 1E9,
+            (double) manifest->header.image_size * 1E3 / (double) elapsed_ns, (unsigned long) num_differ);
+    free (hashes);
+
+    return num_differ;
+}
+
+/**
+ * @brief Display the ranges of the device memory which differ from an image
+ */
+static void diff_image (nvram_uio_context *const context, const char *const manifest_pathname)
+{
+    blockhash_manifest manifest;
+    bool *differs;
+    uint64_t block;
+    uint64_t run_start;
+
+    (void) compare_with_image (context, manifest_pathname, &manifest, &differs);
+    for (block = 0; block < manifest.header.num_blocks; block++)
+    {
+        if (differs[block])
+        {
+            run_start = block;
+            while (((block + 1) < manifest.header.num_blocks) && differs[block + 1])
+            {
+                block++;
+            }
+            printf ("  0x%09lx..0x%09lx differs\n", (unsigned long) (run_start * BLOCKHASH_BLOCK_SIZE),
+                    (unsigned long) (((block + 1) * BLOCKHASH_BLOCK_SIZE) - 1));
+        }
+    }
+    free (differs);
+    blockhash_manifest_free (&manifest);
+}
+
+/**
+ * @brief Restore the blocks of an image which differ from the device memory
+ * @details The blocks are read from the image file straight into the DMA buffer, and checked against the manifest
+ *          before being written to the device memory.
+ */
+static bool restore_image (nvram_uio_context *const context, const char *const image_pathname,
+                           const char *const manifest_pathname)
+{
+    const size_t chunk_blocks = context->dma_buffer_size / BLOCKHASH_BLOCK_SIZE;
+    blockhash_manifest manifest;
+    bool *differs;
+    uint64_t block;
+    uint64_t run_blocks;
+    uint64_t block_index;
+    uint64_t card_offset;
+    size_t num_bytes;
+    uint64_t blocks_written = 0;
+    bool success = true;
+    int image_fd;
+
+    (void) compare_with_image (context, manifest_pathname, &manifest, &differs);
+    image_fd = open (image_pathname, O_RDONLY);
+    if (image_fd < 0)
+    {
+        perror (image_pathname);
+        exit (EXIT_FAILURE);
+    }
+
+    for (block = 0; success && (block < manifest.header.num_blocks); block += run_blocks)
+    {
+        /* Find the next run of blocks which differ, limited to the DMA buffer */
+        run_blocks = 1;
+        if (differs[block])
+        {
+            while (((block + run_blocks) < manifest.header.num_blocks) && differs[block + run_blocks] &&
+                   (run_blocks < chunk_blocks))
+            {
+                run_blocks++;
+            }
+            card_offset = block * BLOCKHASH_BLOCK_SIZE;
+            num_bytes = (size_t) (run_blocks * BLOCKHASH_BLOCK_SIZE);
+            if ((card_offset + num_bytes) > manifest.header.image_size)
+            {
+                num_bytes = (size_t) (manifest.header.image_size - card_offset);
+            }
+
+            success = pread (image_fd, context->dma_buffer, num_bytes, (off_t) card_offset) == (ssize_t) num_bytes;
+            for (block_index = 0; success && (block_index < run_blocks); block_index++)
+            {
+                success = blockhash (&context->dma_buffer[block_index * BLOCKHASH_BLOCK_SIZE],
+                                     ((num_bytes - (block_index * BLOCKHASH_BLOCK_SIZE)) < BLOCKHASH_BLOCK_SIZE) ?
+                                     (num_bytes - (block_index * BLOCKHASH_BLOCK_SIZE)) : BLOCKHASH_BLOCK_SIZE) ==
+                        manifest.hashes[block + block_index];
+                if (!success)
+                {
+                    printf ("Image block %lu doesn't match the manifest\n", (unsigned long) (block + block_index));
+                }
+            }
+            success = success && dma_transfer (context, DMA_READ_FROM_HOST, card_offset, 0, num_bytes);
+            if (success)
+            {
+                blocks_written += run_blocks;
+            }
+        }
+    }
+    close (image_fd);
+
+    printf ("Restore %s: wrote %lu of %lu blocks\n", success ? "complete" : "FAILED", (unsigned long) blocks_written,
+            (unsigned long) manifest.header.num_blocks);
+    free (differs);
+    blockhash_manifest_free (&manifest);
+
+    return success;
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    char manifest_pathname[PATH_MAX];
+    bool success = true;
+
+    if (argc != 3)
+    {
+        printf ("Usage: %s save|diff|restore <image>\n", argv[0]);
+        exit (EXIT_FAILURE);
+    }
+    snprintf (manifest_pathname, sizeof (manifest_pathname), "%s.manifest", argv[2]);
+
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+    if ((context.memory_size_bytes == 0) || (context.dma_buffer_size < BLOCKHASH_BLOCK_SIZE))
+    {
+        printf ("Unknown device memory size, or DMA buffer smaller than a block\n");
+        exit (EXIT_FAILURE);
+    }
+
+    if (strcmp (argv[1], "save") == 0)
+    {
+        success = save_image (&context, argv[2], manifest_pathname);
+    }
+    else if (strcmp (argv[1], "diff") == 0)
+    {
+        diff_image (&context, manifest_pathname);
+    }
+    else if (strcmp (argv[1], "restore") == 0)
+    {
+        success = restore_image (&context, argv[2], manifest_pathname);
+    }
+    else
+    {
+        printf ("Unknown command %s\n", argv[1]);
+        success = false;
+    }
+
+    close_uio_device (&context);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,306 @@
+/*
+ * @file nvram_journal_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the commit throughput of the sharded journal as the number of committing threads increases
+ * @details
+ *   The journal region is formatted, then for each thread count the threads commit records as fast as possible,
+ *   each pinned to its own CPU, and the journal is reset between runs. After the last run the journal is reopened
+ *   to check that the records of that run are replayed in sequence order. Usage:
+ *     nvram_journal_bench -r <offset>:<size> [-s <num_shards>] [-n] [-l <record_length>] [-c <records_per_thread>]
+ *                         [-t <max_threads>] [-i <index_interval>]
+ *   -n maps the shards per NUMA node rather than per CPU. The default number of shards is the number of CPUs.
+ *   -i also rebuilds a sparse seek index with one entry per <index_interval> records, and times random lookups.
+ *   The journal region is overwritten.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_journal.h"
+#include "nvram_uio_seekidx.h"
+
+/* The number of random lookups timed using the seek index */
+#define NUM_INDEX_LOOKUPS 10000
+
+/** One committing thread */
+typedef struct
+{
+    journal *jnl;
+    int cpu;
+    unsigned int record_length;
+    unsigned int num_records;
+    pthread_t thread;
+    unsigned int num_committed;
+} commit_thread;
+
+/** Checks the order of the replayed records */
+typedef struct
+{
+    uint64_t previous_sequence;
+    uint64_t num_records;
+    bool in_order;
+} replay_check;
+
+/**
+ * @brief Thread which commits records to the journal from one CPU
+ */
+static void *commit_thread_entry (void *arg)
+{
+    commit_thread *const thread = arg;
+    uint8_t *const record = calloc (1, thread->record_length);
+    cpu_set_t cpus;
+    uint64_t sequence;
+
+    CPU_ZERO (&cpus);
+    CPU_SET (thread->cpu, &cpus);
+    (void) sched_setaffinity (0, sizeof (cpus), &cpus);
+
+    while ((record != NULL) && (thread->num_committed < thread->num_records))
+    {
+        memcpy (record, &thread->num_committed, sizeof (thread->num_committed));
+        if (!journal_write (thread->jnl, record, thread->record_length, &sequence))
+        {
+            break;
+        }
+        thread->num_committed++;
+    }
+    free (record);
+
+    return NULL;
+}
+
+/**
+ * @brief Rebuild a seek index for the journal, and time random lookups of the records
+ * @param[in,out] context The open NVRAM UIO device, with the journal closed
+ * @param[in] region_offset The offset of the journal region
+ * @param[in] interval The number of records per index entry
+ * @param[in] num_records The number of records in the journal
+ * @param[in] record_length The length of each record
+ */
+static void time_index_lookups (nvram_uio_context *const context, const uint64_t region_offset,
+                                const unsigned int interval, const uint64_t num_records,
+                                const unsigned int record_length)
+{
+    uint8_t *const record = malloc (record_length);
+    seek_index index;
+    unsigned int lookup;
+    unsigned int num_found = 0;
+    size_t length;
+    uint64_t start_ns;
+    uint64_t rebuild_ns;
+    uint64_t lookup_ns;
+
+    if ((record == NULL) || (num_records == 0) || !seek_index_init (&index, context, region_offset, interval))
+    {
+        printf ("Failed to initialise the seek index\n");
+        exit (EXIT_FAILURE);
+    }
+
+    start_ns = get_monotonic_time_ns ();
+    if (!seek_index_rebuild (&index, context, 0, 0))
+    {
+        printf ("Failed to rebuild the seek index\n");
+        exit (EXIT_FAILURE);
+    }
+    rebuild_ns = get_monotonic_time_ns () - start_ns;
+
+    start_ns = get_monotonic_time_ns ();
+    for (lookup = 0; lookup < NUM_INDEX_LOOKUPS; lookup++)
+    {
+        if (seek_index_lookup (&index, context, 1 + ((uint64_t) rand () % num_records), record, record_length, &length))
+        {
+            num_found++;
+        }
+    }
+    lookup_ns = get_monotonic_time_ns () - start_ns;
+
+    printf ("Seek index rebuilt in %.3f ms, %u of %u random lookups found, mean lookup %.1f us\n",
+            (double) rebuild_ns / 1E6, num_found, NUM_INDEX_LOOKUPS, (double) lookup_ns / (1E3 * NUM_INDEX_LOOKUPS));
+    seek_index_free (&index);
+    free (record);
+}
+
+/**
+ * @brief Replay callback which checks the records are replayed in increasing sequence order
+ */
+static void check_replay (const uint64_t sequence, const void *const data, const size_t length, void *const arg)
+{
+    replay_check *const check = arg;
+
+    if (sequence <= check->previous_sequence)
+    {
+        check->in_order = false;
+    }
+    check->previous_sequence = sequence;
+    check->num_records++;
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    journal jnl;
+    commit_thread *threads;
+    replay_check check;
+    journal_shard_mode shard_mode = JOURNAL_SHARD_PER_CPU;
+    const long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    unsigned long long region_offset = 0;
+    unsigned long long region_size = 0;
+    unsigned int num_shards = (unsigned int) num_cpus;
+    unsigned int record_length = 64;
+    unsigned int records_per_thread = 10000;
+    unsigned int max_threads = (unsigned int) num_cpus;
+    unsigned int index_interval = 0;
+    unsigned int num_threads;
+    unsigned int thread_index;
+    uint64_t total_committed = 0;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "r:s:nl:c:t:i:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            if (sscanf (optarg, "%lli:%lli", &region_offset, &region_size) != 2)
+            {
+                printf ("Invalid region %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 's':
+            num_shards = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'n':
+            shard_mode = JOURNAL_SHARD_PER_NODE;
+            break;
+
+        case 'l':
+            record_length = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'c':
+            records_per_thread = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 't':
+            max_threads = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'i':
+            index_interval = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -r <offset>:<size> [-s <num_shards>] [-n] [-l <record_length>]\n"
+                    "         [-c <records_per_thread>] [-t <max_threads>] [-i <index_interval>]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if ((region_size == 0) || (max_threads == 0) || (record_length < sizeof (unsigned int)))
+    {
+        printf ("The journal region, and a non-zero number of threads and record length must be specified\n");
+        exit (EXIT_FAILURE);
+    }
+    if (num_shards > JOURNAL_MAX_SHARDS)
+    {
+        num_shards = JOURNAL_MAX_SHARDS;
+    }
+
+    threads = calloc (max_threads, sizeof (threads[0]));
+    if (threads == NULL)
+    {
+        printf ("Failed to allocate threads\n");
+        exit (EXIT_FAILURE);
+    }
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+    if (!journal_format (&context, region_offset, region_size, num_shards) ||
+        !journal_open (&jnl, &context, region_offset, shard_mode, NULL, NULL))
+    {
+        printf ("Failed to create a journal with %u shards in the region\n", num_shards);
+        exit (EXIT_FAILURE);
+    }
+
+    printf ("%7s %12s %14s %12s\n", "Threads", "Committed", "Commits/sec", "MB/sec");
+    for (num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+        for (thread_index = 0; thread_index < num_threads; thread_index++)
+        {
+            threads[thread_index].jnl = &jnl;
+            threads[thread_index].cpu = (int) (thread_index % (unsigned int) num_cpus);
+            threads[thread_index].record_length = record_length;
+            threads[thread_index].num_records = records_per_thread;
+            threads[thread_index].num_committed = 0;
+        }
+
+        start_ns = get_monotonic_time_ns ();
+        for (thread_index = 0; thread_index < num_threads; thread_index++)
+        {
+            if (pthread_create (&threads[thread_index].thread, NULL, commit_thread_entry, &threads[thread_index]) != 0)
+            {
+                printf ("Failed to create commit thread\n");
+                exit (EXIT_FAILURE);
+            }
+        }
+        total_committed = 0;
+        for (thread_index = 0; thread_index < num_threads; thread_index++)
+        {
+            pthread_join (threads[thread_index].thread, NULL);
+            total_committed += threads[thread_index].num_committed;
+        }
+        elapsed_ns = get_monotonic_time_ns () - start_ns;
+
+        printf ("%7u %12lu %14.0f %12.1f\n", num_threads, (unsigned long) total_committed,
+                (double) total_committed * 1E9 / (double) elapsed_ns,
+                (double) (total_committed * record_length) * 1E3 / (double) elapsed_ns);
+
+        if ((num_threads * 2) <= max_threads)
+        {
+            if (!journal_reset (&jnl))
+            {
+                printf ("Failed to reset the journal\n");
+                exit (EXIT_FAILURE);
+            }
+        }
+    }
+    journal_close (&jnl);
+
+    /* Check recovery of the records committed by the last run */
+    memset (&check, 0, sizeof (check));
+    check.in_order = true;
+    start_ns = get_monotonic_time_ns ();
+    if (!journal_open (&jnl, &context, region_offset, shard_mode, check_replay, &check))
+    {
+        printf ("Failed to reopen the journal\n");
+        exit (EXIT_FAILURE);
+    }
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+    journal_close (&jnl);
+    printf ("Recovery replayed %lu of %lu records %s in %.3f ms\n", (unsigned long) check.num_records,
+            (unsigned long) total_committed, check.in_order ? "in order" : "OUT OF ORDER", (double) elapsed_ns / 1E6);
+    if (index_interval > 0)
+    {
+        time_index_lookups (&context, region_offset, index_interval, check.num_records, record_length);
+    }
+
+    close_uio_device (&context);
+    free (threads);
+
+    return ((check.num_records == total_committed) && check.in_order) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
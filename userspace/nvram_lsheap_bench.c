@@ -0,0 +1,250 @@
+/*
+ * @file nvram_lsheap_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the foreground latency of a log-structured heap while the background compactor runs
+ * @details
+ *   The heap region is formatted and every key written once, then random keys are overwritten and read for the
+ *   duration with the compactor running. Each second the foreground 99th percentile latency, the utilisation and
+ *   the progress of the compactor are reported. Finally the heap is reopened to check the last record written for
+ *   every key is recovered. Usage:
+ *     nvram_lsheap_bench -r <offset>:<size> [-s <segment_size>] [-k <num_keys>] [-l <record_length>]
+ *                        [-d <duration_secs>] [-b <p99_bound_us>] [-u <utilisation_percent>] [-c <chunk_bytes>]
+ *   The default number of keys fills half of the region. The heap region is overwritten.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_lsheap.h"
+
+/** The start of each record written, which identifies the write */
+typedef struct
+{
+    uint64_t key;
+    uint64_t write_count;
+} record_id;
+
+/**
+ * @brief Write the record for a key, identified by the number of times the key has been written
+ */
+static bool put_record (lsheap *const heap, uint8_t *const record, const unsigned int record_length,
+                        const uint64_t key, const uint64_t write_count)
+{
+    record_id id;
+
+    id.key = key;
+    id.write_count = write_count;
+    memcpy (record, &id, sizeof (id));
+
+    return lsheap_put (heap, key, record, record_length);
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    lsheap heap;
+    lsheap_compaction_config config;
+    lsheap_compaction_statistics statistics;
+    uint64_t *write_counts;
+    uint8_t *record;
+    record_id id;
+    uint64_t previous_histogram[NVRAM_UIO_LATENCY_BUCKETS];
+    uint64_t delta[NVRAM_UIO_LATENCY_BUCKETS];
+    unsigned long long region_offset = 0;
+    unsigned long long region_size = 0;
+    unsigned long long segment_size = 1024 * 1024;
+    unsigned long long num_keys = 0;
+    unsigned int record_length = 256;
+    unsigned int duration_secs = 10;
+    unsigned int p99_bound_us = 100;
+    unsigned int utilisation_percent = 80;
+    unsigned long chunk_bytes = 64 * 1024;
+    unsigned int second;
+    unsigned int bucket;
+    uint64_t key;
+    uint64_t second_end_ns;
+    uint64_t num_ops;
+    uint64_t num_stalls = 0;
+    uint64_t live_bytes;
+    uint64_t used_bytes;
+    uint64_t num_verified = 0;
+    uint32_t num_free_segments;
+    size_t length;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "r:s:k:l:d:b:u:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            if (sscanf (optarg, "%lli:%lli", &region_offset, &region_size) != 2)
+            {
+                printf ("Invalid region %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 's':
+            segment_size = strtoull (optarg, NULL, 0);
+            break;
+
+        case 'k':
+            num_keys = strtoull (optarg, NULL, 0);
+            break;
+
+        case 'l':
+            record_length = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'd':
+            duration_secs = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'b':
+            p99_bound_us = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'u':
+            utilisation_percent = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'c':
+            chunk_bytes = strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -r <offset>:<size> [-s <segment_size>] [-k <num_keys>] [-l <record_length>]\n"
+                    "         [-d <duration_secs>] [-b <p99_bound_us>] [-u <utilisation_percent>] [-c <chunk_bytes>]\n",
+                    argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if ((region_size == 0) || (record_length < sizeof (record_id)))
+    {
+        printf ("The heap region, and a record length of at least %zu bytes must be specified\n", sizeof (record_id));
+        exit (EXIT_FAILURE);
+    }
+    if (num_keys == 0)
+    {
+        num_keys = (region_size / 2) / ((sizeof (lsheap_record_header) + record_length + LSHEAP_ALIGN - 1) &
+                                        ~(unsigned long long) (LSHEAP_ALIGN - 1));
+    }
+
+    write_counts = calloc (num_keys, sizeof (write_counts[0]));
+    record = calloc (1, record_length);
+    if ((write_counts == NULL) || (record == NULL))
+    {
+        printf ("Failed to allocate %llu keys\n", num_keys);
+        exit (EXIT_FAILURE);
+    }
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+    if (!lsheap_format (&context, region_offset, region_size, segment_size, num_keys) ||
+        !lsheap_open (&heap, &context, region_offset))
+    {
+        printf ("Failed to create a heap with %llu byte segments in the region\n", segment_size);
+        exit (EXIT_FAILURE);
+    }
+
+    for (key = 0; key < num_keys; key++)
+    {
+        if (!put_record (&heap, record, record_length, key, ++write_counts[key]))
+        {
+            printf ("Failed to write key %lu when filling the heap\n", (unsigned long) key);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    config.utilisation_percent = utilisation_percent;
+    config.p99_bound_ns = p99_bound_us * 1000ULL;
+    config.chunk_bytes = chunk_bytes;
+    config.interval_ns = 100000000ULL;
+    if (!lsheap_start_compactor (&heap, &config))
+    {
+        printf ("Failed to start the compactor\n");
+        exit (EXIT_FAILURE);
+    }
+
+    printf ("%6s %10s %10s %9s %9s %6s %9s %9s %7s %9s\n", "Second", "Ops/sec", "p99 (us)", "Live MB", "Used MB",
+            "Free", "Compacted", "Copied MB", "Paused", "Delay(us)");
+    memcpy (previous_histogram, heap.latency_histogram, sizeof (previous_histogram));
+    for (second = 1; second <= duration_secs; second++)
+    {
+        num_ops = 0;
+        second_end_ns = get_monotonic_time_ns () + 1000000000ULL;
+        while (get_monotonic_time_ns () < second_end_ns)
+        {
+            key = (uint64_t) rand () % num_keys;
+            if ((num_ops % 2) == 0)
+            {
+                if (put_record (&heap, record, record_length, key, write_counts[key] + 1))
+                {
+                    write_counts[key]++;
+                }
+                else
+                {
+                    num_stalls++;
+                }
+            }
+            else
+            {
+                (void) lsheap_get (&heap, key, record, record_length, &length);
+            }
+            num_ops++;
+        }
+
+        for (bucket = 0; bucket < NVRAM_UIO_LATENCY_BUCKETS; bucket++)
+        {
+            const uint64_t count = __atomic_load_n (&heap.latency_histogram[bucket], __ATOMIC_RELAXED);
+
+            delta[bucket] = count - previous_histogram[bucket];
+            previous_histogram[bucket] = count;
+        }
+        lsheap_get_utilisation (&heap, &live_bytes, &used_bytes, &num_free_segments);
+        lsheap_get_compaction_statistics (&heap, &statistics);
+        printf ("%6u %10lu %10.1f %9.1f %9.1f %6u %9lu %9.1f %7lu %9.1f\n", second, (unsigned long) num_ops,
+                (double) latency_histogram_percentile_ns (delta, 99.0) / 1E3, (double) live_bytes / 1E6,
+                (double) used_bytes / 1E6, num_free_segments, (unsigned long) statistics.segments_compacted,
+                (double) statistics.bytes_copied / 1E6, (unsigned long) statistics.intervals_paused,
+                (double) statistics.delay_ns / 1E3);
+    }
+    lsheap_get_compaction_statistics (&heap, &statistics);
+    printf ("%lu writes failed with the heap full, %lu copied records superseded before being remapped\n",
+            (unsigned long) num_stalls, (unsigned long) statistics.records_superseded);
+    lsheap_close (&heap);
+
+    /* Check the last record written for every key is recovered */
+    if (!lsheap_open (&heap, &context, region_offset))
+    {
+        printf ("Failed to reopen the heap\n");
+        exit (EXIT_FAILURE);
+    }
+    for (key = 0; key < num_keys; key++)
+    {
+        if (lsheap_get (&heap, key, record, record_length, &length) && (length == record_length))
+        {
+            memcpy (&id, record, sizeof (id));
+            if ((id.key == key) && (id.write_count == write_counts[key]))
+            {
+                num_verified++;
+            }
+        }
+    }
+    lsheap_close (&heap);
+    printf ("Recovered the last record of %lu of %llu keys\n", (unsigned long) num_verified, num_keys);
+
+    close_uio_device (&context);
+    free (record);
+    free (write_counts);
+
+    return (num_verified == num_keys) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,286 @@
+/*
+ * @file nvram_numa_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Benchmark a NVRAM UIO device from each NUMA node
+ * @details
+ *   For each NUMA node the submitting thread is pinned to the CPUs of the node, and the device is opened so that
+ *   the driver allocates the per-file DMA buffer on that node. The standard read/write sweeps are then run, and a
+ *   node-by-metric matrix is displayed. Usage:
+ *     nvram_numa_bench [-i <iterations>] [-o <card_offset>] [-v]
+ *   -v also displays the full sweep results for each node.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_bench.h"
+
+#define NODE_SYSFS_ROOT "/sys/devices/system/node"
+
+/** The results for one NUMA node */
+typedef struct
+{
+    int node;
+    cpu_set_t cpus;
+    unsigned int num_cpus;
+    /** The node which the driver allocated the DMA buffer on */
+    unsigned int dma_buffer_node;
+    bench_sweep_results results;
+} numa_node_results;
+
+/**
+ * @brief Read the CPUs of one NUMA node from sysfs
+ * @param[in] node The NUMA node
+ * @param[out] cpus The CPUs of the node
+ * @return The number of CPUs in the node
+ */
+static unsigned int read_node_cpus (const int node, cpu_set_t *const cpus)
+{
+    char pathname[PATH_MAX];
+    char cpulist[4096];
+    FILE *cpulist_file;
+    char *range;
+    char *saveptr;
+    unsigned int first_cpu;
+    unsigned int last_cpu;
+    unsigned int cpu;
+
+    CPU_ZERO (cpus);
+    snprintf (pathname, sizeof (pathname), "%s/node%d/cpulist", NODE_SYSFS_ROOT, node);
+    cpulist_file = fopen (pathname, "r");
+    if (cpulist_file == NULL)
+    {
+        return 0;
+    }
+    if (fgets (cpulist, sizeof (cpulist), cpulist_file) == NULL)
+    {
+        cpulist[0] = '\0';
+    }
+    fclose (cpulist_file);
+
+    for (range = strtok_r (cpulist, ",\n", &saveptr); range != NULL; range = strtok_r (NULL, ",\n", &saveptr))
+    {
+        switch (sscanf (range, "%u-%u", &first_cpu, &last_cpu))
+        {
+        case 1:
+            last_cpu = first_cpu;
+            /* Fall through */
+        case 2:
+            for (cpu = first_cpu; (cpu <= last_cpu) && (cpu < CPU_SETSIZE); cpu++)
+            {
+                CPU_SET (cpu, cpus);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return (unsigned int) CPU_COUNT (cpus);
+}
+
+/**
+ * @brief Find the NUMA nodes which have CPUs
+ * @param[out] nodes The NUMA nodes found, in ascending order
+ * @param[in] max_nodes The maximum number of nodes to return
+ * @return The number of nodes found
+ */
+static unsigned int find_numa_nodes (numa_node_results *const nodes, const unsigned int max_nodes)
+{
+    DIR *node_dir;
+    struct dirent *entry;
+    unsigned int num_nodes = 0;
+    int node;
+    int max_node = -1;
+
+    node_dir = opendir (NODE_SYSFS_ROOT);
+    if (node_dir != NULL)
+    {
+        while ((entry = readdir (node_dir)) != NULL)
+        {
+            if ((sscanf (entry->d_name, "node%d", &node) == 1) && (node > max_node))
+            {
+                max_node = node;
+            }
+        }
+        closedir (node_dir);
+    }
+
+    for (node = 0; (node <= max_node) && (num_nodes < max_nodes); node++)
+    {
+        nodes[num_nodes].node = node;
+        nodes[num_nodes].num_cpus = read_node_cpus (node, &nodes[num_nodes].cpus);
+        if (nodes[num_nodes].num_cpus > 0)
+        {
+            num_nodes++;
+        }
+    }
+
+    if (num_nodes == 0)
+    {
+        /* Kernel without NUMA support, so treat all CPUs as node 0 */
+        nodes[0].node = 0;
+        sched_getaffinity (0, sizeof (nodes[0].cpus), &nodes[0].cpus);
+        nodes[0].num_cpus = (unsigned int) CPU_COUNT (&nodes[0].cpus);
+        num_nodes = 1;
+    }
+
+    return num_nodes;
+}
+
+/**
+ * @brief Read the NUMA node the device is attached to
+ * @return The NUMA node, or -1 if not known
+ */
+static int read_device_numa_node (const char *const device_name)
+{
+    char pathname[PATH_MAX];
+    FILE *numa_node_file;
+    int node = -1;
+
+    if (snprintf (pathname, sizeof (pathname), "%s/%s/device/numa_node", UIO_CLASS_ROOT, device_name) >=
+        (int) sizeof (pathname))
+    {
+        return -1;
+    }
+    numa_node_file = fopen (pathname, "r");
+    if (numa_node_file != NULL)
+    {
+        if (fscanf (numa_node_file, "%d", &node) != 1)
+        {
+            node = -1;
+        }
+        fclose (numa_node_file);
+    }
+
+    return node;
+}
+
+/**
+ * @brief Return the sweep entry for a transfer size, or NULL if the size wasn't run
+ */
+static const bench_sweep_entry *find_sweep_size (const bench_sweep_results *const results, const size_t transfer_size)
+{
+    unsigned int size_index;
+
+    for (size_index = 0; size_index < results->num_sizes; size_index++)
+    {
+        if (results->sizes[size_index].transfer_size == transfer_size)
+        {
+            return &results->sizes[size_index];
+        }
+    }
+
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    numa_node_results nodes[64];
+    unsigned int num_nodes;
+    unsigned int node_index;
+    unsigned int iterations = 1000;
+    uint64_t card_offset = 0;
+    bool verbose = false;
+    nvram_uio_context context;
+    numa_node_results *node;
+    const bench_sweep_entry *small;
+    const bench_sweep_entry *large;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "i:o:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            iterations = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'o':
+            card_offset = strtoull (optarg, NULL, 0);
+            break;
+
+        case 'v':
+            verbose = true;
+            break;
+
+        default:
+            printf ("Usage: %s [-i <iterations>] [-o <card_offset>] [-v]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (iterations == 0)
+    {
+        iterations = 1;
+    }
+
+    num_nodes = find_numa_nodes (nodes, sizeof (nodes) / sizeof (nodes[0]));
+    for (node_index = 0; node_index < num_nodes; node_index++)
+    {
+        node = &nodes[node_index];
+
+        /* Pin before the open, so the driver allocates the DMA buffer on this node */
+        if (sched_setaffinity (0, sizeof (node->cpus), &node->cpus) != 0)
+        {
+            printf ("Failed to set affinity to node %d\n", node->node);
+            exit (EXIT_FAILURE);
+        }
+
+        find_uio_device (&context);
+        get_uio_device_parameters (&context);
+        open_uio_device (&context);
+        map_dma_buffer (&context);
+        node->dma_buffer_node = context.dma_info->numa_node;
+        if (node_index == 0)
+        {
+            printf ("Device %s on NUMA node %d\n", context.device_name, read_device_numa_node (context.device_name));
+        }
+
+        bench_run_sweeps (&context, card_offset, iterations, &node->results);
+        if (verbose)
+        {
+            printf ("\nNode %d (%u CPUs, DMA buffer on node %u):\n", node->node, node->num_cpus, node->dma_buffer_node);
+            bench_print_sweeps (stdout, &node->results);
+        }
+        close_uio_device (&context);
+    }
+
+    printf ("\n%4s %5s %8s %10s %12s %12s %12s %12s %12s %12s\n", "Node", "CPUs", "Buf node", "MMIO rd ns",
+            "4K rd p50us", "4K rd p99us", "4K wr p50us", "4K wr p99us", "Max rd MB/s", "Max wr MB/s");
+    for (node_index = 0; node_index < num_nodes; node_index++)
+    {
+        node = &nodes[node_index];
+        small = find_sweep_size (&node->results, BENCH_MIN_TRANSFER_SIZE);
+        large = (node->results.num_sizes > 0) ? &node->results.sizes[node->results.num_sizes - 1] : NULL;
+        printf ("%4d %5u %8u %10.0f", node->node, node->num_cpus, node->dma_buffer_node,
+                node->results.mmio_read_latency_ns);
+        if ((small != NULL) && (large != NULL))
+        {
+            printf (" %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+                    (double) small->p50_latency_ns[NVRAM_UIO_STATS_READ] / 1E3,
+                    (double) small->p99_latency_ns[NVRAM_UIO_STATS_READ] / 1E3,
+                    (double) small->p50_latency_ns[NVRAM_UIO_STATS_WRITE] / 1E3,
+                    (double) small->p99_latency_ns[NVRAM_UIO_STATS_WRITE] / 1E3,
+                    large->throughput_mbps[NVRAM_UIO_STATS_READ], large->throughput_mbps[NVRAM_UIO_STATS_WRITE]);
+        }
+        else
+        {
+            printf (" (no DMA sweep results)\n");
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
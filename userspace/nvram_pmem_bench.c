@@ -0,0 +1,136 @@
+/*
+ * @file nvram_pmem_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the cost of pmem_memcpy_persist() on a device region through the libpmem compatible API
+ * @details
+ *   For each copy size random data is copied to random cache line aligned offsets of the mapping with
+ *   pmem_memcpy_persist(), and the mean latency reported along with whether the flushes went through the window or
+ *   by DMA. Finally the mapping is unmapped and mapped again, which reads the region back from the device, to check
+ *   all the copies were made durable. Usage:
+ *     nvram_pmem_bench -p <path> [-n <copies_per_size>] [-m <max_copy_size>]
+ *   Where the path is given as for pmem_map_file(), for example nvram:0x100000:0x1000000. The mapping is overwritten.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_pmem.h"
+
+int main (int argc, char *argv[])
+{
+    const char *path = NULL;
+    nvram_pmem_statistics before;
+    nvram_pmem_statistics after;
+    uint8_t *pmem_addr;
+    uint8_t *expected;
+    size_t mapped_len;
+    int is_pmem;
+    unsigned long copies_per_size = 10000;
+    unsigned long long max_copy_size = 1024 * 1024;
+    unsigned long copy_index;
+    size_t copy_size;
+    size_t offset;
+    size_t index;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    bool success;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "p:n:m:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            path = optarg;
+            break;
+
+        case 'n':
+            copies_per_size = strtoul (optarg, NULL, 0);
+            break;
+
+        case 'm':
+            max_copy_size = strtoull (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -p <path> [-n <copies_per_size>] [-m <max_copy_size>]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (path == NULL)
+    {
+        printf ("The path to map must be specified\n");
+        exit (EXIT_FAILURE);
+    }
+
+    pmem_addr = pmem_map_file (path, 0, 0, 0, &mapped_len, &is_pmem);
+    if (pmem_addr == NULL)
+    {
+        printf ("pmem_map_file failed: %s\n", pmem_errormsg ());
+        exit (EXIT_FAILURE);
+    }
+    if (!is_pmem)
+    {
+        printf ("%s isn't a device region\n", path);
+        exit (EXIT_FAILURE);
+    }
+    if (max_copy_size > mapped_len)
+    {
+        max_copy_size = mapped_len;
+    }
+    expected = malloc (mapped_len);
+    if (expected == NULL)
+    {
+        printf ("Failed to allocate the host copy of %zu bytes\n", mapped_len);
+        exit (EXIT_FAILURE);
+    }
+    memcpy (expected, pmem_addr, mapped_len);
+
+    printf ("Mapped %zu bytes of %s\n", mapped_len, path);
+    printf ("%10s %12s %10s %13s %11s\n", "Copy size", "Latency(us)", "MB/s", "Window/DMA", "Drains");
+    for (copy_size = 8; copy_size <= max_copy_size; copy_size *= 4)
+    {
+        nvram_pmem_get_statistics (&before);
+        elapsed_ns = 0;
+        for (copy_index = 0; copy_index < copies_per_size; copy_index++)
+        {
+            offset = ((size_t) rand () % (mapped_len - copy_size + 1)) & ~(size_t) (PMEM_FLUSH_ALIGN - 1);
+            for (index = 0; index < copy_size; index++)
+            {
+                expected[offset + index] = (uint8_t) rand ();
+            }
+
+            start_ns = get_monotonic_time_ns ();
+            pmem_memcpy_persist (&pmem_addr[offset], &expected[offset], copy_size);
+            elapsed_ns += get_monotonic_time_ns () - start_ns;
+        }
+        nvram_pmem_get_statistics (&after);
+        printf ("%10zu %12.2f %10.1f %6lu/%-6lu %11lu\n", copy_size,
+                (double) elapsed_ns / 1E3 / (double) copies_per_size,
+                (double) copy_size * (double) copies_per_size * 1E3 / (double) elapsed_ns,
+                (unsigned long) (after.window_flushes - before.window_flushes),
+                (unsigned long) (after.dma_flushes - before.dma_flushes),
+                (unsigned long) (after.drains_waited - before.drains_waited));
+    }
+
+    /* Mapping again discards the host copy, and reads the region from the device */
+    pmem_unmap (pmem_addr, mapped_len);
+    pmem_addr = pmem_map_file (path, 0, 0, 0, &mapped_len, &is_pmem);
+    if (pmem_addr == NULL)
+    {
+        printf ("Failed to map %s again: %s\n", path, pmem_errormsg ());
+        exit (EXIT_FAILURE);
+    }
+    success = memcmp (pmem_addr, expected, mapped_len) == 0;
+    printf ("After mapping again the region %s the persisted copies\n", success ? "matches" : "DIFFERS from");
+    pmem_unmap (pmem_addr, mapped_len);
+    free (expected);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
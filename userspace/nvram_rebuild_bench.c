@@ -0,0 +1,250 @@
+/*
+ * @file nvram_rebuild_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the time to rebuild a host memory index of the objects in the NVRAM device memory
+ * @details
+ *   Two kinds of store can be indexed:
+ *   - With -j the records of a sharded journal are indexed by sequence number, reading each shard as a contiguous
+ *     range. The index is then checked by reading back the record headers of a sample of the keys.
+ *   - With -S the objects of a store with a fixed stride are indexed by the first 8 bytes of the header of each
+ *     object, reading only the headers. Objects with a zero key are treated as free.
+ *   Usage:
+ *     nvram_rebuild_bench -j <offset> | -S <offset>:<size>:<stride>:<header_size>
+ *                         [-t <num_inserters>] [-b <table_bits>] [-e <expected_count>]
+ *   The device memory is only read.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_journal.h"
+#include "nvram_uio_rebuild.h"
+
+/* The number of keys whose record headers are read back to check the index */
+#define NUM_CHECKED_KEYS 1000
+
+/**
+ * @brief Parse function for the records of a journal shard, emitting the sequence number and offset of each record
+ * @details Stops at the first record which isn't valid for the epoch of the journal, which is the tail of the shard.
+ */
+static size_t parse_journal_records (void *const arg, const uint64_t card_offset, const uint8_t *const data,
+                                     const size_t num_bytes, rebuild_emitter *const emitter)
+{
+    const journal_superblock *const superblock = arg;
+    journal_record_header header;
+    size_t record_bytes;
+    size_t offset = 0;
+
+    while ((offset + sizeof (header)) <= num_bytes)
+    {
+        memcpy (&header, &data[offset], sizeof (header));
+        if ((header.epoch != superblock->epoch) || (header.length > superblock->shard_size))
+        {
+            break;
+        }
+        record_bytes = journal_align (sizeof (header) + header.length);
+        if ((offset + record_bytes) > num_bytes)
+        {
+            /* The record continues into the next chunk */
+            break;
+        }
+        if (header.check != journal_record_check (&header, &data[offset + sizeof (header)]))
+        {
+            break;
+        }
+        rebuild_emit (emitter, header.sequence, card_offset + offset);
+        offset += record_bytes;
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Parse function for fixed stride objects, emitting the first 8 bytes of the header as the key
+ */
+static size_t parse_strided_header (void *const arg, const uint64_t card_offset, const uint8_t *const data,
+                                    const size_t num_bytes, rebuild_emitter *const emitter)
+{
+    uint64_t key;
+
+    memcpy (&key, data, sizeof (key));
+    if (key != 0)
+    {
+        rebuild_emit (emitter, key, card_offset);
+    }
+
+    return num_bytes;
+}
+
+/**
+ * @brief Check a sample of the keys of a journal index, by reading back the record header at the offset indexed
+ */
+static void check_journal_index (nvram_uio_context *const context, const swiss_index *const index)
+{
+    journal_record_header header;
+    unsigned int table_num;
+    size_t slot;
+    size_t num_slots;
+    unsigned int num_checked = 0;
+    unsigned int num_matched = 0;
+
+    for (table_num = 0; (table_num < index->num_tables) && (num_checked < NUM_CHECKED_KEYS); table_num++)
+    {
+        num_slots = index->tables[table_num].num_groups * SWISS_GROUP_SIZE;
+        for (slot = 0; (slot < num_slots) && (num_checked < NUM_CHECKED_KEYS); slot += 1 + (num_slots / 64))
+        {
+            if (index->tables[table_num].ctrl[slot] != SWISS_CTRL_EMPTY)
+            {
+                num_checked++;
+                if (dma_read_to_host (context, index->tables[table_num].slots[slot].value, &header, sizeof (header)) &&
+                    (header.sequence == index->tables[table_num].slots[slot].key))
+                {
+                    num_matched++;
+                }
+            }
+        }
+    }
+    printf ("%u of %u sampled keys matched the record header at the indexed offset\n", num_matched, num_checked);
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    journal_superblock superblock;
+    rebuild_range ranges[JOURNAL_MAX_SHARDS];
+    rebuild_statistics statistics;
+    swiss_index *index;
+    rebuild_parse_fn parse = NULL;
+    void *parse_arg = NULL;
+    unsigned long long journal_offset = 0;
+    unsigned long long store_offset = 0;
+    unsigned long long store_size = 0;
+    unsigned int store_stride = 0;
+    unsigned int header_size = 0;
+    unsigned int num_inserters = (unsigned int) sysconf (_SC_NPROCESSORS_ONLN);
+    unsigned int table_bits = 8;
+    unsigned long expected_count = 1000000;
+    unsigned int num_ranges = 0;
+    unsigned int shard_index;
+    bool is_journal = false;
+    bool success;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "j:S:t:b:e:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            journal_offset = strtoull (optarg, NULL, 0);
+            is_journal = true;
+            break;
+
+        case 'S':
+            if (sscanf (optarg, "%lli:%lli:%i:%i", &store_offset, &store_size, &store_stride, &header_size) != 4)
+            {
+                printf ("Invalid store %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 't':
+            num_inserters = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'b':
+            if (strtoul (optarg, NULL, 0) > SWISS_INDEX_MAX_TABLE_BITS)
+            {
+                printf ("The table bits must be no more than %u\n", SWISS_INDEX_MAX_TABLE_BITS);
+                exit (EXIT_FAILURE);
+            }
+            table_bits = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'e':
+            expected_count = strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -j <offset> | -S <offset>:<size>:<stride>:<header_size>\n"
+                    "         [-t <num_inserters>] [-b <table_bits>] [-e <expected_count>]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (is_journal == (store_size != 0))
+    {
+        printf ("One of a journal or a strided store must be specified\n");
+        exit (EXIT_FAILURE);
+    }
+    if ((store_size != 0) && ((store_stride == 0) || (header_size < sizeof (uint64_t)) || (header_size > store_stride)))
+    {
+        printf ("The stride must be non-zero, and the header at least 8 bytes and no larger than the stride\n");
+        exit (EXIT_FAILURE);
+    }
+
+    index = malloc (sizeof (*index));
+    if ((index == NULL) || !swiss_index_init (index, table_bits, expected_count))
+    {
+        printf ("Failed to allocate an index with %u table bits\n", table_bits);
+        exit (EXIT_FAILURE);
+    }
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+
+    if (is_journal)
+    {
+        if (!dma_read_to_host (&context, journal_offset, &superblock, sizeof (superblock)) ||
+            (superblock.magic != JOURNAL_MAGIC) || (superblock.num_shards == 0) ||
+            (superblock.num_shards > JOURNAL_MAX_SHARDS))
+        {
+            printf ("No journal found at offset 0x%llx\n", journal_offset);
+            exit (EXIT_FAILURE);
+        }
+        for (shard_index = 0; shard_index < superblock.num_shards; shard_index++)
+        {
+            ranges[shard_index].card_offset =
+                    journal_offset + sizeof (superblock) + (shard_index * superblock.shard_size);
+            ranges[shard_index].size = superblock.shard_size;
+            ranges[shard_index].stride = 0;
+            ranges[shard_index].header_size = 0;
+        }
+        num_ranges = superblock.num_shards;
+        parse = parse_journal_records;
+        parse_arg = &superblock;
+    }
+    else
+    {
+        ranges[0].card_offset = store_offset;
+        ranges[0].size = store_size;
+        ranges[0].stride = store_stride;
+        ranges[0].header_size = header_size;
+        num_ranges = 1;
+        parse = parse_strided_header;
+    }
+
+    success = rebuild_index (&context, ranges, num_ranges, parse, parse_arg, index, num_inserters, &statistics);
+    printf ("Rebuild %s: %lu keys emitted, %lu in the index using %u tables\n", success ? "complete" : "FAILED",
+            (unsigned long) statistics.num_emitted, (unsigned long) swiss_index_count (index), index->num_tables);
+    printf ("Read %lu bytes in %lu DMA chains in %.3f ms (%.1f MB/s), rebuild complete in %.3f ms (%.1f M keys/s)\n",
+            (unsigned long) statistics.bytes_read, (unsigned long) statistics.num_dma_chains,
+            (double) statistics.read_ns / 1E6, (double) statistics.bytes_read * 1E3 / (double) statistics.read_ns,
+            (double) statistics.total_ns / 1E6, (double) statistics.num_emitted * 1E3 / (double) statistics.total_ns);
+    if (success && is_journal)
+    {
+        check_journal_index (&context, index);
+    }
+
+    close_uio_device (&context);
+    swiss_index_free (index);
+    free (index);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
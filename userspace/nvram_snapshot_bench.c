@@ -0,0 +1,247 @@
+/*
+ * @file nvram_snapshot_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the cost of snapshots of a page-mapped region, and check the snapshots preserve their contents
+ * @details
+ *   The logical pages are written with random data, then for each snapshot a snapshot is created and random
+ *   partial and whole page writes are made to the live map. Host copies of the expected contents of the live map and
+ *   of each snapshot are compared against reads through their maps, both before and after the region is reopened.
+ *   Finally the snapshots are deleted, which should free every page not mapped by the live map. Usage:
+ *     nvram_snapshot_bench -r <offset>:<size> [-l <logical_size>] [-n <num_snapshots>] [-w <writes_per_snapshot>]
+ *   The default logical size is half of the region. The region is overwritten.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_snapshot.h"
+
+/* The maximum length of each random write, which may span pages */
+#define MAX_WRITE_LENGTH (3 * SNAP_PAGE_SIZE)
+
+/**
+ * @brief Fill a buffer with random bytes
+ */
+static void fill_random (uint8_t *const buffer, const size_t num_bytes)
+{
+    size_t index;
+
+    for (index = 0; index < num_bytes; index++)
+    {
+        buffer[index] = (uint8_t) rand ();
+    }
+}
+
+/**
+ * @brief Compare the live map or a snapshot against its expected contents
+ * @return Returns true if the contents match
+ */
+static bool verify_contents (snap_region *const region, const uint32_t snapshot_id, const uint8_t *const expected,
+                             uint8_t *const actual, const uint64_t logical_size)
+{
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    bool success;
+
+    start_ns = get_monotonic_time_ns ();
+    success = snap_read (region, snapshot_id, 0, actual, logical_size);
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+    success = success && (memcmp (expected, actual, logical_size) == 0);
+    if (snapshot_id == SNAP_LIVE)
+    {
+        printf ("  live map %s, read at %.1f MB/s\n", success ? "matches" : "DIFFERS",
+                (double) logical_size * 1E3 / (double) elapsed_ns);
+    }
+    else
+    {
+        printf ("  snapshot %u %s, read at %.1f MB/s\n", snapshot_id, success ? "matches" : "DIFFERS",
+                (double) logical_size * 1E3 / (double) elapsed_ns);
+    }
+
+    return success;
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    snap_region region;
+    snap_snapshot_entry entries[SNAP_MAX_SNAPSHOTS];
+    uint8_t **expected;
+    uint8_t *actual;
+    uint32_t *snapshot_ids;
+    unsigned long long region_offset = 0;
+    unsigned long long region_size = 0;
+    unsigned long long logical_size = 0;
+    unsigned int num_snapshots = 4;
+    unsigned int writes_per_snapshot = 1000;
+    unsigned int snapshot;
+    unsigned int write_index;
+    unsigned int num_listed;
+    uint64_t write_offset;
+    size_t write_length;
+    uint32_t num_free_pages;
+    uint32_t num_physical_pages;
+    uint32_t free_after_fill;
+    uint64_t start_ns;
+    uint64_t create_ns;
+    uint64_t writes_ns;
+    bool success = true;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "r:l:n:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            if (sscanf (optarg, "%lli:%lli", &region_offset, &region_size) != 2)
+            {
+                printf ("Invalid region %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 'l':
+            logical_size = strtoull (optarg, NULL, 0);
+            break;
+
+        case 'n':
+            num_snapshots = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'w':
+            writes_per_snapshot = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -r <offset>:<size> [-l <logical_size>] [-n <num_snapshots>] [-w <writes_per_snapshot>]\n",
+                    argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (logical_size == 0)
+    {
+        logical_size = (region_size / 2) & ~(unsigned long long) (SNAP_PAGE_SIZE - 1);
+    }
+    if ((region_size == 0) || (num_snapshots > SNAP_MAX_SNAPSHOTS) || (logical_size < MAX_WRITE_LENGTH))
+    {
+        printf ("The region must be specified, with at most %u snapshots\n", SNAP_MAX_SNAPSHOTS);
+        exit (EXIT_FAILURE);
+    }
+
+    /* expected[0] is the live map, and expected[1+n] snapshot n */
+    expected = calloc (num_snapshots + 1, sizeof (expected[0]));
+    snapshot_ids = calloc (num_snapshots + 1, sizeof (snapshot_ids[0]));
+    actual = malloc (logical_size);
+    for (snapshot = 0; (expected != NULL) && (snapshot <= num_snapshots); snapshot++)
+    {
+        expected[snapshot] = malloc (logical_size);
+        success = success && (expected[snapshot] != NULL);
+    }
+    if ((expected == NULL) || (snapshot_ids == NULL) || (actual == NULL) || !success)
+    {
+        printf ("Failed to allocate host copies of the contents\n");
+        exit (EXIT_FAILURE);
+    }
+
+    find_uio_device (&context);
+    get_uio_device_parameters (&context);
+    open_uio_device (&context);
+    map_dma_buffer (&context);
+    if (!snap_format (&context, region_offset, region_size, logical_size) ||
+        !snap_open (&region, &context, region_offset))
+    {
+        printf ("Failed to create a snapshot region with a logical size of %llu bytes\n", logical_size);
+        exit (EXIT_FAILURE);
+    }
+
+    fill_random (expected[0], logical_size);
+    if (!snap_write (&region, 0, expected[0], logical_size))
+    {
+        printf ("Failed to fill the logical pages\n");
+        exit (EXIT_FAILURE);
+    }
+    snap_get_usage (&region, &free_after_fill, &num_physical_pages);
+    printf ("Filled %llu logical pages, %u of %u physical pages free\n", logical_size / SNAP_PAGE_SIZE,
+            free_after_fill, num_physical_pages);
+
+    printf ("%8s %11s %13s %10s\n", "Snapshot", "Create (us)", "Writes/sec", "Free pages");
+    for (snapshot = 1; success && (snapshot <= num_snapshots); snapshot++)
+    {
+        start_ns = get_monotonic_time_ns ();
+        success = snap_create (&region, &snapshot_ids[snapshot]);
+        create_ns = get_monotonic_time_ns () - start_ns;
+        memcpy (expected[snapshot], expected[0], logical_size);
+
+        start_ns = get_monotonic_time_ns ();
+        for (write_index = 0; success && (write_index < writes_per_snapshot); write_index++)
+        {
+            write_length = 1 + ((size_t) rand () % MAX_WRITE_LENGTH);
+            write_offset = (uint64_t) rand () % (logical_size - write_length + 1);
+            if ((write_index % 4) == 0)
+            {
+                /* Whole page writes, which don't need the previous contents */
+                write_offset &= ~(uint64_t) (SNAP_PAGE_SIZE - 1);
+                write_length = SNAP_PAGE_SIZE;
+            }
+            fill_random (&expected[0][write_offset], write_length);
+            success = snap_write (&region, write_offset, &expected[0][write_offset], write_length);
+        }
+        writes_ns = get_monotonic_time_ns () - start_ns;
+        snap_get_usage (&region, &num_free_pages, &num_physical_pages);
+        printf ("%8u %11.1f %13.0f %10u\n", snapshot_ids[snapshot], (double) create_ns / 1E3,
+                (double) writes_per_snapshot * 1E9 / (double) writes_ns, num_free_pages);
+    }
+    if (!success)
+    {
+        printf ("Snapshot or write failed, the region may be out of free pages\n");
+        exit (EXIT_FAILURE);
+    }
+
+    printf ("Before reopening:\n");
+    for (snapshot = 0; snapshot <= num_snapshots; snapshot++)
+    {
+        success = verify_contents (&region, snapshot_ids[snapshot], expected[snapshot], actual, logical_size) &&
+                success;
+    }
+    snap_close (&region);
+    if (!snap_open (&region, &context, region_offset))
+    {
+        printf ("Failed to reopen the region\n");
+        exit (EXIT_FAILURE);
+    }
+    num_listed = snap_list (&region, entries);
+    printf ("After reopening, %u snapshots listed:\n", num_listed);
+    for (snapshot = 0; snapshot <= num_snapshots; snapshot++)
+    {
+        success = verify_contents (&region, snapshot_ids[snapshot], expected[snapshot], actual, logical_size) &&
+                success;
+    }
+
+    for (snapshot = 1; snapshot <= num_snapshots; snapshot++)
+    {
+        success = snap_delete (&region, snapshot_ids[snapshot]) && success;
+    }
+    snap_get_usage (&region, &num_free_pages, &num_physical_pages);
+    printf ("After deleting the snapshots %u physical pages free, expected %u\n", num_free_pages, free_after_fill);
+    success = success && (num_free_pages == free_after_fill) && (num_listed == num_snapshots);
+    success = verify_contents (&region, SNAP_LIVE, expected[0], actual, logical_size) && success;
+    snap_close (&region);
+
+    close_uio_device (&context);
+    for (snapshot = 0; snapshot <= num_snapshots; snapshot++)
+    {
+        free (expected[snapshot]);
+    }
+    free (expected);
+    free (snapshot_ids);
+    free (actual);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
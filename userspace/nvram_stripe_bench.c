@@ -0,0 +1,219 @@
+/*
+ * @file nvram_stripe_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure striping with XOR parity over all the NVRAM devices in the host, in normal and degraded modes
+ * @details
+ *   The region is formatted as a set over every NVRAM device found, and all the data written with whole stripe
+ *   writes, followed by random partial stripe writes. The data is read back and compared against a host copy, then
+ *   after reopening the set. One member is then failed, and the reads and random writes repeated in degraded mode.
+ *   Usage:
+ *     nvram_stripe_bench -r <offset>:<size> [-c <chunk_size>] [-w <partial_writes>] [-f <failed_member>]
+ *   The region is at the same offset of each device, and is overwritten.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_stripe.h"
+
+/* The size of each write when filling the set, which covers many stripes */
+#define FILL_WRITE_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief Fill a buffer with random bytes
+ */
+static void fill_random (uint8_t *const buffer, const size_t num_bytes)
+{
+    size_t index;
+
+    for (index = 0; index < num_bytes; index++)
+    {
+        buffer[index] = (uint8_t) rand ();
+    }
+}
+
+/**
+ * @brief Read all the data of the set and compare it against the expected contents
+ * @return Returns true if the contents match
+ */
+static bool verify_set (stripe_set *const set, const uint8_t *const expected, uint8_t *const actual,
+                        const char *const description)
+{
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    bool success;
+
+    start_ns = get_monotonic_time_ns ();
+    success = stripe_read (set, 0, actual, set->data_size);
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+    success = success && (memcmp (expected, actual, set->data_size) == 0);
+    printf ("  %s: data %s, read at %.1f MB/s\n", description, success ? "matches" : "DIFFERS",
+            (double) set->data_size * 1E3 / (double) elapsed_ns);
+
+    return success;
+}
+
+/**
+ * @brief Make random writes of part of a stripe, which may cross into the next stripe
+ * @return Returns true if all the writes were performed
+ */
+static bool random_writes (stripe_set *const set, uint8_t *const expected, const unsigned int num_writes,
+                           const char *const description)
+{
+    unsigned int write_index;
+    uint64_t offset;
+    size_t length;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    bool success = true;
+
+    start_ns = get_monotonic_time_ns ();
+    for (write_index = 0; success && (write_index < num_writes); write_index++)
+    {
+        length = 1 + ((size_t) rand () % set->chunk_size);
+        offset = (uint64_t) rand () % (set->data_size - length + 1);
+        fill_random (&expected[offset], length);
+        success = stripe_write (set, offset, &expected[offset], length);
+    }
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+    printf ("  %s: %u partial writes at %.0f writes/sec\n", description, num_writes,
+            (double) num_writes * 1E9 / (double) elapsed_ns);
+
+    return success;
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context contexts[STRIPE_MAX_MEMBERS];
+    nvram_uio_context *context_pointers[STRIPE_MAX_MEMBERS];
+    stripe_set set;
+    uint8_t *expected;
+    uint8_t *actual;
+    unsigned long long region_offset = 0;
+    unsigned long long region_size = 0;
+    unsigned long chunk_size = 64 * 1024;
+    unsigned int partial_writes = 10000;
+    unsigned int failed_member = 0;
+    unsigned int num_devices;
+    unsigned int device_index;
+    uint64_t offset;
+    size_t length;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    bool success = true;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "r:c:w:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            if (sscanf (optarg, "%lli:%lli", &region_offset, &region_size) != 2)
+            {
+                printf ("Invalid region %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 'c':
+            chunk_size = strtoul (optarg, NULL, 0);
+            break;
+
+        case 'w':
+            partial_writes = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'f':
+            failed_member = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -r <offset>:<size> [-c <chunk_size>] [-w <partial_writes>] [-f <failed_member>]\n",
+                    argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (region_size == 0)
+    {
+        printf ("The region must be specified\n");
+        exit (EXIT_FAILURE);
+    }
+
+    num_devices = find_uio_devices (contexts, STRIPE_MAX_MEMBERS);
+    if (num_devices < STRIPE_MIN_MEMBERS)
+    {
+        printf ("Found %u NVRAM devices, at least %u are required\n", num_devices, STRIPE_MIN_MEMBERS);
+        exit (EXIT_FAILURE);
+    }
+    for (device_index = 0; device_index < num_devices; device_index++)
+    {
+        get_uio_device_parameters (&contexts[device_index]);
+        open_uio_device (&contexts[device_index]);
+        map_dma_buffer (&contexts[device_index]);
+        context_pointers[device_index] = &contexts[device_index];
+    }
+    if (!stripe_format (context_pointers, num_devices, region_offset, region_size, (uint32_t) chunk_size) ||
+        !stripe_open (&set, context_pointers, num_devices, region_offset))
+    {
+        printf ("Failed to create a set of %u members with a chunk size of %lu\n", num_devices, chunk_size);
+        exit (EXIT_FAILURE);
+    }
+    printf ("Set of %u members with %lu byte chunks: %.1f MB of data, parity using %s, %u stripes per batch\n",
+            set.num_members, chunk_size, (double) set.data_size / 1E6, stripe_parity_implementation (),
+            set.stripes_per_batch);
+
+    expected = malloc (set.data_size);
+    actual = malloc (set.data_size);
+    if ((expected == NULL) || (actual == NULL))
+    {
+        printf ("Failed to allocate host copies of the data\n");
+        exit (EXIT_FAILURE);
+    }
+    fill_random (expected, set.data_size);
+
+    start_ns = get_monotonic_time_ns ();
+    for (offset = 0; success && (offset < set.data_size); offset += length)
+    {
+        length = ((set.data_size - offset) < FILL_WRITE_SIZE) ? (size_t) (set.data_size - offset) : FILL_WRITE_SIZE;
+        success = stripe_write (&set, offset, &expected[offset], length);
+    }
+    elapsed_ns = get_monotonic_time_ns () - start_ns;
+    printf ("  Full stripe writes at %.1f MB/s\n", (double) set.data_size * 1E3 / (double) elapsed_ns);
+
+    success = success && random_writes (&set, expected, partial_writes, "Normal");
+    success = verify_set (&set, expected, actual, "Normal") && success;
+    stripe_close (&set);
+    if (!stripe_open (&set, context_pointers, num_devices, region_offset))
+    {
+        printf ("Failed to reopen the set\n");
+        exit (EXIT_FAILURE);
+    }
+    success = verify_set (&set, expected, actual, "Reopened") && success;
+
+    if (!stripe_fail_member (&set, failed_member))
+    {
+        printf ("Failed to fail member %u\n", failed_member);
+        exit (EXIT_FAILURE);
+    }
+    printf ("Member %u failed:\n", failed_member);
+    success = verify_set (&set, expected, actual, "Degraded") && success;
+    success = random_writes (&set, expected, partial_writes, "Degraded") && success;
+    success = verify_set (&set, expected, actual, "Degraded") && success;
+    stripe_close (&set);
+
+    for (device_index = 0; device_index < num_devices; device_index++)
+    {
+        close_uio_device (&contexts[device_index]);
+    }
+    free (expected);
+    free (actual);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,451 @@
+/*
+ * @file nvram_top.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Live top-style monitor of NVRAM UIO device activity
+ * @details
+ *   Only reads the shared memory statistics published by the clients of the device, so doesn't access the device
+ *   itself. The device status is refreshed by the clients while they are using the device, so is shown with the
+ *   time since it was sampled. The rates, error counts and latency percentiles are for the last refresh interval,
+ *   and the totals are the sums over the clients. Usage:
+ *     nvram_top [-d <uio_device_name>] [-i <refresh_interval_ms>]
+ *   Press 'q' to exit.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+
+/* The minimum interval at which the display may be refreshed */
+#define MIN_REFRESH_INTERVAL_MS 50
+
+/** The percentiles reported for operation latencies */
+static const double reported_percentiles[] = {50.0, 99.0, 99.9};
+#define NUM_REPORTED_PERCENTILES (sizeof (reported_percentiles) / sizeof (reported_percentiles[0]))
+
+/** The change in the statistics for one client over one refresh interval */
+typedef struct
+{
+    uint64_t ops[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    uint64_t bytes[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    uint64_t errors;
+    uint64_t latency_histogram[NVRAM_UIO_LATENCY_BUCKETS];
+} client_stats_delta;
+
+/** The terminal settings to restore on exit */
+static struct termios original_termios;
+static bool terminal_modified;
+
+/** Set by a signal handler to request the monitor exits */
+static volatile sig_atomic_t exit_requested;
+
+/**
+ * @brief Restore the terminal settings which were changed to read single key presses
+ */
+static void restore_terminal (void)
+{
+    if (terminal_modified)
+    {
+        tcsetattr (STDIN_FILENO, TCSANOW, &original_termios);
+        terminal_modified = false;
+    }
+}
+
+/**
+ * @brief Signal handler to request the monitor exits
+ */
+static void request_exit (int sig)
+{
+    (void) sig;
+    exit_requested = true;
+}
+
+/**
+ * @brief Set the terminal to return key presses without waiting for a newline or echoing them
+ */
+static void set_terminal_raw (void)
+{
+    struct termios raw_termios;
+
+    if (isatty (STDIN_FILENO) && (tcgetattr (STDIN_FILENO, &original_termios) == 0))
+    {
+        raw_termios = original_termios;
+        raw_termios.c_lflag &= ~(ICANON | ECHO);
+        raw_termios.c_cc[VMIN] = 0;
+        raw_termios.c_cc[VTIME] = 0;
+        if (tcsetattr (STDIN_FILENO, TCSANOW, &raw_termios) == 0)
+        {
+            terminal_modified = true;
+            atexit (restore_terminal);
+        }
+    }
+}
+
+/**
+ * @brief Wait for the refresh interval, returning early if the user requests an exit
+ * @details Once stdin reaches end-of-file, e.g. when not run from a terminal, just waits for the interval.
+ * @param[in] interval_ms The refresh interval
+ */
+static void wait_for_refresh (const int interval_ms)
+{
+    static bool stdin_eof;
+    struct pollfd stdin_poll = {.fd = STDIN_FILENO, .events = POLLIN};
+    char key;
+    ssize_t num_read;
+
+    if (!stdin_eof && (poll (&stdin_poll, 1, interval_ms) == 1))
+    {
+        num_read = read (STDIN_FILENO, &key, 1);
+        if (num_read == 1)
+        {
+            if ((key == 'q') || (key == 'Q'))
+            {
+                exit_requested = true;
+            }
+        }
+        else if (num_read == 0)
+        {
+            stdin_eof = true;
+        }
+    }
+    if (stdin_eof)
+    {
+        (void) poll (NULL, 0, interval_ms);
+    }
+}
+
+/**
+ * @brief Format a latency in a fixed width with units
+ */
+static void format_latency (char *const text, const size_t text_size, const uint64_t latency_ns)
+{
+    if (latency_ns == 0)
+    {
+        snprintf (text, text_size, "%8s", "-");
+    }
+    else if (latency_ns < 10000ULL)
+    {
+        snprintf (text, text_size, "%6luns", (unsigned long) latency_ns);
+    }
+    else if (latency_ns < 10000000ULL)
+    {
+        snprintf (text, text_size, "%6.1fus", (double) latency_ns / 1E3);
+    }
+    else
+    {
+        snprintf (text, text_size, "%6.1fms", (double) latency_ns / 1E6);
+    }
+}
+
+/**
+ * @brief Return the text for the memory size reported by the device
+ */
+static const char *memory_size_text (const uint8_t memctrlstatus_memory)
+{
+    switch (memctrlstatus_memory)
+    {
+    case MEM_128_MB: return "128 MB";
+    case MEM_256_MB: return "256 MB";
+    case MEM_512_MB: return "512 MB";
+    case MEM_1_GB:   return "1GB";
+    case MEM_2_GB:   return "2GB";
+    default:         return "unknown";
+    }
+}
+
+/**
+ * @brief Return the text for the ECC mode reported by the device
+ */
+static const char *ecc_mode_text (const uint8_t memctrlcmd_errctrl)
+{
+    switch (memctrlcmd_errctrl & 0x03)
+    {
+    case EDC_NONE_DEFAULT:  return "none (default)";
+    case EDC_NONE:          return "none";
+    case EDC_STORE_READ:    return "store/read";
+    case EDC_STORE_CORRECT: return "store/correct";
+    default:                return "unknown";
+    }
+}
+
+static const char *const completion_mode_names[NVRAM_UIO_COMPLETION_NUM_MODES] =
+{
+    [NVRAM_UIO_COMPLETION_NONE     ] = "-",
+    [NVRAM_UIO_COMPLETION_POLLED   ] = "polled",
+    [NVRAM_UIO_COMPLETION_INTERRUPT] = "interrupt"
+};
+
+/**
+ * @brief Calculate the change in the statistics of one client
+ * @param[in] current The current statistics of the client
+ * @param[in] previous The statistics of the client at the previous refresh, or NULL if the client is new
+ * @param[out] delta The change in statistics
+ */
+static void calculate_client_delta (const nvram_uio_client_stats *const current,
+                                    const nvram_uio_client_stats *const previous, client_stats_delta *const delta)
+{
+    unsigned int index;
+
+    for (index = 0; index < NVRAM_UIO_STATS_NUM_DIRECTIONS; index++)
+    {
+        delta->ops[index] = current->ops[index] - ((previous != NULL) ? previous->ops[index] : 0);
+        delta->bytes[index] = current->bytes[index] - ((previous != NULL) ? previous->bytes[index] : 0);
+    }
+    delta->errors = current->errors - ((previous != NULL) ? previous->errors : 0);
+    for (index = 0; index < NVRAM_UIO_LATENCY_BUCKETS; index++)
+    {
+        delta->latency_histogram[index] =
+                current->latency_histogram[index] - ((previous != NULL) ? previous->latency_histogram[index] : 0);
+    }
+}
+
+/**
+ * @brief Copy the statistics segment using relaxed atomic loads, since clients update it concurrently
+ */
+static void snapshot_segment (const nvram_uio_stats_segment *const segment, nvram_uio_stats_segment *const snapshot)
+{
+    unsigned int client_index;
+    unsigned int index;
+    const nvram_uio_client_stats *client;
+    nvram_uio_client_stats *copy;
+
+    memset (snapshot, 0, sizeof (*snapshot));
+    snapshot->status_sample_time_ns = __atomic_load_n (&segment->status_sample_time_ns, __ATOMIC_ACQUIRE);
+    snapshot->memctrlstatus_memory = __atomic_load_n (&segment->memctrlstatus_memory, __ATOMIC_RELAXED);
+    snapshot->memctrlstatus_battery = __atomic_load_n (&segment->memctrlstatus_battery, __ATOMIC_RELAXED);
+    snapshot->memctrlcmd_errctrl = __atomic_load_n (&segment->memctrlcmd_errctrl, __ATOMIC_RELAXED);
+    snapshot->memctrlcmd_errcnt = __atomic_load_n (&segment->memctrlcmd_errcnt, __ATOMIC_RELAXED);
+    for (client_index = 0; client_index < NVRAM_UIO_STATS_MAX_CLIENTS; client_index++)
+    {
+        client = &segment->clients[client_index];
+        copy = &snapshot->clients[client_index];
+        copy->pid = __atomic_load_n (&client->pid, __ATOMIC_ACQUIRE);
+        if (copy->pid != 0)
+        {
+            memcpy (copy->comm, client->comm, sizeof (copy->comm));
+            copy->comm[sizeof (copy->comm) - 1] = '\0';
+            for (index = 0; index < NVRAM_UIO_STATS_NUM_DIRECTIONS; index++)
+            {
+                copy->ops[index] = __atomic_load_n (&client->ops[index], __ATOMIC_RELAXED);
+                copy->bytes[index] = __atomic_load_n (&client->bytes[index], __ATOMIC_RELAXED);
+            }
+            copy->errors = __atomic_load_n (&client->errors, __ATOMIC_RELAXED);
+            copy->in_flight = __atomic_load_n (&client->in_flight, __ATOMIC_RELAXED);
+            copy->completion_mode = __atomic_load_n (&client->completion_mode, __ATOMIC_RELAXED);
+            for (index = 0; index < NVRAM_UIO_LATENCY_BUCKETS; index++)
+            {
+                copy->latency_histogram[index] = __atomic_load_n (&client->latency_histogram[index], __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Display the statistics for one refresh interval
+ * @param[in] device_name The device being monitored
+ * @param[in] current The current statistics
+ * @param[in] previous The statistics at the previous refresh
+ * @param[in] interval_secs The actual time between the previous and current statistics
+ */
+static void display_statistics (const char *const device_name,
+                                const nvram_uio_stats_segment *const current,
+                                const nvram_uio_stats_segment *const previous, const double interval_secs)
+{
+    client_stats_delta total;
+    client_stats_delta delta;
+    const nvram_uio_client_stats *client;
+    const nvram_uio_client_stats *previous_client;
+    unsigned int client_index;
+    unsigned int index;
+    unsigned int percentile_index;
+    uint32_t total_in_flight = 0;
+    unsigned int num_clients = 0;
+    char latency_text[NUM_REPORTED_PERCENTILES][32];
+    const uint8_t battery = current->memctrlstatus_battery;
+
+    memset (&total, 0, sizeof (total));
+    printf ("\033[H\033[2J");
+    printf ("nvram_top - %s (refresh %.2f s, 'q' to quit)\n\n", device_name, interval_secs);
+
+    if (current->status_sample_time_ns == 0)
+    {
+        printf ("Device status: not yet sampled by any client\n");
+    }
+    else
+    {
+        printf ("Memory %s  Battery 1 %s (%s)  Battery 2 %s (%s)\n",
+                memory_size_text (current->memctrlstatus_memory),
+                battery & BATTERY_1_DISABLED ? "Disabled" : "Enabled",
+                !(battery & BATTERY_1_FAILURE) ? "OK" : "FAILURE",
+                battery & BATTERY_2_DISABLED ? "Disabled" : "Enabled",
+                !(battery & BATTERY_2_FAILURE) ? "OK" : "FAILURE");
+        printf ("ECC %s  error count %u  (sampled %.1f s ago)\n",
+                ecc_mode_text (current->memctrlcmd_errctrl), current->memctrlcmd_errcnt,
+                (double) (get_monotonic_time_ns () - current->status_sample_time_ns) / 1E9);
+    }
+
+    printf ("\n%7s %-16s %9s %9s %9s %9s %5s %7s %-9s %8s %8s %8s\n",
+            "PID", "COMMAND", "R IOPS", "W IOPS", "R MB/s", "W MB/s", "QD", "ERRS", "MODE",
+            "p50", "p99", "p99.9");
+    for (client_index = 0; client_index < NVRAM_UIO_STATS_MAX_CLIENTS; client_index++)
+    {
+        client = &current->clients[client_index];
+        if (client->pid != 0)
+        {
+            previous_client = &previous->clients[client_index];
+            calculate_client_delta (client, (previous_client->pid == client->pid) ? previous_client : NULL, &delta);
+            for (index = 0; index < NVRAM_UIO_STATS_NUM_DIRECTIONS; index++)
+            {
+                total.ops[index] += delta.ops[index];
+                total.bytes[index] += delta.bytes[index];
+            }
+            total.errors += delta.errors;
+            for (index = 0; index < NVRAM_UIO_LATENCY_BUCKETS; index++)
+            {
+                total.latency_histogram[index] += delta.latency_histogram[index];
+            }
+            total_in_flight += client->in_flight;
+            num_clients++;
+
+            for (percentile_index = 0; percentile_index < NUM_REPORTED_PERCENTILES; percentile_index++)
+            {
+                format_latency (latency_text[percentile_index], sizeof (latency_text[percentile_index]),
+                        latency_histogram_percentile_ns (delta.latency_histogram,
+                                                         reported_percentiles[percentile_index]));
+            }
+            printf ("%7d %-16s %9.0f %9.0f %9.1f %9.1f %5u %7lu %-9s %s %s %s\n",
+                    (int) client->pid, client->comm,
+                    (double) delta.ops[NVRAM_UIO_STATS_READ] / interval_secs,
+                    (double) delta.ops[NVRAM_UIO_STATS_WRITE] / interval_secs,
+                    (double) delta.bytes[NVRAM_UIO_STATS_READ] / interval_secs / 1E6,
+                    (double) delta.bytes[NVRAM_UIO_STATS_WRITE] / interval_secs / 1E6,
+                    client->in_flight, (unsigned long) delta.errors,
+                    (client->completion_mode < NVRAM_UIO_COMPLETION_NUM_MODES) ?
+                            completion_mode_names[client->completion_mode] : "?",
+                    latency_text[0], latency_text[1], latency_text[2]);
+        }
+    }
+
+    for (percentile_index = 0; percentile_index < NUM_REPORTED_PERCENTILES; percentile_index++)
+    {
+        format_latency (latency_text[percentile_index], sizeof (latency_text[percentile_index]),
+                        latency_histogram_percentile_ns (total.latency_histogram,
+                                                         reported_percentiles[percentile_index]));
+    }
+    printf ("%7s %-16s %9.0f %9.0f %9.1f %9.1f %5u %7lu %-9s %s %s %s\n",
+            "", "TOTAL",
+            (double) total.ops[NVRAM_UIO_STATS_READ] / interval_secs,
+            (double) total.ops[NVRAM_UIO_STATS_WRITE] / interval_secs,
+            (double) total.bytes[NVRAM_UIO_STATS_READ] / interval_secs / 1E6,
+            (double) total.bytes[NVRAM_UIO_STATS_WRITE] / interval_secs / 1E6,
+            total_in_flight, (unsigned long) total.errors, "", latency_text[0], latency_text[1], latency_text[2]);
+    printf ("\n%u client(s)\n", num_clients);
+    fflush (stdout);
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context context;
+    int interval_ms = 1000;
+    const nvram_uio_stats_segment *segment = NULL;
+    nvram_uio_stats_segment *current;
+    nvram_uio_stats_segment *previous;
+    nvram_uio_stats_segment *swap;
+    uint64_t current_time_ns;
+    uint64_t previous_time_ns;
+    int opt;
+
+    memset (&context, 0, sizeof (context));
+    while ((opt = getopt (argc, argv, "d:i:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            snprintf (context.device_name, sizeof (context.device_name), "%s", optarg);
+            break;
+
+        case 'i':
+            interval_ms = atoi (optarg);
+            if (interval_ms < MIN_REFRESH_INTERVAL_MS)
+            {
+                interval_ms = MIN_REFRESH_INTERVAL_MS;
+            }
+            break;
+
+        default:
+            printf ("Usage: %s [-d <uio_device_name>] [-i <refresh_interval_ms>]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (context.device_name[0] == '\0')
+    {
+        /* Only reads sysfs, not the device */
+        find_uio_device (&context);
+    }
+
+    current = calloc (1, sizeof (nvram_uio_stats_segment));
+    previous = calloc (1, sizeof (nvram_uio_stats_segment));
+    if ((current == NULL) || (previous == NULL))
+    {
+        printf ("Failed to allocate statistics snapshots\n");
+        exit (EXIT_FAILURE);
+    }
+
+    signal (SIGINT, request_exit);
+    signal (SIGTERM, request_exit);
+    set_terminal_raw ();
+
+    previous_time_ns = get_monotonic_time_ns ();
+    while (!exit_requested)
+    {
+        if (segment == NULL)
+        {
+            /* The segment is created by the first client to open the device */
+            segment = map_stats_segment (context.device_name, false);
+            if (segment != NULL)
+            {
+                snapshot_segment (segment, previous);
+                previous_time_ns = get_monotonic_time_ns ();
+            }
+            else
+            {
+                printf ("\033[H\033[2Jnvram_top - %s\n\nWaiting for a client to open the device\n",
+                        context.device_name);
+                fflush (stdout);
+            }
+        }
+
+        wait_for_refresh (interval_ms);
+
+        if ((segment != NULL) && !exit_requested)
+        {
+            snapshot_segment (segment, current);
+            current_time_ns = get_monotonic_time_ns ();
+            display_statistics (context.device_name, current, previous,
+                                (double) (current_time_ns - previous_time_ns) / 1E9);
+            swap = previous;
+            previous = current;
+            current = swap;
+            previous_time_ns = current_time_ns;
+        }
+    }
+
+    restore_terminal ();
+    printf ("\n");
+    if (segment != NULL)
+    {
+        unmap_stats_segment ((nvram_uio_stats_segment *) segment);
+    }
+    free (current);
+    free (previous);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,569 @@
+/*
+ * @file nvram_uio_access.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Library to access a NVRAM UIO device from userspace
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <time.h>
+#include <poll.h>
+#include <x86intrin.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_probes.h"
+#include "nvram_uio_heatmap.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_window.h"
+
+/**
+ * @brief Determine if a UIO device is bound to the NVRAM driver
+ * @param[in] device_name The name of the UIO device under UIO_CLASS_ROOT
+ * @return Returns true if the UIO device is a NVRAM device
+ */
+static bool is_nvram_uio_device (const char *const device_name)
+{
+    char uio_param_pathname[PATH_MAX];
+    FILE *uio_param_file;
+    char uio_driver_name[80];
+    bool found_nvram_uio_device = false;
+
+    snprintf (uio_param_pathname, PATH_MAX, "%s/%s/name", UIO_CLASS_ROOT, device_name);
+    uio_param_file = fopen (uio_param_pathname, "r");
+    if (uio_param_file != NULL)
+    {
+        found_nvram_uio_device = fgets (uio_driver_name, sizeof (uio_driver_name), uio_param_file) != NULL;
+        if (found_nvram_uio_device)
+        {
+            if (uio_driver_name[strlen(uio_driver_name) - 1] == '\n')
+            {
+                uio_driver_name[strlen(uio_driver_name) - 1] = '\0';
+            }
+            found_nvram_uio_device = strcmp (uio_driver_name, DRIVER_NAME) == 0;
+        }
+        fclose (uio_param_file);
+    }
+
+    return found_nvram_uio_device;
+}
+
+/**
+ * @brief Find the UIO device entry for the NVRAM board
+ * @param[out] context The NVRAM UIO device which has been found
+ */
+void find_uio_device (nvram_uio_context *const context)
+{
+    DIR *uio_dir;
+    struct dirent *entry;
+    bool found_nvram_uio_device = false;
+
+    memset (context, 0, sizeof (nvram_uio_context));
+    uio_dir = opendir (UIO_CLASS_ROOT);
+    if (uio_dir == NULL)
+    {
+        printf ("Failed to open %s\n", UIO_CLASS_ROOT);
+        exit (EXIT_FAILURE);
+    }
+
+    entry = readdir (uio_dir);
+    while ((entry != NULL) && !found_nvram_uio_device)
+    {
+        if ((entry->d_type == DT_DIR) || (entry->d_type == DT_LNK))
+        {
+            found_nvram_uio_device = is_nvram_uio_device (entry->d_name);
+            if (found_nvram_uio_device)
+            {
+                strcpy (context->device_name, entry->d_name);
+            }
+        }
+        entry = readdir (uio_dir);
+    }
+    closedir (uio_dir);
+
+    if (!found_nvram_uio_device)
+    {
+        printf ("Failed to find entry for %s under %s\n", DRIVER_NAME, UIO_CLASS_ROOT);
+        exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Order UIO device names by their number, so uio10 follows uio9
+ */
+static int compare_device_names (const void *const a, const void *const b)
+{
+    const nvram_uio_context *const context_a = a;
+    const nvram_uio_context *const context_b = b;
+    const size_t length_a = strlen (context_a->device_name);
+    const size_t length_b = strlen (context_b->device_name);
+
+    if (length_a != length_b)
+    {
+        return (length_a < length_b) ? -1 : 1;
+    }
+
+    return strcmp (context_a->device_name, context_b->device_name);
+}
+
+/**
+ * @brief Find the UIO device entries of all the NVRAM boards in the host, for use of several devices at once
+ * @details Each context found has to be opened with get_uio_device_parameters() and open_uio_device(), as for
+ *          find_uio_device(). The order of the devices follows the UIO device numbers, which may change between
+ *          boots, so the devices should be identified by their contents rather than their order.
+ * @param[out] contexts The NVRAM UIO devices which have been found
+ * @param[in] max_devices The maximum number of devices to find
+ * @return The number of devices found
+ */
+unsigned int find_uio_devices (nvram_uio_context *const contexts, const unsigned int max_devices)
+{
+    DIR *uio_dir;
+    struct dirent *entry;
+    unsigned int num_devices = 0;
+
+    uio_dir = opendir (UIO_CLASS_ROOT);
+    if (uio_dir == NULL)
+    {
+        return 0;
+    }
+
+    entry = readdir (uio_dir);
+    while ((entry != NULL) && (num_devices < max_devices))
+    {
+        if (((entry->d_type == DT_DIR) || (entry->d_type == DT_LNK)) && is_nvram_uio_device (entry->d_name))
+        {
+            memset (&contexts[num_devices], 0, sizeof (nvram_uio_context));
+            snprintf (contexts[num_devices].device_name, sizeof (contexts[num_devices].device_name), "%s",
+                      entry->d_name);
+            num_devices++;
+        }
+        entry = readdir (uio_dir);
+    }
+    closedir (uio_dir);
+    qsort (contexts, num_devices, sizeof (contexts[0]), compare_device_names);
+
+    return num_devices;
+}
+
+/**
+ * @brief Read the parameter value for one UIO device mapping
+ * @param[in] device_name The name of the UIO device to read the parameter for
+ * @param[in] mapping_index Which mapping to read the parameter for
+ * @param[in] param_name The name of the parameter to read the value for
+ * @return Returns the parameter value
+ */
+unsigned int read_uio_mapping_param (const char *device_name, const unsigned int mapping_index, const char *param_name)
+{
+    char uio_param_pathname[PATH_MAX];
+    FILE *uio_param_file;
+    bool success;
+    unsigned int param_value;
+
+    snprintf (uio_param_pathname, PATH_MAX, "%s/%s/maps/map%u/%s", UIO_CLASS_ROOT, device_name, mapping_index, param_name);
+    uio_param_file = fopen (uio_param_pathname, "r");
+    success = uio_param_file != NULL;
+    if (success)
+    {
+        success = fscanf (uio_param_file, "0x%x", &param_value) == 1;
+        fclose (uio_param_file);
+    }
+    if (!success)
+    {
+        printf ("Failed to read value from %s\n", uio_param_pathname);
+        exit (EXIT_FAILURE);
+    }
+
+    return param_value;
+}
+
+/**
+ * @brief Determine if a UIO device has a mapping, for mappings which are optional
+ * @param[in] device_name The name of the UIO device to check
+ * @param[in] mapping_index Which mapping to check for
+ * @return Returns true if the mapping exists
+ */
+bool uio_mapping_exists (const char *device_name, const unsigned int mapping_index)
+{
+    char uio_param_pathname[PATH_MAX];
+
+    snprintf (uio_param_pathname, PATH_MAX, "%s/%s/maps/map%u/size", UIO_CLASS_ROOT, device_name, mapping_index);
+
+    return access (uio_param_pathname, R_OK) == 0;
+}
+
+/**
+ * @brief Get the NVRAM UIO device parameters required for operation
+ * @param[in,out] context The NVRAM UIO device being opened
+ */
+void get_uio_device_parameters (nvram_uio_context *const context)
+{
+    context->csr_mmap_offset = read_uio_mapping_param (context->device_name, CSR_MAPPING_INDEX, "offset");
+    context->csr_mmap_size = read_uio_mapping_param (context->device_name, CSR_MAPPING_INDEX, "size");
+}
+
+/**
+ * @brief Open the NVRAM UIO device, and map its csr registers
+ * @param[in,out] context The NVRAM UIO device being opened
+ */
+void open_uio_device (nvram_uio_context *const context)
+{
+    unsigned int recovery_state;
+    char device_pathname[PATH_MAX];
+
+    if (snprintf (device_pathname, sizeof (device_pathname), "/dev/%s", context->device_name) >=
+        (int) sizeof (device_pathname))
+    {
+        printf ("Device name %s is too long\n", context->device_name);
+        exit (EXIT_FAILURE);
+    }
+    context->device_fd = open (device_pathname, O_RDWR);
+    if (context->device_fd == -1)
+    {
+        printf ("Failed to open %s\n", device_pathname);
+        perror (NULL);
+        exit (EXIT_FAILURE);
+    }
+
+    context->csr = mmap (NULL, context->csr_mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, context->device_fd,
+                         CSR_MAPPING_INDEX * getpagesize ());
+    if (context->csr == MAP_FAILED)
+    {
+        printf ("Failed to map csr registers for %s\n", context->device_name);
+        perror (NULL);
+        exit (EXIT_FAILURE);
+    }
+    context->csr += context->csr_mmap_offset;
+
+    context->memctrlstatus_magic = (volatile uint8_t *) &context->csr[MEMCTRLSTATUS_MAGIC];
+    context->memctrlstatus_memory = (volatile uint8_t *) &context->csr[MEMCTRLSTATUS_MEMORY];
+    context->memctrlstatus_battery = (volatile uint8_t *) &context->csr[MEMCTRLSTATUS_BATTERY];
+    context->memctrlcmd_ledctrl = (volatile uint8_t *) &context->csr[MEMCTRLCMD_LEDCTRL];
+    context->memctrlcmd_errctrl = (volatile uint8_t *) &context->csr[MEMCTRLCMD_ERRCTRL];
+    context->memctrlcmd_errcnt = (volatile uint8_t *) &context->csr[MEMCTRLCMD_ERRCNT];
+    context->windowmap_winnum = (volatile uint8_t *) &context->csr[WINDOWMAP_WINNUM];
+    context->selected_window = -1;
+    context->memory_size_bytes = decode_memory_size (*context->memctrlstatus_memory);
+    (void) read_device_recovery (context->device_name, &recovery_state, &context->recovery_count);
+    pthread_mutex_init (&context->device_lock, NULL);
+
+    context->stats_segment = map_stats_segment (context->device_name, true);
+    if (context->stats_segment != NULL)
+    {
+        context->stats = claim_client_stats (context->stats_segment);
+        publish_device_status (context);
+    }
+    context->heatmap_sampled = heatmap_acquire_from_environment (context->device_name, context->memory_size_bytes);
+    NVRAM_UIO_PROBE1 (device_open, context->device_fd);
+}
+
+/**
+ * @brief Close the NVRAM UIO device
+ * @param[in,out] context The NVRAM UIO device to close
+ */
+void close_uio_device (nvram_uio_context *const context)
+{
+    int rc;
+
+    if (context->heatmap_sampled)
+    {
+        heatmap_release ();
+        context->heatmap_sampled = false;
+    }
+    unmap_window (context);
+    unmap_dma_buffer (context);
+    if (context->stats != NULL)
+    {
+        release_client_stats (context->stats);
+        context->stats = NULL;
+    }
+    if (context->stats_segment != NULL)
+    {
+        unmap_stats_segment (context->stats_segment);
+        context->stats_segment = NULL;
+    }
+
+    rc = munmap ((void *) context->csr, context->csr_mmap_size);
+    if (rc != 0)
+    {
+        printf ("Failed to munmap %s\n", context->device_name);
+        exit (EXIT_FAILURE);
+    }
+    context->csr = NULL;
+
+    NVRAM_UIO_PROBE1 (device_close, context->device_fd);
+    close (context->device_fd);
+}
+
+/**
+ * @brief Set a LED on the NVRAM board
+ * @param[in] The NVRAM UIO device to set the led state for
+ * @param[in] shift Identifies which led to set the state for
+ * @param[in] state The state of the led to set
+ */
+void set_led (nvram_uio_context *const context, int shift, unsigned char state)
+{
+    uint8_t led;
+
+    led = *context->memctrlcmd_ledctrl;
+    if (state == LED_FLIP)
+    {
+        led ^= (1<<shift);
+    }
+    else
+    {
+        led &= ~(0x03 << shift);
+        led |= (state << shift);
+    }
+    *context->memctrlcmd_ledctrl = led;
+    NVRAM_UIO_PROBE2 (led_set, shift, state);
+}
+
+/**
+ * @brief Obtain exclusive use of the device-wide state, i.e. the DMA engine and the memory window selection
+ * @details Excludes both the other threads in this process, and other processes which have the device open.
+ *          Also refreshes the published device status once it is older than DEVICE_STATUS_REFRESH_NS, so that
+ *          monitors see changes in the battery and ECC status while any client is using the device.
+ * @param[in,out] context The NVRAM UIO device to lock
+ */
+void lock_device (nvram_uio_context *const context)
+{
+    const nvram_uio_stats_segment *const segment = context->stats_segment;
+
+    pthread_mutex_lock (&context->device_lock);
+    flock (context->device_fd, LOCK_EX);
+    if ((segment != NULL) &&
+        ((get_monotonic_time_ns () - __atomic_load_n (&segment->status_sample_time_ns, __ATOMIC_RELAXED)) >=
+         DEVICE_STATUS_REFRESH_NS))
+    {
+        publish_device_status (context);
+    }
+}
+
+/**
+ * @brief Release exclusive use of the device-wide state obtained by lock_device()
+ * @param[in,out] context The NVRAM UIO device to unlock
+ */
+void unlock_device (nvram_uio_context *const context)
+{
+    flock (context->device_fd, LOCK_UN);
+    pthread_mutex_unlock (&context->device_lock);
+}
+
+/**
+ * @brief Decode the size of the NVRAM device memory
+ * @param[in] memctrlstatus_memory The value of the MEMCTRLSTATUS_MEMORY register
+ * @return The memory size in bytes, or zero if the register value is not recognised
+ */
+uint64_t decode_memory_size (const uint8_t memctrlstatus_memory)
+{
+    switch (memctrlstatus_memory)
+    {
+    case MEM_128_MB: return 128ULL << 20;
+    case MEM_256_MB: return 256ULL << 20;
+    case MEM_512_MB: return 512ULL << 20;
+    case MEM_1_GB:   return 1ULL << 30;
+    case MEM_2_GB:   return 2ULL << 30;
+    default:         return 0;
+    }
+}
+
+/**
+ * @brief Publish the current values of the NVRAM device status registers in the shared memory statistics
+ * @details This allows monitors to display the device status without accessing the device. Called when the
+ *          device is opened, and periodically by lock_device().
+ * @param[in,out] context The NVRAM UIO device to publish the status for
+ */
+void publish_device_status (nvram_uio_context *const context)
+{
+    nvram_uio_stats_segment *const segment = context->stats_segment;
+
+    if (segment != NULL)
+    {
+        __atomic_store_n (&segment->memctrlstatus_memory, *context->memctrlstatus_memory, __ATOMIC_RELAXED);
+        __atomic_store_n (&segment->memctrlstatus_battery, *context->memctrlstatus_battery, __ATOMIC_RELAXED);
+        __atomic_store_n (&segment->memctrlcmd_errctrl, *context->memctrlcmd_errctrl, __ATOMIC_RELAXED);
+        __atomic_store_n (&segment->memctrlcmd_errcnt, *context->memctrlcmd_errcnt, __ATOMIC_RELAXED);
+        __atomic_store_n (&segment->status_sample_time_ns, get_monotonic_time_ns (), __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief Return the check word of a structure or record stored in the device memory, treating its check field as zero
+ * @details The data is mixed one 64-bit word at a time, with a final partial word padded with zeros.
+ * @param[in] data The data to check
+ * @param[in] num_bytes The size of the data
+ * @param[in] check_offset The offset of the 64-bit check field in the data, which must be a multiple of 8
+ * @return The check word
+ */
+uint64_t compute_check_word (const void *const data, const size_t num_bytes, const size_t check_offset)
+{
+    const uint8_t *const bytes = data;
+    uint64_t check = 0xcbf29ce484222325ULL;
+    uint64_t word;
+    size_t index;
+
+    for (index = 0; index < num_bytes; index += sizeof (word))
+    {
+        word = 0;
+        if (index != check_offset)
+        {
+            memcpy (&word, &bytes[index], ((num_bytes - index) < sizeof (word)) ? (num_bytes - index) : sizeof (word));
+        }
+        check = (check ^ word) * 0x100000001b3ULL;
+        check ^= check >> 29;
+    }
+
+    return check;
+}
+
+/**
+ * @brief Return an identifier for a new set of devices, which is stored in each member so that members of different
+ *        sets aren't mixed up
+ * @details Combines the CLOCK_REALTIME time with the process ID, so is unique unless the clock is set back.
+ */
+uint64_t generate_set_id (void)
+{
+    struct timespec now;
+    uint64_t set_id;
+
+    clock_gettime (CLOCK_REALTIME, &now);
+    set_id = ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+    set_id ^= (uint64_t) getpid () << 48;
+
+    return set_id;
+}
+
+/**
+ * @brief Return the current CLOCK_MONOTONIC time in nanoseconds, used for timing operations
+ */
+uint64_t get_monotonic_time_ns (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Measure the TSC frequency against CLOCK_MONOTONIC, for converting TSC timestamps to time
+ */
+uint64_t measure_tsc_hz (void)
+{
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = 10000000};
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t start_tsc;
+    uint64_t end_tsc;
+
+    start_ns = get_monotonic_time_ns ();
+    start_tsc = __rdtsc ();
+    nanosleep (&delay, NULL);
+    end_tsc = __rdtsc ();
+    end_ns = get_monotonic_time_ns ();
+
+    return ((end_tsc - start_tsc) * 1000000000ULL) / (end_ns - start_ns);
+}
+
+/**
+ * @brief Read the PCI error recovery state of a device from the sysfs attributes of the driver
+ * @param[in] device_name The name of the UIO device
+ * @param[out] state The enum nvram_uio_recovery_state
+ * @param[out] count The number of recoveries completed
+ * @return Returns true if the state was read, or false if the driver doesn't provide the attributes
+ */
+bool read_device_recovery (const char *device_name, unsigned int *const state, unsigned int *const count)
+{
+    const char *const attr_names[2] = {"recovery_state", "recovery_count"};
+    unsigned int *const values[2] = {state, count};
+    char attr_pathname[PATH_MAX];
+    FILE *attr_file;
+    unsigned int attr_index;
+    bool success = true;
+
+    *state = NVRAM_UIO_RECOVERY_NORMAL;
+    *count = 0;
+    for (attr_index = 0; success && (attr_index < 2); attr_index++)
+    {
+        snprintf (attr_pathname, PATH_MAX, "%s/%s/device/%s", UIO_CLASS_ROOT, device_name, attr_names[attr_index]);
+        attr_file = fopen (attr_pathname, "r");
+        success = attr_file != NULL;
+        if (success)
+        {
+            success = fscanf (attr_file, "%u", values[attr_index]) == 1;
+            fclose (attr_file);
+        }
+    }
+
+    return success;
+}
+
+/**
+ * @brief Determine if the device has had a PCI error since the last recovery seen by the context
+ * @param[in] context The open NVRAM UIO device
+ * @return Returns true if the device is being, or has been, recovered
+ */
+bool device_recovery_pending (const nvram_uio_context *const context)
+{
+    unsigned int state;
+    unsigned int count;
+
+    return read_device_recovery (context->device_name, &state, &count) &&
+            ((state != NVRAM_UIO_RECOVERY_NORMAL) || (count != context->recovery_count));
+}
+
+/**
+ * @brief Wait for the driver to complete recovery of the device from a PCI error
+ * @details Waits on the UIO event which the driver signals on each change of recovery state, so returns as soon
+ *          as the device has been resumed.
+ * @param[in,out] context The open NVRAM UIO device
+ * @param[in] timeout_ns The maximum time to wait
+ * @return Returns true if the device is available for I/O, or false if recovery failed or timed out
+ */
+bool wait_for_device_recovery (nvram_uio_context *const context, const uint64_t timeout_ns)
+{
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    struct pollfd event_poll = {.fd = context->device_fd, .events = POLLIN};
+    unsigned int state;
+    unsigned int count;
+    uint64_t elapsed_ns;
+    uint32_t event_count;
+
+    for (;;)
+    {
+        if (!read_device_recovery (context->device_name, &state, &count) || (state == NVRAM_UIO_RECOVERY_FAILED))
+        {
+            return false;
+        }
+        if (state == NVRAM_UIO_RECOVERY_NORMAL)
+        {
+            context->recovery_count = count;
+            context->selected_window = -1;
+            NVRAM_UIO_PROBE1 (device_recovered, count);
+            return true;
+        }
+
+        elapsed_ns = get_monotonic_time_ns () - start_ns;
+        if (elapsed_ns >= timeout_ns)
+        {
+            return false;
+        }
+        if ((poll (&event_poll, 1, (int) (((timeout_ns - elapsed_ns) + 999999) / 1000000)) > 0) &&
+            ((event_poll.revents & POLLIN) != 0))
+        {
+            /* Consume the event, the state is re-read above */
+            (void) read (context->device_fd, &event_count, sizeof (event_count));
+        }
+    }
+}
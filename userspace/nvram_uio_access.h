@@ -0,0 +1,102 @@
+/*
+ * @file nvram_uio_access.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Library to access a NVRAM UIO device from userspace
+ */
+
+#ifndef NVRAM_UIO_ACCESS_H_
+#define NVRAM_UIO_ACCESS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <linux/types.h>
+#include "umem.h"
+#include "nvram_uio_stats.h"
+
+#define UIO_CLASS_ROOT "/sys/class/uio"
+
+/* How long to wait for the driver to recover the device from a PCI error */
+#define DEVICE_RECOVERY_TIMEOUT_NS 5000000000ULL
+
+/* The interval at which clients which lock the device refresh the status published in the shared memory statistics */
+#define DEVICE_STATUS_REFRESH_NS 1000000000ULL
+
+/** Contains the context of the NVRAM UIO device */
+typedef struct
+{
+    /** The name of the NVRAM UIO device */
+    char device_name[PATH_MAX];
+    /** The offset required to be added to the mmap for access for the NVRAM device csr registers */
+    unsigned int csr_mmap_offset;
+    /** The size of the csr registers to be mapped */
+    unsigned int csr_mmap_size;
+    /** The file descriptor for the NVRAM UIO device */
+    int device_fd;
+    /** The base of mapped NVRAM device csr registers */
+    volatile char *csr;
+    /** Mapped to specific NVRAM device csr registers */
+    volatile uint8_t *memctrlstatus_magic;
+    volatile uint8_t *memctrlstatus_memory;
+    volatile uint8_t *memctrlstatus_battery;
+    volatile uint8_t *memctrlcmd_ledctrl;
+    volatile uint8_t *memctrlcmd_errctrl;
+    volatile uint8_t *memctrlcmd_errcnt;
+    /** The size of the NVRAM device memory in bytes, or zero if the size is not recognised */
+    uint64_t memory_size_bytes;
+    /** The shared memory statistics for the device, or NULL if the statistics couldn't be mapped */
+    nvram_uio_stats_segment *stats_segment;
+    /** The statistics slot of this process in stats_segment, or NULL if no slot was available */
+    nvram_uio_client_stats *stats;
+    /** The per-file DMA mapping, or NULL if not mapped by map_dma_buffer() */
+    void *dma_mapping;
+    size_t dma_mapping_size;
+    /** The information page at the start of the DMA mapping, written by the driver */
+    const volatile struct nvram_uio_dma_info *dma_info;
+    /** The DMA descriptors which follow the information page, and their bus address */
+    struct mm_dma_desc *dma_descs;
+    uint64_t dma_descs_bus_addr;
+    unsigned int max_dma_chain_length;
+    /** The data buffer in the DMA mapping, and its bus address */
+    uint8_t *dma_buffer;
+    uint64_t dma_buffer_bus_addr;
+    size_t dma_buffer_size;
+    /** The write-combining memory window, or NULL if not mapped by map_window() */
+    uint8_t *window;
+    size_t window_size;
+    /** The window number currently selected in WINDOWMAP_WINNUM, or -1 if not known */
+    int64_t selected_window;
+    volatile uint8_t *windowmap_winnum;
+    /** The number of PCI error recoveries of the device seen by this context */
+    unsigned int recovery_count;
+    /** Set when the accesses through this context are recorded by the heatmap sampler */
+    bool heatmap_sampled;
+    /** Serialises use of the device-wide DMA engine and window selection by the threads in this process */
+    pthread_mutex_t device_lock;
+} nvram_uio_context;
+
+void find_uio_device (nvram_uio_context *const context);
+unsigned int find_uio_devices (nvram_uio_context *const contexts, const unsigned int max_devices);
+unsigned int read_uio_mapping_param (const char *device_name, const unsigned int mapping_index, const char *param_name);
+void get_uio_device_parameters (nvram_uio_context *const context);
+void open_uio_device (nvram_uio_context *const context);
+void close_uio_device (nvram_uio_context *const context);
+void set_led (nvram_uio_context *const context, int shift, unsigned char state);
+bool uio_mapping_exists (const char *device_name, const unsigned int mapping_index);
+void lock_device (nvram_uio_context *const context);
+void unlock_device (nvram_uio_context *const context);
+uint64_t decode_memory_size (const uint8_t memctrlstatus_memory);
+void publish_device_status (nvram_uio_context *const context);
+uint64_t compute_check_word (const void *const data, const size_t num_bytes, const size_t check_offset);
+uint64_t generate_set_id (void);
+uint64_t get_monotonic_time_ns (void);
+uint64_t measure_tsc_hz (void);
+bool read_device_recovery (const char *device_name, unsigned int *const state, unsigned int *const count);
+bool device_recovery_pending (const nvram_uio_context *const context);
+bool wait_for_device_recovery (nvram_uio_context *const context, const uint64_t timeout_ns);
+
+#endif /* NVRAM_UIO_ACCESS_H_ */
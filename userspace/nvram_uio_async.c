@@ -0,0 +1,162 @@
+/*
+ * @file nvram_uio_async.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Asynchronous DMA transfers, with completion callbacks run on a work-stealing executor
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#include "nvram_uio_async.h"
+
+/* The maximum number of requests combined into one DMA chain */
+#define MAX_ASYNC_CHAIN_LENGTH 64
+
+/**
+ * @brief Executor task which calls the callback of a completed request
+ */
+static void run_completion (executor_task *const task)
+{
+    dma_async_request *const request = (dma_async_request *) task;
+
+    request->callback (request);
+}
+
+/**
+ * @brief Perform the requests taken from the submission queue, and post their completions to the executor
+ * @param[in,out] queue The queue the requests were taken from
+ * @param[in] requests The list of requests, in submission order
+ */
+static void perform_requests (dma_async_queue *const queue, dma_async_request *requests)
+{
+    const unsigned int max_chain_length = (queue->context->max_dma_chain_length < MAX_ASYNC_CHAIN_LENGTH) ?
+            queue->context->max_dma_chain_length : MAX_ASYNC_CHAIN_LENGTH;
+    dma_async_request *chain[MAX_ASYNC_CHAIN_LENGTH];
+    dma_chain_element elements[MAX_ASYNC_CHAIN_LENGTH];
+    unsigned int chain_length;
+    unsigned int chain_index;
+    uint64_t complete_ns;
+    bool success;
+
+    while (requests != NULL)
+    {
+        /* Combine consecutive requests in the same direction */
+        chain_length = 0;
+        do
+        {
+            chain[chain_length] = requests;
+            elements[chain_length] = requests->element;
+            chain_length++;
+            requests = requests->next;
+        } while ((requests != NULL) && (chain_length < max_chain_length) &&
+                 (requests->direction == chain[0]->direction));
+
+        success = dma_transfer_chain (queue->context, chain[0]->direction, elements, chain_length);
+        complete_ns = get_monotonic_time_ns ();
+        for (chain_index = 0; chain_index < chain_length; chain_index++)
+        {
+            chain[chain_index]->success = success;
+            chain[chain_index]->latency_ns = complete_ns - chain[chain_index]->submit_ns;
+            executor_post (queue->pool, &chain[chain_index]->task);
+        }
+    }
+}
+
+/**
+ * @brief The harvester thread, which performs queued requests until the queue is stopped and empty
+ */
+static void *harvester_thread (void *const arg)
+{
+    dma_async_queue *const queue = arg;
+    dma_async_request *requests;
+    bool stopping = false;
+
+    while (!stopping)
+    {
+        pthread_mutex_lock (&queue->lock);
+        while ((queue->head == NULL) && !queue->stopping)
+        {
+            pthread_cond_wait (&queue->submitted, &queue->lock);
+        }
+        requests = queue->head;
+        queue->head = NULL;
+        queue->tail = NULL;
+        stopping = queue->stopping && (requests == NULL);
+        pthread_mutex_unlock (&queue->lock);
+
+        perform_requests (queue, requests);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start an asynchronous DMA queue
+ * @param[out] queue The queue to start
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in,out] pool The executor to run completion callbacks on. The queue is the only producer for the executor.
+ */
+void dma_async_start (dma_async_queue *const queue, nvram_uio_context *const context, executor *const pool)
+{
+    queue->context = context;
+    queue->pool = pool;
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->stopping = false;
+    pthread_mutex_init (&queue->lock, NULL);
+    pthread_cond_init (&queue->submitted, NULL);
+    if (pthread_create (&queue->harvester, NULL, harvester_thread, queue) != 0)
+    {
+        printf ("Failed to create DMA harvester thread\n");
+        exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Stop an asynchronous DMA queue, once the requests already submitted have been performed
+ * @details The callbacks of the requests may still be running on the executor on return.
+ * @param[in,out] queue The queue to stop
+ */
+void dma_async_stop (dma_async_queue *const queue)
+{
+    pthread_mutex_lock (&queue->lock);
+    queue->stopping = true;
+    pthread_cond_signal (&queue->submitted);
+    pthread_mutex_unlock (&queue->lock);
+    pthread_join (queue->harvester, NULL);
+    pthread_cond_destroy (&queue->submitted);
+    pthread_mutex_destroy (&queue->lock);
+}
+
+/**
+ * @brief Submit an asynchronous DMA request
+ * @param[in,out] queue The queue to submit to
+ * @param[in,out] request The request, with the direction, element and callback set
+ */
+void dma_async_submit (dma_async_queue *const queue, dma_async_request *const request)
+{
+    request->task.run = run_completion;
+    request->task.cpu_hint = sched_getcpu ();
+    request->success = false;
+    request->submit_ns = get_monotonic_time_ns ();
+    request->next = NULL;
+
+    pthread_mutex_lock (&queue->lock);
+    if (queue->tail != NULL)
+    {
+        queue->tail->next = request;
+    }
+    else
+    {
+        queue->head = request;
+    }
+    queue->tail = request;
+    pthread_cond_signal (&queue->submitted);
+    pthread_mutex_unlock (&queue->lock);
+}
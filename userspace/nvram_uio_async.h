@@ -0,0 +1,64 @@
+/*
+ * @file nvram_uio_async.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Asynchronous DMA transfers, with completion callbacks run on a work-stealing executor
+ * @details
+ *   Requests are queued by any thread, and performed by a single harvester thread which owns the DMA engine for the
+ *   queue. Consecutive queued requests in the same direction are combined into one DMA chain. On completion the
+ *   harvester posts each request to the executor, hinted to run on the CPU which submitted it, and carries on with
+ *   the next chain without waiting for the callbacks.
+ *
+ *   The buffer_offset of each request is in the DMA buffer of the context, and the caller is responsible for
+ *   not reusing that part of the buffer until the callback for the request has run.
+ */
+
+#ifndef NVRAM_UIO_ASYNC_H_
+#define NVRAM_UIO_ASYNC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_executor.h"
+
+/** One asynchronous DMA request, which must remain valid until its callback has been called */
+typedef struct dma_async_request
+{
+    /** Used to run the callback on the executor */
+    executor_task task;
+    /** Either DMA_READ_FROM_HOST to write the device memory, or DMA_WRITE_TO_HOST to read it */
+    uint32_t direction;
+    dma_chain_element element;
+    /** Called on an executor worker once the transfer has completed */
+    void (*callback) (struct dma_async_request *const request);
+    /** For use by the callback */
+    void *arg;
+    /** Set before the callback is called */
+    bool success;
+    uint64_t submit_ns;
+    uint64_t latency_ns;
+    /** Links the request in the submission queue */
+    struct dma_async_request *next;
+} dma_async_request;
+
+/** A queue of asynchronous DMA requests for one open device */
+typedef struct
+{
+    nvram_uio_context *context;
+    executor *pool;
+    pthread_t harvester;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    dma_async_request *head;
+    dma_async_request *tail;
+    bool stopping;
+} dma_async_queue;
+
+void dma_async_start (dma_async_queue *const queue, nvram_uio_context *const context, executor *const pool);
+void dma_async_stop (dma_async_queue *const queue);
+void dma_async_submit (dma_async_queue *const queue, dma_async_request *const request);
+
+#endif /* NVRAM_UIO_ASYNC_H_ */
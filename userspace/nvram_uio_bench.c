@@ -0,0 +1,194 @@
+/*
+ * @file nvram_uio_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Standard read/write sweeps used to benchmark a NVRAM UIO device
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "nvram_uio_bench.h"
+#include "nvram_uio_dma.h"
+
+/**
+ * @brief qsort comparison function for latencies
+ */
+static int compare_latencies (const void *const a, const void *const b)
+{
+    const uint64_t latency_a = *(const uint64_t *) a;
+    const uint64_t latency_b = *(const uint64_t *) b;
+
+    return (latency_a < latency_b) ? -1 : ((latency_a > latency_b) ? 1 : 0);
+}
+
+/**
+ * @brief Return a percentile from a set of latencies
+ * @param[in,out] latencies_ns The latencies, which are sorted in place
+ * @param[in] num_latencies The number of latencies
+ * @param[in] percentile The percentile to return
+ * @return The latency at the percentile, or zero if there are no latencies
+ */
+uint64_t bench_latency_percentile (uint64_t *const latencies_ns, const size_t num_latencies, const double percentile)
+{
+    size_t index;
+
+    if (num_latencies == 0)
+    {
+        return 0;
+    }
+    qsort (latencies_ns, num_latencies, sizeof (latencies_ns[0]), compare_latencies);
+    index = (size_t) (((double) num_latencies * percentile) / 100.0);
+
+    return latencies_ns[(index < num_latencies) ? index : (num_latencies - 1)];
+}
+
+/**
+ * @brief Measure the mean latency of reading a CSR register, which is a non-posted read across PCI
+ * @param[in] context The open NVRAM UIO device
+ * @param[in] iterations The number of reads to time
+ * @return The mean latency
+ */
+double bench_mmio_read_latency (nvram_uio_context *const context, const unsigned int iterations)
+{
+    uint64_t start_ns;
+    unsigned int iteration;
+    uint8_t value;
+
+    start_ns = get_monotonic_time_ns ();
+    for (iteration = 0; iteration < iterations; iteration++)
+    {
+        value = *context->memctrlstatus_magic;
+        (void) value;
+    }
+
+    return (double) (get_monotonic_time_ns () - start_ns) / (double) iterations;
+}
+
+/**
+ * @brief Run the standard DMA read/write sweeps, and the MMIO read latency measurement
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] card_offset The start of the device memory used by the sweeps, which is written back with the data read
+ *                        from it. Writes made by other clients to the area during the sweeps may be lost.
+ * @param[in] iterations The number of transfers of each size in each direction
+ * @param[out] results The results of the sweeps
+ */
+void bench_run_sweeps (nvram_uio_context *const context, const uint64_t card_offset, const unsigned int iterations,
+                       bench_sweep_results *const results)
+{
+    uint64_t *latencies_ns[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    uint64_t total_ns[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    unsigned int num_samples[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    bench_sweep_entry *entry;
+    size_t transfer_size;
+    unsigned int iteration;
+    unsigned int direction;
+    uint64_t start_ns;
+    uint64_t latency_ns;
+    uint64_t transfer_card_offset;
+    size_t card_window;
+    bool read_ok;
+
+    memset (results, 0, sizeof (*results));
+    results->mmio_read_latency_ns = bench_mmio_read_latency (context, iterations);
+
+    for (direction = 0; direction < NVRAM_UIO_STATS_NUM_DIRECTIONS; direction++)
+    {
+        latencies_ns[direction] = calloc (iterations, sizeof (uint64_t));
+        if (latencies_ns[direction] == NULL)
+        {
+            printf ("Failed to allocate latencies\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    card_window = context->dma_buffer_size;
+    if ((context->memory_size_bytes != 0) && ((card_offset + card_window) > context->memory_size_bytes))
+    {
+        card_window = (card_offset < context->memory_size_bytes) ? (context->memory_size_bytes - card_offset) : 0;
+    }
+
+    for (transfer_size = BENCH_MIN_TRANSFER_SIZE;
+         (transfer_size <= card_window) && (results->num_sizes < BENCH_MAX_SWEEP_SIZES);
+         transfer_size *= 2)
+    {
+        entry = &results->sizes[results->num_sizes];
+        entry->transfer_size = transfer_size;
+        memset (total_ns, 0, sizeof (total_ns));
+        memset (num_samples, 0, sizeof (num_samples));
+
+        for (iteration = 0; iteration < iterations; iteration++)
+        {
+            /* Step through the window, so that successive transfers don't just re-use the same card lines */
+            transfer_card_offset = card_offset + ((iteration % (card_window / transfer_size)) * transfer_size);
+
+            start_ns = get_monotonic_time_ns ();
+            read_ok = dma_transfer (context, DMA_WRITE_TO_HOST, transfer_card_offset, 0, transfer_size);
+            latency_ns = get_monotonic_time_ns () - start_ns;
+            latencies_ns[NVRAM_UIO_STATS_READ][num_samples[NVRAM_UIO_STATS_READ]++] = latency_ns;
+            total_ns[NVRAM_UIO_STATS_READ] += latency_ns;
+            if (!read_ok)
+            {
+                /* The DMA buffer doesn't hold the device memory, so writing it back would corrupt the device memory */
+                entry->num_errors++;
+                continue;
+            }
+
+            /* Write back the data just read, which loses any write by another client since the read */
+            start_ns = get_monotonic_time_ns ();
+            if (!dma_transfer (context, DMA_READ_FROM_HOST, transfer_card_offset, 0, transfer_size))
+            {
+                entry->num_errors++;
+            }
+            latency_ns = get_monotonic_time_ns () - start_ns;
+            latencies_ns[NVRAM_UIO_STATS_WRITE][num_samples[NVRAM_UIO_STATS_WRITE]++] = latency_ns;
+            total_ns[NVRAM_UIO_STATS_WRITE] += latency_ns;
+        }
+
+        for (direction = 0; direction < NVRAM_UIO_STATS_NUM_DIRECTIONS; direction++)
+        {
+            entry->throughput_mbps[direction] = (total_ns[direction] > 0) ?
+                    (((double) transfer_size * num_samples[direction] * 1E3) / (double) total_ns[direction]) : 0.0;
+            entry->p50_latency_ns[direction] =
+                    bench_latency_percentile (latencies_ns[direction], num_samples[direction], 50.0);
+            entry->p99_latency_ns[direction] =
+                    bench_latency_percentile (latencies_ns[direction], num_samples[direction], 99.0);
+        }
+        results->num_sizes++;
+    }
+
+    for (direction = 0; direction < NVRAM_UIO_STATS_NUM_DIRECTIONS; direction++)
+    {
+        free (latencies_ns[direction]);
+    }
+}
+
+/**
+ * @brief Display the results of the standard sweeps
+ * @param[in,out] out The stream to write the results to
+ * @param[in] results The results to display
+ */
+void bench_print_sweeps (FILE *const out, const bench_sweep_results *const results)
+{
+    unsigned int size_index;
+    const bench_sweep_entry *entry;
+
+    fprintf (out, "MMIO read latency %.0f ns\n", results->mmio_read_latency_ns);
+    fprintf (out, "%10s %12s %12s %12s %12s %12s %12s %6s\n", "Size", "Read MB/s", "Read p50", "Read p99",
+             "Write MB/s", "Write p50", "Write p99", "Errors");
+    for (size_index = 0; size_index < results->num_sizes; size_index++)
+    {
+        entry = &results->sizes[size_index];
+        fprintf (out, "%10zu %12.1f %10.1fus %10.1fus %12.1f %10.1fus %10.1fus %6u\n", entry->transfer_size,
+                 entry->throughput_mbps[NVRAM_UIO_STATS_READ],
+                 (double) entry->p50_latency_ns[NVRAM_UIO_STATS_READ] / 1E3,
+                 (double) entry->p99_latency_ns[NVRAM_UIO_STATS_READ] / 1E3,
+                 entry->throughput_mbps[NVRAM_UIO_STATS_WRITE],
+                 (double) entry->p50_latency_ns[NVRAM_UIO_STATS_WRITE] / 1E3,
+                 (double) entry->p99_latency_ns[NVRAM_UIO_STATS_WRITE] / 1E3,
+                 entry->num_errors);
+    }
+}
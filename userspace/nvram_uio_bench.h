@@ -0,0 +1,53 @@
+/*
+ * @file nvram_uio_bench.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Standard read/write sweeps used to benchmark a NVRAM UIO device
+ * @details
+ *   The DMA sweeps measure throughput and latency for power-of-two transfer sizes. Each write transfers back the
+ *   data which was just read from the same offset. The device lock isn't held between the read and the write-back,
+ *   so the contents are only preserved if no other client writes the area used by the sweeps, which should be a
+ *   scratch area.
+ */
+
+#ifndef NVRAM_UIO_BENCH_H_
+#define NVRAM_UIO_BENCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "nvram_uio_access.h"
+
+#define BENCH_MIN_TRANSFER_SIZE 4096
+#define BENCH_MAX_SWEEP_SIZES 16
+
+/** The results for one transfer size in a DMA sweep */
+typedef struct
+{
+    size_t transfer_size;
+    /** Throughput in MB/s, indexed by nvram_uio_stats_direction */
+    double throughput_mbps[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    /** Latency percentiles, indexed by nvram_uio_stats_direction */
+    uint64_t p50_latency_ns[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    uint64_t p99_latency_ns[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    /** The number of failed transfers */
+    uint32_t num_errors;
+} bench_sweep_entry;
+
+/** The results of the standard sweeps */
+typedef struct
+{
+    /** Mean latency of a read of a CSR register */
+    double mmio_read_latency_ns;
+    unsigned int num_sizes;
+    bench_sweep_entry sizes[BENCH_MAX_SWEEP_SIZES];
+} bench_sweep_results;
+
+uint64_t bench_latency_percentile (uint64_t *const latencies_ns, const size_t num_latencies, const double percentile);
+double bench_mmio_read_latency (nvram_uio_context *const context, const unsigned int iterations);
+void bench_run_sweeps (nvram_uio_context *const context, const uint64_t card_offset, const unsigned int iterations,
+                       bench_sweep_results *const results);
+void bench_print_sweeps (FILE *const out, const bench_sweep_results *const results);
+
+#endif /* NVRAM_UIO_BENCH_H_ */
@@ -0,0 +1,377 @@
+/*
+ * @file nvram_uio_blockhash.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Hashing of the NVRAM device memory in fixed size blocks, to find the blocks which differ from an image
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "nvram_uio_blockhash.h"
+#include "nvram_uio_dma.h"
+
+#define STRIPE_SIZE 64
+#define NUM_ACCUMULATORS 8
+
+/* The number of stripes between scrambles of the accumulators */
+#define STRIPES_PER_SCRAMBLE 16
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+/* Keys combined with the input stripes, and with the accumulators when scrambled */
+static const uint64_t stripe_keys[NUM_ACCUMULATORS] __attribute__((aligned(32))) =
+{
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL
+};
+static const uint64_t scramble_keys[NUM_ACCUMULATORS] __attribute__((aligned(32))) =
+{
+    0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL, 0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+    0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL, 0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL
+};
+
+/** Accumulates a number of whole stripes, then scrambles the accumulators */
+typedef void (*accumulate_fn) (uint64_t *const acc, const uint8_t *const data, const size_t num_stripes);
+
+/**
+ * @brief Accumulate stripes one 64-bit lane at a time, which is the reference for the vector implementations
+ */
+static void accumulate_scalar (uint64_t *const acc, const uint8_t *const data, const size_t num_stripes)
+{
+    uint64_t word;
+    uint64_t keyed;
+    size_t stripe;
+    unsigned int lane;
+
+    for (stripe = 0; stripe < num_stripes; stripe++)
+    {
+        for (lane = 0; lane < NUM_ACCUMULATORS; lane++)
+        {
+            memcpy (&word, &data[(stripe * STRIPE_SIZE) + (lane * sizeof (word))], sizeof (word));
+            keyed = word ^ stripe_keys[lane];
+            acc[lane ^ 1] += word;
+            acc[lane] += (keyed & 0xffffffffU) * (keyed >> 32);
+        }
+    }
+    for (lane = 0; lane < NUM_ACCUMULATORS; lane++)
+    {
+        acc[lane] ^= acc[lane] >> 47;
+        acc[lane] ^= scramble_keys[lane];
+        acc[lane] *= PRIME32_1;
+    }
+}
+
+/**
+ * @brief Accumulate stripes using SSE2, two lanes per vector
+ */
+static void accumulate_sse2 (uint64_t *const acc, const uint8_t *const data, const size_t num_stripes)
+{
+    __m128i acc_vecs[NUM_ACCUMULATORS / 2];
+    const __m128i prime = _mm_set1_epi32 ((int) PRIME32_1);
+    __m128i word;
+    __m128i keyed;
+    size_t stripe;
+    unsigned int vec;
+
+    for (vec = 0; vec < (NUM_ACCUMULATORS / 2); vec++)
+    {
+        acc_vecs[vec] = _mm_loadu_si128 ((const __m128i *) &acc[vec * 2]);
+    }
+    for (stripe = 0; stripe < num_stripes; stripe++)
+    {
+        for (vec = 0; vec < (NUM_ACCUMULATORS / 2); vec++)
+        {
+            word = _mm_loadu_si128 ((const __m128i *) &data[(stripe * STRIPE_SIZE) + (vec * sizeof (__m128i))]);
+            keyed = _mm_xor_si128 (word, _mm_load_si128 ((const __m128i *) &stripe_keys[vec * 2]));
+            acc_vecs[vec] = _mm_add_epi64 (acc_vecs[vec], _mm_shuffle_epi32 (word, _MM_SHUFFLE (1, 0, 3, 2)));
+            acc_vecs[vec] = _mm_add_epi64 (acc_vecs[vec], _mm_mul_epu32 (keyed, _mm_srli_epi64 (keyed, 32)));
+        }
+    }
+    for (vec = 0; vec < (NUM_ACCUMULATORS / 2); vec++)
+    {
+        acc_vecs[vec] = _mm_xor_si128 (acc_vecs[vec], _mm_srli_epi64 (acc_vecs[vec], 47));
+        acc_vecs[vec] = _mm_xor_si128 (acc_vecs[vec], _mm_load_si128 ((const __m128i *) &scramble_keys[vec * 2]));
+        acc_vecs[vec] = _mm_add_epi64 (_mm_mul_epu32 (acc_vecs[vec], prime),
+                                       _mm_slli_epi64 (_mm_mul_epu32 (_mm_srli_epi64 (acc_vecs[vec], 32), prime), 32));
+        _mm_storeu_si128 ((__m128i *) &acc[vec * 2], acc_vecs[vec]);
+    }
+}
+
+/**
+ * @brief Accumulate stripes using AVX2, four lanes per vector
+ */
+__attribute__((target("avx2")))
+static void accumulate_avx2 (uint64_t *const acc, const uint8_t *const data, const size_t num_stripes)
+{
+    __m256i acc_vecs[NUM_ACCUMULATORS / 4];
+    const __m256i prime = _mm256_set1_epi32 ((int) PRIME32_1);
+    __m256i word;
+    __m256i keyed;
+    size_t stripe;
+    unsigned int vec;
+
+    for (vec = 0; vec < (NUM_ACCUMULATORS / 4); vec++)
+    {
+        acc_vecs[vec] = _mm256_loadu_si256 ((const __m256i *) &acc[vec * 4]);
+    }
+    for (stripe = 0; stripe < num_stripes; stripe++)
+    {
+        for (vec = 0; vec < (NUM_ACCUMULATORS / 4); vec++)
+        {
+            word = _mm256_loadu_si256 ((const __m256i *) &data[(stripe * STRIPE_SIZE) + (vec * sizeof (__m256i))]);
+            keyed = _mm256_xor_si256 (word, _mm256_load_si256 ((const __m256i *) &stripe_keys[vec * 4]));
+            acc_vecs[vec] = _mm256_add_epi64 (acc_vecs[vec], _mm256_shuffle_epi32 (word, _MM_SHUFFLE (1, 0, 3, 2)));
+            acc_vecs[vec] = _mm256_add_epi64 (acc_vecs[vec], _mm256_mul_epu32 (keyed, _mm256_srli_epi64 (keyed, 32)));
+        }
+    }
+    for (vec = 0; vec < (NUM_ACCUMULATORS / 4); vec++)
+    {
+        acc_vecs[vec] = _mm256_xor_si256 (acc_vecs[vec], _mm256_srli_epi64 (acc_vecs[vec], 47));
+        acc_vecs[vec] = _mm256_xor_si256 (acc_vecs[vec], _mm256_load_si256 ((const __m256i *) &scramble_keys[vec * 4]));
+        acc_vecs[vec] = _mm256_add_epi64 (_mm256_mul_epu32 (acc_vecs[vec], prime),
+                                          _mm256_slli_epi64 (_mm256_mul_epu32 (_mm256_srli_epi64 (acc_vecs[vec], 32),
+                                                                               prime), 32));
+        _mm256_storeu_si256 ((__m256i *) &acc[vec * 4], acc_vecs[vec]);
+    }
+}
+
+/**
+ * @brief Select the widest accumulate implementation supported by the CPU
+ * @details The NVRAM_UIO_BLOCKHASH environment variable may select "scalar" or "sse2" instead, to cross-check
+ *          the implementations.
+ */
+static accumulate_fn select_accumulate (const char **const name)
+{
+    const char *const override = getenv ("NVRAM_UIO_BLOCKHASH");
+
+    if ((override != NULL) && (strcmp (override, "scalar") == 0))
+    {
+        *name = "scalar";
+        return accumulate_scalar;
+    }
+    if (((override == NULL) || (strcmp (override, "sse2") != 0)) && __builtin_cpu_supports ("avx2"))
+    {
+        *name = "AVX2";
+        return accumulate_avx2;
+    }
+    *name = "SSE2";
+    return accumulate_sse2;
+}
+
+/**
+ * @brief Mix the final accumulators into the hash
+ */
+static uint64_t finalise (const uint64_t *const acc, const size_t num_bytes)
+{
+    uint64_t hash = num_bytes * PRIME64_1;
+    unsigned __int128 product;
+    unsigned int lane;
+
+    for (lane = 0; lane < NUM_ACCUMULATORS; lane += 2)
+    {
+        product = (unsigned __int128) (acc[lane] ^ stripe_keys[lane]) * (acc[lane + 1] ^ scramble_keys[lane + 1]);
+        hash += (uint64_t) product ^ (uint64_t) (product >> 64);
+    }
+    hash ^= hash >> 37;
+    hash *= PRIME64_2;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+static const char *accumulate_name;
+static accumulate_fn accumulate;
+
+/**
+ * @brief Hash a block of data
+ * @details Blocks which aren't a multiple of the stripe size have the last stripe padded with zeros.
+ * @param[in] data The data to hash
+ * @param[in] num_bytes The number of bytes to hash
+ * @return The hash
+ */
+uint64_t blockhash (const void *const data, const size_t num_bytes)
+{
+    const uint8_t *const bytes = data;
+    const size_t num_stripes = num_bytes / STRIPE_SIZE;
+    uint64_t acc[NUM_ACCUMULATORS] =
+    {
+        PRIME32_1, PRIME64_1, PRIME64_2, 0x165667B19E3779F9ULL,
+        0x85EBCA77C2B2AE63ULL, 0x27D4EB2F165667C5ULL, PRIME64_1 ^ PRIME64_2, PRIME32_1 ^ PRIME64_1
+    };
+    uint8_t last_stripe[STRIPE_SIZE];
+    size_t stripe;
+    size_t stripes_done;
+
+    if (accumulate == NULL)
+    {
+        accumulate = select_accumulate (&accumulate_name);
+    }
+
+    for (stripe = 0; stripe < num_stripes; stripe += stripes_done)
+    {
+        stripes_done = ((num_stripes - stripe) < STRIPES_PER_SCRAMBLE) ? (num_stripes - stripe) : STRIPES_PER_SCRAMBLE;
+        accumulate (acc, &bytes[stripe * STRIPE_SIZE], stripes_done);
+    }
+    if ((num_bytes % STRIPE_SIZE) != 0)
+    {
+        memset (last_stripe, 0, sizeof (last_stripe));
+        memcpy (last_stripe, &bytes[num_stripes * STRIPE_SIZE], num_bytes % STRIPE_SIZE);
+        accumulate (acc, last_stripe, 1);
+    }
+
+    return finalise (acc, num_bytes);
+}
+
+/**
+ * @brief Return the name of the implementation selected for the CPU
+ */
+const char *blockhash_implementation (void)
+{
+    if (accumulate == NULL)
+    {
+        accumulate = select_accumulate (&accumulate_name);
+    }
+
+    return accumulate_name;
+}
+
+/**
+ * @brief Hash an area of the device memory, streaming it by DMA into the DMA buffer
+ * @details The area is read in chunks of a whole number of blocks which fit in the DMA buffer.
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer of at least BLOCKHASH_BLOCK_SIZE
+ * @param[in] card_offset The offset in the device memory of the first block
+ * @param[in] num_bytes The number of bytes to hash, the last block may be partial
+ * @param[out] hashes The hash of each block
+ * @param[in] chunk_callback If not NULL, called with each chunk read before the next is read
+ * @param[in] arg Passed to chunk_callback
+ * @return Returns true if the whole area was hashed
+ */
+bool blockhash_device (nvram_uio_context *const context, const uint64_t card_offset, const uint64_t num_bytes,
+                       uint64_t *const hashes, blockhash_chunk_fn chunk_callback, void *const arg)
+{
+    const size_t chunk_size = (context->dma_buffer_size / BLOCKHASH_BLOCK_SIZE) * BLOCKHASH_BLOCK_SIZE;
+    uint64_t bytes_done;
+    size_t chunk_bytes;
+    size_t block_offset;
+    size_t block_bytes;
+
+    if ((context->dma_mapping == NULL) || (chunk_size == 0))
+    {
+        return false;
+    }
+
+    for (bytes_done = 0; bytes_done < num_bytes; bytes_done += chunk_bytes)
+    {
+        chunk_bytes = ((num_bytes - bytes_done) < chunk_size) ? (size_t) (num_bytes - bytes_done) : chunk_size;
+        if (!dma_transfer (context, DMA_WRITE_TO_HOST, card_offset + bytes_done, 0, chunk_bytes))
+        {
+            return false;
+        }
+        for (block_offset = 0; block_offset < chunk_bytes; block_offset += block_bytes)
+        {
+            block_bytes = ((chunk_bytes - block_offset) < BLOCKHASH_BLOCK_SIZE) ?
+                    (chunk_bytes - block_offset) : BLOCKHASH_BLOCK_SIZE;
+            hashes[(bytes_done + block_offset) / BLOCKHASH_BLOCK_SIZE] =
+                    blockhash (&context->dma_buffer[block_offset], block_bytes);
+        }
+        if ((chunk_callback != NULL) &&
+            !chunk_callback (arg, card_offset + bytes_done, context->dma_buffer, chunk_bytes))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Allocate a manifest for an image of the device memory
+ * @param[out] manifest The manifest to allocate
+ * @param[in] image_size The number of bytes of device memory in the image
+ * @return Returns true if the manifest was allocated
+ */
+bool blockhash_manifest_alloc (blockhash_manifest *const manifest, const uint64_t image_size)
+{
+    memset (manifest, 0, sizeof (*manifest));
+    manifest->header.magic = BLOCKHASH_MANIFEST_MAGIC;
+    manifest->header.version = BLOCKHASH_MANIFEST_VERSION;
+    manifest->header.block_size = BLOCKHASH_BLOCK_SIZE;
+    manifest->header.num_blocks = (image_size + (BLOCKHASH_BLOCK_SIZE - 1)) / BLOCKHASH_BLOCK_SIZE;
+    manifest->header.image_size = image_size;
+    manifest->hashes = calloc (manifest->header.num_blocks, sizeof (manifest->hashes[0]));
+
+    return manifest->hashes != NULL;
+}
+
+/**
+ * @brief Free the hashes of a manifest
+ */
+void blockhash_manifest_free (blockhash_manifest *const manifest)
+{
+    free (manifest->hashes);
+    manifest->hashes = NULL;
+}
+
+/**
+ * @brief Read a manifest file
+ * @param[out] manifest The manifest read, which is allocated
+ * @param[in] pathname The manifest file
+ * @return Returns true if a valid manifest was read
+ */
+bool blockhash_manifest_read (blockhash_manifest *const manifest, const char *const pathname)
+{
+    blockhash_manifest_header header;
+    FILE *manifest_file;
+    bool success;
+
+    memset (manifest, 0, sizeof (*manifest));
+    manifest_file = fopen (pathname, "rb");
+    if (manifest_file == NULL)
+    {
+        return false;
+    }
+    success = (fread (&header, sizeof (header), 1, manifest_file) == 1) &&
+            (header.magic == BLOCKHASH_MANIFEST_MAGIC) && (header.version == BLOCKHASH_MANIFEST_VERSION) &&
+            (header.block_size == BLOCKHASH_BLOCK_SIZE) &&
+            (header.num_blocks == ((header.image_size + (BLOCKHASH_BLOCK_SIZE - 1)) / BLOCKHASH_BLOCK_SIZE)) &&
+            blockhash_manifest_alloc (manifest, header.image_size) &&
+            (fread (manifest->hashes, sizeof (manifest->hashes[0]), header.num_blocks, manifest_file) ==
+             header.num_blocks);
+    fclose (manifest_file);
+    if (!success)
+    {
+        blockhash_manifest_free (manifest);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Write a manifest file
+ * @param[in] manifest The manifest to write
+ * @param[in] pathname The manifest file, which is replaced
+ * @return Returns true if the manifest was written
+ */
+bool blockhash_manifest_write (const blockhash_manifest *const manifest, const char *const pathname)
+{
+    FILE *manifest_file;
+    bool success;
+
+    manifest_file = fopen (pathname, "wb");
+    if (manifest_file == NULL)
+    {
+        return false;
+    }
+    success = (fwrite (&manifest->header, sizeof (manifest->header), 1, manifest_file) == 1) &&
+            (fwrite (manifest->hashes, sizeof (manifest->hashes[0]), manifest->header.num_blocks, manifest_file) ==
+             manifest->header.num_blocks);
+
+    return (fclose (manifest_file) == 0) && success;
+}
@@ -0,0 +1,65 @@
+/*
+ * @file nvram_uio_blockhash.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Hashing of the NVRAM device memory in fixed size blocks, to find the blocks which differ from an image
+ * @details
+ *   The block hash is modelled on the XXH3 long-input loop: eight 64-bit accumulators are updated from each 64 byte
+ *   stripe with a 32x32 bit multiply of the keyed input, and scrambled every 1 KB. It is not compatible with
+ *   XXH3. The scalar, SSE2 and AVX2 implementations give identical results, with the widest supported by the CPU
+ *   selected at runtime.
+ *
+ *   A manifest holds the hash of each block of a saved image of the device memory, so the device memory can be
+ *   compared against the image, or the image restored, by streaming the device memory by DMA to hash it and then
+ *   only transferring the blocks whose hashes differ.
+ */
+
+#ifndef NVRAM_UIO_BLOCKHASH_H_
+#define NVRAM_UIO_BLOCKHASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "nvram_uio_access.h"
+
+#define BLOCKHASH_BLOCK_SIZE (64 * 1024)
+
+#define BLOCKHASH_MANIFEST_MAGIC 0x4e414d4b4c42564eULL /* "NVBLKMAN" */
+#define BLOCKHASH_MANIFEST_VERSION 1
+
+/** The header of a manifest file, followed by the hash of each block */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t num_blocks;
+    /** The number of bytes of device memory covered */
+    uint64_t image_size;
+} blockhash_manifest_header;
+
+/** A manifest in host memory */
+typedef struct
+{
+    blockhash_manifest_header header;
+    uint64_t *hashes;
+} blockhash_manifest;
+
+/**
+ * Called with each chunk of the device memory read while hashing, with the chunk in the DMA buffer.
+ * Returns false to abort the hashing.
+ */
+typedef bool (*blockhash_chunk_fn) (void *const arg, const uint64_t card_offset, const void *const data,
+                                    const size_t num_bytes);
+
+uint64_t blockhash (const void *const data, const size_t num_bytes);
+const char *blockhash_implementation (void);
+bool blockhash_device (nvram_uio_context *const context, const uint64_t card_offset, const uint64_t num_bytes,
+                       uint64_t *const hashes, blockhash_chunk_fn chunk_callback, void *const arg);
+bool blockhash_manifest_alloc (blockhash_manifest *const manifest, const uint64_t image_size);
+void blockhash_manifest_free (blockhash_manifest *const manifest);
+bool blockhash_manifest_read (blockhash_manifest *const manifest, const char *const pathname);
+bool blockhash_manifest_write (const blockhash_manifest *const manifest, const char *const pathname);
+
+#endif /* NVRAM_UIO_BLOCKHASH_H_ */
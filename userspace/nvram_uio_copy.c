@@ -0,0 +1,338 @@
+/*
+ * @file nvram_uio_copy.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Runtime-dispatched copy kernels for DMA staging buffers and the write-combining memory window
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+#include "nvram_uio_copy.h"
+
+/* The number of times each kernel is timed for each size class, keeping the fastest */
+#define CALIBRATION_REPEATS 5
+
+/* The most copies timed in one repeat */
+#define CALIBRATION_COPIES 64
+
+/*
+ * The bytes copied in one repeat, bounding the number of copies of the larger size classes so that calibrating
+ * all the kernels takes milliseconds rather than copying gigabytes
+ */
+#define CALIBRATION_SAMPLE_BYTES (1024 * 1024)
+
+/** One candidate copy kernel */
+typedef struct
+{
+    const char *name;
+    copy_kernel_fn copy;
+    /** Returns true if the CPU supports the kernel */
+    bool (*supported) (void);
+} copy_kernel;
+
+/** The size timed for each size class */
+static const size_t calibration_sizes[COPY_NUM_SIZE_CLASSES] =
+{
+    [COPY_SIZE_UP_TO_256] = 256,
+    [COPY_SIZE_UP_TO_4K ] = 4096,
+    [COPY_SIZE_UP_TO_64K] = 65536,
+    [COPY_SIZE_LARGE    ] = 1024 * 1024
+};
+
+static const char *const destination_names[COPY_NUM_DESTINATIONS] =
+{
+    [COPY_DEST_DMA_STAGING] = "DMA staging",
+    [COPY_DEST_WC_WINDOW  ] = "WC window"
+};
+
+/**
+ * @brief Copy using the C library memcpy()
+ */
+static void copy_memcpy (void *dst, const void *src, size_t num_bytes)
+{
+    memcpy (dst, src, num_bytes);
+}
+
+/**
+ * @brief Copy using rep movsb, which is microcoded to use full line stores on CPUs with enhanced rep movsb
+ */
+static void copy_rep_movsb (void *dst, const void *src, size_t num_bytes)
+{
+    __asm__ __volatile__ ("rep movsb" : "+D" (dst), "+S" (src), "+c" (num_bytes) : : "memory");
+}
+
+/**
+ * @brief Copy the unaligned head of a destination, up to the next 64 byte boundary
+ * @return The number of bytes copied
+ */
+static inline size_t copy_head_to_line (uint8_t *const dst, const uint8_t *const src, const size_t num_bytes)
+{
+    size_t head_bytes = (64 - ((uintptr_t) dst & 63)) & 63;
+
+    if (head_bytes > num_bytes)
+    {
+        head_bytes = num_bytes;
+    }
+    memcpy (dst, src, head_bytes);
+
+    return head_bytes;
+}
+
+/**
+ * @brief Copy writing 64 byte aligned lines with four SSE2 non-temporal stores per line
+ */
+static void copy_nt_sse2 (void *dst, const void *src, size_t num_bytes)
+{
+    uint8_t *dst_bytes = dst;
+    const uint8_t *src_bytes = src;
+    size_t copied;
+    __m128i a, b, c, d;
+
+    copied = copy_head_to_line (dst_bytes, src_bytes, num_bytes);
+    dst_bytes += copied;
+    src_bytes += copied;
+    num_bytes -= copied;
+    while (num_bytes >= 64)
+    {
+        a = _mm_loadu_si128 ((const __m128i *) &src_bytes[0]);
+        b = _mm_loadu_si128 ((const __m128i *) &src_bytes[16]);
+        c = _mm_loadu_si128 ((const __m128i *) &src_bytes[32]);
+        d = _mm_loadu_si128 ((const __m128i *) &src_bytes[48]);
+        _mm_stream_si128 ((__m128i *) &dst_bytes[0], a);
+        _mm_stream_si128 ((__m128i *) &dst_bytes[16], b);
+        _mm_stream_si128 ((__m128i *) &dst_bytes[32], c);
+        _mm_stream_si128 ((__m128i *) &dst_bytes[48], d);
+        dst_bytes += 64;
+        src_bytes += 64;
+        num_bytes -= 64;
+    }
+    memcpy (dst_bytes, src_bytes, num_bytes);
+    _mm_sfence ();
+}
+
+/**
+ * @brief Copy writing 64 byte aligned lines with two AVX non-temporal stores per line
+ */
+__attribute__((target("avx")))
+static void copy_nt_avx (void *dst, const void *src, size_t num_bytes)
+{
+    uint8_t *dst_bytes = dst;
+    const uint8_t *src_bytes = src;
+    size_t copied;
+    __m256i a, b;
+
+    copied = copy_head_to_line (dst_bytes, src_bytes, num_bytes);
+    dst_bytes += copied;
+    src_bytes += copied;
+    num_bytes -= copied;
+    while (num_bytes >= 64)
+    {
+        a = _mm256_loadu_si256 ((const __m256i *) &src_bytes[0]);
+        b = _mm256_loadu_si256 ((const __m256i *) &src_bytes[32]);
+        _mm256_stream_si256 ((__m256i *) &dst_bytes[0], a);
+        _mm256_stream_si256 ((__m256i *) &dst_bytes[32], b);
+        dst_bytes += 64;
+        src_bytes += 64;
+        num_bytes -= 64;
+    }
+    memcpy (dst_bytes, src_bytes, num_bytes);
+    _mm_sfence ();
+}
+
+/**
+ * @brief Copy writing 64 byte aligned lines with one AVX-512 non-temporal store per line
+ */
+__attribute__((target("avx512f")))
+static void copy_nt_avx512 (void *dst, const void *src, size_t num_bytes)
+{
+    uint8_t *dst_bytes = dst;
+    const uint8_t *src_bytes = src;
+    size_t copied;
+
+    copied = copy_head_to_line (dst_bytes, src_bytes, num_bytes);
+    dst_bytes += copied;
+    src_bytes += copied;
+    num_bytes -= copied;
+    while (num_bytes >= 64)
+    {
+        _mm512_stream_si512 ((void *) dst_bytes, _mm512_loadu_si512 ((const void *) src_bytes));
+        dst_bytes += 64;
+        src_bytes += 64;
+        num_bytes -= 64;
+    }
+    memcpy (dst_bytes, src_bytes, num_bytes);
+    _mm_sfence ();
+}
+
+static bool always_supported (void)
+{
+    return true;
+}
+
+static bool avx_supported (void)
+{
+    return __builtin_cpu_supports ("avx");
+}
+
+static bool avx512_supported (void)
+{
+    return __builtin_cpu_supports ("avx512f");
+}
+
+static const copy_kernel copy_kernels[] =
+{
+    {"memcpy",        copy_memcpy,    always_supported},
+    {"rep movsb",     copy_rep_movsb, always_supported},
+    {"SSE2 NT lines", copy_nt_sse2,   always_supported},
+    {"AVX NT lines",  copy_nt_avx,    avx_supported},
+    {"AVX-512 NT",    copy_nt_avx512, avx512_supported}
+};
+#define NUM_COPY_KERNELS (sizeof (copy_kernels) / sizeof (copy_kernels[0]))
+
+copy_kernel_fn copy_dispatch[COPY_NUM_DESTINATIONS][COPY_NUM_SIZE_CLASSES] =
+{
+    [COPY_DEST_DMA_STAGING] = {copy_memcpy, copy_memcpy, copy_memcpy, copy_memcpy},
+    [COPY_DEST_WC_WINDOW  ] = {copy_memcpy, copy_memcpy, copy_memcpy, copy_memcpy}
+};
+
+/** The selected kernel and its measured throughput, for reporting */
+static const copy_kernel *selected_kernels[COPY_NUM_DESTINATIONS][COPY_NUM_SIZE_CLASSES];
+static double selected_throughput_gbps[COPY_NUM_DESTINATIONS][COPY_NUM_SIZE_CLASSES];
+static size_t selected_copy_size[COPY_NUM_DESTINATIONS][COPY_NUM_SIZE_CLASSES];
+
+/**
+ * @brief Return the current CLOCK_MONOTONIC time in nanoseconds
+ */
+static uint64_t calibration_time_ns (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Select the fastest copy kernel for each size class of one destination type, by timing copies into it
+ * @details The contents of dst_buffer are overwritten. Size classes whose calibration size doesn't fit in the
+ *          buffer are timed using the buffer size.
+ * @param[in] destination The destination type to select the kernels for
+ * @param[out] dst_buffer Destination memory of the type being calibrated
+ * @param[in] dst_buffer_size The size of dst_buffer
+ */
+void copy_calibrate (const copy_destination destination, void *const dst_buffer, const size_t dst_buffer_size)
+{
+    uint8_t *src_buffer;
+    uint8_t *const dst_bytes = dst_buffer;
+    unsigned int size_class;
+    unsigned int kernel_index;
+    unsigned int repeat;
+    unsigned int copy_index;
+    unsigned int num_copies;
+    size_t copy_size;
+    size_t num_slots;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+    uint64_t best_ns;
+    uint64_t selected_ns;
+
+    if (dst_buffer_size < 64)
+    {
+        return;
+    }
+    src_buffer = aligned_alloc (64, dst_buffer_size);
+    if (src_buffer == NULL)
+    {
+        return;
+    }
+    memset (src_buffer, 0xa5, dst_buffer_size);
+
+    for (size_class = 0; size_class < COPY_NUM_SIZE_CLASSES; size_class++)
+    {
+        copy_size = (calibration_sizes[size_class] < dst_buffer_size) ? calibration_sizes[size_class] : dst_buffer_size;
+        num_slots = dst_buffer_size / copy_size;
+        num_copies = (unsigned int) (CALIBRATION_SAMPLE_BYTES / copy_size);
+        if (num_copies == 0)
+        {
+            num_copies = 1;
+        }
+        else if (num_copies > CALIBRATION_COPIES)
+        {
+            num_copies = CALIBRATION_COPIES;
+        }
+        selected_ns = UINT64_MAX;
+
+        for (kernel_index = 0; kernel_index < NUM_COPY_KERNELS; kernel_index++)
+        {
+            const copy_kernel *const kernel = &copy_kernels[kernel_index];
+
+            if (!kernel->supported ())
+            {
+                continue;
+            }
+
+            best_ns = UINT64_MAX;
+            for (repeat = 0; repeat < CALIBRATION_REPEATS; repeat++)
+            {
+                start_ns = calibration_time_ns ();
+                for (copy_index = 0; copy_index < num_copies; copy_index++)
+                {
+                    kernel->copy (&dst_bytes[(copy_index % num_slots) * copy_size],
+                                  &src_buffer[(copy_index % num_slots) * copy_size], copy_size);
+                }
+                /* Include draining the write-combining buffers in the time for all kernels */
+                _mm_sfence ();
+                elapsed_ns = calibration_time_ns () - start_ns;
+                if (elapsed_ns < best_ns)
+                {
+                    best_ns = elapsed_ns;
+                }
+            }
+
+            if (best_ns < selected_ns)
+            {
+                selected_ns = best_ns;
+                copy_dispatch[destination][size_class] = kernel->copy;
+                selected_kernels[destination][size_class] = kernel;
+                selected_copy_size[destination][size_class] = copy_size;
+                selected_throughput_gbps[destination][size_class] =
+                        ((double) copy_size * num_copies) / (double) ((best_ns > 0) ? best_ns : 1);
+            }
+        }
+    }
+
+    free (src_buffer);
+}
+
+/**
+ * @brief Display the copy kernels selected by calibration
+ */
+void copy_print_selection (void)
+{
+    unsigned int destination;
+    unsigned int size_class;
+
+    for (destination = 0; destination < COPY_NUM_DESTINATIONS; destination++)
+    {
+        for (size_class = 0; size_class < COPY_NUM_SIZE_CLASSES; size_class++)
+        {
+            if (selected_kernels[destination][size_class] != NULL)
+            {
+                printf ("%-12s %8zu bytes: %-14s %6.2f GB/s\n", destination_names[destination],
+                        selected_copy_size[destination][size_class], selected_kernels[destination][size_class]->name,
+                        selected_throughput_gbps[destination][size_class]);
+            }
+            else
+            {
+                printf ("%-12s %8zu bytes: %-14s (not calibrated)\n", destination_names[destination],
+                        calibration_sizes[size_class], "memcpy");
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * @file nvram_uio_copy.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Runtime-dispatched copy kernels for DMA staging buffers and the write-combining memory window
+ * @details
+ *   The best instruction sequence for a copy depends upon the type of destination memory and the copy size:
+ *   - A DMA staging buffer is cached host memory which is next read by the device, so non-temporal stores avoid
+ *     both the read-for-ownership and leaving lines in the cache which the device read then has to snoop.
+ *   - The memory window is write-combining, where a partial line is sent as multiple small PCIe writes, so
+ *     writing whole 64 byte lines with a single store per line is the largest win.
+ *
+ *   copy_calibrate() times each kernel supported by the CPU for each size class on the actual destination memory,
+ *   and selects the fastest into a dispatch table. Until calibrated the dispatch table uses memcpy().
+ */
+
+#ifndef NVRAM_UIO_COPY_H_
+#define NVRAM_UIO_COPY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** The types of destination memory which copy kernels are selected for */
+typedef enum
+{
+    COPY_DEST_DMA_STAGING,
+    COPY_DEST_WC_WINDOW,
+    COPY_NUM_DESTINATIONS
+} copy_destination;
+
+/** The size classes which copy kernels are selected for, by the upper bound on the copy size */
+typedef enum
+{
+    COPY_SIZE_UP_TO_256,
+    COPY_SIZE_UP_TO_4K,
+    COPY_SIZE_UP_TO_64K,
+    COPY_SIZE_LARGE,
+    COPY_NUM_SIZE_CLASSES
+} copy_size_class;
+
+typedef void (*copy_kernel_fn) (void *dst, const void *src, size_t num_bytes);
+
+/** The selected kernel for each destination type and size class */
+extern copy_kernel_fn copy_dispatch[COPY_NUM_DESTINATIONS][COPY_NUM_SIZE_CLASSES];
+
+void copy_calibrate (const copy_destination destination, void *const dst_buffer, const size_t dst_buffer_size);
+void copy_print_selection (void);
+
+/**
+ * @brief Return the size class for a copy size
+ */
+static inline copy_size_class copy_size_class_for (const size_t num_bytes)
+{
+    if (num_bytes <= 256)
+    {
+        return COPY_SIZE_UP_TO_256;
+    }
+    else if (num_bytes <= 4096)
+    {
+        return COPY_SIZE_UP_TO_4K;
+    }
+    else if (num_bytes <= 65536)
+    {
+        return COPY_SIZE_UP_TO_64K;
+    }
+    else
+    {
+        return COPY_SIZE_LARGE;
+    }
+}
+
+/**
+ * @brief Copy to a destination using the selected kernel
+ * @details Kernels which use non-temporal stores end with a sfence, so the stores are ordered before any
+ *          following stores such as a DMA doorbell.
+ * @param[in] destination The type of the destination memory
+ * @param[out] dst Where to copy to
+ * @param[in] src Where to copy from
+ * @param[in] num_bytes The number of bytes to copy
+ */
+static inline void copy_to_destination (const copy_destination destination, void *const dst,
+                                        const void *const src, const size_t num_bytes)
+{
+    copy_dispatch[destination][copy_size_class_for (num_bytes)] (dst, src, num_bytes);
+}
+
+#endif /* NVRAM_UIO_COPY_H_ */
@@ -0,0 +1,349 @@
+/*
+ * @file nvram_uio_csrsample.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Sample the DMA engine registers at a high rate with TSC timestamps, into a compressed file
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <endian.h>
+#include <immintrin.h>
+#include <x86intrin.h>
+
+#include "nvram_uio_csrsample.h"
+
+/* The file listing the CPUs isolated from the scheduler */
+#define ISOLATED_CPUS_PATHNAME "/sys/devices/system/cpu/isolated"
+
+/**
+ * @brief Write the encoded records to the file
+ */
+static void write_block (csrsample_sampler *const sampler)
+{
+    if ((sampler->block_used > 0) && !sampler->write_failed)
+    {
+        sampler->write_failed = fwrite (sampler->block, 1, sampler->block_used, sampler->file) != sampler->block_used;
+    }
+    sampler->block_used = 0;
+}
+
+/**
+ * @brief Make room in the block for one record of at most four varints and the type byte
+ */
+static inline uint8_t *reserve_record (csrsample_sampler *const sampler)
+{
+    if ((sampler->block_used + 1 + (4 * CSRSAMPLE_MAX_VARINT_BYTES)) > CSRSAMPLE_BLOCK_SIZE)
+    {
+        write_block (sampler);
+    }
+
+    return &sampler->block[sampler->block_used];
+}
+
+/**
+ * @brief Write the record for the run of unchanged samples since the last record, if any
+ */
+static void encode_repeat (csrsample_sampler *const sampler)
+{
+    uint8_t *record;
+    size_t num_bytes = 1;
+
+    if (sampler->repeat_count > 0)
+    {
+        record = reserve_record (sampler);
+        record[0] = CSRSAMPLE_RECORD_REPEAT;
+        num_bytes += csrsample_encode_varint (&record[num_bytes], sampler->repeat_count);
+        num_bytes += csrsample_encode_varint (&record[num_bytes], sampler->repeat_last_tsc - sampler->previous_tsc);
+        sampler->block_used += num_bytes;
+        sampler->previous_tsc = sampler->repeat_last_tsc;
+        sampler->repeat_count = 0;
+    }
+}
+
+/**
+ * @brief Add one sample, which extends the run of unchanged samples or is written as a sample record
+ */
+static inline void encode_sample (csrsample_sampler *const sampler, const uint64_t tsc, const uint32_t status,
+                                  const uint8_t errcnt, const uint32_t semaphore)
+{
+    uint8_t changed = 0;
+    uint8_t *record;
+    size_t num_bytes = 1;
+
+    changed |= (status != sampler->previous_status) ? CSRSAMPLE_FIELD_STATUS : 0;
+    changed |= (errcnt != sampler->previous_errcnt) ? CSRSAMPLE_FIELD_ERRCNT : 0;
+    changed |= (semaphore != sampler->previous_semaphore) ? CSRSAMPLE_FIELD_SEMAPHORE : 0;
+    if ((changed == 0) && (sampler->header.num_samples > 0))
+    {
+        sampler->repeat_count++;
+        sampler->repeat_last_tsc = tsc;
+        sampler->header.num_samples++;
+        return;
+    }
+
+    encode_repeat (sampler);
+    record = reserve_record (sampler);
+    record[0] = CSRSAMPLE_RECORD_SAMPLE | changed;
+    num_bytes += csrsample_encode_varint (&record[num_bytes], tsc - sampler->previous_tsc);
+    if ((changed & CSRSAMPLE_FIELD_STATUS) != 0)
+    {
+        num_bytes += csrsample_encode_varint (&record[num_bytes], status ^ sampler->previous_status);
+    }
+    if ((changed & CSRSAMPLE_FIELD_ERRCNT) != 0)
+    {
+        num_bytes += csrsample_encode_varint (&record[num_bytes], errcnt ^ sampler->previous_errcnt);
+    }
+    if ((changed & CSRSAMPLE_FIELD_SEMAPHORE) != 0)
+    {
+        num_bytes += csrsample_encode_varint (&record[num_bytes], semaphore ^ sampler->previous_semaphore);
+    }
+    sampler->block_used += num_bytes;
+    sampler->previous_tsc = tsc;
+    sampler->previous_status = status;
+    sampler->previous_errcnt = errcnt;
+    sampler->previous_semaphore = semaphore;
+    sampler->header.num_samples++;
+}
+
+/**
+ * @brief Write records for the request events waiting in the ring
+ * @details The requests have absolute timestamps, so they don't break the deltas between samples.
+ */
+static void encode_requests (csrsample_sampler *const sampler)
+{
+    const uint64_t head = __atomic_load_n (&sampler->requests_head, __ATOMIC_ACQUIRE);
+    const csrsample_request_event *event;
+    uint8_t *record;
+    size_t num_bytes;
+
+    while (sampler->requests_tail != head)
+    {
+        event = &sampler->requests[sampler->requests_tail % CSRSAMPLE_REQUEST_RING_SIZE];
+        record = reserve_record (sampler);
+        record[0] = CSRSAMPLE_RECORD_REQUEST | (event->end ? CSRSAMPLE_REQUEST_END : 0);
+        num_bytes = 1;
+        num_bytes += csrsample_encode_varint (&record[num_bytes], event->tsc - sampler->header.start_tsc);
+        num_bytes += csrsample_encode_varint (&record[num_bytes], event->request_id);
+        sampler->block_used += num_bytes;
+        sampler->header.num_requests++;
+        sampler->requests_tail++;
+    }
+    __atomic_store_n (&sampler->requests_tail, sampler->requests_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief The sampler thread, which busy-polls until asked to stop
+ * @details When the sampling falls behind the interval, e.g. while a block is written, the next sample is taken
+ *          at once and the interval restarted from it, rather than taking a burst of samples to catch up.
+ */
+static void *sampler_thread (void *const arg)
+{
+    csrsample_sampler *const sampler = arg;
+    uint64_t next_tsc = __rdtsc ();
+    uint64_t tsc;
+    uint32_t semaphore;
+
+    while (!sampler->stop)
+    {
+        if (sampler->interval_tsc > 0)
+        {
+            while (__rdtsc () < next_tsc)
+            {
+                _mm_pause ();
+            }
+        }
+        tsc = __rdtsc ();
+        semaphore = (sampler->semaphore != NULL) ? (uint32_t) le64toh (*sampler->semaphore) : 0;
+        encode_sample (sampler, tsc, le32toh (*sampler->status_ctrl), *sampler->errcnt, semaphore);
+        if (sampler->requests_tail != __atomic_load_n (&sampler->requests_head, __ATOMIC_RELAXED))
+        {
+            encode_requests (sampler);
+        }
+
+        next_tsc += sampler->interval_tsc;
+        if ((tsc - next_tsc) < (UINT64_MAX / 2))
+        {
+            next_tsc = tsc + sampler->interval_tsc;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Determine if a CPU is isolated from the scheduler, so a sampler on it doesn't compete with the workload
+ * @param[in] cpu The CPU to check
+ * @return Returns true if the CPU is in the kernel's list of isolated CPUs
+ */
+bool csrsample_cpu_isolated (const int cpu)
+{
+    FILE *isolated_file;
+    char cpu_list[1024];
+    char *range;
+    char *saveptr;
+    int first_cpu;
+    int last_cpu;
+    bool isolated = false;
+
+    isolated_file = fopen (ISOLATED_CPUS_PATHNAME, "r");
+    if (isolated_file == NULL)
+    {
+        return false;
+    }
+    if (fgets (cpu_list, sizeof (cpu_list), isolated_file) != NULL)
+    {
+        for (range = strtok_r (cpu_list, ",\n", &saveptr); (range != NULL) && !isolated;
+             range = strtok_r (NULL, ",\n", &saveptr))
+        {
+            if (sscanf (range, "%d-%d", &first_cpu, &last_cpu) != 2)
+            {
+                last_cpu = first_cpu = atoi (range);
+            }
+            isolated = (cpu >= first_cpu) && (cpu <= last_cpu);
+        }
+    }
+    fclose (isolated_file);
+
+    return isolated;
+}
+
+/**
+ * @brief Start sampling the registers of a device into a file
+ * @param[out] sampler The sampler to start
+ * @param[in,out] context The open device to sample
+ * @param[in] pathname The file to create
+ * @param[in] cpu The CPU to run the sampler thread on, which should be isolated from the workload
+ * @param[in] interval_ns The interval between samples, or zero to sample as fast as possible
+ * @param[in] semaphore_index Which of the DMA descriptors of the context to sample the semaphore word of, or
+ *                            UINT32_MAX for none. Must be less than the max_dma_chain_length of the context.
+ * @return Returns true if the sampler thread was started. Fails if the device name doesn't fit in the file header.
+ */
+bool csrsample_start (csrsample_sampler *const sampler, nvram_uio_context *const context, const char *const pathname,
+                      const int cpu, const uint64_t interval_ns, const uint32_t semaphore_index)
+{
+    struct timespec now;
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    int rc;
+
+    memset (sampler, 0, sizeof (*sampler));
+    if (snprintf (sampler->header.device_name, sizeof (sampler->header.device_name), "%s", context->device_name) >=
+        (int) sizeof (sampler->header.device_name))
+    {
+        return false;
+    }
+    sampler->context = context;
+    sampler->status_ctrl = (const volatile uint32_t *) &context->csr[DMA_STATUS_CTRL];
+    sampler->errcnt = context->memctrlcmd_errcnt;
+    if ((semaphore_index != UINT32_MAX) && (context->dma_descs != NULL) &&
+        (semaphore_index < context->max_dma_chain_length))
+    {
+        sampler->semaphore = (const volatile uint64_t *) &context->dma_descs[semaphore_index].sem_control_bits;
+    }
+
+    sampler->block = malloc (CSRSAMPLE_BLOCK_SIZE);
+    sampler->file = fopen (pathname, "wb");
+    if ((sampler->block == NULL) || (sampler->file == NULL))
+    {
+        free (sampler->block);
+        if (sampler->file != NULL)
+        {
+            fclose (sampler->file);
+        }
+        return false;
+    }
+
+    sampler->header.magic = CSRSAMPLE_MAGIC;
+    sampler->header.version = CSRSAMPLE_VERSION;
+    sampler->header.cpu = (uint32_t) cpu;
+    sampler->header.tsc_hz = measure_tsc_hz ();
+    sampler->header.interval_ns = interval_ns;
+    sampler->header.semaphore_index = (sampler->semaphore != NULL) ? semaphore_index : UINT32_MAX;
+    clock_gettime (CLOCK_REALTIME, &now);
+    sampler->header.start_monotonic_ns = get_monotonic_time_ns ();
+    sampler->header.start_tsc = __rdtsc ();
+    sampler->header.start_realtime_ns = ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+    sampler->previous_tsc = sampler->header.start_tsc;
+    sampler->interval_tsc = (interval_ns * sampler->header.tsc_hz) / 1000000000ULL;
+
+    /* The header is rewritten with the totals on stopping */
+    if (fwrite (&sampler->header, sizeof (sampler->header), 1, sampler->file) != 1)
+    {
+        fclose (sampler->file);
+        free (sampler->block);
+        return false;
+    }
+
+    CPU_ZERO (&cpus);
+    CPU_SET (cpu, &cpus);
+    pthread_attr_init (&attr);
+    pthread_attr_setaffinity_np (&attr, sizeof (cpus), &cpus);
+    rc = pthread_create (&sampler->thread, &attr, sampler_thread, sampler);
+    pthread_attr_destroy (&attr);
+    if (rc != 0)
+    {
+        fclose (sampler->file);
+        free (sampler->block);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Record the start or end of a request, to be shown on the timeline of the samples
+ * @details Must only be called from one thread at a time. The event is dropped if the sampler has fallen behind.
+ * @param[in,out] sampler The running sampler
+ * @param[in] request_id Identifies the request
+ * @param[in] end True for the end of the request, or false for the start
+ */
+void csrsample_request (csrsample_sampler *const sampler, const uint32_t request_id, const bool end)
+{
+    const uint64_t head = sampler->requests_head;
+    csrsample_request_event *event;
+
+    if ((head - __atomic_load_n (&sampler->requests_tail, __ATOMIC_ACQUIRE)) >= CSRSAMPLE_REQUEST_RING_SIZE)
+    {
+        __atomic_add_fetch (&sampler->header.requests_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    event = &sampler->requests[head % CSRSAMPLE_REQUEST_RING_SIZE];
+    event->tsc = __rdtsc ();
+    event->request_id = request_id;
+    event->end = end;
+    __atomic_store_n (&sampler->requests_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Stop the sampler thread, and complete the file
+ * @param[in,out] sampler The running sampler
+ * @return Returns true if all the records and the header were written
+ */
+bool csrsample_stop (csrsample_sampler *const sampler)
+{
+    bool success;
+
+    sampler->stop = true;
+    pthread_join (sampler->thread, NULL);
+    encode_requests (sampler);
+    encode_repeat (sampler);
+    write_block (sampler);
+
+    sampler->header.end_tsc = __rdtsc ();
+    success = !sampler->write_failed && (fseek (sampler->file, 0, SEEK_SET) == 0) &&
+            (fwrite (&sampler->header, sizeof (sampler->header), 1, sampler->file) == 1);
+    success = (fclose (sampler->file) == 0) && success;
+    free (sampler->block);
+    sampler->block = NULL;
+
+    return success;
+}
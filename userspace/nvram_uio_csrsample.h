@@ -0,0 +1,169 @@
+/*
+ * @file nvram_uio_csrsample.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Sample the DMA engine registers at a high rate with TSC timestamps, into a compressed file
+ * @details
+ *   A sampler thread pinned to one CPU, which should be isolated from the scheduler, busy-polls the DMA_STATUS_CTRL
+ *   and MEMCTRLCMD_ERRCNT registers and the semaphore word of one of the DMA descriptors of the context. The
+ *   semaphore is in the DMA mapping of the calling process, so the sampler runs in the process doing the DMA.
+ *
+ *   The file is a csrsample_header followed by a stream of records:
+ *   - A sample, written when any of the sampled values differ from the previous sample. The first byte holds the
+ *     record type and a mask of the changed fields, followed by the varint TSC delta from the previous sample and
+ *     then for each changed field the varint of the XOR of its new and previous values.
+ *   - A repeat, for a run of samples with the values unchanged. Holds the varint number of samples in the run and
+ *     the varint TSC delta from the previous sample to the last sample of the run.
+ *   - A request, recorded by the application with csrsample_request() at the start or end of a request. Holds the
+ *     varint TSC since the start of the file and the varint request identity.
+ *   As the registers hold the same values for most samples, each sample costs about a bit in the file.
+ */
+
+#ifndef NVRAM_UIO_CSRSAMPLE_H_
+#define NVRAM_UIO_CSRSAMPLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+
+#define CSRSAMPLE_MAGIC 0x504d53525343564eULL /* "NVCSRSMP" */
+#define CSRSAMPLE_VERSION 1
+
+/* The record types, in the low bits of the first byte of each record */
+#define CSRSAMPLE_RECORD_SAMPLE 0
+#define CSRSAMPLE_RECORD_REPEAT 1
+#define CSRSAMPLE_RECORD_REQUEST 2
+#define CSRSAMPLE_RECORD_TYPE_MASK 0x03
+
+/* In the first byte of a sample record, the fields which have changed */
+#define CSRSAMPLE_FIELD_STATUS 0x04
+#define CSRSAMPLE_FIELD_ERRCNT 0x08
+#define CSRSAMPLE_FIELD_SEMAPHORE 0x10
+
+/* In the first byte of a request record, set for the end of a request */
+#define CSRSAMPLE_REQUEST_END 0x04
+
+/* The size of the blocks the records are encoded into before being written to the file */
+#define CSRSAMPLE_BLOCK_SIZE (1024 * 1024)
+
+/* The most request events which can be waiting for the sampler thread */
+#define CSRSAMPLE_REQUEST_RING_SIZE 4096
+
+/* The most bytes in an encoded varint */
+#define CSRSAMPLE_MAX_VARINT_BYTES 10
+
+/** The header at the start of the file, rewritten with the totals when the sampler stops */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    /** The CPU the sampler thread ran on */
+    uint32_t cpu;
+    /** The measured TSC frequency, and the TSC and clocks when sampling started, to relate the TSC to other logs */
+    uint64_t tsc_hz;
+    uint64_t start_tsc;
+    uint64_t start_realtime_ns;
+    uint64_t start_monotonic_ns;
+    /** The requested interval between samples, or zero to sample as fast as possible */
+    uint64_t interval_ns;
+    uint64_t end_tsc;
+    uint64_t num_samples;
+    uint64_t num_requests;
+    /** Request events dropped as the ring to the sampler thread was full */
+    uint64_t requests_dropped;
+    /** The DMA descriptor whose semaphore word was sampled, or UINT32_MAX if none */
+    uint32_t semaphore_index;
+    uint32_t reserved;
+    char device_name[64];
+} csrsample_header;
+
+/** A request event waiting for the sampler thread */
+typedef struct
+{
+    uint64_t tsc;
+    uint32_t request_id;
+    bool end;
+} csrsample_request_event;
+
+/** A sampler, which is running between csrsample_start() and csrsample_stop() */
+typedef struct
+{
+    nvram_uio_context *context;
+    FILE *file;
+    csrsample_header header;
+    pthread_t thread;
+    uint64_t interval_tsc;
+    volatile bool stop;
+    /** The registers and semaphore word sampled, where semaphore is NULL if the DMA buffer isn't mapped */
+    const volatile uint32_t *status_ctrl;
+    const volatile uint8_t *errcnt;
+    const volatile uint64_t *semaphore;
+    /** The previous sample, and the run of unchanged samples since the last record */
+    uint64_t previous_tsc;
+    uint32_t previous_status;
+    uint8_t previous_errcnt;
+    uint32_t previous_semaphore;
+    uint64_t repeat_count;
+    uint64_t repeat_last_tsc;
+    /** The block the records are encoded into */
+    uint8_t *block;
+    size_t block_used;
+    bool write_failed;
+    /** Request events, produced by one application thread and consumed by the sampler thread */
+    csrsample_request_event requests[CSRSAMPLE_REQUEST_RING_SIZE];
+    uint64_t requests_head;
+    uint64_t requests_tail;
+} csrsample_sampler;
+
+/**
+ * @brief Encode an unsigned value as a varint of 7 bits per byte, least significant first
+ * @return The number of bytes encoded
+ */
+static inline size_t csrsample_encode_varint (uint8_t *const buffer, uint64_t value)
+{
+    size_t num_bytes = 0;
+
+    while (value >= 0x80)
+    {
+        buffer[num_bytes++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buffer[num_bytes++] = (uint8_t) value;
+
+    return num_bytes;
+}
+
+/**
+ * @brief Decode a varint encoded by csrsample_encode_varint()
+ * @return The number of bytes decoded, or zero if the varint isn't complete within the buffer
+ */
+static inline size_t csrsample_decode_varint (const uint8_t *const buffer, const size_t buffer_size,
+                                              uint64_t *const value)
+{
+    size_t num_bytes = 0;
+    unsigned int shift = 0;
+
+    *value = 0;
+    while ((num_bytes < buffer_size) && (num_bytes < CSRSAMPLE_MAX_VARINT_BYTES))
+    {
+        *value |= (uint64_t) (buffer[num_bytes] & 0x7f) << shift;
+        shift += 7;
+        if ((buffer[num_bytes++] & 0x80) == 0)
+        {
+            return num_bytes;
+        }
+    }
+
+    return 0;
+}
+
+bool csrsample_start (csrsample_sampler *const sampler, nvram_uio_context *const context, const char *const pathname,
+                      const int cpu, const uint64_t interval_ns, const uint32_t semaphore_index);
+bool csrsample_stop (csrsample_sampler *const sampler);
+void csrsample_request (csrsample_sampler *const sampler, const uint32_t request_id, const bool end);
+bool csrsample_cpu_isolated (const int cpu);
+
+#endif /* NVRAM_UIO_CSRSAMPLE_H_ */
@@ -0,0 +1,337 @@
+/*
+ * @file nvram_uio_dma.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief DMA transfers between the per-file DMA buffer and the NVRAM device memory
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <endian.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "nvram_uio_dma.h"
+#include "nvram_uio_probes.h"
+#include "nvram_uio_heatmap.h"
+#include "nvram_uio_copy.h"
+
+/* The number of semaphore polls between checks of the DMA status register for errors */
+#define DMA_STATUS_POLL_INTERVAL 1024
+
+/* Set once the copy kernels for DMA staging have been calibrated by this process */
+static bool dma_staging_calibrated;
+
+/**
+ * @brief Map the DMA buffer for the open device file, which causes the driver to allocate it
+ * @details The first mapping in the process is used to select the copy kernels for staging data into DMA buffers.
+ * @param[in,out] context The open NVRAM UIO device to map the DMA buffer for
+ */
+void map_dma_buffer (nvram_uio_context *const context)
+{
+    const size_t page_size = (size_t) getpagesize ();
+    char *mapping;
+
+    context->dma_mapping_size = read_uio_mapping_param (context->device_name, DMA_MAPPING_INDEX, "size");
+    mapping = mmap (NULL, context->dma_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, context->device_fd,
+                    DMA_MAPPING_INDEX * page_size);
+    if (mapping == MAP_FAILED)
+    {
+        printf ("Failed to map DMA buffer for %s\n", context->device_name);
+        perror (NULL);
+        exit (EXIT_FAILURE);
+    }
+
+    context->dma_mapping = mapping;
+    context->dma_info = (const volatile struct nvram_uio_dma_info *) mapping;
+    context->dma_descs = (struct mm_dma_desc *) &mapping[NVRAM_UIO_DMA_DESC_OFFSET];
+    context->dma_descs_bus_addr = context->dma_info->info_bus_addr + NVRAM_UIO_DMA_DESC_OFFSET;
+    context->max_dma_chain_length = (unsigned int) ((page_size - NVRAM_UIO_DMA_DESC_OFFSET) / sizeof (struct mm_dma_desc));
+    context->dma_buffer = (uint8_t *) &mapping[page_size];
+    context->dma_buffer_bus_addr = context->dma_info->buffer_bus_addr;
+    context->dma_buffer_size = context->dma_info->buffer_size;
+
+    if (!dma_staging_calibrated)
+    {
+        copy_calibrate (COPY_DEST_DMA_STAGING, context->dma_buffer, context->dma_buffer_size);
+        dma_staging_calibrated = true;
+    }
+
+    if (context->stats != NULL)
+    {
+        __atomic_store_n (&context->stats->completion_mode, NVRAM_UIO_COMPLETION_POLLED, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Unmap the DMA buffer, if mapped
+ * @param[in,out] context The open NVRAM UIO device to unmap the DMA buffer for
+ */
+void unmap_dma_buffer (nvram_uio_context *const context)
+{
+    if (context->dma_mapping != NULL)
+    {
+        munmap (context->dma_mapping, context->dma_mapping_size);
+        context->dma_mapping = NULL;
+        context->dma_info = NULL;
+        context->dma_descs = NULL;
+        context->dma_buffer = NULL;
+    }
+}
+
+/**
+ * @brief Perform one attempt at a chain of DMA transfers in one direction, waiting for the chain to complete
+ */
+static bool perform_dma_chain (nvram_uio_context *const context, const uint32_t direction,
+                               const dma_chain_element *const elements, const unsigned int num_elements)
+{
+    const uint32_t control_bits = DMASCR_GO | DMASCR_CHAIN_EN | DMASCR_SEM_EN | DMASCR_READMULTI |
+            ((direction == DMA_READ_FROM_HOST) ? DMASCR_TRANSFER_READ : 0);
+    volatile uint32_t *const dma_status_ctrl = (volatile uint32_t *) &context->csr[DMA_STATUS_CTRL];
+    volatile uint32_t *const dma_descriptor_addr = (volatile uint32_t *) &context->csr[DMA_DESCRIPTOR_ADDR];
+    volatile uint8_t *const dma_status_ctrl_complete = (volatile uint8_t *) &context->csr[DMA_STATUS_CTRL + 2];
+    const volatile uint64_t *semaphore;
+    struct mm_dma_desc *desc;
+    unsigned int element_index;
+    uint64_t total_bytes = 0;
+    uint64_t start_ns;
+    uint64_t latency_ns;
+    uint32_t dma_status = 0;
+    uint32_t poll_count = 0;
+    bool complete = false;
+    bool success = true;
+
+    if ((context->dma_mapping == NULL) || (num_elements == 0) || (num_elements > context->max_dma_chain_length))
+    {
+        return false;
+    }
+    for (element_index = 0; element_index < num_elements; element_index++)
+    {
+        const dma_chain_element *const element = &elements[element_index];
+
+        if (((element->buffer_offset + element->num_bytes) > context->dma_buffer_size) ||
+            ((context->memory_size_bytes != 0) &&
+             ((element->card_offset + element->num_bytes) > context->memory_size_bytes)))
+        {
+            return false;
+        }
+        total_bytes += element->num_bytes;
+    }
+
+    start_ns = get_monotonic_time_ns ();
+    NVRAM_UIO_PROBE3 (dma_submit, elements[0].card_offset, total_bytes, direction);
+    adjust_client_in_flight (context->stats, (int32_t) num_elements);
+
+    lock_device (context);
+
+    for (element_index = 0; element_index < num_elements; element_index++)
+    {
+        desc = &context->dma_descs[element_index];
+        desc->pci_addr = htole64 (context->dma_buffer_bus_addr + elements[element_index].buffer_offset);
+        desc->local_addr = htole64 (elements[element_index].card_offset);
+        desc->transfer_size = htole32 ((uint32_t) elements[element_index].num_bytes);
+        desc->zero1 = 0;
+        desc->next_desc_addr = htole64 (context->dma_descs_bus_addr + ((element_index + 1) * sizeof (struct mm_dma_desc)));
+        desc->sem_addr = htole64 (context->dma_descs_bus_addr + (element_index * sizeof (struct mm_dma_desc)) +
+                                  offsetof (struct mm_dma_desc, sem_control_bits));
+        desc->control_bits = htole32 (control_bits);
+        desc->zero2 = 0;
+        desc->sem_control_bits = 0;
+    }
+
+    /* Make the last descriptor end the chain */
+    desc = &context->dma_descs[num_elements - 1];
+    desc->control_bits &= ~htole32 (DMASCR_CHAIN_EN);
+    desc->next_desc_addr = 0;
+    semaphore = (const volatile uint64_t *) &desc->sem_control_bits;
+
+    /* The descriptors must be visible to the device before it is started */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    dma_descriptor_addr[0] = htole32 ((uint32_t) context->dma_descs_bus_addr);
+    dma_descriptor_addr[1] = htole32 ((uint32_t) (context->dma_descs_bus_addr >> 32));
+    NVRAM_UIO_PROBE3 (dma_doorbell, elements[0].card_offset, total_bytes, direction);
+    *dma_status_ctrl = htole32 (DMASCR_GO | DMASCR_CHAIN_EN | DMASCR_READMULTI);
+
+    while (!complete)
+    {
+        if ((le64toh (*semaphore) & DMASCR_DMA_COMPLETE) != 0)
+        {
+            complete = true;
+        }
+        else if ((++poll_count % DMA_STATUS_POLL_INTERVAL) == 0)
+        {
+            dma_status = le32toh (*dma_status_ctrl);
+            if ((dma_status & DMASCR_ERROR_MASK) != 0)
+            {
+                success = false;
+                complete = true;
+            }
+            else if ((get_monotonic_time_ns () - start_ns) > DMA_COMPLETION_TIMEOUT_NS)
+            {
+                success = false;
+                complete = true;
+            }
+        }
+    }
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+    if (success)
+    {
+        *dma_status_ctrl_complete = (DMASCR_DMA_COMPLETE | DMASCR_CHAIN_COMPLETE) >> 16;
+    }
+    else
+    {
+        /* Stop the engine and clear the error status, so the next chain can start */
+        *dma_status_ctrl = htole32 (dma_status & DMASCR_ERROR_MASK);
+    }
+
+    unlock_device (context);
+
+    latency_ns = get_monotonic_time_ns () - start_ns;
+    adjust_client_in_flight (context->stats, -(int32_t) num_elements);
+    if (success)
+    {
+        NVRAM_UIO_PROBE4 (dma_complete, elements[0].card_offset, total_bytes, direction, latency_ns);
+    }
+    else
+    {
+        NVRAM_UIO_PROBE3 (dma_error, elements[0].card_offset, total_bytes, dma_status);
+    }
+    for (element_index = 0; element_index < num_elements; element_index++)
+    {
+        record_client_operation (context->stats,
+                                 (direction == DMA_WRITE_TO_HOST) ? NVRAM_UIO_STATS_READ : NVRAM_UIO_STATS_WRITE,
+                                 elements[element_index].num_bytes, latency_ns, !success);
+        heatmap_sample_access (context->heatmap_sampled, elements[element_index].card_offset,
+                               elements[element_index].num_bytes,
+                               (direction == DMA_WRITE_TO_HOST) ? HEATMAP_READ : HEATMAP_WRITE);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Perform a chain of DMA transfers in one direction, waiting for the chain to complete
+ * @details If the chain fails due to a PCI error, waits for the driver to recover the device and retries once.
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] direction Either DMA_READ_FROM_HOST to write the device memory, or DMA_WRITE_TO_HOST to read it
+ * @param[in] elements The transfers in the chain
+ * @param[in] num_elements The number of transfers, which must not exceed context->max_dma_chain_length
+ * @return Returns true if the chain completed without error
+ */
+bool dma_transfer_chain (nvram_uio_context *const context, const uint32_t direction,
+                         const dma_chain_element *const elements, const unsigned int num_elements)
+{
+    bool success;
+
+    success = perform_dma_chain (context, direction, elements, num_elements);
+    if (!success && device_recovery_pending (context) && wait_for_device_recovery (context, DEVICE_RECOVERY_TIMEOUT_NS))
+    {
+        /* The chain was lost in a PCI error, and the device has been recovered by the driver */
+        success = perform_dma_chain (context, direction, elements, num_elements);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Perform a single DMA transfer, waiting for it to complete
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] direction Either DMA_READ_FROM_HOST to write the device memory, or DMA_WRITE_TO_HOST to read it
+ * @param[in] card_offset The offset in the device memory
+ * @param[in] buffer_offset The offset in the DMA buffer
+ * @param[in] num_bytes The number of bytes to transfer
+ * @return Returns true if the transfer completed without error
+ */
+bool dma_transfer (nvram_uio_context *const context, const uint32_t direction,
+                   const uint64_t card_offset, const size_t buffer_offset, const size_t num_bytes)
+{
+    const dma_chain_element element =
+    {
+        .card_offset = card_offset,
+        .buffer_offset = buffer_offset,
+        .num_bytes = num_bytes
+    };
+
+    return dma_transfer_chain (context, direction, &element, 1);
+}
+
+/**
+ * @brief Write data to the device memory by staging it in the DMA buffer, using the copy kernel selected for staging
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] card_offset The offset in the device memory to write to
+ * @param[in] src The data to write
+ * @param[in] num_bytes The number of bytes to write, which must not exceed the size of the DMA buffer
+ * @return Returns true if the transfer completed without error
+ */
+bool dma_write_staged (nvram_uio_context *const context, const uint64_t card_offset,
+                       const void *const src, const size_t num_bytes)
+{
+    if ((context->dma_mapping == NULL) || (num_bytes > context->dma_buffer_size))
+    {
+        return false;
+    }
+    copy_to_destination (COPY_DEST_DMA_STAGING, context->dma_buffer, src, num_bytes);
+
+    return dma_transfer (context, DMA_READ_FROM_HOST, card_offset, 0, num_bytes);
+}
+
+/**
+ * @brief Write an area of host memory of any size to the device memory, by staging it through the DMA buffer
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] card_offset The offset in the device memory to write to
+ * @param[in] src The data to write
+ * @param[in] num_bytes The number of bytes to write
+ * @return Returns true if all the transfers completed without error
+ */
+bool dma_write_from_host (nvram_uio_context *const context, const uint64_t card_offset,
+                          const void *const src, const size_t num_bytes)
+{
+    const uint8_t *const src_bytes = src;
+    size_t bytes_done;
+    size_t chunk_bytes;
+
+    for (bytes_done = 0; bytes_done < num_bytes; bytes_done += chunk_bytes)
+    {
+        chunk_bytes = ((num_bytes - bytes_done) < context->dma_buffer_size) ?
+                (num_bytes - bytes_done) : context->dma_buffer_size;
+        if (!dma_write_staged (context, card_offset + bytes_done, &src_bytes[bytes_done], chunk_bytes))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read an area of the device memory of any size into host memory, by DMA through the DMA buffer
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] card_offset The offset in the device memory to read from
+ * @param[out] dst Where to store the data read
+ * @param[in] num_bytes The number of bytes to read
+ * @return Returns true if all the transfers completed without error
+ */
+bool dma_read_to_host (nvram_uio_context *const context, const uint64_t card_offset,
+                       void *const dst, const size_t num_bytes)
+{
+    uint8_t *const dst_bytes = dst;
+    size_t bytes_done;
+    size_t chunk_bytes;
+
+    for (bytes_done = 0; bytes_done < num_bytes; bytes_done += chunk_bytes)
+    {
+        chunk_bytes = ((num_bytes - bytes_done) < context->dma_buffer_size) ?
+                (num_bytes - bytes_done) : context->dma_buffer_size;
+        if (!dma_transfer (context, DMA_WRITE_TO_HOST, card_offset + bytes_done, 0, chunk_bytes))
+        {
+            return false;
+        }
+        memcpy (&dst_bytes[bytes_done], context->dma_buffer, chunk_bytes);
+    }
+
+    return true;
+}
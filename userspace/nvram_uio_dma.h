@@ -0,0 +1,52 @@
+/*
+ * @file nvram_uio_dma.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief DMA transfers between the per-file DMA buffer and the NVRAM device memory
+ * @details
+ *   Each open of the device has its own DMA buffer, allocated by the driver, so processes don't need to coordinate
+ *   use of host memory for DMA. The device has one DMA engine, so a transfer holds an exclusive flock() on the
+ *   device file across processes, and a mutex across the threads of a process, while the engine is in use (see
+ *   lock_device()).
+ *
+ *   Transfers are synchronous, with completion detected by polling the semaphore the device writes to the last
+ *   descriptor of the chain.
+ */
+
+#ifndef NVRAM_UIO_DMA_H_
+#define NVRAM_UIO_DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "nvram_uio_access.h"
+
+/* How long to wait for a DMA chain to complete before reporting a timeout */
+#define DMA_COMPLETION_TIMEOUT_NS 1000000000ULL
+
+/** One element of a DMA chain */
+typedef struct
+{
+    /** The offset in the device memory */
+    uint64_t card_offset;
+    /** The offset in the DMA buffer */
+    size_t buffer_offset;
+    /** The number of bytes to transfer */
+    size_t num_bytes;
+} dma_chain_element;
+
+void map_dma_buffer (nvram_uio_context *const context);
+void unmap_dma_buffer (nvram_uio_context *const context);
+bool dma_transfer_chain (nvram_uio_context *const context, const uint32_t direction,
+                         const dma_chain_element *const elements, const unsigned int num_elements);
+bool dma_transfer (nvram_uio_context *const context, const uint32_t direction,
+                   const uint64_t card_offset, const size_t buffer_offset, const size_t num_bytes);
+bool dma_write_staged (nvram_uio_context *const context, const uint64_t card_offset,
+                       const void *const src, const size_t num_bytes);
+bool dma_write_from_host (nvram_uio_context *const context, const uint64_t card_offset,
+                          const void *const src, const size_t num_bytes);
+bool dma_read_to_host (nvram_uio_context *const context, const uint64_t card_offset,
+                       void *const dst, const size_t num_bytes);
+
+#endif /* NVRAM_UIO_DMA_H_ */
@@ -0,0 +1,367 @@
+/*
+ * @file nvram_uio_epoch.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Epoch-based reclamation, so readers of host-side caches and indexes over the card data don't need locks
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "nvram_uio_epoch.h"
+
+/* The number of domains whose slots are cached per thread */
+#define EPOCH_CACHED_DOMAINS 8
+
+/** The slot of the calling thread in a domain, cached to avoid searching the slots */
+typedef struct
+{
+    epoch_domain *domain;
+    uint64_t generation;
+    epoch_thread *thread;
+} epoch_cached_slot;
+
+static __thread epoch_cached_slot cached_slots[EPOCH_CACHED_DOMAINS];
+static __thread unsigned int next_cached_slot;
+static __thread pid_t cached_tid;
+
+/* The initialised domains, protected by live_domains_lock so an exiting thread can release its slots */
+static pthread_mutex_t live_domains_lock = PTHREAD_MUTEX_INITIALIZER;
+static epoch_domain *live_domains;
+static uint64_t next_generation = 1;
+
+/* The key whose destructor releases the slots of an exiting thread, set once the thread has claimed a slot */
+static pthread_once_t thread_exit_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_exit_key;
+
+/**
+ * @brief Release the slots claimed by a thread which is exiting, in all the initialised domains
+ * @details The slot is left quiescent so it can't hold back the epoch, and any retired items stay in the slot.
+ * @param[in] arg The thread ID of the exiting thread
+ */
+static void release_thread_slots (void *arg)
+{
+    const pid_t tid = (pid_t) (intptr_t) arg;
+    epoch_domain *domain;
+    epoch_thread *thread;
+    unsigned int index;
+
+    pthread_mutex_lock (&live_domains_lock);
+    for (domain = live_domains; domain != NULL; domain = domain->next)
+    {
+        for (index = 0; index < domain->max_threads; index++)
+        {
+            thread = &domain->threads[index];
+            if (__atomic_load_n (&thread->owner, __ATOMIC_RELAXED) == tid)
+            {
+                thread->nesting = 0;
+                __atomic_store_n (&thread->local_epoch, EPOCH_QUIESCENT, __ATOMIC_RELEASE);
+                __atomic_store_n (&thread->owner, 0, __ATOMIC_RELEASE);
+            }
+        }
+    }
+    pthread_mutex_unlock (&live_domains_lock);
+}
+
+/**
+ * @brief Create the key used to release the slots of exiting threads
+ */
+static void create_thread_exit_key (void)
+{
+    if (pthread_key_create (&thread_exit_key, release_thread_slots) != 0)
+    {
+        printf ("pthread_key_create() failed\n");
+        exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Initialise a domain
+ * @param[out] domain The domain to initialise
+ * @param[in] max_threads The most threads which can use the domain
+ * @return Returns true if the domain was initialised, or false if the slots couldn't be allocated
+ */
+bool epoch_domain_init (epoch_domain *const domain, const unsigned int max_threads)
+{
+    memset (domain, 0, sizeof (*domain));
+    domain->threads = aligned_alloc (sizeof (epoch_thread), max_threads * sizeof (epoch_thread));
+    if (domain->threads == NULL)
+    {
+        return false;
+    }
+    memset (domain->threads, 0, max_threads * sizeof (epoch_thread));
+    domain->max_threads = max_threads;
+    domain->global_epoch = 1;
+
+    pthread_mutex_lock (&live_domains_lock);
+    domain->generation = next_generation++;
+    domain->next = live_domains;
+    live_domains = domain;
+    pthread_mutex_unlock (&live_domains_lock);
+
+    return true;
+}
+
+/**
+ * @brief Free the items of a retired list
+ */
+static void free_retired_list (epoch_retired_list *const list)
+{
+    size_t item_index;
+
+    for (item_index = 0; item_index < list->num_items; item_index++)
+    {
+        if (list->items[item_index].free_fn != NULL)
+        {
+            list->items[item_index].free_fn (list->items[item_index].item);
+        }
+        else
+        {
+            free (list->items[item_index].item);
+        }
+    }
+    list->num_items = 0;
+}
+
+/**
+ * @brief Free a domain, including all the items still retired
+ * @details Must only be called once no thread uses the data structures of the domain.
+ * @param[in,out] domain The domain to free
+ */
+void epoch_domain_free (epoch_domain *const domain)
+{
+    epoch_domain **link;
+    unsigned int thread_index;
+    unsigned int list_index;
+
+    pthread_mutex_lock (&live_domains_lock);
+    for (link = &live_domains; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == domain)
+        {
+            *link = domain->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock (&live_domains_lock);
+
+    for (thread_index = 0; thread_index < domain->max_threads; thread_index++)
+    {
+        for (list_index = 0; list_index < 3; list_index++)
+        {
+            free_retired_list (&domain->threads[thread_index].retired[list_index]);
+            free (domain->threads[thread_index].retired[list_index].items);
+        }
+    }
+    free (domain->threads);
+    domain->threads = NULL;
+    domain->max_threads = 0;
+    domain->generation = 0;
+}
+
+/**
+ * @brief Return the slot of the calling thread in a domain, claiming a free slot on the first call by the thread
+ * @details Exits if all the slots have been claimed, since the domain was sized for fewer threads than use it at
+ *          once. The slot is released when the thread exits.
+ * @param[in,out] domain The domain to get the slot for
+ * @return The slot of the calling thread
+ */
+epoch_thread *epoch_thread_self (epoch_domain *const domain)
+{
+    epoch_thread *thread = NULL;
+    unsigned int index;
+    pid_t free_owner;
+
+    if (cached_tid == 0)
+    {
+        cached_tid = (pid_t) syscall (SYS_gettid);
+        pthread_once (&thread_exit_key_once, create_thread_exit_key);
+        (void) pthread_setspecific (thread_exit_key, (void *) (intptr_t) cached_tid);
+    }
+
+    /* The generation is checked as the domain may have been freed and another initialised at the same address */
+    for (index = 0; index < EPOCH_CACHED_DOMAINS; index++)
+    {
+        if ((cached_slots[index].domain == domain) && (cached_slots[index].generation == domain->generation))
+        {
+            return cached_slots[index].thread;
+        }
+    }
+
+    /* Find the slot already claimed by the thread if it was evicted from the cache, otherwise claim a free slot */
+    for (index = 0; (thread == NULL) && (index < domain->max_threads); index++)
+    {
+        if (__atomic_load_n (&domain->threads[index].owner, __ATOMIC_ACQUIRE) == cached_tid)
+        {
+            thread = &domain->threads[index];
+        }
+    }
+    for (index = 0; (thread == NULL) && (index < domain->max_threads); index++)
+    {
+        free_owner = 0;
+        if (__atomic_compare_exchange_n (&domain->threads[index].owner, &free_owner, cached_tid, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            thread = &domain->threads[index];
+        }
+    }
+    if (thread == NULL)
+    {
+        printf ("All %u slots of the epoch domain are in use\n", domain->max_threads);
+        exit (EXIT_FAILURE);
+    }
+
+    cached_slots[next_cached_slot].domain = domain;
+    cached_slots[next_cached_slot].generation = domain->generation;
+    cached_slots[next_cached_slot].thread = thread;
+    next_cached_slot = (next_cached_slot + 1) % EPOCH_CACHED_DOMAINS;
+
+    return thread;
+}
+
+/**
+ * @brief Attempt to advance the global epoch, which can only be done once every reader in a critical section has
+ *        observed the current epoch
+ */
+static void try_advance (epoch_domain *const domain)
+{
+    uint64_t epoch = __atomic_load_n (&domain->global_epoch, __ATOMIC_ACQUIRE);
+    uint64_t local_epoch;
+    unsigned int index;
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    for (index = 0; index < domain->max_threads; index++)
+    {
+        if (__atomic_load_n (&domain->threads[index].owner, __ATOMIC_RELAXED) != 0)
+        {
+            local_epoch = __atomic_load_n (&domain->threads[index].local_epoch, __ATOMIC_ACQUIRE);
+            if ((local_epoch != EPOCH_QUIESCENT) && (local_epoch != epoch))
+            {
+                return;
+            }
+        }
+    }
+
+    /* Another thread may have advanced the epoch already */
+    (void) __atomic_compare_exchange_n (&domain->global_epoch, &epoch, epoch + 1, false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Free the lists of a thread retired at least two epochs before the global epoch
+ */
+static void reclaim (epoch_domain *const domain, epoch_thread *const thread)
+{
+    const uint64_t epoch = __atomic_load_n (&domain->global_epoch, __ATOMIC_ACQUIRE);
+    epoch_retired_list *list;
+    unsigned int list_index;
+
+    for (list_index = 0; list_index < 3; list_index++)
+    {
+        list = &thread->retired[list_index];
+        if ((list->num_items > 0) && ((list->epoch + 2) <= epoch))
+        {
+            free_retired_list (list);
+        }
+    }
+}
+
+/**
+ * @brief Wait until all the items retired by a thread have been freed
+ * @details Must be called outside of a critical section, as it waits for the readers in critical sections.
+ * @param[in,out] domain The domain the items were retired to
+ * @param[in,out] thread The slot of the calling thread
+ */
+void epoch_barrier (epoch_domain *const domain, epoch_thread *const thread)
+{
+    const uint64_t target_epoch = __atomic_load_n (&domain->global_epoch, __ATOMIC_ACQUIRE) + 2;
+
+    while (__atomic_load_n (&domain->global_epoch, __ATOMIC_ACQUIRE) < target_epoch)
+    {
+        try_advance (domain);
+        if (__atomic_load_n (&domain->global_epoch, __ATOMIC_ACQUIRE) < target_epoch)
+        {
+            sched_yield ();
+        }
+    }
+    reclaim (domain, thread);
+}
+
+/**
+ * @brief Retire an item which has been unlinked from the data structures of the domain, to be freed once no reader
+ *        can hold a reference to it
+ * @details Once EPOCH_RETIRE_BATCH items have been retired since the last attempt, an attempt is made to advance the
+ *          epoch and free the items retired by the thread which readers can no longer hold. If the item can't be
+ *          queued it is freed after waiting for the readers, so this must be called outside of a critical section.
+ *
+ *          The item is tagged with the global epoch read after a sequentially consistent fence. The fence orders the
+ *          store which unlinked the item before the read of the epoch, pairing with the fence in epoch_enter() between
+ *          announcing the epoch and reading the data structures. So a reader which can still see the item announced
+ *          an epoch no later than the tag, and the item isn't freed until that reader has left its critical section.
+ *          Without the fence the read of the epoch could be performed before the unlinking store, tagging the item
+ *          with an epoch older than a reader which loaded it.
+ * @param[in,out] domain The domain of the data structure the item was unlinked from
+ * @param[in,out] thread The slot of the calling thread
+ * @param[in] item The item to free
+ * @param[in] free_fn The function to free the item, or NULL to use free()
+ */
+void epoch_retire (epoch_domain *const domain, epoch_thread *const thread, void *const item,
+                   const epoch_free_fn free_fn)
+{
+    uint64_t epoch;
+    epoch_retired_list *list;
+    epoch_retired_item *items;
+    size_t capacity;
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n (&domain->global_epoch, __ATOMIC_ACQUIRE);
+    list = &thread->retired[epoch % 3];
+
+    /* A list with items from a previous use of the same index is at least three epochs old */
+    if ((list->num_items > 0) && (list->epoch != epoch))
+    {
+        free_retired_list (list);
+    }
+    list->epoch = epoch;
+
+    if (list->num_items == list->capacity)
+    {
+        capacity = (list->capacity == 0) ? EPOCH_RETIRE_BATCH : (list->capacity * 2);
+        items = realloc (list->items, capacity * sizeof (items[0]));
+        if (items == NULL)
+        {
+            epoch_barrier (domain, thread);
+            if (free_fn != NULL)
+            {
+                free_fn (item);
+            }
+            else
+            {
+                free (item);
+            }
+            return;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->num_items].item = item;
+    list->items[list->num_items].free_fn = free_fn;
+    list->num_items++;
+
+    thread->retired_since_attempt++;
+    if (thread->retired_since_attempt >= EPOCH_RETIRE_BATCH)
+    {
+        thread->retired_since_attempt = 0;
+        try_advance (domain);
+        reclaim (domain, thread);
+    }
+}
@@ -0,0 +1,123 @@
+/*
+ * @file nvram_uio_epoch.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Epoch-based reclamation, so readers of host-side caches and indexes over the card data don't need locks
+ * @details
+ *   A reader brackets its accesses with epoch_enter() and epoch_exit(), which only write the epoch of the reader's
+ *   own slot. A writer which unlinks memory passes it to epoch_retire() rather than freeing it, and the memory is
+ *   freed once every reader which could have seen it has left its critical section.
+ *
+ *   The domain has a global epoch, which advances when every reader inside a critical section has observed the
+ *   current epoch. Memory retired during epoch E is freed once the global epoch reaches E + 2. Each thread retires
+ *   memory into lists of its own slot, one per epoch modulo 3, and only attempts to advance the epoch and free the
+ *   lists every EPOCH_RETIRE_BATCH items retired, so the cost of scanning the slots is shared by a batch of frees.
+ *
+ *   Each thread using a domain claims a slot on first use, found again through a thread-local cache tagged with the
+ *   generation of the domain, so a domain freed and another initialised at the same address isn't mistaken for it.
+ *   The slots of a thread are released when it exits. Items the thread retired which haven't been freed stay in the
+ *   slot, and are freed by the next thread to claim the slot or when the domain is freed.
+ */
+
+#ifndef NVRAM_UIO_EPOCH_H_
+#define NVRAM_UIO_EPOCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* The number of items retired by a thread before it attempts to advance the epoch and free the retired items */
+#define EPOCH_RETIRE_BATCH 64
+
+/* The epoch of a slot whose thread is outside of a critical section. The global epoch starts at 1. */
+#define EPOCH_QUIESCENT 0
+
+/** The function to free a retired item */
+typedef void (*epoch_free_fn) (void *const item);
+
+/** An item retired, waiting until no reader can hold a reference to it */
+typedef struct
+{
+    void *item;
+    epoch_free_fn free_fn;
+} epoch_retired_item;
+
+/** The items retired by a thread during one epoch */
+typedef struct
+{
+    uint64_t epoch;
+    epoch_retired_item *items;
+    size_t num_items;
+    size_t capacity;
+} epoch_retired_list;
+
+/** The slot of one thread using a domain, on its own cache line so readers don't contend */
+typedef struct
+{
+    /** The global epoch observed on entering the outermost critical section, or EPOCH_QUIESCENT */
+    uint64_t local_epoch;
+    /** The thread ID which has claimed the slot, or zero if free */
+    pid_t owner;
+    /** The depth of nested critical sections */
+    unsigned int nesting;
+    /** The retired items, indexed by their epoch modulo 3 */
+    epoch_retired_list retired[3];
+    /** The number of items retired since the last attempt to advance the epoch */
+    size_t retired_since_attempt;
+} __attribute__((aligned(64))) epoch_thread;
+
+/** A reclamation domain, shared by the readers and writers of one or more data structures */
+typedef struct epoch_domain
+{
+    uint64_t global_epoch __attribute__((aligned(64)));
+    epoch_thread *threads;
+    unsigned int max_threads;
+    /** Unique to each initialisation of a domain, to validate the cached slots of threads */
+    uint64_t generation;
+    /** The next initialised domain, to find the slots to release when a thread exits */
+    struct epoch_domain *next;
+} epoch_domain;
+
+bool epoch_domain_init (epoch_domain *const domain, const unsigned int max_threads);
+void epoch_domain_free (epoch_domain *const domain);
+epoch_thread *epoch_thread_self (epoch_domain *const domain);
+void epoch_retire (epoch_domain *const domain, epoch_thread *const thread, void *const item,
+                   const epoch_free_fn free_fn);
+void epoch_barrier (epoch_domain *const domain, epoch_thread *const thread);
+
+/**
+ * @brief Enter a critical section, during which memory read from the data structures of the domain isn't freed
+ * @details Critical sections may be nested. The epoch is announced before being checked again, so a reader
+ *          delayed between reading and announcing the epoch can't announce an epoch which has already been passed.
+ * @param[in,out] domain The domain of the data structures
+ * @param[in,out] thread The slot of the calling thread, from epoch_thread_self()
+ */
+static inline void epoch_enter (epoch_domain *const domain, epoch_thread *const thread)
+{
+    uint64_t epoch;
+
+    if (thread->nesting++ == 0)
+    {
+        do
+        {
+            epoch = __atomic_load_n (&domain->global_epoch, __ATOMIC_RELAXED);
+            __atomic_store_n (&thread->local_epoch, epoch, __ATOMIC_RELAXED);
+            __atomic_thread_fence (__ATOMIC_SEQ_CST);
+        } while (__atomic_load_n (&domain->global_epoch, __ATOMIC_RELAXED) != epoch);
+    }
+}
+
+/**
+ * @brief Leave a critical section, after which the memory read during it must no longer be used
+ * @param[in,out] thread The slot of the calling thread
+ */
+static inline void epoch_exit (epoch_thread *const thread)
+{
+    if (--thread->nesting == 0)
+    {
+        __atomic_store_n (&thread->local_epoch, EPOCH_QUIESCENT, __ATOMIC_RELEASE);
+    }
+}
+
+#endif /* NVRAM_UIO_EPOCH_H_ */
@@ -0,0 +1,496 @@
+/*
+ * @file nvram_uio_executor.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Work-stealing pool of worker threads, used to run DMA completion callbacks
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "nvram_uio_executor.h"
+
+/* The capacity of the inbox of each worker, which must be a power of two */
+#define EXECUTOR_INBOX_SIZE 256
+
+/* The capacity of the deque of each worker, which must be a power of two */
+#define EXECUTOR_DEQUE_SIZE 1024
+
+/** One worker thread, aligned so the fields written by different threads don't share cache lines */
+typedef struct
+{
+    executor *pool;
+    unsigned int index;
+    /** The CPU the worker is pinned to, or -1 if not pinned */
+    int cpu;
+    pthread_t thread;
+
+    /** The inbox. Tail is written by the producer, and head by the worker. */
+    executor_task *inbox[EXECUTOR_INBOX_SIZE];
+    uint64_t inbox_tail __attribute__((aligned(64)));
+    uint64_t inbox_head __attribute__((aligned(64)));
+
+    /** The Chase-Lev deque. Bottom is only written by the worker, and top is advanced by the worker or thieves. */
+    executor_task *deque[EXECUTOR_DEQUE_SIZE];
+    int64_t deque_bottom __attribute__((aligned(64)));
+    int64_t deque_top __attribute__((aligned(64)));
+
+    /** Futex word incremented to wake the worker, and set non-zero while the worker is waiting on it */
+    uint32_t wake_seq __attribute__((aligned(64)));
+    uint32_t sleeping;
+
+    /** Counts of the tasks run by the worker */
+    uint64_t run_local __attribute__((aligned(64)));
+    uint64_t run_stolen;
+} __attribute__((aligned(64))) executor_worker;
+
+struct executor
+{
+    executor_worker *workers;
+    unsigned int num_workers;
+    /** Maps a CPU to the worker which tasks with that CPU hint are posted to */
+    int cpu_to_worker[CPU_SETSIZE];
+    bool stopping;
+    /** Tasks which didn't fit in any inbox */
+    pthread_mutex_t overflow_lock;
+    executor_task *overflow_head;
+    executor_task *overflow_tail;
+    /** Counts of posts, only written by the producer */
+    uint64_t posted;
+    uint64_t posted_to_preferred;
+    uint64_t posted_to_overflow;
+};
+
+static void futex_wait (uint32_t *const word, const uint32_t expected)
+{
+    syscall (SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake (uint32_t *const word)
+{
+    syscall (SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @brief Wake a worker, if it is waiting for work
+ */
+static void wake_worker (executor_worker *const worker)
+{
+    __atomic_add_fetch (&worker->wake_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&worker->sleeping, __ATOMIC_SEQ_CST) != 0)
+    {
+        futex_wake (&worker->wake_seq);
+    }
+}
+
+/**
+ * @brief Wake one waiting worker other than the caller, so it can steal work
+ * @param[in] pool The executor
+ * @param[in] exclude The index of a worker not to wake, or num_workers for none
+ */
+static void wake_idle_worker (executor *const pool, const unsigned int exclude)
+{
+    unsigned int worker_index;
+
+    for (worker_index = 0; worker_index < pool->num_workers; worker_index++)
+    {
+        if ((worker_index != exclude) && (__atomic_load_n (&pool->workers[worker_index].sleeping, __ATOMIC_SEQ_CST) != 0))
+        {
+            wake_worker (&pool->workers[worker_index]);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Post a task to the inbox of a worker. Only called by the producer.
+ * @return Returns true if the task was posted, or false if the inbox is full
+ */
+static bool inbox_push (executor_worker *const worker, executor_task *const task)
+{
+    const uint64_t tail = __atomic_load_n (&worker->inbox_tail, __ATOMIC_RELAXED);
+
+    if ((tail - __atomic_load_n (&worker->inbox_head, __ATOMIC_ACQUIRE)) == EXECUTOR_INBOX_SIZE)
+    {
+        return false;
+    }
+    worker->inbox[tail % EXECUTOR_INBOX_SIZE] = task;
+    __atomic_store_n (&worker->inbox_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * @brief Push a task onto the bottom of the deque of a worker. Only called by the worker.
+ * @return Returns true if the task was pushed, or false if the deque is full
+ */
+static bool deque_push (executor_worker *const worker, executor_task *const task)
+{
+    const int64_t bottom = __atomic_load_n (&worker->deque_bottom, __ATOMIC_RELAXED);
+    const int64_t top = __atomic_load_n (&worker->deque_top, __ATOMIC_ACQUIRE);
+
+    if ((bottom - top) >= EXECUTOR_DEQUE_SIZE)
+    {
+        return false;
+    }
+    __atomic_store_n (&worker->deque[bottom & (EXECUTOR_DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    __atomic_store_n (&worker->deque_bottom, bottom + 1, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+/**
+ * @brief Pop a task from the bottom of the deque of a worker. Only called by the worker.
+ * @return The task, or NULL if the deque is empty
+ */
+static executor_task *deque_pop (executor_worker *const worker)
+{
+    const int64_t bottom = __atomic_load_n (&worker->deque_bottom, __ATOMIC_RELAXED) - 1;
+    int64_t top;
+    executor_task *task = NULL;
+
+    __atomic_store_n (&worker->deque_bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    top = __atomic_load_n (&worker->deque_top, __ATOMIC_RELAXED);
+    if (top <= bottom)
+    {
+        task = __atomic_load_n (&worker->deque[bottom & (EXECUTOR_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+        if (top == bottom)
+        {
+            /* The last task, which a thief may be racing for */
+            if (!__atomic_compare_exchange_n (&worker->deque_top, &top, top + 1, false,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            {
+                task = NULL;
+            }
+            __atomic_store_n (&worker->deque_bottom, bottom + 1, __ATOMIC_RELAXED);
+        }
+    }
+    else
+    {
+        __atomic_store_n (&worker->deque_bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+/**
+ * @brief Steal a task from the top of the deque of another worker
+ * @return The task, or NULL if the deque was empty or another thread took the task first
+ */
+static executor_task *deque_steal (executor_worker *const victim)
+{
+    int64_t top = __atomic_load_n (&victim->deque_top, __ATOMIC_ACQUIRE);
+    int64_t bottom;
+    executor_task *task;
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n (&victim->deque_bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    task = __atomic_load_n (&victim->deque[top & (EXECUTOR_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n (&victim->deque_top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+
+    return task;
+}
+
+/**
+ * @brief Move tasks from the inbox of a worker to its deque, while the deque has space
+ * @return The number of tasks moved
+ */
+static unsigned int drain_inbox (executor_worker *const worker)
+{
+    uint64_t head = __atomic_load_n (&worker->inbox_head, __ATOMIC_RELAXED);
+    const uint64_t tail = __atomic_load_n (&worker->inbox_tail, __ATOMIC_ACQUIRE);
+    unsigned int num_moved = 0;
+
+    while ((head != tail) && deque_push (worker, worker->inbox[head % EXECUTOR_INBOX_SIZE]))
+    {
+        head++;
+        num_moved++;
+    }
+    __atomic_store_n (&worker->inbox_head, head, __ATOMIC_RELEASE);
+
+    return num_moved;
+}
+
+/**
+ * @brief Take a task from the overflow list
+ * @return The task, or NULL if the overflow list is empty
+ */
+static executor_task *overflow_pop (executor *const pool)
+{
+    executor_task *task = NULL;
+
+    if (__atomic_load_n (&pool->overflow_head, __ATOMIC_RELAXED) != NULL)
+    {
+        pthread_mutex_lock (&pool->overflow_lock);
+        task = pool->overflow_head;
+        if (task != NULL)
+        {
+            pool->overflow_head = task->next;
+            if (pool->overflow_head == NULL)
+            {
+                pool->overflow_tail = NULL;
+            }
+        }
+        pthread_mutex_unlock (&pool->overflow_lock);
+    }
+
+    return task;
+}
+
+/**
+ * @brief Find the next task for a worker to run: from its own deque, then stolen, then from the overflow list
+ * @param[in,out] worker The worker looking for a task
+ * @param[out] stolen Set true if the task was stolen from another worker
+ * @return The task, or NULL if there is no work
+ */
+static executor_task *find_task (executor_worker *const worker, bool *const stolen)
+{
+    executor *const pool = worker->pool;
+    executor_task *task;
+    unsigned int victim_offset;
+
+    if (drain_inbox (worker) > 1)
+    {
+        /* More than one task is waiting, so let an idle worker steal some */
+        wake_idle_worker (pool, worker->index);
+    }
+
+    *stolen = false;
+    task = deque_pop (worker);
+    if (task == NULL)
+    {
+        for (victim_offset = 1; (task == NULL) && (victim_offset < pool->num_workers); victim_offset++)
+        {
+            task = deque_steal (&pool->workers[(worker->index + victim_offset) % pool->num_workers]);
+        }
+        *stolen = task != NULL;
+    }
+    if (task == NULL)
+    {
+        task = overflow_pop (pool);
+    }
+
+    return task;
+}
+
+/**
+ * @brief The thread of one worker, which runs tasks until the executor is stopped and there is no work left
+ */
+static void *worker_thread (void *const arg)
+{
+    executor_worker *const worker = arg;
+    executor *const pool = worker->pool;
+    executor_task *task;
+    uint32_t wake_seq;
+    bool stolen;
+
+    for (;;)
+    {
+        wake_seq = __atomic_load_n (&worker->wake_seq, __ATOMIC_SEQ_CST);
+        task = find_task (worker, &stolen);
+        if (task != NULL)
+        {
+            if (stolen)
+            {
+                __atomic_store_n (&worker->run_stolen, worker->run_stolen + 1, __ATOMIC_RELAXED);
+            }
+            else
+            {
+                __atomic_store_n (&worker->run_local, worker->run_local + 1, __ATOMIC_RELAXED);
+            }
+            task->run (task);
+        }
+        else if (__atomic_load_n (&pool->stopping, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+        else
+        {
+            /* If work was posted since wake_seq was read the futex wait returns immediately */
+            __atomic_store_n (&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+            futex_wait (&worker->wake_seq, wake_seq);
+            __atomic_store_n (&worker->sleeping, 0, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Create an executor, starting its worker threads
+ * @param[in] num_workers The number of worker threads, or zero for one per CPU the process may run on
+ * @param[in] pin_workers When true each worker is pinned to one CPU, so that CPU hints select a worker on the CPU
+ * @return The executor
+ */
+executor *executor_create (const unsigned int num_workers, const bool pin_workers)
+{
+    executor *pool;
+    cpu_set_t allowed_cpus;
+    cpu_set_t worker_cpus;
+    int cpus[CPU_SETSIZE];
+    unsigned int num_cpus = 0;
+    unsigned int worker_index;
+    int cpu;
+
+    sched_getaffinity (0, sizeof (allowed_cpus), &allowed_cpus);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET (cpu, &allowed_cpus))
+        {
+            cpus[num_cpus++] = cpu;
+        }
+    }
+
+    pool = calloc (1, sizeof (executor));
+    if (pool == NULL)
+    {
+        printf ("Failed to allocate executor\n");
+        exit (EXIT_FAILURE);
+    }
+    pool->num_workers = (num_workers > 0) ? num_workers : num_cpus;
+    if (posix_memalign ((void **) &pool->workers, 64, pool->num_workers * sizeof (executor_worker)) != 0)
+    {
+        printf ("Failed to allocate executor workers\n");
+        exit (EXIT_FAILURE);
+    }
+    memset (pool->workers, 0, pool->num_workers * sizeof (executor_worker));
+    pthread_mutex_init (&pool->overflow_lock, NULL);
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        pool->cpu_to_worker[cpu] = cpu % (int) pool->num_workers;
+    }
+
+    for (worker_index = 0; worker_index < pool->num_workers; worker_index++)
+    {
+        executor_worker *const worker = &pool->workers[worker_index];
+
+        worker->pool = pool;
+        worker->index = worker_index;
+        worker->cpu = -1;
+        if (pthread_create (&worker->thread, NULL, worker_thread, worker) != 0)
+        {
+            printf ("Failed to create executor worker thread\n");
+            exit (EXIT_FAILURE);
+        }
+        if (pin_workers && (num_cpus > 0))
+        {
+            worker->cpu = cpus[worker_index % num_cpus];
+            CPU_ZERO (&worker_cpus);
+            CPU_SET (worker->cpu, &worker_cpus);
+            pthread_setaffinity_np (worker->thread, sizeof (worker_cpus), &worker_cpus);
+            if (worker_index < num_cpus)
+            {
+                pool->cpu_to_worker[worker->cpu] = (int) worker_index;
+            }
+        }
+    }
+
+    return pool;
+}
+
+/**
+ * @brief Stop an executor once all posted tasks have run, and free it
+ * @param[in] pool The executor to destroy. No more tasks may be posted.
+ */
+void executor_destroy (executor *const pool)
+{
+    unsigned int worker_index;
+
+    __atomic_store_n (&pool->stopping, true, __ATOMIC_RELEASE);
+    for (worker_index = 0; worker_index < pool->num_workers; worker_index++)
+    {
+        wake_worker (&pool->workers[worker_index]);
+    }
+    for (worker_index = 0; worker_index < pool->num_workers; worker_index++)
+    {
+        pthread_join (pool->workers[worker_index].thread, NULL);
+    }
+    pthread_mutex_destroy (&pool->overflow_lock);
+    free (pool->workers);
+    free (pool);
+}
+
+/**
+ * @brief Post a task to run on the executor. Must only be called from one producer thread.
+ * @details Never waits for workers, other than briefly taking the overflow lock when all inboxes are full.
+ * @param[in,out] pool The executor to run the task on
+ * @param[in] task The task to run, which must remain valid until run
+ */
+void executor_post (executor *const pool, executor_task *const task)
+{
+    const unsigned int preferred = ((task->cpu_hint >= 0) && (task->cpu_hint < CPU_SETSIZE)) ?
+            (unsigned int) pool->cpu_to_worker[task->cpu_hint] : (unsigned int) (pool->posted % pool->num_workers);
+    unsigned int worker_offset;
+    executor_worker *worker;
+
+    __atomic_store_n (&pool->posted, pool->posted + 1, __ATOMIC_RELAXED);
+    for (worker_offset = 0; worker_offset < pool->num_workers; worker_offset++)
+    {
+        worker = &pool->workers[(preferred + worker_offset) % pool->num_workers];
+        if (inbox_push (worker, task))
+        {
+            if (worker_offset == 0)
+            {
+                __atomic_store_n (&pool->posted_to_preferred, pool->posted_to_preferred + 1, __ATOMIC_RELAXED);
+            }
+            wake_worker (worker);
+            return;
+        }
+    }
+
+    task->next = NULL;
+    pthread_mutex_lock (&pool->overflow_lock);
+    if (pool->overflow_tail != NULL)
+    {
+        pool->overflow_tail->next = task;
+    }
+    else
+    {
+        pool->overflow_head = task;
+    }
+    pool->overflow_tail = task;
+    pthread_mutex_unlock (&pool->overflow_lock);
+    __atomic_store_n (&pool->posted_to_overflow, pool->posted_to_overflow + 1, __ATOMIC_RELAXED);
+    wake_idle_worker (pool, pool->num_workers);
+}
+
+/**
+ * @brief Get counts of how the tasks posted to an executor were run
+ * @param[in] pool The executor to get the statistics for
+ * @param[out] statistics The counts
+ */
+void executor_get_statistics (executor *const pool, executor_statistics *const statistics)
+{
+    unsigned int worker_index;
+
+    memset (statistics, 0, sizeof (*statistics));
+    statistics->posted = __atomic_load_n (&pool->posted, __ATOMIC_RELAXED);
+    statistics->posted_to_preferred = __atomic_load_n (&pool->posted_to_preferred, __ATOMIC_RELAXED);
+    statistics->posted_to_overflow = __atomic_load_n (&pool->posted_to_overflow, __ATOMIC_RELAXED);
+    for (worker_index = 0; worker_index < pool->num_workers; worker_index++)
+    {
+        statistics->run_local += __atomic_load_n (&pool->workers[worker_index].run_local, __ATOMIC_RELAXED);
+        statistics->run_stolen += __atomic_load_n (&pool->workers[worker_index].run_stolen, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * @file nvram_uio_executor.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Work-stealing pool of worker threads, used to run DMA completion callbacks
+ * @details
+ *   Tasks are posted by a single producer thread, e.g. the thread harvesting DMA completions, which must never be
+ *   held up by the callbacks. Each worker has:
+ *   - A bounded single-producer single-consumer inbox, which the producer posts to without locking or waiting.
+ *   - A Chase-Lev deque which the worker moves tasks from its inbox into, and which idle workers steal from.
+ *
+ *   A task carries a CPU hint, normally the CPU of the thread which submitted the DMA. The task is posted to the
+ *   worker pinned to that CPU when there is one, so the callback runs where its data is likely to be cached. If the
+ *   inbox of the preferred worker is full the task goes to the next worker with space, and if all inboxes are full
+ *   to a shared overflow list.
+ */
+
+#ifndef NVRAM_UIO_EXECUTOR_H_
+#define NVRAM_UIO_EXECUTOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** A task to run on the executor, normally embedded in the structure which the task operates on */
+typedef struct executor_task
+{
+    /** Called on a worker thread to run the task */
+    void (*run) (struct executor_task *const task);
+    /** The CPU the task would preferably run on, or -1 for no preference */
+    int cpu_hint;
+    /** Links the task in the overflow list */
+    struct executor_task *next;
+} executor_task;
+
+/** Counts of how tasks were run, for reporting */
+typedef struct
+{
+    uint64_t posted;
+    uint64_t posted_to_preferred;
+    uint64_t posted_to_overflow;
+    uint64_t run_local;
+    uint64_t run_stolen;
+} executor_statistics;
+
+typedef struct executor executor;
+
+executor *executor_create (const unsigned int num_workers, const bool pin_workers);
+void executor_destroy (executor *const pool);
+void executor_post (executor *const pool, executor_task *const task);
+void executor_get_statistics (executor *const pool, executor_statistics *const statistics);
+
+#endif /* NVRAM_UIO_EXECUTOR_H_ */
@@ -0,0 +1,278 @@
+/*
+ * @file nvram_uio_flightrec.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Flight recorder which writes binary trace events into rings in the battery-backed NVRAM device memory
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+#include <x86intrin.h>
+
+#include "nvram_uio_flightrec.h"
+#include "nvram_uio_window.h"
+
+/** The state of the open recorder */
+static struct
+{
+    nvram_uio_context *context;
+    /** The device memory offset of the first ring */
+    uint64_t rings_offset;
+    unsigned int num_rings;
+    uint32_t lines_per_ring;
+    uint16_t generation;
+    /** Incremented on each open, so threads can detect a ring claimed from a previous open */
+    uint32_t open_id;
+    bool open;
+    /** The next ring to be claimed */
+    unsigned int next_ring;
+    /** The number of events dropped as there were more recording threads than rings */
+    uint64_t dropped_events;
+} flightrec;
+
+/** The ring claimed by the calling thread */
+static __thread struct
+{
+    uint32_t open_id;
+    int ring;
+    uint32_t sequence;
+    /** The device memory offset of the ring */
+    uint64_t ring_offset;
+} thread_ring;
+
+/**
+ * @brief Write one line to the window as four 16 byte stores, which the write-combining buffer sends as one write
+ * @details The caller drains the write-combining buffers with a store fence once all the lines of an event are stored.
+ */
+static inline void store_line (uint8_t *const dst, const void *const src)
+{
+    const __m128i *const src_lines = src;
+    __m128i *const dst_lines = (__m128i *) dst;
+
+    _mm_store_si128 (&dst_lines[0], _mm_load_si128 (&src_lines[0]));
+    _mm_store_si128 (&dst_lines[1], _mm_load_si128 (&src_lines[1]));
+    _mm_store_si128 (&dst_lines[2], _mm_load_si128 (&src_lines[2]));
+    _mm_store_si128 (&dst_lines[3], _mm_load_si128 (&src_lines[3]));
+}
+
+/**
+ * @brief Store event lines into the ring of the calling thread
+ * @details The window of the recorder region is selected under the device lock, and the write-combining buffers are
+ *          drained before the lock is released so the lines can't reach the device after another access has
+ *          changed the selection. The region is within one window, so both lines are in the same selection.
+ * @param[in] card_offset The device memory offset of the first line
+ * @param[in] first_line The first line to store
+ * @param[in] second_card_offset The device memory offset of the second line
+ * @param[in] second_line The second line to store, or NULL if only one line
+ */
+static void store_lines (const uint64_t card_offset, const void *const first_line, const uint64_t second_card_offset,
+                         const void *const second_line)
+{
+    nvram_uio_context *const context = flightrec.context;
+
+    lock_device (context);
+    store_line (&context->window[select_window (context, card_offset)], first_line);
+    if (second_line != NULL)
+    {
+        store_line (&context->window[second_card_offset % context->window_size], second_line);
+    }
+    _mm_sfence ();
+    unlock_device (context);
+}
+
+/**
+ * @brief Open the flight recorder in a region of the device memory
+ * @details Requires the window to be mapped.
+ * @param[in,out] context The open NVRAM UIO device
+ * @param[in] region_offset The offset of the region, which must be aligned to FLIGHTREC_LINE_SIZE
+ * @param[in] region_size The size of the region, which must be within one window
+ * @param[in] num_rings The number of rings to divide the region into, which is the maximum number of threads
+ * @return Returns true if the recorder was opened
+ */
+bool flightrec_open (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                     const unsigned int num_rings)
+{
+    flightrec_header header __attribute__((aligned(FLIGHTREC_LINE_SIZE)));
+    flightrec_header previous;
+    struct timespec now;
+    size_t window_offset;
+    uint32_t lines_per_ring;
+
+    if ((context->window == NULL) || flightrec.open || (num_rings == 0) || (num_rings > UINT16_MAX) ||
+        ((region_offset % FLIGHTREC_LINE_SIZE) != 0) || (region_size <= sizeof (flightrec_header)) ||
+        ((region_offset / context->window_size) != ((region_offset + region_size - 1) / context->window_size)))
+    {
+        return false;
+    }
+    lines_per_ring = (uint32_t) (((region_size - sizeof (flightrec_header)) / num_rings) / FLIGHTREC_LINE_SIZE);
+    if (lines_per_ring < 2)
+    {
+        return false;
+    }
+
+    /* Keep the generation increasing across runs with the same layout, so old events can be identified */
+    memset (&header, 0, sizeof (header));
+    header.generation = 1;
+    if (window_read (context, region_offset, &previous, sizeof (previous)) &&
+        (previous.magic == FLIGHTREC_MAGIC) && (previous.version == FLIGHTREC_VERSION) &&
+        (previous.num_rings == num_rings) && (previous.lines_per_ring == lines_per_ring))
+    {
+        header.generation = (uint16_t) (previous.generation + 1);
+        if (header.generation == 0)
+        {
+            header.generation = 1;
+        }
+    }
+    header.magic = FLIGHTREC_MAGIC;
+    header.version = FLIGHTREC_VERSION;
+    header.num_rings = (uint16_t) num_rings;
+    header.lines_per_ring = lines_per_ring;
+    header.tsc_hz = measure_tsc_hz ();
+    clock_gettime (CLOCK_REALTIME, &now);
+    header.open_tsc = __rdtsc ();
+    header.open_realtime_ns = ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+
+    lock_device (context);
+    window_offset = select_window (context, region_offset);
+    store_line (&context->window[window_offset], &header);
+    window_flush (context);
+    unlock_device (context);
+
+    flightrec.context = context;
+    flightrec.rings_offset = region_offset + sizeof (flightrec_header);
+    flightrec.num_rings = num_rings;
+    flightrec.lines_per_ring = lines_per_ring;
+    flightrec.generation = header.generation;
+    flightrec.next_ring = 0;
+    flightrec.dropped_events = 0;
+    __atomic_add_fetch (&flightrec.open_id, 1, __ATOMIC_RELEASE);
+    __atomic_store_n (&flightrec.open, true, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * @brief Close the flight recorder, flushing the events written
+ * @details Must not be called while other threads may be recording events.
+ */
+void flightrec_close (void)
+{
+    if (flightrec.open)
+    {
+        __atomic_store_n (&flightrec.open, false, __ATOMIC_RELEASE);
+        window_flush (flightrec.context);
+        if (flightrec.dropped_events > 0)
+        {
+            printf ("Flight recorder dropped %lu events from threads without a ring\n",
+                    (unsigned long) flightrec.dropped_events);
+        }
+    }
+}
+
+/**
+ * @brief Get the ring of the calling thread, claiming one on the first event of the thread
+ * @return Returns true if the thread has a ring
+ */
+static inline bool get_thread_ring (void)
+{
+    unsigned int ring;
+
+    if (!__atomic_load_n (&flightrec.open, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    if (thread_ring.open_id != flightrec.open_id)
+    {
+        ring = __atomic_fetch_add (&flightrec.next_ring, 1, __ATOMIC_RELAXED);
+        thread_ring.open_id = flightrec.open_id;
+        thread_ring.sequence = 0;
+        thread_ring.ring = (ring < flightrec.num_rings) ? (int) ring : -1;
+        thread_ring.ring_offset = flightrec.rings_offset +
+                ((uint64_t) ring * flightrec.lines_per_ring * FLIGHTREC_LINE_SIZE);
+    }
+    if (thread_ring.ring < 0)
+    {
+        __atomic_add_fetch (&flightrec.dropped_events, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Fill in an event for the next sequence number of the ring of the calling thread
+ */
+static inline void fill_event (flightrec_event *const event, const uint16_t event_id, const uint16_t flags)
+{
+    event->tsc = __rdtsc ();
+    event->sequence = ++thread_ring.sequence;
+    event->generation = flightrec.generation;
+    event->event_id = event_id;
+    event->ring = (uint16_t) thread_ring.ring;
+    event->flags = flags;
+    event->check = flightrec_event_check (event);
+}
+
+/**
+ * @brief Return the device memory offset of the line in the ring of the calling thread for a sequence number
+ */
+static inline uint64_t ring_line (const uint32_t sequence)
+{
+    return thread_ring.ring_offset + ((uint64_t) (sequence % flightrec.lines_per_ring) * FLIGHTREC_LINE_SIZE);
+}
+
+/**
+ * @brief Record an event with up to five arguments
+ * @details Does nothing if the recorder isn't open.
+ * @param[in] event_id Identifies the event to the decoder
+ * @param[in] arg0 .. arg4 The arguments of the event
+ */
+void flightrec_record (const uint16_t event_id, const uint64_t arg0, const uint64_t arg1, const uint64_t arg2,
+                       const uint64_t arg3, const uint64_t arg4)
+{
+    flightrec_event event __attribute__((aligned(FLIGHTREC_LINE_SIZE)));
+
+    if (get_thread_ring ())
+    {
+        event.args[0] = arg0;
+        event.args[1] = arg1;
+        event.args[2] = arg2;
+        event.args[3] = arg3;
+        event.args[4] = arg4;
+        fill_event (&event, event_id, 0);
+        store_lines (ring_line (event.sequence), &event, 0, NULL);
+    }
+}
+
+/**
+ * @brief Record an event with one argument and a text message, which uses two lines
+ * @details Does nothing if the recorder isn't open.
+ * @param[in] event_id Identifies the event to the decoder
+ * @param[in] arg0 The argument of the event
+ * @param[in] text The message, truncated to FLIGHTREC_TEXT_LEN characters
+ */
+void flightrec_record_text (const uint16_t event_id, const uint64_t arg0, const char *const text)
+{
+    flightrec_event event __attribute__((aligned(FLIGHTREC_LINE_SIZE)));
+    flightrec_text text_line __attribute__((aligned(FLIGHTREC_LINE_SIZE)));
+
+    if (get_thread_ring ())
+    {
+        memset (&event.args, 0, sizeof (event.args));
+        event.args[0] = arg0;
+        fill_event (&event, event_id, FLIGHTREC_FLAG_TEXT);
+        /* The text isn't null terminated when it fills the line */
+        memset (text_line.text, 0, sizeof (text_line.text));
+        memcpy (text_line.text, text, strnlen (text, sizeof (text_line.text)));
+        text_line.check = ~event.sequence;
+
+        /* The text line takes the next sequence number */
+        thread_ring.sequence++;
+        store_lines (ring_line (event.sequence), &event, ring_line (event.sequence + 1), &text_line);
+    }
+}
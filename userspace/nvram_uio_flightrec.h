@@ -0,0 +1,116 @@
+/*
+ * @file nvram_uio_flightrec.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Flight recorder which writes binary trace events into rings in the battery-backed NVRAM device memory
+ * @details
+ *   The recorder region starts with a flightrec_header, followed by one ring per recording thread. A thread claims
+ *   a ring on its first event. Each event is written through the write-combining window as one 64 byte line, or two
+ *   lines for an event with text. The window selection is device-wide and may be changed by other accesses, so each
+ *   event takes the device lock, reselects the window of the recorder region if needed and drains the
+ *   write-combining buffers before releasing the lock. So an event costs the process mutex, the flock lock and unlock
+ *   system calls, an uncached read of the window register and a store fence, which is still less than a DMA.
+ *
+ *   There are no ring indices in the device memory, so after a host crash each ring is decoded by scanning it for
+ *   valid events and ordering them by sequence number. An event is valid when its check word matches, which detects
+ *   lines left partially written. Since the lines of an event have been drained from the write-combining buffers
+ *   before recording returns, only the events being recorded at the time of a crash are lost.
+ *
+ *   Opening the recorder increments the generation in the header without clearing the rings, so events from the
+ *   previous run remain until overwritten and can be told apart by their generation.
+ *
+ *   The recorder region should only be used by one process at a time.
+ */
+
+#ifndef NVRAM_UIO_FLIGHTREC_H_
+#define NVRAM_UIO_FLIGHTREC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nvram_uio_access.h"
+
+#define FLIGHTREC_MAGIC 0x434552544c46564eULL /* "NVFLTREC" */
+#define FLIGHTREC_VERSION 1
+
+/* The size of each event line in the rings */
+#define FLIGHTREC_LINE_SIZE 64
+
+#define FLIGHTREC_NUM_ARGS 5
+#define FLIGHTREC_TEXT_LEN 60
+
+/* Set in flightrec_event.flags when the following line holds a flightrec_text */
+#define FLIGHTREC_FLAG_TEXT 0x0001
+
+/** The header at the start of the recorder region */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint16_t generation;
+    uint16_t num_rings;
+    uint32_t lines_per_ring;
+    uint32_t reserved;
+    /** The measured TSC frequency, and the TSC and CLOCK_REALTIME when the recorder was opened, for decoding */
+    uint64_t tsc_hz;
+    uint64_t open_tsc;
+    uint64_t open_realtime_ns;
+    uint64_t padding[2];
+} flightrec_header;
+
+/** One event line */
+typedef struct
+{
+    uint64_t tsc;
+    /** Sequence number of the event within its ring, starting at one */
+    uint32_t sequence;
+    uint16_t generation;
+    uint16_t event_id;
+    uint64_t args[FLIGHTREC_NUM_ARGS];
+    uint16_t ring;
+    uint16_t flags;
+    /** flightrec_event_check() of the other fields, written last */
+    uint32_t check;
+} flightrec_event;
+
+/** The text line which follows an event with FLIGHTREC_FLAG_TEXT */
+typedef struct
+{
+    char text[FLIGHTREC_TEXT_LEN];
+    /** The bitwise inverse of the sequence of the event the text belongs to */
+    uint32_t check;
+} flightrec_text;
+
+_Static_assert (sizeof (flightrec_header) == FLIGHTREC_LINE_SIZE, "flightrec_header must be one line");
+_Static_assert (sizeof (flightrec_event) == FLIGHTREC_LINE_SIZE, "flightrec_event must be one line");
+_Static_assert (sizeof (flightrec_text) == FLIGHTREC_LINE_SIZE, "flightrec_text must be one line");
+
+/**
+ * @brief Return the check word of an event
+ * @details Covers all the other fields, including the arguments, so an event torn by a crash between the stores of
+ *          its line is rejected. Each word is rotated by its position so that exchanged words change the check.
+ */
+static inline uint32_t flightrec_event_check (const flightrec_event *const event)
+{
+    uint32_t check = event->sequence ^ ((uint32_t) event->generation << 16) ^ event->event_id ^
+            ((uint32_t) event->flags << 8) ^ (uint32_t) event->ring;
+    uint64_t word;
+    unsigned int index;
+
+    for (index = 0; index <= FLIGHTREC_NUM_ARGS; index++)
+    {
+        word = (index == 0) ? event->tsc : event->args[index - 1];
+        check = ((check << 7) | (check >> 25)) ^ (uint32_t) word ^ (uint32_t) (word >> 32);
+    }
+
+    return ~check;
+}
+
+bool flightrec_open (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                     const unsigned int num_rings);
+void flightrec_close (void);
+void flightrec_record (const uint16_t event_id, const uint64_t arg0, const uint64_t arg1, const uint64_t arg2,
+                       const uint64_t arg3, const uint64_t arg4);
+void flightrec_record_text (const uint16_t event_id, const uint64_t arg0, const char *const text);
+
+#endif /* NVRAM_UIO_FLIGHTREC_H_ */
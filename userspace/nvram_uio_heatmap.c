@@ -0,0 +1,378 @@
+/*
+ * @file nvram_uio_heatmap.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Sampling profiler which records which regions of the NVRAM device memory are accessed
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "nvram_uio_heatmap.h"
+
+/* The default interval at which the per-thread histograms are merged into a slice in the heatmap file */
+#define DEFAULT_MERGE_INTERVAL_MS 1000
+
+/** The histogram of sampled accesses for one thread */
+typedef struct thread_histogram_s
+{
+    /** The next histogram in the list of all threads */
+    struct thread_histogram_s *next;
+    /** Cumulative sampled accesses, only written by the owning thread. Indexed by [direction][region] */
+    uint32_t *accesses;
+    /** The values of accesses when last merged, only accessed by the merge thread */
+    uint32_t *merged_accesses;
+} thread_histogram;
+
+uint32_t heatmap_sample_rate;
+__thread uint32_t heatmap_sample_countdown;
+
+/** The histogram of the calling thread, which is only valid if thread_histogram_generation matches */
+static __thread thread_histogram *this_thread_histogram;
+static __thread uint32_t this_thread_histogram_generation;
+
+/** Incremented on each start, so that threads allocate a new histogram after a stop and re-start */
+static uint32_t heatmap_generation;
+
+/** Protects the list of thread histograms and the stop request */
+static pthread_mutex_t heatmap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t heatmap_stop_cond = PTHREAD_COND_INITIALIZER;
+static thread_histogram *thread_histograms;
+static bool heatmap_stop_requested;
+
+static uint32_t heatmap_num_regions;
+static uint32_t heatmap_merge_interval_ms;
+static FILE *heatmap_file;
+static pthread_t heatmap_merge_thread;
+/** The merged accesses for one slice, indexed by [direction][region] */
+static uint32_t *slice_accesses;
+
+/** Serialises the references taken by the contexts of the sampled device */
+static pthread_mutex_t heatmap_reference_lock = PTHREAD_MUTEX_INITIALIZER;
+/** The number of open contexts whose accesses are sampled, and the name of their device */
+static unsigned int heatmap_references;
+static char heatmap_device_name[PATH_MAX];
+
+/**
+ * @brief Merge the per-thread histograms and append one time slice to the heatmap file
+ */
+static void merge_thread_histograms (void)
+{
+    const size_t num_counts = (size_t) HEATMAP_NUM_DIRECTIONS * heatmap_num_regions;
+    const thread_histogram *histogram;
+    heatmap_slice_header slice_header;
+    heatmap_slice_entry entry;
+    struct timespec now;
+    uint32_t region;
+    uint32_t direction;
+    uint32_t current;
+    size_t count_index;
+
+    memset (slice_accesses, 0, num_counts * sizeof (slice_accesses[0]));
+    pthread_mutex_lock (&heatmap_lock);
+    for (histogram = thread_histograms; histogram != NULL; histogram = histogram->next)
+    {
+        for (count_index = 0; count_index < num_counts; count_index++)
+        {
+            current = __atomic_load_n (&histogram->accesses[count_index], __ATOMIC_RELAXED);
+            slice_accesses[count_index] += current - histogram->merged_accesses[count_index];
+            histogram->merged_accesses[count_index] = current;
+        }
+    }
+    pthread_mutex_unlock (&heatmap_lock);
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    slice_header.end_time_ns = ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+    slice_header.num_entries = 0;
+    slice_header.reserved = 0;
+    for (region = 0; region < heatmap_num_regions; region++)
+    {
+        if ((slice_accesses[(HEATMAP_READ * heatmap_num_regions) + region] != 0) ||
+            (slice_accesses[(HEATMAP_WRITE * heatmap_num_regions) + region] != 0))
+        {
+            slice_header.num_entries++;
+        }
+    }
+
+    fwrite (&slice_header, sizeof (slice_header), 1, heatmap_file);
+    for (region = 0; region < heatmap_num_regions; region++)
+    {
+        entry.region = region;
+        for (direction = 0; direction < HEATMAP_NUM_DIRECTIONS; direction++)
+        {
+            entry.accesses[direction] = slice_accesses[(direction * heatmap_num_regions) + region];
+        }
+        if ((entry.accesses[HEATMAP_READ] != 0) || (entry.accesses[HEATMAP_WRITE] != 0))
+        {
+            fwrite (&entry, sizeof (entry), 1, heatmap_file);
+        }
+    }
+    fflush (heatmap_file);
+}
+
+/**
+ * @brief Thread which merges the per-thread histograms at the merge interval, until a stop is requested
+ */
+static void *heatmap_merge_thread_entry (void *arg)
+{
+    struct timespec deadline;
+    bool stop;
+
+    (void) arg;
+    clock_gettime (CLOCK_MONOTONIC, &deadline);
+    do
+    {
+        deadline.tv_sec += heatmap_merge_interval_ms / 1000;
+        deadline.tv_nsec += (long) (heatmap_merge_interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock (&heatmap_lock);
+        while (!heatmap_stop_requested &&
+               (pthread_cond_timedwait (&heatmap_stop_cond, &heatmap_lock, &deadline) != ETIMEDOUT))
+        {
+        }
+        stop = heatmap_stop_requested;
+        pthread_mutex_unlock (&heatmap_lock);
+
+        merge_thread_histograms ();
+    } while (!stop);
+
+    return NULL;
+}
+
+/**
+ * @brief Start sampling accesses to the device memory
+ * @param[in] memory_size_bytes The size of the device memory
+ * @param[in] sample_rate One in sample_rate accesses by each thread are recorded
+ * @param[in] merge_interval_ms The interval at which time slices are written to the heatmap file
+ * @param[in] filename The heatmap file to create
+ * @return Returns true if sampling was started
+ */
+bool heatmap_start (const uint64_t memory_size_bytes, const uint32_t sample_rate, const uint32_t merge_interval_ms,
+                    const char *const filename)
+{
+    heatmap_file_header file_header;
+    pthread_condattr_t cond_attr;
+    int rc;
+
+    if ((sample_rate == 0) || (merge_interval_ms == 0) || (memory_size_bytes == 0) ||
+        (__atomic_load_n (&heatmap_sample_rate, __ATOMIC_RELAXED) != 0))
+    {
+        return false;
+    }
+
+    heatmap_file = fopen (filename, "wb");
+    if (heatmap_file == NULL)
+    {
+        printf ("Failed to create heatmap file %s\n", filename);
+        return false;
+    }
+
+    heatmap_num_regions = (uint32_t) ((memory_size_bytes + HEATMAP_REGION_SIZE - 1) >> HEATMAP_REGION_SHIFT);
+    heatmap_merge_interval_ms = merge_interval_ms;
+    slice_accesses = calloc ((size_t) HEATMAP_NUM_DIRECTIONS * heatmap_num_regions, sizeof (slice_accesses[0]));
+    if (slice_accesses == NULL)
+    {
+        fclose (heatmap_file);
+        return false;
+    }
+
+    file_header.magic = HEATMAP_FILE_MAGIC;
+    file_header.version = HEATMAP_FILE_VERSION;
+    file_header.region_size = HEATMAP_REGION_SIZE;
+    file_header.num_regions = heatmap_num_regions;
+    file_header.sample_rate = sample_rate;
+    file_header.merge_interval_ms = merge_interval_ms;
+    fwrite (&file_header, sizeof (file_header), 1, heatmap_file);
+
+    pthread_condattr_init (&cond_attr);
+    pthread_condattr_setclock (&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init (&heatmap_stop_cond, &cond_attr);
+    pthread_condattr_destroy (&cond_attr);
+    heatmap_stop_requested = false;
+    __atomic_add_fetch (&heatmap_generation, 1, __ATOMIC_RELEASE);
+
+    rc = pthread_create (&heatmap_merge_thread, NULL, heatmap_merge_thread_entry, NULL);
+    if (rc != 0)
+    {
+        free (slice_accesses);
+        fclose (heatmap_file);
+        return false;
+    }
+
+    __atomic_store_n (&heatmap_sample_rate, sample_rate, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * @brief Take a reference on the sampling of a device being opened, starting sampling if enabled by the environment
+ * @details Only one device is sampled at once, since the regions of the heatmap are offsets in the device memory.
+ *          The first device opened while enabled is sampled, and the accesses through the contexts of other devices
+ *          are ignored. Sampling continues until heatmap_release() has been called for every context which took a
+ *          reference.
+ * @param[in] device_name The name of the device being opened
+ * @param[in] memory_size_bytes The size of the device memory
+ * @return Returns true if the accesses through the context being opened are to be sampled
+ */
+bool heatmap_acquire_from_environment (const char *const device_name, const uint64_t memory_size_bytes)
+{
+    const char *const sample_rate_text = getenv ("NVRAM_UIO_HEATMAP_SAMPLE_RATE");
+    const char *const interval_text = getenv ("NVRAM_UIO_HEATMAP_INTERVAL_MS");
+    const char *filename = getenv ("NVRAM_UIO_HEATMAP_FILE");
+    char default_filename[64];
+    bool sampled = false;
+
+    if (sample_rate_text != NULL)
+    {
+        pthread_mutex_lock (&heatmap_reference_lock);
+        if (heatmap_references > 0)
+        {
+            sampled = strcmp (device_name, heatmap_device_name) == 0;
+        }
+        else
+        {
+            if (filename == NULL)
+            {
+                snprintf (default_filename, sizeof (default_filename), "nvram_heatmap_%d.dat", (int) getpid ());
+                filename = default_filename;
+            }
+            sampled = heatmap_start (memory_size_bytes, (uint32_t) strtoul (sample_rate_text, NULL, 0),
+                                     (interval_text != NULL) ? (uint32_t) strtoul (interval_text, NULL, 0) :
+                                                               DEFAULT_MERGE_INTERVAL_MS, filename);
+            if (sampled)
+            {
+                snprintf (heatmap_device_name, sizeof (heatmap_device_name), "%s", device_name);
+            }
+        }
+        if (sampled)
+        {
+            heatmap_references++;
+        }
+        pthread_mutex_unlock (&heatmap_reference_lock);
+    }
+
+    return sampled;
+}
+
+/**
+ * @brief Release a reference taken by heatmap_acquire_from_environment(), stopping sampling when the last is released
+ * @details Must not be called while other threads may be accessing the sampled device.
+ */
+void heatmap_release (void)
+{
+    pthread_mutex_lock (&heatmap_reference_lock);
+    if (heatmap_references > 0)
+    {
+        heatmap_references--;
+        if (heatmap_references == 0)
+        {
+            heatmap_stop ();
+        }
+    }
+    pthread_mutex_unlock (&heatmap_reference_lock);
+}
+
+/**
+ * @brief Stop sampling accesses, writing the final slice to the heatmap file
+ * @details Must not be called while other threads may be accessing the device.
+ */
+void heatmap_stop (void)
+{
+    thread_histogram *histogram;
+
+    if (__atomic_load_n (&heatmap_sample_rate, __ATOMIC_RELAXED) == 0)
+    {
+        return;
+    }
+    __atomic_store_n (&heatmap_sample_rate, 0, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock (&heatmap_lock);
+    heatmap_stop_requested = true;
+    pthread_cond_signal (&heatmap_stop_cond);
+    pthread_mutex_unlock (&heatmap_lock);
+    pthread_join (heatmap_merge_thread, NULL);
+
+    while (thread_histograms != NULL)
+    {
+        histogram = thread_histograms;
+        thread_histograms = histogram->next;
+        free (histogram->accesses);
+        free (histogram->merged_accesses);
+        free (histogram);
+    }
+    free (slice_accesses);
+    slice_accesses = NULL;
+    fclose (heatmap_file);
+    heatmap_file = NULL;
+}
+
+/**
+ * @brief Record one sampled access in the histogram of the calling thread
+ * @details The access is counted against every region it overlaps.
+ * @param[in] card_offset The start of the access in the device memory
+ * @param[in] num_bytes The length of the access
+ * @param[in] direction The direction of the access
+ */
+void heatmap_record_sample (const uint64_t card_offset, const size_t num_bytes, const heatmap_direction direction)
+{
+    const uint32_t generation = __atomic_load_n (&heatmap_generation, __ATOMIC_ACQUIRE);
+    thread_histogram *histogram = this_thread_histogram;
+    uint64_t region;
+    uint64_t last_region;
+    uint32_t *count;
+
+    heatmap_sample_countdown = __atomic_load_n (&heatmap_sample_rate, __ATOMIC_RELAXED);
+
+    if ((histogram == NULL) || (this_thread_histogram_generation != generation))
+    {
+        histogram = calloc (1, sizeof (thread_histogram));
+        if (histogram == NULL)
+        {
+            return;
+        }
+        histogram->accesses = calloc ((size_t) HEATMAP_NUM_DIRECTIONS * heatmap_num_regions,
+                                      sizeof (histogram->accesses[0]));
+        histogram->merged_accesses = calloc ((size_t) HEATMAP_NUM_DIRECTIONS * heatmap_num_regions,
+                                             sizeof (histogram->merged_accesses[0]));
+        if ((histogram->accesses == NULL) || (histogram->merged_accesses == NULL))
+        {
+            free (histogram->accesses);
+            free (histogram->merged_accesses);
+            free (histogram);
+            return;
+        }
+
+        pthread_mutex_lock (&heatmap_lock);
+        histogram->next = thread_histograms;
+        thread_histograms = histogram;
+        pthread_mutex_unlock (&heatmap_lock);
+        this_thread_histogram = histogram;
+        this_thread_histogram_generation = generation;
+    }
+
+    region = card_offset >> HEATMAP_REGION_SHIFT;
+    last_region = (card_offset + ((num_bytes > 0) ? (num_bytes - 1) : 0)) >> HEATMAP_REGION_SHIFT;
+    if (last_region >= heatmap_num_regions)
+    {
+        last_region = heatmap_num_regions - 1;
+    }
+    while (region <= last_region)
+    {
+        count = &histogram->accesses[((size_t) direction * heatmap_num_regions) + region];
+        __atomic_store_n (count, __atomic_load_n (count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+        region++;
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * @file nvram_uio_heatmap.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Sampling profiler which records which regions of the NVRAM device memory are accessed
+ * @details
+ *   When enabled, one in every sample_rate accesses made by each thread is recorded in a per-thread histogram
+ *   indexed by 64 KB region of the device memory. A background thread periodically merges the per-thread
+ *   histograms and appends the counts for the interval to a heatmap file, which is rendered by nvram_heatmap.
+ *
+ *   The per-thread histograms are only written by their owning thread, using plain loads and stores of relaxed
+ *   atomics, so that the sampled path doesn't need locked instructions.
+ *
+ *   Enabled by open_uio_device() when the NVRAM_UIO_HEATMAP_SAMPLE_RATE environment variable is set.
+ *   NVRAM_UIO_HEATMAP_FILE and NVRAM_UIO_HEATMAP_INTERVAL_MS optionally set the file and merge interval.
+ *   Only the first device opened is sampled, and each open context of that device holds a reference so that
+ *   sampling stops when the last of them is closed.
+ */
+
+#ifndef NVRAM_UIO_HEATMAP_H_
+#define NVRAM_UIO_HEATMAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HEATMAP_REGION_SHIFT 16
+#define HEATMAP_REGION_SIZE (1U << HEATMAP_REGION_SHIFT)
+
+#define HEATMAP_FILE_MAGIC 0x4e56484d
+#define HEATMAP_FILE_VERSION 1
+
+/** The direction of an access recorded in the heatmap */
+typedef enum
+{
+    HEATMAP_READ,
+    HEATMAP_WRITE,
+    HEATMAP_NUM_DIRECTIONS
+} heatmap_direction;
+
+/** The header at the start of a heatmap file */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    /** The size of each region which the accesses are counted for */
+    uint32_t region_size;
+    /** The number of regions in the device memory */
+    uint32_t num_regions;
+    /** One in sample_rate accesses is recorded */
+    uint32_t sample_rate;
+    /** The interval at which the counts are merged into a slice */
+    uint32_t merge_interval_ms;
+} heatmap_file_header;
+
+/** The header of one time slice in a heatmap file, followed by num_entries heatmap_slice_entry */
+typedef struct
+{
+    /** CLOCK_MONOTONIC time at the end of the slice */
+    uint64_t end_time_ns;
+    uint32_t num_entries;
+    uint32_t reserved;
+} heatmap_slice_header;
+
+/** The sampled accesses to one region during a time slice. Regions with no accesses are omitted. */
+typedef struct
+{
+    uint32_t region;
+    uint32_t accesses[HEATMAP_NUM_DIRECTIONS];
+} heatmap_slice_entry;
+
+/** Non-zero when sampling is enabled, tested before taking the sampled path */
+extern uint32_t heatmap_sample_rate;
+
+/** The number of accesses left until the calling thread takes the next sample */
+extern __thread uint32_t heatmap_sample_countdown;
+
+bool heatmap_start (const uint64_t memory_size_bytes, const uint32_t sample_rate, const uint32_t merge_interval_ms,
+                    const char *const filename);
+bool heatmap_acquire_from_environment (const char *const device_name, const uint64_t memory_size_bytes);
+void heatmap_release (void);
+void heatmap_stop (void);
+void heatmap_record_sample (const uint64_t card_offset, const size_t num_bytes, const heatmap_direction direction);
+
+/**
+ * @brief Called on every access to the device memory, to sample one in every heatmap_sample_rate accesses
+ * @param[in] device_sampled Set when the access is through a context of the sampled device
+ * @param[in] card_offset The start of the access in the device memory
+ * @param[in] num_bytes The length of the access
+ * @param[in] direction The direction of the access
+ */
+static inline void heatmap_sample_access (const bool device_sampled, const uint64_t card_offset,
+                                          const size_t num_bytes, const heatmap_direction direction)
+{
+    if (__builtin_expect (device_sampled && (__atomic_load_n (&heatmap_sample_rate, __ATOMIC_RELAXED) != 0), 0))
+    {
+        if (heatmap_sample_countdown <= 1)
+        {
+            heatmap_record_sample (card_offset, num_bytes, direction);
+        }
+        else
+        {
+            heatmap_sample_countdown--;
+        }
+    }
+}
+
+#endif /* NVRAM_UIO_HEATMAP_H_ */
@@ -0,0 +1,621 @@
+/*
+ * @file nvram_uio_journal.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Write-ahead journal in the NVRAM device memory, sharded per CPU or per NUMA node
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "nvram_uio_journal.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_copy.h"
+#include "nvram_uio_probes.h"
+
+#define CPU_SYSFS_ROOT "/sys/devices/system/cpu"
+
+/** The result of scanning one shard when the journal is opened */
+typedef struct
+{
+    journal *jnl;
+    unsigned int shard_index;
+    pthread_t thread;
+    bool thread_created;
+    /** Host copy of the start of the shard, of which valid_bytes contain valid records */
+    uint8_t *data;
+    size_t data_len;
+    uint64_t valid_bytes;
+    uint64_t num_records;
+    uint64_t max_sequence;
+    bool success;
+    /** The offset in data of the next record to be merged */
+    uint64_t merge_offset;
+} shard_scan;
+
+/**
+ * @brief Read the superblock of a journal region
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the journal region
+ * @param[out] superblock The superblock read
+ * @return Returns true if a valid superblock was read
+ */
+static bool read_superblock (nvram_uio_context *const context, const uint64_t region_offset,
+                             journal_superblock *const superblock)
+{
+    return dma_read_to_host (context, region_offset, superblock, sizeof (*superblock)) &&
+            (superblock->magic == JOURNAL_MAGIC) && (superblock->version == JOURNAL_VERSION) &&
+            (superblock->num_shards > 0) && (superblock->num_shards <= JOURNAL_MAX_SHARDS) &&
+            (superblock->shard_size >= (2 * JOURNAL_ALIGN)) && ((superblock->shard_size % JOURNAL_ALIGN) == 0);
+}
+
+/**
+ * @brief Format a journal region, discarding any records it contains
+ * @details The epoch continues from any existing superblock, and the first record of each shard is also cleared,
+ *          so that records written with a previous layout can't be mistaken for valid records.
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the journal region, which must be aligned to JOURNAL_ALIGN
+ * @param[in] region_size The size of the journal region
+ * @param[in] num_shards The number of shards to divide the region into
+ * @return Returns true if the region was formatted
+ */
+bool journal_format (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                     const unsigned int num_shards)
+{
+    journal_superblock superblock;
+    journal_superblock previous;
+    unsigned int shard_index;
+    bool success;
+
+    if ((context->dma_mapping == NULL) || ((region_offset % JOURNAL_ALIGN) != 0) || (num_shards == 0) ||
+        (num_shards > JOURNAL_MAX_SHARDS) || (region_size < sizeof (superblock)))
+    {
+        return false;
+    }
+
+    memset (&superblock, 0, sizeof (superblock));
+    superblock.magic = JOURNAL_MAGIC;
+    superblock.version = JOURNAL_VERSION;
+    superblock.num_shards = num_shards;
+    superblock.epoch = read_superblock (context, region_offset, &previous) ? (previous.epoch + 1) : 1;
+    superblock.shard_size = ((region_size - sizeof (superblock)) / num_shards) & ~(uint64_t) (JOURNAL_ALIGN - 1);
+    if (superblock.shard_size < (2 * JOURNAL_ALIGN))
+    {
+        return false;
+    }
+
+    memset (context->dma_buffer, 0, JOURNAL_ALIGN);
+    success = true;
+    for (shard_index = 0; success && (shard_index < num_shards); shard_index++)
+    {
+        success = dma_transfer (context, DMA_READ_FROM_HOST,
+                                region_offset + sizeof (superblock) + (shard_index * superblock.shard_size),
+                                0, JOURNAL_ALIGN);
+    }
+
+    return success && dma_write_staged (context, region_offset, &superblock, sizeof (superblock));
+}
+
+/**
+ * @brief Find the NUMA node of a CPU from sysfs
+ * @return The NUMA node, or zero if not known
+ */
+static unsigned int cpu_numa_node (const unsigned int cpu)
+{
+    char pathname[PATH_MAX];
+    struct dirent *entry;
+    unsigned int node = 0;
+    DIR *cpu_dir;
+
+    snprintf (pathname, sizeof (pathname), "%s/cpu%u", CPU_SYSFS_ROOT, cpu);
+    cpu_dir = opendir (pathname);
+    if (cpu_dir != NULL)
+    {
+        while ((entry = readdir (cpu_dir)) != NULL)
+        {
+            if (sscanf (entry->d_name, "node%u", &node) == 1)
+            {
+                break;
+            }
+        }
+        closedir (cpu_dir);
+    }
+
+    return node;
+}
+
+/**
+ * @brief Map each CPU to a shard
+ */
+static void map_cpu_shards (journal *const jnl, const journal_shard_mode shard_mode)
+{
+    long num_cpus = sysconf (_SC_NPROCESSORS_CONF);
+    unsigned int cpu;
+
+    memset (jnl->cpu_shards, 0, sizeof (jnl->cpu_shards));
+    if ((num_cpus < 0) || (num_cpus > JOURNAL_MAX_CPUS))
+    {
+        num_cpus = JOURNAL_MAX_CPUS;
+    }
+    for (cpu = 0; cpu < (unsigned int) num_cpus; cpu++)
+    {
+        jnl->cpu_shards[cpu] = (uint8_t) (((shard_mode == JOURNAL_SHARD_PER_NODE) ? cpu_numa_node (cpu) : cpu) %
+                                          jnl->superblock.num_shards);
+    }
+}
+
+/**
+ * @brief Thread which scans one shard for valid records, reading the shard into host memory
+ * @details The scan stops at the first record which isn't valid for the current epoch, or which doesn't have a
+ *          higher sequence number than the previous record, which marks the tail of the shard.
+ * @param[in,out] arg The shard_scan for the shard
+ */
+static void *scan_shard_thread (void *arg)
+{
+    shard_scan *const scan = arg;
+    journal *const jnl = scan->jnl;
+    const journal_shard *const shard = &jnl->shards[scan->shard_index];
+    const size_t chunk_size = 2 * shard->half_size;
+    const journal_record_header *header;
+    uint64_t required_bytes;
+    uint64_t previous_sequence = 0;
+    size_t read_bytes;
+    uint8_t *data;
+    bool at_tail = false;
+
+    scan->success = true;
+    while (!at_tail && scan->success)
+    {
+        header = (const journal_record_header *) &scan->data[scan->valid_bytes];
+        if ((scan->valid_bytes + sizeof (*header)) > scan->data_len)
+        {
+            required_bytes = sizeof (*header);
+        }
+        else
+        {
+            /* A corrupt length is treated as extending past the end of the shard */
+            required_bytes = (header->length <= jnl->superblock.shard_size) ?
+                    journal_align (sizeof (*header) + header->length) : (jnl->superblock.shard_size + 1);
+        }
+
+        if ((scan->valid_bytes + required_bytes) > jnl->superblock.shard_size)
+        {
+            at_tail = true;
+        }
+        else if ((scan->valid_bytes + required_bytes) > scan->data_len)
+        {
+            /* Read the next chunk of the shard, using the shard's part of the DMA buffer */
+            read_bytes = ((jnl->superblock.shard_size - scan->data_len) < chunk_size) ?
+                    (jnl->superblock.shard_size - scan->data_len) : chunk_size;
+            data = realloc (scan->data, scan->data_len + read_bytes);
+            scan->success = (data != NULL) &&
+                    dma_transfer (jnl->context, DMA_WRITE_TO_HOST, shard->card_offset + scan->data_len,
+                                  shard->buffer_offset, read_bytes);
+            if (data != NULL)
+            {
+                scan->data = data;
+            }
+            if (scan->success)
+            {
+                memcpy (&scan->data[scan->data_len], &jnl->context->dma_buffer[shard->buffer_offset], read_bytes);
+                scan->data_len += read_bytes;
+            }
+        }
+        else if ((header->epoch != jnl->superblock.epoch) || (header->sequence <= previous_sequence) ||
+                 (header->check != journal_record_check (header, &header[1])))
+        {
+            at_tail = true;
+        }
+        else
+        {
+            previous_sequence = header->sequence;
+            scan->valid_bytes += required_bytes;
+            scan->num_records++;
+        }
+    }
+    scan->max_sequence = previous_sequence;
+
+    return NULL;
+}
+
+/**
+ * @brief Return the sequence number of the next record to be merged from a shard
+ */
+static inline uint64_t merge_sequence (const shard_scan *const scan)
+{
+    return ((const journal_record_header *) &scan->data[scan->merge_offset])->sequence;
+}
+
+/**
+ * @brief Restore the heap order of the shards being merged, by moving an entry down the heap
+ */
+static void sift_down (shard_scan **const heap, const unsigned int heap_size, unsigned int index)
+{
+    shard_scan *const entry = heap[index];
+    unsigned int child;
+
+    while ((child = (2 * index) + 1) < heap_size)
+    {
+        if (((child + 1) < heap_size) && (merge_sequence (heap[child + 1]) < merge_sequence (heap[child])))
+        {
+            child++;
+        }
+        if (merge_sequence (entry) <= merge_sequence (heap[child]))
+        {
+            break;
+        }
+        heap[index] = heap[child];
+        index = child;
+    }
+    heap[index] = entry;
+}
+
+/**
+ * @brief Replay the records of all shards in sequence order, by a k-way merge using a heap of the shards
+ */
+static void merge_shards (shard_scan *const scans, const unsigned int num_shards,
+                          journal_replay_fn replay, void *const replay_arg)
+{
+    shard_scan *heap[JOURNAL_MAX_SHARDS];
+    const journal_record_header *header;
+    unsigned int heap_size = 0;
+    unsigned int shard_index;
+    int index;
+
+    for (shard_index = 0; shard_index < num_shards; shard_index++)
+    {
+        if (scans[shard_index].valid_bytes > 0)
+        {
+            heap[heap_size++] = &scans[shard_index];
+        }
+    }
+    for (index = ((int) heap_size / 2) - 1; index >= 0; index--)
+    {
+        sift_down (heap, heap_size, (unsigned int) index);
+    }
+
+    while (heap_size > 0)
+    {
+        header = (const journal_record_header *) &heap[0]->data[heap[0]->merge_offset];
+        replay (header->sequence, &header[1], header->length, replay_arg);
+        heap[0]->merge_offset += journal_align (sizeof (*header) + header->length);
+        if (heap[0]->merge_offset >= heap[0]->valid_bytes)
+        {
+            heap[0] = heap[--heap_size];
+        }
+        if (heap_size > 0)
+        {
+            sift_down (heap, heap_size, 0);
+        }
+    }
+}
+
+/**
+ * @brief Open a formatted journal region, replaying the records it contains
+ * @details The shards are scanned in parallel, one thread per shard, to find their tails. The DMA buffer is
+ *          divided between the shards, and must be at least 4 * JOURNAL_ALIGN bytes per shard.
+ * @param[out] jnl The journal to open
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the journal region
+ * @param[in] shard_mode How the CPUs of the calling threads are mapped to shards
+ * @param[in] replay If not NULL, called for each record in the journal in sequence order
+ * @param[in] replay_arg Passed to replay
+ * @return Returns true if the journal was opened
+ */
+bool journal_open (journal *const jnl, nvram_uio_context *const context, const uint64_t region_offset,
+                   const journal_shard_mode shard_mode, journal_replay_fn replay, void *const replay_arg)
+{
+    shard_scan scans[JOURNAL_MAX_SHARDS];
+    journal_shard *shard;
+    unsigned int shard_index;
+    size_t slice_size;
+    uint64_t max_sequence = 0;
+    bool success;
+
+    memset (jnl, 0, sizeof (*jnl));
+    if ((context->dma_mapping == NULL) || !read_superblock (context, region_offset, &jnl->superblock))
+    {
+        return false;
+    }
+    slice_size = (context->dma_buffer_size / jnl->superblock.num_shards) & ~(size_t) (2 * JOURNAL_ALIGN - 1);
+    if (slice_size < (4 * JOURNAL_ALIGN))
+    {
+        return false;
+    }
+
+    jnl->context = context;
+    jnl->region_offset = region_offset;
+    map_cpu_shards (jnl, shard_mode);
+    for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+    {
+        shard = &jnl->shards[shard_index];
+        pthread_mutex_init (&shard->lock, NULL);
+        pthread_cond_init (&shard->flushed, NULL);
+        shard->card_offset = region_offset + sizeof (journal_superblock) + (shard_index * jnl->superblock.shard_size);
+        shard->buffer_offset = shard_index * slice_size;
+        shard->half_size = slice_size / 2;
+    }
+
+    /* Scan the shards in parallel */
+    memset (scans, 0, sizeof (scans));
+    success = true;
+    for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+    {
+        scans[shard_index].jnl = jnl;
+        scans[shard_index].shard_index = shard_index;
+        scans[shard_index].thread_created =
+                pthread_create (&scans[shard_index].thread, NULL, scan_shard_thread, &scans[shard_index]) == 0;
+        if (!scans[shard_index].thread_created)
+        {
+            /* Scan in the calling thread instead */
+            scan_shard_thread (&scans[shard_index]);
+        }
+    }
+    for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+    {
+        if (scans[shard_index].thread_created)
+        {
+            pthread_join (scans[shard_index].thread, NULL);
+        }
+        success = success && scans[shard_index].success;
+        if (scans[shard_index].max_sequence > max_sequence)
+        {
+            max_sequence = scans[shard_index].max_sequence;
+        }
+    }
+
+    if (success)
+    {
+        if (replay != NULL)
+        {
+            merge_shards (scans, jnl->superblock.num_shards, replay, replay_arg);
+        }
+        for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+        {
+            shard = &jnl->shards[shard_index];
+            shard->tail = scans[shard_index].valid_bytes;
+            shard->staged_tail = shard->tail;
+            shard->num_records = scans[shard_index].num_records;
+            shard->staging_group = 1;
+        }
+        jnl->next_sequence = max_sequence + 1;
+    }
+    for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+    {
+        free (scans[shard_index].data);
+    }
+    if (!success)
+    {
+        journal_close (jnl);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Pass the records of a group commit which has been written to the append observer, in sequence order.
+ *        Called with the shard lock held.
+ */
+static void observe_group_commit (journal *const jnl, journal_shard *const shard, const size_t buffer_offset,
+                                  const uint64_t shard_offset, const size_t num_bytes)
+{
+    const journal_record_header *header;
+    uint64_t record_size;
+    size_t offset;
+
+    for (offset = 0; offset < num_bytes; offset += record_size)
+    {
+        header = (const journal_record_header *) &jnl->context->dma_buffer[buffer_offset + offset];
+        record_size = journal_align (sizeof (*header) + header->length);
+        jnl->append_observer (jnl->append_observer_arg, (unsigned int) (shard - jnl->shards), header->sequence,
+                              shard_offset + offset, record_size);
+    }
+}
+
+/**
+ * @brief Write the records staged in a shard as one group commit. Called with the shard lock held, which is
+ *        released while the DMA transfer is performed.
+ * @details The half of the buffer written isn't staged into again until the next group commit starts, which can't
+ *          happen before this one completes, so the written records can still be passed to the append observer.
+ */
+static void write_group_commit (journal *const jnl, journal_shard *const shard)
+{
+    const uint64_t group = shard->staging_group;
+    const size_t buffer_offset = shard->buffer_offset + (shard->staging_half * shard->half_size);
+    const size_t num_bytes = shard->staged_bytes;
+    const uint64_t shard_offset = shard->staged_tail;
+    const uint64_t card_offset = shard->card_offset + shard_offset;
+    bool success;
+
+    /* Further records are staged in the other half while this group is written */
+    shard->writing = true;
+    shard->staging_half ^= 1;
+    shard->staged_bytes = 0;
+    shard->staged_tail = shard->tail;
+    shard->staging_group++;
+    pthread_mutex_unlock (&shard->lock);
+
+    success = dma_transfer (jnl->context, DMA_READ_FROM_HOST, card_offset, buffer_offset, num_bytes);
+
+    pthread_mutex_lock (&shard->lock);
+    shard->writing = false;
+    if (success)
+    {
+        shard->written_group = group;
+        shard->num_group_commits++;
+        if (jnl->append_observer != NULL)
+        {
+            observe_group_commit (jnl, shard, buffer_offset, shard_offset, num_bytes);
+        }
+    }
+    else
+    {
+        shard->failed = true;
+    }
+    pthread_cond_broadcast (&shard->flushed);
+}
+
+/**
+ * @brief Append a record to the shard of the calling thread's CPU, and wait for it to be written to the device
+ * @details If another thread of the shard is already writing a group commit, the record is written in the next
+ *          group commit along with any other records appended meanwhile.
+ * @param[in,out] jnl The open journal
+ * @param[in] data The record data
+ * @param[in] length The length of the record data
+ * @param[out] sequence The sequence number given to the record
+ * @return Returns true if the record was written, or false if the shard is full or a write failed
+ */
+bool journal_write (journal *const jnl, const void *const data, const size_t length, uint64_t *const sequence)
+{
+    const int cpu = sched_getcpu ();
+    journal_shard *const shard = &jnl->shards[((cpu >= 0) && (cpu < JOURNAL_MAX_CPUS)) ? jnl->cpu_shards[cpu] : 0];
+    const uint64_t record_size = journal_align (sizeof (journal_record_header) + length);
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    journal_record_header header;
+    uint8_t *staging;
+    uint64_t card_offset;
+    uint64_t group;
+    bool success;
+
+    if (record_size > shard->half_size)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&shard->lock);
+
+    /* Wait for space in the half of the buffer being staged into */
+    while (!shard->failed && ((shard->staged_bytes + record_size) > shard->half_size))
+    {
+        if (shard->writing)
+        {
+            pthread_cond_wait (&shard->flushed, &shard->lock);
+        }
+        else
+        {
+            write_group_commit (jnl, shard);
+        }
+    }
+    if (shard->failed || ((shard->tail + record_size) > jnl->superblock.shard_size))
+    {
+        pthread_mutex_unlock (&shard->lock);
+        return false;
+    }
+
+    /* Stage the record. The sequence is taken with the shard locked, so sequences increase within the shard. */
+    memset (&header, 0, sizeof (header));
+    header.sequence = __atomic_fetch_add (&jnl->next_sequence, 1, __ATOMIC_RELAXED);
+    header.epoch = jnl->superblock.epoch;
+    header.length = (uint32_t) length;
+    header.check = journal_record_check (&header, data);
+    staging = &jnl->context->dma_buffer[shard->buffer_offset + (shard->staging_half * shard->half_size) +
+                                        shard->staged_bytes];
+    memcpy (staging, &header, sizeof (header));
+    copy_to_destination (COPY_DEST_DMA_STAGING, &staging[sizeof (header)], data, length);
+    card_offset = shard->card_offset + shard->tail;
+    shard->staged_bytes += record_size;
+    shard->tail += record_size;
+    shard->num_records++;
+    group = shard->staging_group;
+
+    /* Wait for the group commit containing the record, writing it if no other thread is writing */
+    while (!shard->failed && (shard->written_group < group))
+    {
+        if (shard->writing)
+        {
+            pthread_cond_wait (&shard->flushed, &shard->lock);
+        }
+        else
+        {
+            write_group_commit (jnl, shard);
+        }
+    }
+    success = shard->written_group >= group;
+
+    pthread_mutex_unlock (&shard->lock);
+    *sequence = header.sequence;
+    if (success)
+    {
+        NVRAM_UIO_PROBE3 (commit, card_offset, record_size, get_monotonic_time_ns () - start_ns);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Set the observer called as each record is written to the device
+ * @details Must be set before threads start writing to the journal.
+ * @param[in,out] jnl The open journal
+ * @param[in] observer The observer, or NULL to remove the observer
+ * @param[in] arg Passed to the observer
+ */
+void journal_set_append_observer (journal *const jnl, journal_append_fn observer, void *const arg)
+{
+    jnl->append_observer = observer;
+    jnl->append_observer_arg = arg;
+}
+
+/**
+ * @brief Discard all records in the journal, by starting a new epoch
+ * @details Must not be called while other threads may be writing to the journal.
+ * @param[in,out] jnl The open journal
+ * @return Returns true if the new epoch was written to the superblock
+ */
+bool journal_reset (journal *const jnl)
+{
+    journal_shard *shard;
+    unsigned int shard_index;
+
+    jnl->superblock.epoch++;
+    if (!dma_write_staged (jnl->context, jnl->region_offset, &jnl->superblock, sizeof (jnl->superblock)))
+    {
+        return false;
+    }
+    for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+    {
+        shard = &jnl->shards[shard_index];
+        shard->tail = 0;
+        shard->staged_tail = 0;
+        shard->staged_bytes = 0;
+        shard->num_records = 0;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Close a journal, displaying the number of records and group commits per shard
+ * @details Must not be called while other threads may be writing to the journal.
+ * @param[in,out] jnl The journal to close
+ */
+void journal_close (journal *const jnl)
+{
+    journal_shard *shard;
+    unsigned int shard_index;
+
+    if (jnl->context != NULL)
+    {
+        for (shard_index = 0; shard_index < jnl->superblock.num_shards; shard_index++)
+        {
+            shard = &jnl->shards[shard_index];
+            if (shard->num_group_commits > 0)
+            {
+                printf ("Journal shard %u: %lu records, %lu group commits, %lu bytes used\n", shard_index,
+                        (unsigned long) shard->num_records, (unsigned long) shard->num_group_commits,
+                        (unsigned long) shard->tail);
+            }
+            pthread_cond_destroy (&shard->flushed);
+            pthread_mutex_destroy (&shard->lock);
+        }
+        jnl->context = NULL;
+    }
+}
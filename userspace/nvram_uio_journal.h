@@ -0,0 +1,175 @@
+/*
+ * @file nvram_uio_journal.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Write-ahead journal in the NVRAM device memory, sharded per CPU or per NUMA node
+ * @details
+ *   The journal region starts with a journal_superblock, followed by a fixed number of shards. Each shard is an
+ *   append-only log with its own tail and its own part of the DMA buffer, so threads on different CPUs (or NUMA
+ *   nodes) commit without contending for a single tail. Within a shard commits are grouped: the first committing
+ *   thread writes every record appended to the shard so far in one DMA transfer, while later records are staged
+ *   in the other half of the shard's part of the DMA buffer.
+ *
+ *   Each record is given a sequence number from a process-wide counter when appended, which gives a global order
+ *   across shards. The sequence numbers in each shard are increasing, so on open the shards are scanned in
+ *   parallel and the records replayed in global order by a k-way merge of the shards.
+ *
+ *   The shards are not circular. journal_reset() discards all records, by incrementing the epoch stored in the
+ *   superblock and in each record, once the records have been applied elsewhere.
+ *
+ *   Only one process may have a journal region open at a time.
+ */
+
+#ifndef NVRAM_UIO_JOURNAL_H_
+#define NVRAM_UIO_JOURNAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+
+#define JOURNAL_MAGIC 0x4c4e524a4d41564eULL /* "NVAMJRNL" */
+#define JOURNAL_VERSION 1
+
+/* Records and shards are aligned to this size in the device memory */
+#define JOURNAL_ALIGN 64
+
+#define JOURNAL_MAX_SHARDS 64
+
+/* The maximum number of CPUs mapped to shards; CPUs with higher numbers use shard zero */
+#define JOURNAL_MAX_CPUS 1024
+
+/** The superblock at the start of the journal region */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_shards;
+    /** Incremented by journal_reset(), records with a different epoch are ignored */
+    uint32_t epoch;
+    uint32_t reserved;
+    uint64_t shard_size;
+    uint64_t padding[4];
+} journal_superblock;
+
+/** The header of each record in a shard, followed by the record data padded to JOURNAL_ALIGN */
+typedef struct
+{
+    uint64_t sequence;
+    uint32_t epoch;
+    uint32_t length;
+    /** journal_record_check() of the header and data */
+    uint64_t check;
+    uint64_t reserved;
+} journal_record_header;
+
+_Static_assert (sizeof (journal_superblock) == JOURNAL_ALIGN, "journal_superblock must be one line");
+
+/** Selects how the calling thread's CPU is mapped to a shard */
+typedef enum
+{
+    JOURNAL_SHARD_PER_CPU,
+    JOURNAL_SHARD_PER_NODE
+} journal_shard_mode;
+
+/** The host state of one shard */
+typedef struct
+{
+    /** Protects the other fields */
+    pthread_mutex_t lock;
+    /** Signalled when a group commit completes */
+    pthread_cond_t flushed;
+    /** The offset of the shard in the device memory */
+    uint64_t card_offset;
+    /** The number of bytes of the shard used, including records staged but not yet written */
+    uint64_t tail;
+    /** The shard's part of the DMA buffer, used as two halves which alternate between staging and being written */
+    size_t buffer_offset;
+    size_t half_size;
+    /** The half of the buffer being staged into, and the number of bytes staged */
+    unsigned int staging_half;
+    size_t staged_bytes;
+    /** The shard offset of the first record staged */
+    uint64_t staged_tail;
+    /** Number of the group commit of the records being staged, and of the last group commit written */
+    uint64_t staging_group;
+    uint64_t written_group;
+    /** Set while one thread is writing a group commit */
+    bool writing;
+    /** Set when a write failed, after which all commits to the shard fail */
+    bool failed;
+    uint64_t num_records;
+    uint64_t num_group_commits;
+} __attribute__((aligned(64))) journal_shard;
+
+/**
+ * Called with the shard locked for each record once the group commit containing it has been written to the device,
+ * in increasing sequence order within each shard.
+ */
+typedef void (*journal_append_fn) (void *const arg, const unsigned int shard_index, const uint64_t sequence,
+                                   const uint64_t shard_offset, const uint64_t record_size);
+
+/** An open journal */
+typedef struct
+{
+    nvram_uio_context *context;
+    uint64_t region_offset;
+    journal_superblock superblock;
+    journal_shard shards[JOURNAL_MAX_SHARDS];
+    /** The next sequence number to be given to a record */
+    uint64_t next_sequence __attribute__((aligned(64)));
+    /** Maps the CPU numbers to shards */
+    uint8_t cpu_shards[JOURNAL_MAX_CPUS];
+    /** Optional observer of written records, e.g. to maintain an index */
+    journal_append_fn append_observer;
+    void *append_observer_arg;
+} journal;
+
+/** Called for each record found when a journal is opened, in sequence order */
+typedef void (*journal_replay_fn) (const uint64_t sequence, const void *const data, const size_t length,
+                                   void *const arg);
+
+/**
+ * @brief Round a size up to JOURNAL_ALIGN
+ */
+static inline uint64_t journal_align (const uint64_t size)
+{
+    return (size + (JOURNAL_ALIGN - 1)) & ~(uint64_t) (JOURNAL_ALIGN - 1);
+}
+
+/**
+ * @brief Return the check word of a record, which covers the header fields and the data
+ */
+static inline uint64_t journal_record_check (const journal_record_header *const header, const void *const data)
+{
+    const uint8_t *const bytes = data;
+    uint64_t check = 0xcbf29ce484222325ULL ^ header->sequence ^ ((uint64_t) header->epoch << 32) ^ header->length;
+    uint64_t word;
+    size_t index;
+
+    for (index = 0; (index + sizeof (word)) <= header->length; index += sizeof (word))
+    {
+        __builtin_memcpy (&word, &bytes[index], sizeof (word));
+        check = (check ^ word) * 0x100000001b3ULL;
+        check ^= check >> 29;
+    }
+    for (; index < header->length; index++)
+    {
+        check = (check ^ bytes[index]) * 0x100000001b3ULL;
+    }
+
+    return check;
+}
+
+bool journal_format (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                     const unsigned int num_shards);
+bool journal_open (journal *const jnl, nvram_uio_context *const context, const uint64_t region_offset,
+                   const journal_shard_mode shard_mode, journal_replay_fn replay, void *const replay_arg);
+bool journal_write (journal *const jnl, const void *const data, const size_t length, uint64_t *const sequence);
+void journal_set_append_observer (journal *const jnl, journal_append_fn observer, void *const arg);
+bool journal_reset (journal *const jnl);
+void journal_close (journal *const jnl);
+
+#endif /* NVRAM_UIO_JOURNAL_H_ */
@@ -0,0 +1,828 @@
+/*
+ * @file nvram_uio_lsheap.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Log-structured heap of keyed records in the NVRAM device memory, with a background compactor
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "nvram_uio_lsheap.h"
+#include "nvram_uio_dma.h"
+
+/** A record copied by the compactor, which is remapped once written */
+typedef struct
+{
+    uint64_t key;
+    uint64_t old_location;
+    uint64_t new_location;
+    uint32_t record_size;
+} copied_record;
+
+/** The state of the compactor thread */
+typedef struct
+{
+    lsheap *heap;
+    /** Host copies of the victim segment, and of the records being copied to the destination segment */
+    uint8_t *victim_data;
+    uint8_t *output;
+    size_t output_bytes;
+    copied_record *copied;
+    size_t num_copied;
+    /** The destination segment offset at which the output is written */
+    uint64_t output_segment_offset;
+    /** The throttle */
+    uint64_t interval_start_ns;
+    uint64_t previous_histogram[NVRAM_UIO_LATENCY_BUCKETS];
+    bool paused;
+    uint64_t delay_ns;
+} compactor_state;
+
+/**
+ * @brief Round a size up to LSHEAP_ALIGN
+ */
+static inline uint64_t lsheap_align (const uint64_t size)
+{
+    return (size + (LSHEAP_ALIGN - 1)) & ~(uint64_t) (LSHEAP_ALIGN - 1);
+}
+
+/**
+ * @brief Return the device offset of a segment
+ */
+static inline uint64_t segment_offset (const lsheap *const heap, const uint32_t segment)
+{
+    return heap->region_offset + sizeof (lsheap_superblock) + ((uint64_t) segment * heap->superblock.segment_size);
+}
+
+/**
+ * @brief Return the segment containing a device offset
+ */
+static inline uint32_t location_segment (const lsheap *const heap, const uint64_t location)
+{
+    return (uint32_t) ((location - heap->region_offset - sizeof (lsheap_superblock)) /
+                       heap->superblock.segment_size);
+}
+
+/**
+ * @brief Return the check word of a record, which covers the header fields and the data
+ */
+static uint64_t lsheap_record_check (const lsheap_record_header *const header, const uint8_t *const data)
+{
+    uint64_t check = 0xcbf29ce484222325ULL ^ header->key ^ (header->version << 17) ^ header->length;
+    uint64_t word;
+    size_t index;
+
+    for (index = 0; (index + sizeof (word)) <= header->length; index += sizeof (word))
+    {
+        memcpy (&word, &data[index], sizeof (word));
+        check = (check ^ word) * 0x100000001b3ULL;
+        check ^= check >> 29;
+    }
+    for (; index < header->length; index++)
+    {
+        check = (check ^ data[index]) * 0x100000001b3ULL;
+    }
+
+    return check;
+}
+
+/**
+ * @brief Sleep for a number of nanoseconds
+ */
+static void sleep_ns (const uint64_t delay_ns)
+{
+    struct timespec delay;
+
+    delay.tv_sec = (time_t) (delay_ns / 1000000000ULL);
+    delay.tv_nsec = (long) (delay_ns % 1000000000ULL);
+    nanosleep (&delay, NULL);
+}
+
+/**
+ * @brief Format a heap region, with every segment free
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the heap region in the device memory, a multiple of LSHEAP_ALIGN
+ * @param[in] region_size The size of the heap region
+ * @param[in] segment_size The size of each segment, a multiple of LSHEAP_ALIGN
+ * @param[in] max_keys The number of keys
+ * @return Returns true if the heap was formatted
+ */
+bool lsheap_format (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                    const uint64_t segment_size, const uint64_t max_keys)
+{
+    const lsheap_segment_header free_header = {0};
+    lsheap_superblock superblock;
+    uint32_t segment;
+
+    memset (&superblock, 0, sizeof (superblock));
+    superblock.magic = LSHEAP_MAGIC;
+    superblock.version = LSHEAP_VERSION;
+    superblock.segment_size = segment_size;
+    superblock.max_keys = max_keys;
+    if (((region_offset % LSHEAP_ALIGN) != 0) || ((segment_size % LSHEAP_ALIGN) != 0) ||
+        (segment_size < (4 * LSHEAP_ALIGN)) || (segment_size > UINT32_MAX) || (max_keys == 0) ||
+        (region_size < sizeof (superblock)))
+    {
+        return false;
+    }
+    superblock.num_segments = (uint32_t) ((region_size - sizeof (superblock)) / segment_size);
+    if (superblock.num_segments < (LSHEAP_RESERVED_SEGMENTS + 2))
+    {
+        return false;
+    }
+
+    /* Free every segment before writing the superblock, so a partially formatted heap can't be opened */
+    for (segment = 0; segment < superblock.num_segments; segment++)
+    {
+        if (!dma_write_from_host (context, region_offset + sizeof (superblock) + (segment * segment_size),
+                                  &free_header, sizeof (free_header)))
+        {
+            return false;
+        }
+    }
+
+    return dma_write_from_host (context, region_offset, &superblock, sizeof (superblock));
+}
+
+/**
+ * @brief Scan one segment when the heap is opened, making live the records with the greatest versions
+ * @param[in,out] heap The heap being opened
+ * @param[in] segment The segment to scan
+ * @param[in,out] versions The greatest version found so far for each key
+ * @return Returns false if the segment couldn't be read
+ */
+static bool scan_segment (lsheap *const heap, const uint32_t segment, uint64_t *const versions)
+{
+    const uint64_t segment_size = heap->superblock.segment_size;
+    const uint64_t card_offset = segment_offset (heap, segment);
+    uint8_t *const data = heap->record_buffer;
+    lsheap_segment_header segment_header;
+    lsheap_record_header header;
+    uint64_t offset;
+    uint64_t record_size;
+
+    if (!dma_read_to_host (heap->context, card_offset, &segment_header, sizeof (segment_header)))
+    {
+        return false;
+    }
+    if (segment_header.magic != LSHEAP_SEGMENT_MAGIC)
+    {
+        heap->segment_states[segment] = LSHEAP_SEGMENT_FREE;
+        heap->num_free_segments++;
+        return true;
+    }
+    if (!dma_read_to_host (heap->context, card_offset, data, segment_size))
+    {
+        return false;
+    }
+
+    for (offset = LSHEAP_ALIGN; (offset + sizeof (header)) <= segment_size; offset += record_size)
+    {
+        memcpy (&header, &data[offset], sizeof (header));
+        record_size = lsheap_align (sizeof (header) + header.length);
+        if ((header.key >= heap->superblock.max_keys) || (header.version == 0) ||
+            (header.length > segment_size) || ((offset + record_size) > segment_size) ||
+            (header.check != lsheap_record_check (&header, &data[offset + sizeof (header)])))
+        {
+            break;
+        }
+        if (header.version > versions[header.key])
+        {
+            if (heap->locations[header.key] != 0)
+            {
+                heap->live_bytes[location_segment (heap, heap->locations[header.key])] -=
+                        heap->record_sizes[header.key];
+            }
+            versions[header.key] = header.version;
+            heap->locations[header.key] = card_offset + offset;
+            heap->record_sizes[header.key] = (uint32_t) record_size;
+            heap->live_bytes[segment] += record_size;
+        }
+        if (header.version >= heap->next_version)
+        {
+            heap->next_version = header.version + 1;
+        }
+    }
+    heap->segment_states[segment] = LSHEAP_SEGMENT_SEALED;
+    heap->used_bytes[segment] = offset;
+
+    return true;
+}
+
+/**
+ * @brief Open a heap, scanning the segments to find the live record of each key
+ * @details Segments which were open when the heap was closed are sealed, and are compacted once they have few
+ *          live bytes.
+ * @param[out] heap The heap to open
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the formatted heap region
+ * @return Returns true if the heap was opened
+ */
+bool lsheap_open (lsheap *const heap, nvram_uio_context *const context, const uint64_t region_offset)
+{
+    uint64_t *versions;
+    uint32_t segment;
+    bool success;
+
+    memset (heap, 0, sizeof (*heap));
+    heap->context = context;
+    heap->region_offset = region_offset;
+    heap->head_segment = -1;
+    heap->compaction_segment = -1;
+    heap->next_version = 1;
+    pthread_mutex_init (&heap->lock, NULL);
+    if (!dma_read_to_host (context, region_offset, &heap->superblock, sizeof (heap->superblock)) ||
+        (heap->superblock.magic != LSHEAP_MAGIC) || (heap->superblock.version != LSHEAP_VERSION))
+    {
+        pthread_mutex_destroy (&heap->lock);
+        return false;
+    }
+
+    heap->locations = calloc (heap->superblock.max_keys, sizeof (heap->locations[0]));
+    heap->record_sizes = calloc (heap->superblock.max_keys, sizeof (heap->record_sizes[0]));
+    heap->segment_states = calloc (heap->superblock.num_segments, sizeof (heap->segment_states[0]));
+    heap->used_bytes = calloc (heap->superblock.num_segments, sizeof (heap->used_bytes[0]));
+    heap->live_bytes = calloc (heap->superblock.num_segments, sizeof (heap->live_bytes[0]));
+    heap->record_buffer = malloc (heap->superblock.segment_size);
+    versions = calloc (heap->superblock.max_keys, sizeof (versions[0]));
+    success = (heap->locations != NULL) && (heap->record_sizes != NULL) && (heap->segment_states != NULL) &&
+            (heap->used_bytes != NULL) && (heap->live_bytes != NULL) && (heap->record_buffer != NULL) &&
+            (versions != NULL);
+
+    for (segment = 0; success && (segment < heap->superblock.num_segments); segment++)
+    {
+        success = scan_segment (heap, segment, versions);
+    }
+    free (versions);
+
+    if (!success)
+    {
+        lsheap_close (heap);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Open a free segment as a head, writing its segment header. Called with the heap locked.
+ * @param[in,out] heap The heap
+ * @param[in] use_reserve When true the reserved free segments may be used, which is only done by the compactor
+ * @return The segment opened, or -1 if there are no free segments
+ */
+static int32_t open_free_segment (lsheap *const heap, const bool use_reserve)
+{
+    lsheap_segment_header segment_header;
+    uint32_t segment;
+
+    if (heap->num_free_segments <= (use_reserve ? 0 : LSHEAP_RESERVED_SEGMENTS))
+    {
+        return -1;
+    }
+    for (segment = 0; segment < heap->superblock.num_segments; segment++)
+    {
+        if (heap->segment_states[segment] == LSHEAP_SEGMENT_FREE)
+        {
+            memset (&segment_header, 0, sizeof (segment_header));
+            segment_header.magic = LSHEAP_SEGMENT_MAGIC;
+            if (!dma_write_from_host (heap->context, segment_offset (heap, segment), &segment_header,
+                                      sizeof (segment_header)))
+            {
+                return -1;
+            }
+            heap->segment_states[segment] = LSHEAP_SEGMENT_OPEN;
+            heap->used_bytes[segment] = LSHEAP_ALIGN;
+            heap->live_bytes[segment] = 0;
+            heap->num_free_segments--;
+            return (int32_t) segment;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Record the latency of a foreground operation, for use by the compactor throttle
+ */
+static void record_foreground_latency (lsheap *const heap, const uint64_t start_ns)
+{
+    __atomic_fetch_add (&heap->latency_histogram[latency_bucket (get_monotonic_time_ns () - start_ns)], 1,
+                        __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Write a record for a key, replacing any previous record
+ * @param[in,out] heap The open heap
+ * @param[in] key The key, less than max_keys
+ * @param[in] data The record data
+ * @param[in] length The length of the record data, which must fit in a segment
+ * @return Returns true if the record was written, or false if the heap is full or the write failed
+ */
+bool lsheap_put (lsheap *const heap, const uint64_t key, const void *const data, const size_t length)
+{
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    const uint64_t record_size = lsheap_align (sizeof (lsheap_record_header) + length);
+    lsheap_record_header header;
+    uint64_t location;
+    bool success = false;
+
+    if ((key >= heap->superblock.max_keys) || (record_size > (heap->superblock.segment_size - LSHEAP_ALIGN)))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&heap->lock);
+    if ((heap->head_segment >= 0) &&
+        ((heap->used_bytes[heap->head_segment] + record_size) > heap->superblock.segment_size))
+    {
+        heap->segment_states[heap->head_segment] = LSHEAP_SEGMENT_SEALED;
+        heap->head_segment = -1;
+    }
+    if (heap->head_segment < 0)
+    {
+        heap->head_segment = open_free_segment (heap, false);
+    }
+
+    if (heap->head_segment >= 0)
+    {
+        memset (&header, 0, sizeof (header));
+        header.key = key;
+        header.version = heap->next_version;
+        header.length = (uint32_t) length;
+        header.check = lsheap_record_check (&header, data);
+        memcpy (heap->record_buffer, &header, sizeof (header));
+        memcpy (&heap->record_buffer[sizeof (header)], data, length);
+        memset (&heap->record_buffer[sizeof (header) + length], 0, record_size - sizeof (header) - length);
+
+        location = segment_offset (heap, (uint32_t) heap->head_segment) + heap->used_bytes[heap->head_segment];
+        success = dma_write_from_host (heap->context, location, heap->record_buffer, record_size);
+        if (success)
+        {
+            if (heap->locations[key] != 0)
+            {
+                heap->live_bytes[location_segment (heap, heap->locations[key])] -= heap->record_sizes[key];
+            }
+            heap->locations[key] = location;
+            heap->record_sizes[key] = (uint32_t) record_size;
+            heap->live_bytes[heap->head_segment] += record_size;
+            heap->used_bytes[heap->head_segment] += record_size;
+            heap->next_version++;
+        }
+    }
+    pthread_mutex_unlock (&heap->lock);
+    record_foreground_latency (heap, start_ns);
+
+    return success;
+}
+
+/**
+ * @brief Read the record for a key
+ * @param[in,out] heap The open heap
+ * @param[in] key The key to read
+ * @param[out] data Where to store the record data, truncated to max_length
+ * @param[in] max_length The size of data
+ * @param[out] length The length of the record
+ * @return Returns true if the key has a record, and it was read
+ */
+bool lsheap_get (lsheap *const heap, const uint64_t key, void *const data, const size_t max_length,
+                 size_t *const length)
+{
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    lsheap_record_header header;
+    bool success = false;
+
+    if (key >= heap->superblock.max_keys)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&heap->lock);
+    if ((heap->locations[key] != 0) &&
+        dma_read_to_host (heap->context, heap->locations[key], heap->record_buffer, heap->record_sizes[key]))
+    {
+        memcpy (&header, heap->record_buffer, sizeof (header));
+        *length = header.length;
+        memcpy (data, &heap->record_buffer[sizeof (header)], (header.length < max_length) ? header.length : max_length);
+        success = header.key == key;
+    }
+    pthread_mutex_unlock (&heap->lock);
+    record_foreground_latency (heap, start_ns);
+
+    return success;
+}
+
+/**
+ * @brief Get the utilisation of the heap
+ * @param[in,out] heap The open heap
+ * @param[out] live_bytes The bytes used by live records
+ * @param[out] used_bytes The bytes used by the segments in use, including dead records
+ * @param[out] num_free_segments The number of free segments
+ */
+void lsheap_get_utilisation (lsheap *const heap, uint64_t *const live_bytes, uint64_t *const used_bytes,
+                             uint32_t *const num_free_segments)
+{
+    uint32_t segment;
+
+    *live_bytes = 0;
+    *used_bytes = 0;
+    pthread_mutex_lock (&heap->lock);
+    for (segment = 0; segment < heap->superblock.num_segments; segment++)
+    {
+        *live_bytes += heap->live_bytes[segment];
+        *used_bytes += heap->used_bytes[segment];
+    }
+    *num_free_segments = heap->num_free_segments;
+    pthread_mutex_unlock (&heap->lock);
+}
+
+/**
+ * @brief Wait before the compactor performs its next transfer, throttled by the foreground latency
+ * @details At the end of each interval the 99th percentile of the foreground latencies during the interval is
+ *          compared against the bound. While the bound is exceeded compaction pauses for whole intervals, unless
+ *          the foreground has run out of free segments.
+ * @param[in,out] state The compactor
+ * @return Returns false if the compactor is to stop
+ */
+static bool compactor_throttle (compactor_state *const state)
+{
+    lsheap *const heap = state->heap;
+    const lsheap_compaction_config *const config = &heap->compaction_config;
+    uint64_t histogram[NVRAM_UIO_LATENCY_BUCKETS];
+    uint64_t delta[NVRAM_UIO_LATENCY_BUCKETS];
+    uint64_t now_ns;
+    uint64_t p99_ns;
+    unsigned int bucket;
+    bool out_of_space;
+
+    for (;;)
+    {
+        if (__atomic_load_n (&heap->stop_compactor, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+
+        now_ns = get_monotonic_time_ns ();
+        if ((now_ns - state->interval_start_ns) >= config->interval_ns)
+        {
+            for (bucket = 0; bucket < NVRAM_UIO_LATENCY_BUCKETS; bucket++)
+            {
+                histogram[bucket] = __atomic_load_n (&heap->latency_histogram[bucket], __ATOMIC_RELAXED);
+                delta[bucket] = histogram[bucket] - state->previous_histogram[bucket];
+            }
+            memcpy (state->previous_histogram, histogram, sizeof (histogram));
+            state->interval_start_ns = now_ns;
+
+            p99_ns = latency_histogram_percentile_ns (delta, 99.0);
+            state->paused = p99_ns > config->p99_bound_ns;
+            if (state->paused)
+            {
+                state->delay_ns = (state->delay_ns == 0) ? (config->interval_ns / 64) : (state->delay_ns * 2);
+                if (state->delay_ns > config->interval_ns)
+                {
+                    state->delay_ns = config->interval_ns;
+                }
+            }
+            else
+            {
+                state->delay_ns /= 2;
+            }
+
+            pthread_mutex_lock (&heap->lock);
+            heap->compaction_statistics.last_p99_ns = p99_ns;
+            heap->compaction_statistics.delay_ns = state->delay_ns;
+            if (state->paused)
+            {
+                heap->compaction_statistics.intervals_paused++;
+            }
+            pthread_mutex_unlock (&heap->lock);
+        }
+
+        /* Once the foreground can't allocate a segment its writes fail, which is worse than exceeding the bound */
+        out_of_space = __atomic_load_n (&heap->num_free_segments, __ATOMIC_RELAXED) <= LSHEAP_RESERVED_SEGMENTS;
+        if (!state->paused || out_of_space)
+        {
+            break;
+        }
+        sleep_ns (state->interval_start_ns + config->interval_ns - now_ns);
+    }
+
+    if ((state->delay_ns > 0) && !out_of_space)
+    {
+        sleep_ns (state->delay_ns);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write the records copied to the output, then remap the keys whose records haven't been overwritten
+ * @param[in,out] state The compactor
+ * @param[in] victim The segment being compacted
+ * @return Returns false if the compactor is to stop, or a write failed
+ */
+static bool flush_output (compactor_state *const state, const uint32_t victim)
+{
+    lsheap *const heap = state->heap;
+    const int32_t destination = heap->compaction_segment;
+    const uint64_t output_offset = segment_offset (heap, (uint32_t) destination) + state->output_segment_offset;
+    size_t bytes_done;
+    size_t chunk_bytes;
+    size_t record_index;
+    copied_record *record;
+    bool success = true;
+
+    for (bytes_done = 0; success && (bytes_done < state->output_bytes); bytes_done += chunk_bytes)
+    {
+        chunk_bytes = ((state->output_bytes - bytes_done) < heap->compaction_config.chunk_bytes) ?
+                (state->output_bytes - bytes_done) : heap->compaction_config.chunk_bytes;
+        success = compactor_throttle (state);
+        if (success)
+        {
+            pthread_mutex_lock (&heap->lock);
+            success = dma_write_from_host (heap->context, output_offset + bytes_done, &state->output[bytes_done],
+                                           chunk_bytes);
+            pthread_mutex_unlock (&heap->lock);
+        }
+    }
+
+    /* The copies are in the device memory, so can be made live */
+    pthread_mutex_lock (&heap->lock);
+    if (success)
+    {
+        heap->used_bytes[destination] += state->output_bytes;
+        for (record_index = 0; record_index < state->num_copied; record_index++)
+        {
+            record = &state->copied[record_index];
+            if (heap->locations[record->key] == record->old_location)
+            {
+                heap->locations[record->key] = record->new_location;
+                heap->live_bytes[destination] += record->record_size;
+                heap->live_bytes[victim] -= record->record_size;
+            }
+            else
+            {
+                heap->compaction_statistics.records_superseded++;
+            }
+        }
+        heap->compaction_statistics.records_copied += state->num_copied;
+        heap->compaction_statistics.bytes_copied += state->output_bytes;
+    }
+    state->output_segment_offset += state->output_bytes;
+    state->output_bytes = 0;
+    state->num_copied = 0;
+    pthread_mutex_unlock (&heap->lock);
+
+    return success;
+}
+
+/**
+ * @brief Compact one segment, copying its live records to the compactor's destination segment then freeing it
+ * @param[in,out] state The compactor
+ * @param[in] victim The sealed segment to compact
+ * @return Returns false if the compactor is to stop, the heap has no free segment or a transfer failed
+ */
+static bool compact_segment (compactor_state *const state, const uint32_t victim)
+{
+    lsheap *const heap = state->heap;
+    const lsheap_segment_header free_header = {0};
+    const uint64_t victim_offset = segment_offset (heap, victim);
+    const uint64_t segment_size = heap->superblock.segment_size;
+    lsheap_record_header header;
+    uint64_t victim_used;
+    uint64_t offset;
+    uint64_t record_size;
+    size_t chunk_bytes;
+    bool live;
+    bool success = true;
+
+    pthread_mutex_lock (&heap->lock);
+    victim_used = heap->used_bytes[victim];
+    pthread_mutex_unlock (&heap->lock);
+
+    /* Read the victim segment, a chunk at a time */
+    for (offset = 0; success && (offset < victim_used); offset += chunk_bytes)
+    {
+        chunk_bytes = ((victim_used - offset) < heap->compaction_config.chunk_bytes) ?
+                (size_t) (victim_used - offset) : heap->compaction_config.chunk_bytes;
+        success = compactor_throttle (state);
+        if (success)
+        {
+            pthread_mutex_lock (&heap->lock);
+            success = dma_read_to_host (heap->context, victim_offset + offset, &state->victim_data[offset],
+                                        chunk_bytes);
+            pthread_mutex_unlock (&heap->lock);
+        }
+    }
+
+    /* Copy the live records to the output, flushing the output when the destination segment is full */
+    for (offset = LSHEAP_ALIGN; success && (offset < victim_used); offset += record_size)
+    {
+        memcpy (&header, &state->victim_data[offset], sizeof (header));
+        record_size = lsheap_align (sizeof (header) + header.length);
+
+        pthread_mutex_lock (&heap->lock);
+        live = (header.key < heap->superblock.max_keys) && (heap->locations[header.key] == (victim_offset + offset));
+        if (live && ((heap->compaction_segment < 0) ||
+                     ((state->output_segment_offset + state->output_bytes + record_size) > segment_size)))
+        {
+            pthread_mutex_unlock (&heap->lock);
+            success = (heap->compaction_segment < 0) || flush_output (state, victim);
+            pthread_mutex_lock (&heap->lock);
+            if (heap->compaction_segment >= 0)
+            {
+                heap->segment_states[heap->compaction_segment] = LSHEAP_SEGMENT_SEALED;
+            }
+            heap->compaction_segment = success ? open_free_segment (heap, true) : -1;
+            state->output_segment_offset = LSHEAP_ALIGN;
+            success = success && (heap->compaction_segment >= 0);
+        }
+        pthread_mutex_unlock (&heap->lock);
+
+        if (success && live)
+        {
+            memcpy (&state->output[state->output_bytes], &state->victim_data[offset], record_size);
+            state->copied[state->num_copied].key = header.key;
+            state->copied[state->num_copied].old_location = victim_offset + offset;
+            state->copied[state->num_copied].new_location = segment_offset (heap, (uint32_t) heap->compaction_segment) +
+                    state->output_segment_offset + state->output_bytes;
+            state->copied[state->num_copied].record_size = (uint32_t) record_size;
+            state->num_copied++;
+            state->output_bytes += record_size;
+        }
+    }
+    if (success && (state->output_bytes > 0))
+    {
+        success = flush_output (state, victim);
+    }
+
+    /* Free the victim once none of its records are live */
+    if (success)
+    {
+        pthread_mutex_lock (&heap->lock);
+        if (heap->live_bytes[victim] == 0)
+        {
+            success = dma_write_from_host (heap->context, victim_offset, &free_header, sizeof (free_header));
+            if (success)
+            {
+                heap->segment_states[victim] = LSHEAP_SEGMENT_FREE;
+                heap->used_bytes[victim] = 0;
+                heap->num_free_segments++;
+                heap->compaction_statistics.segments_compacted++;
+            }
+        }
+        pthread_mutex_unlock (&heap->lock);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Select the sealed segment with the fewest live bytes, if below the utilisation threshold
+ * @return The segment to compact, or -1 if none
+ */
+static int32_t select_victim (lsheap *const heap)
+{
+    const uint64_t threshold = (heap->superblock.segment_size * heap->compaction_config.utilisation_percent) / 100;
+    int32_t victim = -1;
+    uint32_t segment;
+
+    pthread_mutex_lock (&heap->lock);
+    for (segment = 0; segment < heap->superblock.num_segments; segment++)
+    {
+        if ((heap->segment_states[segment] == LSHEAP_SEGMENT_SEALED) && (heap->live_bytes[segment] < threshold) &&
+            ((victim < 0) || (heap->live_bytes[segment] < heap->live_bytes[victim])))
+        {
+            victim = (int32_t) segment;
+        }
+    }
+    pthread_mutex_unlock (&heap->lock);
+
+    return victim;
+}
+
+/**
+ * @brief Thread which compacts the segments with low utilisation until stopped
+ */
+static void *compactor_thread (void *arg)
+{
+    compactor_state *const state = arg;
+    lsheap *const heap = state->heap;
+    int32_t victim;
+
+    while (!__atomic_load_n (&heap->stop_compactor, __ATOMIC_ACQUIRE))
+    {
+        victim = select_victim (heap);
+        if ((victim < 0) || !compact_segment (state, (uint32_t) victim))
+        {
+            sleep_ns (heap->compaction_config.interval_ns);
+        }
+    }
+
+    free (state->victim_data);
+    free (state->output);
+    free (state->copied);
+    free (state);
+
+    return NULL;
+}
+
+/**
+ * @brief Start the background compactor thread
+ * @param[in,out] heap The open heap
+ * @param[in] config Controls the compactor
+ * @return Returns true if the compactor was started
+ */
+bool lsheap_start_compactor (lsheap *const heap, const lsheap_compaction_config *const config)
+{
+    const uint64_t segment_size = heap->superblock.segment_size;
+    compactor_state *state;
+
+    if (heap->compactor_running || (config->chunk_bytes == 0) || (config->interval_ns == 0))
+    {
+        return false;
+    }
+    state = calloc (1, sizeof (*state));
+    if (state == NULL)
+    {
+        return false;
+    }
+    state->heap = heap;
+    state->victim_data = malloc (segment_size);
+    state->output = malloc (segment_size);
+    state->copied = calloc (segment_size / LSHEAP_ALIGN, sizeof (state->copied[0]));
+    state->interval_start_ns = get_monotonic_time_ns ();
+    memcpy (state->previous_histogram, heap->latency_histogram, sizeof (state->previous_histogram));
+    if ((state->victim_data == NULL) || (state->output == NULL) || (state->copied == NULL))
+    {
+        free (state->victim_data);
+        free (state->output);
+        free (state->copied);
+        free (state);
+        return false;
+    }
+
+    heap->compaction_config = *config;
+    heap->stop_compactor = false;
+    if (pthread_create (&heap->compactor_thread, NULL, compactor_thread, state) != 0)
+    {
+        free (state->victim_data);
+        free (state->output);
+        free (state->copied);
+        free (state);
+        return false;
+    }
+    heap->compactor_running = true;
+
+    return true;
+}
+
+/**
+ * @brief Get the statistics of the compactor
+ */
+void lsheap_get_compaction_statistics (lsheap *const heap, lsheap_compaction_statistics *const statistics)
+{
+    pthread_mutex_lock (&heap->lock);
+    *statistics = heap->compaction_statistics;
+    pthread_mutex_unlock (&heap->lock);
+}
+
+/**
+ * @brief Stop the background compactor thread, if running
+ * @details The compactor stops before its next transfer, leaving any partially compacted segment sealed.
+ */
+void lsheap_stop_compactor (lsheap *const heap)
+{
+    if (heap->compactor_running)
+    {
+        __atomic_store_n (&heap->stop_compactor, true, __ATOMIC_RELEASE);
+        pthread_join (heap->compactor_thread, NULL);
+        heap->compactor_running = false;
+    }
+}
+
+/**
+ * @brief Close a heap, stopping the compactor and freeing the host state
+ */
+void lsheap_close (lsheap *const heap)
+{
+    lsheap_stop_compactor (heap);
+    free (heap->locations);
+    free (heap->record_sizes);
+    free (heap->segment_states);
+    free (heap->used_bytes);
+    free (heap->live_bytes);
+    free (heap->record_buffer);
+    heap->locations = NULL;
+    heap->record_sizes = NULL;
+    heap->segment_states = NULL;
+    heap->used_bytes = NULL;
+    heap->live_bytes = NULL;
+    heap->record_buffer = NULL;
+    pthread_mutex_destroy (&heap->lock);
+}
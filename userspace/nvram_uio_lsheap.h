@@ -0,0 +1,162 @@
+/*
+ * @file nvram_uio_lsheap.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Log-structured heap of keyed records in the NVRAM device memory, with a background compactor
+ * @details
+ *   The heap region starts with a lsheap_superblock, followed by fixed size segments. Each record is appended to
+ *   the head segment with a version number greater than any previous record, so overwriting a key leaves the
+ *   previous record dead in its segment. When the heap is opened every segment is scanned and the record with the
+ *   greatest version of each key is live.
+ *
+ *   The compactor thread selects the sealed segment with the lowest proportion of live bytes, below a threshold,
+ *   reads it to host memory, copies the records which are still live to its own destination segment and then, with
+ *   the heap locked, remaps the keys whose location hasn't changed since and frees the victim segment. A copied
+ *   record keeps its version, so a crash during compaction leaves two identical copies of which either is valid.
+ *
+ *   The DMA buffer and the single DMA engine are shared by the foreground and the compactor, so the compactor
+ *   transfers at most chunk_bytes at a time. The foreground latencies are recorded in a histogram, and after each
+ *   interval the compactor computes the 99th percentile of the latencies during the interval. While the percentile
+ *   exceeds the bound compaction pauses and the delay between chunks is doubled; once the percentile is back within
+ *   the bound the delay is halved. Compaction doesn't pause once only the reserved free segments remain, as the
+ *   foreground writes would otherwise fail.
+ */
+
+#ifndef NVRAM_UIO_LSHEAP_H_
+#define NVRAM_UIO_LSHEAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_stats.h"
+
+#define LSHEAP_MAGIC 0x50414548534c564eULL /* "NVLSHEAP" */
+#define LSHEAP_SEGMENT_MAGIC 0x4745534c564eULL /* "NVLSEG" */
+#define LSHEAP_VERSION 1
+
+/* Records and segment headers are aligned to a cache line */
+#define LSHEAP_ALIGN 64
+
+/* The number of free segments only the compactor may allocate, so that compaction can always make progress */
+#define LSHEAP_RESERVED_SEGMENTS 1
+
+/** The superblock at the start of the heap region */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_segments;
+    uint64_t segment_size;
+    /** Keys are in the range 0..max_keys-1 */
+    uint64_t max_keys;
+    uint64_t padding[4];
+} lsheap_superblock;
+
+/** The header at the start of each segment which is in use */
+typedef struct
+{
+    uint64_t magic;
+    uint64_t padding[7];
+} lsheap_segment_header;
+
+/** The header of each record in a segment, followed by the record data padded to LSHEAP_ALIGN */
+typedef struct
+{
+    uint64_t key;
+    uint64_t version;
+    uint32_t length;
+    uint32_t reserved;
+    /** Check word of the header fields and the data */
+    uint64_t check;
+} lsheap_record_header;
+
+_Static_assert (sizeof (lsheap_superblock) == LSHEAP_ALIGN, "lsheap_superblock must be one line");
+_Static_assert (sizeof (lsheap_segment_header) == LSHEAP_ALIGN, "lsheap_segment_header must be one line");
+
+/** The state of a segment */
+typedef enum
+{
+    LSHEAP_SEGMENT_FREE,
+    /** The head segment being appended to by either the foreground or the compactor */
+    LSHEAP_SEGMENT_OPEN,
+    LSHEAP_SEGMENT_SEALED
+} lsheap_segment_state;
+
+/** Controls the compactor */
+typedef struct
+{
+    /** Segments with a lower percentage of live bytes than this are compacted */
+    unsigned int utilisation_percent;
+    /** The bound on the 99th percentile of the foreground latency */
+    uint64_t p99_bound_ns;
+    /** The maximum bytes transferred by the compactor at a time */
+    size_t chunk_bytes;
+    /** The interval over which the foreground latency is measured */
+    uint64_t interval_ns;
+} lsheap_compaction_config;
+
+/** Statistics of the compactor */
+typedef struct
+{
+    uint64_t segments_compacted;
+    uint64_t records_copied;
+    uint64_t bytes_copied;
+    /** Records copied which were overwritten by the foreground before they could be remapped */
+    uint64_t records_superseded;
+    /** The number of intervals in which compaction was paused by the foreground latency */
+    uint64_t intervals_paused;
+    /** The 99th percentile of the foreground latency in the last interval, and the current delay between chunks */
+    uint64_t last_p99_ns;
+    uint64_t delay_ns;
+} lsheap_compaction_statistics;
+
+/** An open heap */
+typedef struct
+{
+    nvram_uio_context *context;
+    uint64_t region_offset;
+    lsheap_superblock superblock;
+    /** Protects the other fields, and serialises use of the DMA buffer */
+    pthread_mutex_t lock;
+    /** For each key the device offset of the live record header, or zero if the key has no record */
+    uint64_t *locations;
+    /** For each key the size of the live record, including the header and padding */
+    uint32_t *record_sizes;
+    /** For each segment a lsheap_segment_state, the bytes used including dead records, and the live bytes */
+    uint8_t *segment_states;
+    uint64_t *used_bytes;
+    uint64_t *live_bytes;
+    uint32_t num_free_segments;
+    /** The heads of the foreground and the compactor, or -1 if none is open */
+    int32_t head_segment;
+    int32_t compaction_segment;
+    uint64_t next_version;
+    /** Host buffer in which a record is assembled before being written */
+    uint8_t *record_buffer;
+    /** Histogram of the foreground put and get latencies, updated with relaxed atomics */
+    uint64_t latency_histogram[NVRAM_UIO_LATENCY_BUCKETS];
+    /** The compactor */
+    lsheap_compaction_config compaction_config;
+    lsheap_compaction_statistics compaction_statistics;
+    pthread_t compactor_thread;
+    bool compactor_running;
+    bool stop_compactor;
+} lsheap;
+
+bool lsheap_format (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                    const uint64_t segment_size, const uint64_t max_keys);
+bool lsheap_open (lsheap *const heap, nvram_uio_context *const context, const uint64_t region_offset);
+bool lsheap_put (lsheap *const heap, const uint64_t key, const void *const data, const size_t length);
+bool lsheap_get (lsheap *const heap, const uint64_t key, void *const data, const size_t max_length,
+                 size_t *const length);
+void lsheap_get_utilisation (lsheap *const heap, uint64_t *const live_bytes, uint64_t *const used_bytes,
+                             uint32_t *const num_free_segments);
+bool lsheap_start_compactor (lsheap *const heap, const lsheap_compaction_config *const config);
+void lsheap_get_compaction_statistics (lsheap *const heap, lsheap_compaction_statistics *const statistics);
+void lsheap_stop_compactor (lsheap *const heap);
+void lsheap_close (lsheap *const heap);
+
+#endif /* NVRAM_UIO_LSHEAP_H_ */
@@ -0,0 +1,642 @@
+/*
+ * @file nvram_uio_pmem.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Subset of the libpmem persistence API, implemented on regions of the NVRAM device memory
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nvram_uio_pmem.h"
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_window.h"
+#include "nvram_uio_regions.h"
+
+/** A mapped region of the device memory */
+typedef struct
+{
+    /** The host copy of the region returned to the caller */
+    uint8_t *addr;
+    size_t length;
+    /** The length of the host mapping, rounded up to whole pages */
+    size_t mmap_length;
+    uint64_t card_offset;
+} pmem_mapping;
+
+/** The state shared by all threads using the API */
+static struct
+{
+    /** Protects the other fields, and serialises use of the DMA buffer */
+    pthread_mutex_t lock;
+    bool device_opened;
+    nvram_uio_context context;
+    bool window_mapped;
+    size_t window_threshold;
+    unsigned int num_mappings;
+    pmem_mapping mappings[PMEM_MAX_MAPPINGS];
+    nvram_pmem_statistics statistics;
+} pmem_state =
+{
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/* Set when the thread has written through the window since its last drain */
+static __thread bool window_writes_pending;
+
+/* The message for the last error in the thread, returned by pmem_errormsg() */
+static __thread char error_message[256];
+
+/**
+ * @brief Record the message for an error, appending the description of errno when saved_errno is non-zero
+ */
+static void set_error (const int saved_errno, const char *const format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start (args, format);
+    length = vsnprintf (error_message, sizeof (error_message), format, args);
+    va_end (args);
+    if ((saved_errno != 0) && (length >= 0) && ((size_t) length < sizeof (error_message)))
+    {
+        snprintf (&error_message[length], sizeof (error_message) - (size_t) length, ": %s", strerror (saved_errno));
+    }
+    errno = saved_errno;
+}
+
+/**
+ * @brief Open the device on first use. Must be called with the lock held.
+ * @details The device access functions exit the process if the device can't be opened.
+ */
+static void open_pmem_device (void)
+{
+    const char *const threshold_text = getenv ("NVRAM_UIO_PMEM_WINDOW_THRESHOLD");
+
+    if (pmem_state.device_opened)
+    {
+        return;
+    }
+
+    find_uio_device (&pmem_state.context);
+    get_uio_device_parameters (&pmem_state.context);
+    open_uio_device (&pmem_state.context);
+    map_dma_buffer (&pmem_state.context);
+    pmem_state.window_mapped = map_window (&pmem_state.context);
+    pmem_state.window_threshold = (threshold_text != NULL) ?
+            strtoul (threshold_text, NULL, 0) : PMEM_DEFAULT_WINDOW_THRESHOLD;
+    pmem_state.device_opened = true;
+}
+
+/**
+ * @brief Find the mapped device region containing an address
+ * @param[in] addr The address to find
+ * @param[out] mapping Where to return a copy of the mapping found
+ * @return Returns true if addr is in a mapped device region
+ */
+static bool find_mapping (const void *const addr, pmem_mapping *const mapping)
+{
+    const uint8_t *const addr_bytes = addr;
+    unsigned int mapping_index;
+    bool found = false;
+
+    pthread_mutex_lock (&pmem_state.lock);
+    for (mapping_index = 0; !found && (mapping_index < pmem_state.num_mappings); mapping_index++)
+    {
+        const pmem_mapping *const candidate = &pmem_state.mappings[mapping_index];
+
+        if ((addr_bytes >= candidate->addr) && (addr_bytes < &candidate->addr[candidate->length]))
+        {
+            *mapping = *candidate;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock (&pmem_state.lock);
+
+    return found;
+}
+
+/**
+ * @brief Parse the part of a path following PMEM_NVRAM_PATH_PREFIX into the region of the device memory it names
+ * @return Returns true if the region was found
+ */
+static bool parse_device_path (const char *const spec, uint64_t *const region_offset, uint64_t *const region_size)
+{
+    const char *const region_file = getenv ("NVRAM_UIO_PMEM_REGIONS");
+    nvram_region_table table;
+    const nvram_region *region;
+    unsigned long long offset;
+    unsigned long long size;
+    int num_chars = 0;
+
+    if ((sscanf (spec, "%lli:%lli%n", &offset, &size, &num_chars) == 2) && (spec[num_chars] == '\0'))
+    {
+        *region_offset = offset;
+        *region_size = size;
+        return true;
+    }
+
+    memset (&table, 0, sizeof (table));
+    if ((region_file == NULL) || !load_region_file (&table, region_file))
+    {
+        return false;
+    }
+    region = find_region (&table, spec);
+    if (region == NULL)
+    {
+        return false;
+    }
+    *region_offset = region->offset;
+    *region_size = region->size;
+
+    return true;
+}
+
+/**
+ * @brief Map a region of the device memory as a host copy of its current contents
+ */
+static void *map_device_region (const char *const path, const size_t len, const int flags,
+                                size_t *const mapped_lenp, int *const is_pmemp)
+{
+    pmem_mapping *mapping;
+    uint64_t region_offset;
+    uint64_t region_size;
+    void *addr;
+    size_t mmap_length;
+
+    if (!parse_device_path (&path[strlen (PMEM_NVRAM_PATH_PREFIX)], &region_offset, &region_size))
+    {
+        set_error (ENOENT, "No device region %s", path);
+        return NULL;
+    }
+    if ((flags & PMEM_FILE_TMPFILE) != 0)
+    {
+        set_error (EINVAL, "A temporary file can't be created in device region %s", path);
+        return NULL;
+    }
+    if (len > region_size)
+    {
+        set_error (EINVAL, "Length %zu exceeds the %lu bytes of device region %s", len, (unsigned long) region_size,
+                   path);
+        return NULL;
+    }
+    if (len != 0)
+    {
+        region_size = len;
+    }
+    if (region_size == 0)
+    {
+        set_error (EINVAL, "Device region %s is empty", path);
+        return NULL;
+    }
+
+    pthread_mutex_lock (&pmem_state.lock);
+    open_pmem_device ();
+    if ((pmem_state.context.memory_size_bytes != 0) &&
+        ((region_offset + region_size) > pmem_state.context.memory_size_bytes))
+    {
+        pthread_mutex_unlock (&pmem_state.lock);
+        set_error (EINVAL, "Device region %s exceeds the device memory", path);
+        return NULL;
+    }
+    if (pmem_state.num_mappings == PMEM_MAX_MAPPINGS)
+    {
+        pthread_mutex_unlock (&pmem_state.lock);
+        set_error (ENOMEM, "All %u device region mappings are in use", PMEM_MAX_MAPPINGS);
+        return NULL;
+    }
+
+    mmap_length = (region_size + (size_t) getpagesize () - 1) & ~((size_t) getpagesize () - 1);
+    addr = mmap (NULL, mmap_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        pthread_mutex_unlock (&pmem_state.lock);
+        set_error (errno, "Failed to allocate the host copy of device region %s", path);
+        return NULL;
+    }
+    if (!dma_read_to_host (&pmem_state.context, region_offset, addr, region_size))
+    {
+        pthread_mutex_unlock (&pmem_state.lock);
+        munmap (addr, mmap_length);
+        set_error (EIO, "Failed to read device region %s", path);
+        return NULL;
+    }
+
+    mapping = &pmem_state.mappings[pmem_state.num_mappings];
+    mapping->addr = addr;
+    mapping->length = region_size;
+    mapping->mmap_length = mmap_length;
+    mapping->card_offset = region_offset;
+    pmem_state.num_mappings++;
+    pthread_mutex_unlock (&pmem_state.lock);
+
+    if (mapped_lenp != NULL)
+    {
+        *mapped_lenp = region_size;
+    }
+    if (is_pmemp != NULL)
+    {
+        *is_pmemp = 1;
+    }
+
+    return addr;
+}
+
+/**
+ * @brief Map a regular file, following the libpmem rules for the flags and length
+ */
+static void *map_regular_file (const char *const path, size_t len, const int flags, const mode_t mode,
+                               size_t *const mapped_lenp, int *const is_pmemp)
+{
+    const bool create = (flags & PMEM_FILE_CREATE) != 0;
+    int open_flags = O_RDWR;
+    struct stat file_stat;
+    void *addr;
+    int fd;
+    int rc;
+
+    if (create != (len != 0))
+    {
+        set_error (EINVAL, "The length must be non-zero only when creating %s", path);
+        return NULL;
+    }
+    if (create)
+    {
+        open_flags |= O_CREAT | (((flags & PMEM_FILE_EXCL) != 0) ? O_EXCL : 0);
+    }
+    if ((flags & PMEM_FILE_TMPFILE) != 0)
+    {
+        open_flags = O_RDWR | O_TMPFILE | (open_flags & O_EXCL);
+    }
+
+    fd = open (path, open_flags, mode);
+    if (fd < 0)
+    {
+        set_error (errno, "Failed to open %s", path);
+        return NULL;
+    }
+    if (create)
+    {
+        if (ftruncate (fd, (off_t) len) != 0)
+        {
+            set_error (errno, "Failed to set the length of %s", path);
+            close (fd);
+            return NULL;
+        }
+        if ((flags & PMEM_FILE_SPARSE) == 0)
+        {
+            rc = posix_fallocate (fd, 0, (off_t) len);
+            if (rc != 0)
+            {
+                set_error (rc, "Failed to allocate %s", path);
+                close (fd);
+                return NULL;
+            }
+        }
+    }
+    else
+    {
+        if (fstat (fd, &file_stat) != 0)
+        {
+            set_error (errno, "Failed to get the length of %s", path);
+            close (fd);
+            return NULL;
+        }
+        len = (size_t) file_stat.st_size;
+    }
+
+    addr = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        set_error (errno, "Failed to map %s", path);
+        close (fd);
+        return NULL;
+    }
+    close (fd);
+
+    if (mapped_lenp != NULL)
+    {
+        *mapped_lenp = len;
+    }
+    if (is_pmemp != NULL)
+    {
+        *is_pmemp = 0;
+    }
+
+    return addr;
+}
+
+/**
+ * @brief Map a region of the device memory, or a regular file
+ * @details A device region is read into a host copy. PMEM_FILE_CREATE and PMEM_FILE_EXCL have no effect on a device
+ *          region, since it always exists; a non-zero len maps only the start of the region.
+ * @param[in] path Either a device region as described in nvram_uio_pmem.h, or the pathname of a regular file
+ * @param[in] len The length to map, or zero to map all of an existing region or file
+ * @param[in] flags The PMEM_FILE_* flags
+ * @param[in] mode The mode for creating a file
+ * @param[out] mapped_lenp If not NULL where to return the length mapped
+ * @param[out] is_pmemp If not NULL where to return if the mapping is made persistent by pmem_persist()
+ * @return The address of the mapping, or NULL with errno set on failure
+ */
+void *pmem_map_file (const char *path, size_t len, int flags, mode_t mode, size_t *mapped_lenp, int *is_pmemp)
+{
+    if (strncmp (path, PMEM_NVRAM_PATH_PREFIX, strlen (PMEM_NVRAM_PATH_PREFIX)) == 0)
+    {
+        return map_device_region (path, len, flags, mapped_lenp, is_pmemp);
+    }
+    else
+    {
+        return map_regular_file (path, len, flags, mode, mapped_lenp, is_pmemp);
+    }
+}
+
+/**
+ * @brief Unmap a mapping made by pmem_map_file()
+ * @details As with libpmem, stores to a device region which haven't been flushed are lost.
+ * @param[in] addr The address returned by pmem_map_file()
+ * @param[in] len The length mapped
+ * @return Returns zero on success, or -1 with errno set on failure
+ */
+int pmem_unmap (void *addr, size_t len)
+{
+    unsigned int mapping_index;
+    size_t mmap_length = 0;
+
+    pthread_mutex_lock (&pmem_state.lock);
+    for (mapping_index = 0; (mmap_length == 0) && (mapping_index < pmem_state.num_mappings); mapping_index++)
+    {
+        if (pmem_state.mappings[mapping_index].addr == addr)
+        {
+            mmap_length = pmem_state.mappings[mapping_index].mmap_length;
+            pmem_state.num_mappings--;
+            pmem_state.mappings[mapping_index] = pmem_state.mappings[pmem_state.num_mappings];
+        }
+    }
+    pthread_mutex_unlock (&pmem_state.lock);
+
+    if (munmap (addr, (mmap_length != 0) ? mmap_length : len) != 0)
+    {
+        set_error (errno, "Failed to unmap %p", addr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Determine if a range is entirely within a mapped device region
+ * @return Returns 1 if pmem_persist() makes the range durable, or zero if pmem_msync() has to be used
+ */
+int pmem_is_pmem (const void *addr, size_t len)
+{
+    pmem_mapping mapping;
+
+    return (find_mapping (addr, &mapping) &&
+            (((const uint8_t *) addr + len) <= &mapping.addr[mapping.length])) ? 1 : 0;
+}
+
+/**
+ * @brief Write back a range of a mapped device region, which must be within the mapping
+ * @details Writing back through the window only needs a copy, whereas DMA needs descriptor setup and completion
+ *          polling, so the window is cheaper for small ranges. Window writes which are still posted are flushed
+ *          before a DMA write, so that an older window write can't overwrite the data written by DMA.
+ *
+ *          pmem_flush() has no way to report a failure to the caller, so if the device can't be written the process
+ *          exits rather than continuing as if the data were durable.
+ */
+static void write_back (const pmem_mapping *const mapping, const size_t start, const size_t num_bytes)
+{
+    nvram_uio_context *const context = &pmem_state.context;
+    const uint64_t card_offset = mapping->card_offset + start;
+    bool success;
+
+    if (pmem_state.window_mapped && (num_bytes <= pmem_state.window_threshold))
+    {
+        success = window_write (context, card_offset, &mapping->addr[start], num_bytes);
+        window_writes_pending = true;
+        __atomic_add_fetch (&pmem_state.statistics.window_flushes, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch (&pmem_state.statistics.window_bytes, num_bytes, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        if (window_writes_pending)
+        {
+            window_flush (context);
+            window_writes_pending = false;
+        }
+        pthread_mutex_lock (&pmem_state.lock);
+        success = dma_write_from_host (context, card_offset, &mapping->addr[start], num_bytes);
+        pthread_mutex_unlock (&pmem_state.lock);
+        __atomic_add_fetch (&pmem_state.statistics.dma_flushes, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch (&pmem_state.statistics.dma_bytes, num_bytes, __ATOMIC_RELAXED);
+    }
+
+    if (!success)
+    {
+        printf ("Failed to write back %zu bytes to device offset 0x%lx\n", num_bytes, (unsigned long) card_offset);
+        exit (EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Start writing a range back to the device, at the granularity of cache lines
+ * @details Addresses outside of a mapped device region are ignored, as flushing a cache line of DRAM makes no
+ *          difference to durability.
+ * @param[in] addr The start of the range
+ * @param[in] len The length of the range
+ */
+void pmem_flush (const void *addr, size_t len)
+{
+    pmem_mapping mapping;
+    size_t start;
+    size_t end;
+
+    if ((len == 0) || !find_mapping (addr, &mapping))
+    {
+        return;
+    }
+
+    start = (size_t) ((const uint8_t *) addr - mapping.addr);
+    end = start + len;
+    start &= ~(size_t) (PMEM_FLUSH_ALIGN - 1);
+    end = (end + PMEM_FLUSH_ALIGN - 1) & ~(size_t) (PMEM_FLUSH_ALIGN - 1);
+    if (end > mapping.length)
+    {
+        end = mapping.length;
+    }
+    write_back (&mapping, start, end - start);
+}
+
+/**
+ * @brief Wait for the flushes made by the calling thread to be durable
+ * @details Only window writes are posted, so a drain costs nothing unless the thread has written through the window.
+ */
+void pmem_drain (void)
+{
+    if (window_writes_pending)
+    {
+        window_flush (&pmem_state.context);
+        window_writes_pending = false;
+        __atomic_add_fetch (&pmem_state.statistics.drains_waited, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Make a range of a mapped device region durable
+ * @param[in] addr The start of the range
+ * @param[in] len The length of the range
+ */
+void pmem_persist (const void *addr, size_t len)
+{
+    pmem_flush (addr, len);
+    pmem_drain ();
+}
+
+/**
+ * @brief Make a range durable, for either a mapped device region or a regular file
+ * @return Returns zero on success, or -1 with errno set on failure
+ */
+int pmem_msync (const void *addr, size_t len)
+{
+    const uintptr_t page_mask = (uintptr_t) getpagesize () - 1;
+    const uintptr_t start = (uintptr_t) addr & ~page_mask;
+    pmem_mapping mapping;
+
+    if (find_mapping (addr, &mapping))
+    {
+        pmem_persist (addr, len);
+        return 0;
+    }
+    if (msync ((void *) start, len + ((uintptr_t) addr - start), MS_SYNC) != 0)
+    {
+        set_error (errno, "Failed to sync %p", addr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Report if the platform needs no drain after a flush, which is never the case for the device
+ */
+int pmem_has_hw_drain (void)
+{
+    return 0;
+}
+
+/**
+ * @brief Flush and drain after storing to a range, as specified by the PMEM_F_MEM_* flags
+ */
+static void flush_stored (const void *const pmemdest, const size_t len, const unsigned flags)
+{
+    if ((flags & PMEM_F_MEM_NOFLUSH) == 0)
+    {
+        pmem_flush (pmemdest, len);
+        if ((flags & PMEM_F_MEM_NODRAIN) == 0)
+        {
+            pmem_drain ();
+        }
+    }
+}
+
+/**
+ * @brief Copy to a range, which may overlap the source, then flush and drain it as specified by the PMEM_F_MEM_* flags
+ * @return Returns pmemdest
+ */
+void *pmem_memmove (void *pmemdest, const void *src, size_t len, unsigned flags)
+{
+    memmove (pmemdest, src, len);
+    flush_stored (pmemdest, len, flags);
+
+    return pmemdest;
+}
+
+/**
+ * @brief Copy to a range, then flush and drain it as specified by the PMEM_F_MEM_* flags
+ * @return Returns pmemdest
+ */
+void *pmem_memcpy (void *pmemdest, const void *src, size_t len, unsigned flags)
+{
+    memcpy (pmemdest, src, len);
+    flush_stored (pmemdest, len, flags);
+
+    return pmemdest;
+}
+
+/**
+ * @brief Fill a range, then flush and drain it as specified by the PMEM_F_MEM_* flags
+ * @return Returns pmemdest
+ */
+void *pmem_memset (void *pmemdest, int c, size_t len, unsigned flags)
+{
+    memset (pmemdest, c, len);
+    flush_stored (pmemdest, len, flags);
+
+    return pmemdest;
+}
+
+/* The _persist and _nodrain variants are the libpmem shorthands for the flags */
+
+void *pmem_memmove_persist (void *pmemdest, const void *src, size_t len)
+{
+    return pmem_memmove (pmemdest, src, len, 0);
+}
+
+void *pmem_memcpy_persist (void *pmemdest, const void *src, size_t len)
+{
+    return pmem_memcpy (pmemdest, src, len, 0);
+}
+
+void *pmem_memset_persist (void *pmemdest, int c, size_t len)
+{
+    return pmem_memset (pmemdest, c, len, 0);
+}
+
+void *pmem_memmove_nodrain (void *pmemdest, const void *src, size_t len)
+{
+    return pmem_memmove (pmemdest, src, len, PMEM_F_MEM_NODRAIN);
+}
+
+void *pmem_memcpy_nodrain (void *pmemdest, const void *src, size_t len)
+{
+    return pmem_memcpy (pmemdest, src, len, PMEM_F_MEM_NODRAIN);
+}
+
+void *pmem_memset_nodrain (void *pmemdest, int c, size_t len)
+{
+    return pmem_memset (pmemdest, c, len, PMEM_F_MEM_NODRAIN);
+}
+
+/**
+ * @brief Return the message for the last error in the calling thread
+ */
+const char *pmem_errormsg (void)
+{
+    return error_message;
+}
+
+/**
+ * @brief Get a snapshot of the counts of how flushes have been written back
+ * @param[out] statistics Where to store the counts
+ */
+void nvram_pmem_get_statistics (nvram_pmem_statistics *const statistics)
+{
+    statistics->window_flushes = __atomic_load_n (&pmem_state.statistics.window_flushes, __ATOMIC_RELAXED);
+    statistics->window_bytes = __atomic_load_n (&pmem_state.statistics.window_bytes, __ATOMIC_RELAXED);
+    statistics->dma_flushes = __atomic_load_n (&pmem_state.statistics.dma_flushes, __ATOMIC_RELAXED);
+    statistics->dma_bytes = __atomic_load_n (&pmem_state.statistics.dma_bytes, __ATOMIC_RELAXED);
+    statistics->drains_waited = __atomic_load_n (&pmem_state.statistics.drains_waited, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,90 @@
+/*
+ * @file nvram_uio_pmem.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Subset of the libpmem persistence API, implemented on regions of the NVRAM device memory
+ * @details
+ *   Allows code written against libpmem to use the NVRAM device in place of persistent memory. pmem_map_file()
+ *   recognises paths of the form:
+ *     nvram:<offset>:<size>  A region of the device memory, where the offset and size may be decimal, hex or octal
+ *     nvram:<name>           A region named in the region file given by the NVRAM_UIO_PMEM_REGIONS environment variable
+ *   Any other path is mapped as a regular file, with is_pmem returned as zero as libpmem does for non-pmem files.
+ *
+ *   The device memory isn't directly load/store addressable, so a region is mapped as a host copy which is read from
+ *   the device when mapped. Stores to the mapping are made durable by pmem_flush() or pmem_persist(), which write the
+ *   flushed cache lines back to the device. Ranges up to a threshold are written through the write-combining window,
+ *   which are posted writes so pmem_drain() has to wait for them to reach the device. Larger ranges, or all ranges
+ *   when the device has no window, are written by DMA which has completed on return. The threshold defaults to
+ *   PMEM_DEFAULT_WINDOW_THRESHOLD and may be overridden by the NVRAM_UIO_PMEM_WINDOW_THRESHOLD environment variable.
+ *
+ *   As with libpmem, a drain only waits for flushes made by the calling thread. The device is opened on the first
+ *   pmem_map_file() of a device region and left open for the life of the process.
+ */
+
+#ifndef NVRAM_UIO_PMEM_H_
+#define NVRAM_UIO_PMEM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* The path prefix which selects a region of the device memory */
+#define PMEM_NVRAM_PATH_PREFIX "nvram:"
+
+/* The flags for pmem_map_file(), with the same values as libpmem */
+#define PMEM_FILE_CREATE (1 << 0)
+#define PMEM_FILE_EXCL (1 << 1)
+#define PMEM_FILE_SPARSE (1 << 2)
+#define PMEM_FILE_TMPFILE (1 << 3)
+
+/* The flags for pmem_memcpy(), pmem_memmove() and pmem_memset(), with the same values as libpmem.
+ * The hints about the type of store are accepted but have no effect. */
+#define PMEM_F_MEM_NODRAIN (1U << 0)
+#define PMEM_F_MEM_NONTEMPORAL (1U << 1)
+#define PMEM_F_MEM_TEMPORAL (1U << 2)
+#define PMEM_F_MEM_WC (1U << 3)
+#define PMEM_F_MEM_WB (1U << 4)
+#define PMEM_F_MEM_NOFLUSH (1U << 5)
+
+/* The maximum number of device regions which can be mapped at once */
+#define PMEM_MAX_MAPPINGS 32
+
+/* The granularity at which the flushed ranges are written back, as for cache line flushes */
+#define PMEM_FLUSH_ALIGN 64
+
+/* The largest flush written through the window rather than by DMA */
+#define PMEM_DEFAULT_WINDOW_THRESHOLD 4096
+
+/** Counts of how flushes have been written back to the device, summed over all threads */
+typedef struct
+{
+    uint64_t window_flushes;
+    uint64_t window_bytes;
+    uint64_t dma_flushes;
+    uint64_t dma_bytes;
+    /** The number of drains which had to wait for posted window writes */
+    uint64_t drains_waited;
+} nvram_pmem_statistics;
+
+void *pmem_map_file (const char *path, size_t len, int flags, mode_t mode, size_t *mapped_lenp, int *is_pmemp);
+int pmem_unmap (void *addr, size_t len);
+int pmem_is_pmem (const void *addr, size_t len);
+void pmem_flush (const void *addr, size_t len);
+void pmem_drain (void);
+void pmem_persist (const void *addr, size_t len);
+int pmem_msync (const void *addr, size_t len);
+int pmem_has_hw_drain (void);
+void *pmem_memmove (void *pmemdest, const void *src, size_t len, unsigned flags);
+void *pmem_memcpy (void *pmemdest, const void *src, size_t len, unsigned flags);
+void *pmem_memset (void *pmemdest, int c, size_t len, unsigned flags);
+void *pmem_memmove_persist (void *pmemdest, const void *src, size_t len);
+void *pmem_memcpy_persist (void *pmemdest, const void *src, size_t len);
+void *pmem_memset_persist (void *pmemdest, int c, size_t len);
+void *pmem_memmove_nodrain (void *pmemdest, const void *src, size_t len);
+void *pmem_memcpy_nodrain (void *pmemdest, const void *src, size_t len);
+void *pmem_memset_nodrain (void *pmemdest, int c, size_t len);
+const char *pmem_errormsg (void);
+
+void nvram_pmem_get_statistics (nvram_pmem_statistics *const statistics);
+
+#endif /* NVRAM_UIO_PMEM_H_ */
@@ -0,0 +1,52 @@
+/*
+ * @file nvram_uio_probes.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief USDT static probes for the NVRAM UIO userspace library
+ * @details
+ *   The probes use the systemtap <sys/sdt.h> markers, which compile to a single nop at each probe site and
+ *   only cost anything when a tracer such as bpftrace attaches. If <sys/sdt.h> isn't installed the probes
+ *   compile to nothing.
+ *
+ *   All probes are in the nvram_uio provider. Offsets are byte offsets in card memory, sizes are in bytes and
+ *   latencies are in nanoseconds:
+ *     device_open     (device_fd)
+ *     device_close    (device_fd)
+ *     led_set         (shift, state)
+ *     dma_submit      (card_offset, size, direction)
+ *     dma_doorbell    (card_offset, size, direction)
+ *     dma_complete    (card_offset, size, direction, latency_ns)
+ *     dma_error       (card_offset, size, dma_status)
+ *     commit          (card_offset, size, latency_ns)
+ *     pio_write       (card_offset, size, latency_ns)
+ *     device_recovered (recovery_count)
+ *
+ *   E.g. a DMA latency histogram for a running process:
+ *     bpftrace -e 'usdt:./userspace_access_test:nvram_uio:dma_complete { @lat_ns = hist(arg3); }'
+ */
+
+#ifndef NVRAM_UIO_PROBES_H_
+#define NVRAM_UIO_PROBES_H_
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NVRAM_UIO_HAVE_SDT
+#endif
+#endif
+
+#ifdef NVRAM_UIO_HAVE_SDT
+#define NVRAM_UIO_PROBE1(name,a1)             DTRACE_PROBE1(nvram_uio, name, a1)
+#define NVRAM_UIO_PROBE2(name,a1,a2)          DTRACE_PROBE2(nvram_uio, name, a1, a2)
+#define NVRAM_UIO_PROBE3(name,a1,a2,a3)       DTRACE_PROBE3(nvram_uio, name, a1, a2, a3)
+#define NVRAM_UIO_PROBE4(name,a1,a2,a3,a4)    DTRACE_PROBE4(nvram_uio, name, a1, a2, a3, a4)
+#else
+/* The arguments are only referenced in sizeof, so variables used only by probes don't warn but aren't evaluated */
+#define NVRAM_UIO_PROBE1(name,a1)             do { (void) sizeof (a1); } while (0)
+#define NVRAM_UIO_PROBE2(name,a1,a2)          do { (void) sizeof (a1); (void) sizeof (a2); } while (0)
+#define NVRAM_UIO_PROBE3(name,a1,a2,a3)       do { (void) sizeof (a1); (void) sizeof (a2); (void) sizeof (a3); } while (0)
+#define NVRAM_UIO_PROBE4(name,a1,a2,a3,a4) \
+    do { (void) sizeof (a1); (void) sizeof (a2); (void) sizeof (a3); (void) sizeof (a4); } while (0)
+#endif
+
+#endif /* NVRAM_UIO_PROBES_H_ */
@@ -0,0 +1,429 @@
+/*
+ * @file nvram_uio_rebuild.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Parallel rebuild of a host memory index of the objects of a persistent store in the NVRAM device memory
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nvram_uio_rebuild.h"
+#include "nvram_uio_dma.h"
+
+/* The number of entries passed from a reader to an inserter at a time */
+#define REBUILD_BATCH_SIZE 1024
+
+/** One key emitted by the parse function */
+typedef struct
+{
+    uint64_t key;
+    uint64_t hash;
+    uint64_t value;
+} rebuild_entry;
+
+/** A batch of entries for one table */
+typedef struct rebuild_batch
+{
+    struct rebuild_batch *next;
+    unsigned int table_num;
+    unsigned int num_entries;
+    rebuild_entry entries[REBUILD_BATCH_SIZE];
+} rebuild_batch;
+
+/** An inserter thread, with its queue of batches */
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    rebuild_batch *head;
+    rebuild_batch *tail;
+    /** Set once all readers have finished */
+    bool done;
+    swiss_index *index;
+    pthread_t thread;
+    bool success;
+} rebuild_inserter;
+
+typedef struct rebuild_pipeline rebuild_pipeline;
+
+/** The batches being filled by one reader */
+struct rebuild_emitter
+{
+    rebuild_pipeline *pipeline;
+    rebuild_batch *batches[SWISS_INDEX_MAX_TABLES];
+    uint64_t num_emitted;
+    bool success;
+};
+
+/** A reader thread */
+typedef struct
+{
+    rebuild_pipeline *pipeline;
+    unsigned int reader_num;
+    size_t buffer_offset;
+    size_t buffer_size;
+    rebuild_emitter emitter;
+    uint64_t bytes_read;
+    uint64_t num_dma_chains;
+    pthread_t thread;
+    bool success;
+} rebuild_reader;
+
+struct rebuild_pipeline
+{
+    nvram_uio_context *context;
+    const rebuild_range *ranges;
+    unsigned int num_ranges;
+    rebuild_parse_fn parse;
+    void *parse_arg;
+    swiss_index *index;
+    unsigned int num_readers;
+    unsigned int num_inserters;
+    rebuild_inserter inserters[REBUILD_MAX_INSERTERS];
+};
+
+/**
+ * @brief Queue a batch to the inserter which owns its table
+ */
+static void submit_batch (rebuild_pipeline *const pipeline, rebuild_batch *const batch)
+{
+    rebuild_inserter *const inserter = &pipeline->inserters[batch->table_num % pipeline->num_inserters];
+
+    batch->next = NULL;
+    pthread_mutex_lock (&inserter->lock);
+    if (inserter->tail == NULL)
+    {
+        inserter->head = batch;
+    }
+    else
+    {
+        inserter->tail->next = batch;
+    }
+    inserter->tail = batch;
+    pthread_cond_signal (&inserter->available);
+    pthread_mutex_unlock (&inserter->lock);
+}
+
+/**
+ * @brief Emit the key and value of one object, called by the parse function
+ * @param[in,out] emitter Passed to the parse function
+ * @param[in] key The key of the object
+ * @param[in] value The value for the key, e.g. the offset of the object in the device memory
+ */
+void rebuild_emit (rebuild_emitter *const emitter, const uint64_t key, const uint64_t value)
+{
+    const uint64_t hash = swiss_hash (key);
+    const unsigned int table_num = swiss_index_table (emitter->pipeline->index, hash);
+    rebuild_batch *batch = emitter->batches[table_num];
+    rebuild_entry *entry;
+
+    if (batch == NULL)
+    {
+        batch = malloc (sizeof (*batch));
+        if (batch == NULL)
+        {
+            emitter->success = false;
+            return;
+        }
+        batch->table_num = table_num;
+        batch->num_entries = 0;
+        emitter->batches[table_num] = batch;
+    }
+    entry = &batch->entries[batch->num_entries++];
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+    emitter->num_emitted++;
+    if (batch->num_entries == REBUILD_BATCH_SIZE)
+    {
+        submit_batch (emitter->pipeline, batch);
+        emitter->batches[table_num] = NULL;
+    }
+}
+
+/**
+ * @brief Thread which inserts the batches queued for its tables
+ */
+static void *inserter_thread (void *arg)
+{
+    rebuild_inserter *const inserter = arg;
+    rebuild_batch *batch;
+    swiss_table *table;
+    unsigned int entry_num;
+    bool finished = false;
+
+    inserter->success = true;
+    while (!finished)
+    {
+        pthread_mutex_lock (&inserter->lock);
+        while ((inserter->head == NULL) && !inserter->done)
+        {
+            pthread_cond_wait (&inserter->available, &inserter->lock);
+        }
+        batch = inserter->head;
+        if (batch != NULL)
+        {
+            inserter->head = batch->next;
+            if (inserter->head == NULL)
+            {
+                inserter->tail = NULL;
+            }
+        }
+        finished = batch == NULL;
+        pthread_mutex_unlock (&inserter->lock);
+
+        if (batch != NULL)
+        {
+            table = &inserter->index->tables[batch->table_num];
+            for (entry_num = 0; entry_num < batch->num_entries; entry_num++)
+            {
+                if (!swiss_table_insert_max (table, batch->entries[entry_num].key, batch->entries[entry_num].hash,
+                                             batch->entries[entry_num].value))
+                {
+                    inserter->success = false;
+                }
+            }
+            free (batch);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Read the headers of a strided range, gathering one header per stride into the buffer with DMA chains
+ */
+static bool read_strided_range (rebuild_reader *const reader, const rebuild_range *const range,
+                                dma_chain_element *const elements)
+{
+    rebuild_pipeline *const pipeline = reader->pipeline;
+    nvram_uio_context *const context = pipeline->context;
+    const uint64_t num_objects = range->size / range->stride;
+    unsigned int headers_per_chain = context->max_dma_chain_length;
+    unsigned int num_headers;
+    unsigned int header_num;
+    uint64_t object_num;
+
+    if ((range->header_size == 0) || (range->header_size > range->stride) ||
+        (range->header_size > reader->buffer_size))
+    {
+        return false;
+    }
+    if (headers_per_chain > (reader->buffer_size / range->header_size))
+    {
+        headers_per_chain = (unsigned int) (reader->buffer_size / range->header_size);
+    }
+
+    for (object_num = 0; object_num < num_objects; object_num += num_headers)
+    {
+        num_headers = ((num_objects - object_num) < headers_per_chain) ?
+                (unsigned int) (num_objects - object_num) : headers_per_chain;
+        for (header_num = 0; header_num < num_headers; header_num++)
+        {
+            elements[header_num].card_offset = range->card_offset + ((object_num + header_num) * range->stride);
+            elements[header_num].buffer_offset = reader->buffer_offset + (header_num * range->header_size);
+            elements[header_num].num_bytes = range->header_size;
+        }
+        if (!dma_transfer_chain (context, DMA_WRITE_TO_HOST, elements, num_headers))
+        {
+            return false;
+        }
+        reader->num_dma_chains++;
+        reader->bytes_read += (uint64_t) num_headers * range->header_size;
+
+        for (header_num = 0; header_num < num_headers; header_num++)
+        {
+            (void) pipeline->parse (pipeline->parse_arg, elements[header_num].card_offset,
+                                    &context->dma_buffer[elements[header_num].buffer_offset], range->header_size,
+                                    &reader->emitter);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read a contiguous range in chunks, until the parse function stops consuming the chunks
+ */
+static bool read_contiguous_range (rebuild_reader *const reader, const rebuild_range *const range)
+{
+    rebuild_pipeline *const pipeline = reader->pipeline;
+    nvram_uio_context *const context = pipeline->context;
+    uint64_t offset = 0;
+    size_t chunk_bytes;
+    size_t consumed = 1;
+
+    while ((offset < range->size) && (consumed > 0))
+    {
+        chunk_bytes = ((range->size - offset) < reader->buffer_size) ? (size_t) (range->size - offset) :
+                reader->buffer_size;
+        if (!dma_transfer (context, DMA_WRITE_TO_HOST, range->card_offset + offset, reader->buffer_offset,
+                           chunk_bytes))
+        {
+            return false;
+        }
+        reader->num_dma_chains++;
+        reader->bytes_read += chunk_bytes;
+
+        consumed = pipeline->parse (pipeline->parse_arg, range->card_offset + offset,
+                                    &context->dma_buffer[reader->buffer_offset], chunk_bytes, &reader->emitter);
+        if (consumed > chunk_bytes)
+        {
+            consumed = 0;
+        }
+        offset += consumed;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Thread which reads every num_readers'th range, and passes the emitted entries to the inserters
+ */
+static void *reader_thread (void *arg)
+{
+    rebuild_reader *const reader = arg;
+    rebuild_pipeline *const pipeline = reader->pipeline;
+    dma_chain_element *const elements = calloc (pipeline->context->max_dma_chain_length, sizeof (elements[0]));
+    unsigned int range_num;
+    unsigned int table_num;
+
+    reader->emitter.pipeline = pipeline;
+    reader->emitter.success = true;
+    reader->success = elements != NULL;
+    for (range_num = reader->reader_num; reader->success && (range_num < pipeline->num_ranges);
+         range_num += pipeline->num_readers)
+    {
+        reader->success = (pipeline->ranges[range_num].stride != 0) ?
+                read_strided_range (reader, &pipeline->ranges[range_num], elements) :
+                read_contiguous_range (reader, &pipeline->ranges[range_num]);
+    }
+
+    /* Pass on the partially filled batches */
+    for (table_num = 0; table_num < pipeline->index->num_tables; table_num++)
+    {
+        if (reader->emitter.batches[table_num] != NULL)
+        {
+            submit_batch (pipeline, reader->emitter.batches[table_num]);
+            reader->emitter.batches[table_num] = NULL;
+        }
+    }
+    reader->success = reader->success && reader->emitter.success;
+    free (elements);
+
+    return NULL;
+}
+
+/**
+ * @brief Rebuild an index from the objects in ranges of the device memory
+ * @details The DMA buffer is divided between the reader threads, one per range up to REBUILD_MAX_READERS.
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] ranges The ranges of the device memory containing the objects
+ * @param[in] num_ranges The number of ranges
+ * @param[in] parse Parses the object headers
+ * @param[in] parse_arg Passed to parse
+ * @param[in,out] index The initialised index to insert the objects into
+ * @param[in] num_inserters The number of inserter threads, limited to the number of tables in the index
+ * @param[out] statistics The statistics of the rebuild
+ * @return Returns true if all ranges were read and all keys inserted
+ */
+bool rebuild_index (nvram_uio_context *const context, const rebuild_range *const ranges, const unsigned int num_ranges,
+                    rebuild_parse_fn parse, void *const parse_arg, swiss_index *const index,
+                    const unsigned int num_inserters, rebuild_statistics *const statistics)
+{
+    rebuild_pipeline *pipeline;
+    rebuild_reader *readers;
+    rebuild_inserter *inserter;
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    unsigned int reader_num;
+    unsigned int inserter_num;
+    size_t buffer_size;
+    bool success = true;
+
+    memset (statistics, 0, sizeof (*statistics));
+    if ((context->dma_mapping == NULL) || (num_ranges == 0) || (num_inserters == 0) || (index->num_tables == 0))
+    {
+        return false;
+    }
+    pipeline = calloc (1, sizeof (*pipeline));
+    readers = calloc (REBUILD_MAX_READERS, sizeof (readers[0]));
+    if ((pipeline == NULL) || (readers == NULL))
+    {
+        free (pipeline);
+        free (readers);
+        return false;
+    }
+
+    pipeline->context = context;
+    pipeline->ranges = ranges;
+    pipeline->num_ranges = num_ranges;
+    pipeline->parse = parse;
+    pipeline->parse_arg = parse_arg;
+    pipeline->index = index;
+    pipeline->num_readers = (num_ranges < REBUILD_MAX_READERS) ? num_ranges : REBUILD_MAX_READERS;
+    pipeline->num_inserters = (num_inserters < REBUILD_MAX_INSERTERS) ? num_inserters : REBUILD_MAX_INSERTERS;
+    if (pipeline->num_inserters > index->num_tables)
+    {
+        pipeline->num_inserters = index->num_tables;
+    }
+    buffer_size = (context->dma_buffer_size / pipeline->num_readers) & ~(size_t) 63;
+
+    for (inserter_num = 0; inserter_num < pipeline->num_inserters; inserter_num++)
+    {
+        inserter = &pipeline->inserters[inserter_num];
+        pthread_mutex_init (&inserter->lock, NULL);
+        pthread_cond_init (&inserter->available, NULL);
+        inserter->index = index;
+        if (pthread_create (&inserter->thread, NULL, inserter_thread, inserter) != 0)
+        {
+            printf ("Failed to create rebuild inserter thread\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+    for (reader_num = 0; reader_num < pipeline->num_readers; reader_num++)
+    {
+        readers[reader_num].pipeline = pipeline;
+        readers[reader_num].reader_num = reader_num;
+        readers[reader_num].buffer_offset = reader_num * buffer_size;
+        readers[reader_num].buffer_size = buffer_size;
+        if (pthread_create (&readers[reader_num].thread, NULL, reader_thread, &readers[reader_num]) != 0)
+        {
+            printf ("Failed to create rebuild reader thread\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    for (reader_num = 0; reader_num < pipeline->num_readers; reader_num++)
+    {
+        pthread_join (readers[reader_num].thread, NULL);
+        success = success && readers[reader_num].success;
+        statistics->bytes_read += readers[reader_num].bytes_read;
+        statistics->num_dma_chains += readers[reader_num].num_dma_chains;
+        statistics->num_emitted += readers[reader_num].emitter.num_emitted;
+    }
+    statistics->read_ns = get_monotonic_time_ns () - start_ns;
+
+    for (inserter_num = 0; inserter_num < pipeline->num_inserters; inserter_num++)
+    {
+        inserter = &pipeline->inserters[inserter_num];
+        pthread_mutex_lock (&inserter->lock);
+        inserter->done = true;
+        pthread_cond_signal (&inserter->available);
+        pthread_mutex_unlock (&inserter->lock);
+        pthread_join (inserter->thread, NULL);
+        success = success && inserter->success;
+        pthread_cond_destroy (&inserter->available);
+        pthread_mutex_destroy (&inserter->lock);
+    }
+    statistics->total_ns = get_monotonic_time_ns () - start_ns;
+
+    free (readers);
+    free (pipeline);
+
+    return success;
+}
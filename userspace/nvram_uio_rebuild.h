@@ -0,0 +1,69 @@
+/*
+ * @file nvram_uio_rebuild.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Parallel rebuild of a host memory index of the objects of a persistent store in the NVRAM device memory
+ * @details
+ *   The rebuild is a pipeline:
+ *   - Reader threads stream the object headers from ranges of the device memory by DMA, each reader using its own
+ *     part of the DMA buffer. A range is either contiguous, in which case the store's parse function is called with
+ *     each chunk read, or strided, in which case only the header at the start of each stride is read, using DMA
+ *     chains which gather the headers into the buffer.
+ *   - The parse function emits a key and value for each object, which are batched by the swiss_index table which
+ *     the hash of the key selects.
+ *   - Inserter threads each own a subset of the tables, and insert the batches for their tables without locking.
+ *
+ *   Where a key is emitted more than once the greatest value is kept (see swiss_table_insert_max()).
+ */
+
+#ifndef NVRAM_UIO_REBUILD_H_
+#define NVRAM_UIO_REBUILD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_swisstable.h"
+
+#define REBUILD_MAX_READERS 16
+#define REBUILD_MAX_INSERTERS 64
+
+/** A range of the device memory containing objects */
+typedef struct
+{
+    uint64_t card_offset;
+    uint64_t size;
+    /** If non-zero the range is strided, with an object header of header_size bytes at the start of each stride */
+    uint32_t stride;
+    uint32_t header_size;
+} rebuild_range;
+
+typedef struct rebuild_emitter rebuild_emitter;
+
+/**
+ * Parses object headers read from the device memory, calling rebuild_emit() for each object.
+ * For a contiguous range, called with each chunk read and returns the number of bytes of whole objects parsed;
+ * returning zero ends the range, e.g. at the end of the valid objects. For a strided range, called with each
+ * header in turn, and the return value is ignored.
+ */
+typedef size_t (*rebuild_parse_fn) (void *const arg, const uint64_t card_offset, const uint8_t *const data,
+                                    const size_t num_bytes, rebuild_emitter *const emitter);
+
+/** Statistics of a rebuild */
+typedef struct
+{
+    uint64_t bytes_read;
+    uint64_t num_dma_chains;
+    uint64_t num_emitted;
+    /** The time taken until the readers finished, and until the inserters finished */
+    uint64_t read_ns;
+    uint64_t total_ns;
+} rebuild_statistics;
+
+void rebuild_emit (rebuild_emitter *const emitter, const uint64_t key, const uint64_t value);
+bool rebuild_index (nvram_uio_context *const context, const rebuild_range *const ranges, const unsigned int num_ranges,
+                    rebuild_parse_fn parse, void *const parse_arg, swiss_index *const index,
+                    const unsigned int num_inserters, rebuild_statistics *const statistics);
+
+#endif /* NVRAM_UIO_REBUILD_H_ */
@@ -0,0 +1,155 @@
+/*
+ * @file nvram_uio_regions.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Table of named regions of the NVRAM device memory
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "nvram_uio_regions.h"
+
+/**
+ * @brief Add a region to a table from a specification of the form <name>=<offset>:<size>
+ * @param[in,out] table The table to add the region to
+ * @param[in] spec The region specification
+ * @return Returns true if the specification was valid and the region added
+ */
+bool add_region_spec (nvram_region_table *const table, const char *const spec)
+{
+    nvram_region region;
+    unsigned long long offset;
+    unsigned long long size;
+    char trailing;
+
+    if (table->num_regions == NVRAM_REGION_MAX_REGIONS)
+    {
+        printf ("Too many regions\n");
+        return false;
+    }
+
+    memset (&region, 0, sizeof (region));
+    if ((sscanf (spec, "%63[^=/]=%lli:%lli %c", region.name, &offset, &size, &trailing) != 3) || (size == 0))
+    {
+        printf ("Invalid region specification \"%s\"\n", spec);
+        return false;
+    }
+    if (find_region (table, region.name) != NULL)
+    {
+        printf ("Duplicate region name \"%s\"\n", region.name);
+        return false;
+    }
+    region.offset = offset;
+    region.size = size;
+    table->regions[table->num_regions++] = region;
+
+    return true;
+}
+
+/**
+ * @brief Add the regions in a file to a table
+ * @param[in,out] table The table to add the regions to
+ * @param[in] pathname The region file
+ * @return Returns true if the file was read and all its regions valid
+ */
+bool load_region_file (nvram_region_table *const table, const char *const pathname)
+{
+    FILE *region_file;
+    char line[256];
+    char *spec;
+    bool success = true;
+
+    region_file = fopen (pathname, "r");
+    if (region_file == NULL)
+    {
+        printf ("Failed to open region file %s\n", pathname);
+        return false;
+    }
+
+    while (success && (fgets (line, sizeof (line), region_file) != NULL))
+    {
+        spec = line;
+        while (isspace ((unsigned char) *spec))
+        {
+            spec++;
+        }
+        if ((*spec != '\0') && (*spec != '#'))
+        {
+            success = add_region_spec (table, spec);
+        }
+    }
+    fclose (region_file);
+
+    return success;
+}
+
+/**
+ * @brief Find a region by name
+ * @param[in] table The table to search
+ * @param[in] name The name of the region
+ * @return The region, or NULL if not found
+ */
+const nvram_region *find_region (const nvram_region_table *const table, const char *const name)
+{
+    unsigned int region_index;
+
+    for (region_index = 0; region_index < table->num_regions; region_index++)
+    {
+        if (strcmp (table->regions[region_index].name, name) == 0)
+        {
+            return &table->regions[region_index];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check that the regions are within the device memory and don't overlap
+ * @details If the table is empty, a single region named "card" covering all of the device memory is added.
+ * @param[in,out] table The table to validate
+ * @param[in] memory_size_bytes The size of the device memory
+ * @return Returns true if the table is valid
+ */
+bool validate_region_table (nvram_region_table *const table, const uint64_t memory_size_bytes)
+{
+    unsigned int region_index;
+    unsigned int other_index;
+
+    if (table->num_regions == 0)
+    {
+        strcpy (table->regions[0].name, "card");
+        table->regions[0].offset = 0;
+        table->regions[0].size = memory_size_bytes;
+        table->num_regions = (memory_size_bytes > 0) ? 1 : 0;
+    }
+
+    for (region_index = 0; region_index < table->num_regions; region_index++)
+    {
+        const nvram_region *const region = &table->regions[region_index];
+
+        if ((region->offset + region->size < region->offset) || ((region->offset + region->size) > memory_size_bytes))
+        {
+            printf ("Region %s exceeds the device memory size of 0x%llx\n",
+                    region->name, (unsigned long long) memory_size_bytes);
+            return false;
+        }
+        for (other_index = region_index + 1; other_index < table->num_regions; other_index++)
+        {
+            const nvram_region *const other = &table->regions[other_index];
+
+            if ((region->offset < (other->offset + other->size)) && (other->offset < (region->offset + region->size)))
+            {
+                printf ("Regions %s and %s overlap\n", region->name, other->name);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
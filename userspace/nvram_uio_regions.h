@@ -0,0 +1,40 @@
+/*
+ * @file nvram_uio_regions.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Table of named regions of the NVRAM device memory
+ * @details
+ *   A region is specified as <name>=<offset>:<size>, where the offset and size may be decimal, hex or octal.
+ *   A region file contains one specification per line, with blank lines and lines starting with '#' ignored.
+ */
+
+#ifndef NVRAM_UIO_REGIONS_H_
+#define NVRAM_UIO_REGIONS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NVRAM_REGION_MAX_NAME_LEN 63
+#define NVRAM_REGION_MAX_REGIONS 64
+
+/** One named region of the device memory */
+typedef struct
+{
+    char name[NVRAM_REGION_MAX_NAME_LEN + 1];
+    uint64_t offset;
+    uint64_t size;
+} nvram_region;
+
+/** The table of named regions */
+typedef struct
+{
+    unsigned int num_regions;
+    nvram_region regions[NVRAM_REGION_MAX_REGIONS];
+} nvram_region_table;
+
+bool add_region_spec (nvram_region_table *const table, const char *const spec);
+bool load_region_file (nvram_region_table *const table, const char *const pathname);
+const nvram_region *find_region (const nvram_region_table *const table, const char *const name);
+bool validate_region_table (nvram_region_table *const table, const uint64_t memory_size_bytes);
+
+#endif /* NVRAM_UIO_REGIONS_H_ */
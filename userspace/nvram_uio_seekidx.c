@@ -0,0 +1,681 @@
+/*
+ * @file nvram_uio_seekidx.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Sparse index of the records in a sharded journal, to find a record by sequence number without a scan
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nvram_uio_seekidx.h"
+#include "nvram_uio_dma.h"
+
+/** The state of the scan of one shard by seek_index_rebuild() */
+typedef struct
+{
+    seek_index *index;
+    nvram_uio_context *context;
+    unsigned int shard_index;
+    /** The part of the DMA buffer used by the scan */
+    size_t buffer_offset;
+    size_t buffer_size;
+    pthread_t thread;
+    bool thread_created;
+    bool success;
+} shard_index_scan;
+
+/**
+ * @brief Round a size up to JOURNAL_ALIGN
+ */
+static inline uint64_t record_align (const uint64_t size)
+{
+    return (size + (JOURNAL_ALIGN - 1)) & ~(uint64_t) (JOURNAL_ALIGN - 1);
+}
+
+/**
+ * @brief Return the device memory offset of a journal shard
+ */
+static inline uint64_t shard_card_offset (const seek_index *const index, const unsigned int shard_index)
+{
+    return index->journal_offset + sizeof (journal_superblock) + (shard_index * index->superblock.shard_size);
+}
+
+/**
+ * @brief Return the check word of part of a checkpoint
+ */
+static uint64_t checkpoint_check (uint64_t check, const void *const data, const size_t num_bytes)
+{
+    const uint8_t *const bytes = data;
+    uint64_t word;
+    size_t index;
+
+    for (index = 0; (index + sizeof (word)) <= num_bytes; index += sizeof (word))
+    {
+        memcpy (&word, &bytes[index], sizeof (word));
+        check = (check ^ word) * 0x100000001b3ULL;
+        check ^= check >> 29;
+    }
+
+    return check;
+}
+
+/**
+ * @brief Publish the range of a shard covered by its entries to lookups. Called with the shard index locked.
+ * @details The last sequence number is published last, as lookups read it first to find if the shard is a candidate.
+ */
+static void publish_shard (seek_index_shard *const shard, const size_t num_entries, const uint64_t end_offset,
+                           const uint64_t last_sequence)
+{
+    __atomic_store_n (&shard->num_entries, num_entries, __ATOMIC_RELEASE);
+    __atomic_store_n (&shard->end_offset, end_offset, __ATOMIC_RELEASE);
+    __atomic_store_n (&shard->last_sequence, last_sequence, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Remove all entries from the index
+ */
+static void clear_index (seek_index *const index)
+{
+    seek_index_shard *shard;
+    unsigned int shard_index;
+
+    for (shard_index = 0; shard_index < index->superblock.num_shards; shard_index++)
+    {
+        shard = &index->shards[shard_index];
+        pthread_mutex_lock (&shard->lock);
+        __atomic_store_n (&shard->last_sequence, 0, __ATOMIC_RELEASE);
+        publish_shard (shard, 0, 0, 0);
+        shard->records_since_entry = 0;
+        pthread_mutex_unlock (&shard->lock);
+    }
+}
+
+/**
+ * @brief Replace the entries of a shard with a new array, retiring the old array until no lookup can be using it.
+ *        Called with the shard index locked.
+ */
+static void replace_entries (seek_index *const index, seek_index_shard *const shard, seek_index_entry *const entries,
+                             const size_t capacity)
+{
+    seek_index_entry *const old_entries = shard->entries;
+
+    __atomic_store_n (&shard->entries, entries, __ATOMIC_RELEASE);
+    shard->capacity = capacity;
+    if (old_entries != NULL)
+    {
+        epoch_retire (&index->epoch, epoch_thread_self (&index->epoch), old_entries, NULL);
+    }
+}
+
+/**
+ * @brief Initialise an empty index for a journal
+ * @param[out] index The index to initialise
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer, used to read the journal superblock
+ * @param[in] journal_offset The offset of the journal region
+ * @param[in] interval The number of records per index entry
+ * @return Returns true if the index was initialised, or false if the region doesn't contain a journal
+ */
+bool seek_index_init (seek_index *const index, nvram_uio_context *const context, const uint64_t journal_offset,
+                      const unsigned int interval)
+{
+    unsigned int shard_index;
+
+    memset (index, 0, sizeof (*index));
+    if ((interval == 0) || !epoch_domain_init (&index->epoch, SEEK_INDEX_MAX_THREADS) ||
+        !dma_read_to_host (context, journal_offset, &index->superblock, sizeof (index->superblock)) ||
+        (index->superblock.magic != JOURNAL_MAGIC) || (index->superblock.version != JOURNAL_VERSION) ||
+        (index->superblock.num_shards == 0) || (index->superblock.num_shards > JOURNAL_MAX_SHARDS))
+    {
+        epoch_domain_free (&index->epoch);
+        return false;
+    }
+    index->journal_offset = journal_offset;
+    index->interval = interval;
+    for (shard_index = 0; shard_index < index->superblock.num_shards; shard_index++)
+    {
+        pthread_mutex_init (&index->shards[shard_index].lock, NULL);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Free the entries of an index
+ * @details Must only be called once no lookups or updates are in progress.
+ * @param[in,out] index The index to free
+ */
+void seek_index_free (seek_index *const index)
+{
+    unsigned int shard_index;
+
+    for (shard_index = 0; shard_index < index->superblock.num_shards; shard_index++)
+    {
+        free (index->shards[shard_index].entries);
+        index->shards[shard_index].entries = NULL;
+        pthread_mutex_destroy (&index->shards[shard_index].lock);
+    }
+    index->superblock.num_shards = 0;
+    epoch_domain_free (&index->epoch);
+}
+
+/**
+ * @brief Add a record to the index of a shard. Called with the shard index locked.
+ * @details The entries are grown into a new array rather than with realloc(), as lookups may be searching the old
+ *          array. A new entry is written before the count of entries including it is published.
+ * @return Returns false if the entries couldn't be extended
+ */
+static bool add_record (seek_index *const index, seek_index_shard *const shard, const uint64_t sequence,
+                        const uint64_t shard_offset, const uint64_t record_size)
+{
+    seek_index_entry *entries;
+    size_t num_entries = shard->num_entries;
+    size_t capacity;
+
+    if ((num_entries == 0) || (shard->records_since_entry >= index->interval))
+    {
+        if (num_entries == shard->capacity)
+        {
+            capacity = (shard->capacity == 0) ? 256 : (shard->capacity * 2);
+            entries = malloc (capacity * sizeof (entries[0]));
+            if (entries == NULL)
+            {
+                return false;
+            }
+            if (num_entries > 0)
+            {
+                memcpy (entries, shard->entries, num_entries * sizeof (entries[0]));
+            }
+            replace_entries (index, shard, entries, capacity);
+        }
+        shard->entries[num_entries].sequence = sequence;
+        shard->entries[num_entries].shard_offset = shard_offset;
+        num_entries++;
+        shard->records_since_entry = 0;
+    }
+    shard->records_since_entry++;
+    publish_shard (shard, num_entries, shard_offset + record_size, sequence);
+
+    return true;
+}
+
+/**
+ * @brief Add a record written to the journal to the index. Has the signature of a journal_append_fn, to be set
+ *        with journal_set_append_observer() with the index as the argument.
+ */
+void seek_index_note_record (void *const arg, const unsigned int shard_index, const uint64_t sequence,
+                             const uint64_t shard_offset, const uint64_t record_size)
+{
+    seek_index *const index = arg;
+    seek_index_shard *const shard = &index->shards[shard_index];
+
+    pthread_mutex_lock (&shard->lock);
+    (void) add_record (index, shard, sequence, shard_offset, record_size);
+    pthread_mutex_unlock (&shard->lock);
+}
+
+/**
+ * @brief Write the index to a checkpoint region of the device memory
+ * @details The entries are written before the header, so an interrupted checkpoint fails the check of the header.
+ * @param[in,out] index The index to write
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] checkpoint_offset The offset of the checkpoint region
+ * @param[in] checkpoint_size The size of the checkpoint region
+ * @return Returns true if the checkpoint was written, or false if it didn't fit in the region or a write failed
+ */
+bool seek_index_checkpoint (seek_index *const index, nvram_uio_context *const context,
+                            const uint64_t checkpoint_offset, const uint64_t checkpoint_size)
+{
+    seek_index_checkpoint_header header;
+    seek_index_entry *entries = NULL;
+    seek_index_entry *new_entries;
+    seek_index_shard *shard;
+    size_t num_entries = 0;
+    unsigned int shard_index;
+    bool success = true;
+
+    memset (&header, 0, sizeof (header));
+    header.magic = SEEK_INDEX_MAGIC;
+    header.version = SEEK_INDEX_VERSION;
+    header.journal_epoch = index->superblock.epoch;
+    header.num_shards = index->superblock.num_shards;
+    header.interval = index->interval;
+
+    /* Take a consistent copy of each shard's index */
+    for (shard_index = 0; success && (shard_index < index->superblock.num_shards); shard_index++)
+    {
+        shard = &index->shards[shard_index];
+        pthread_mutex_lock (&shard->lock);
+        new_entries = realloc (entries, (num_entries + shard->num_entries + 1) * sizeof (entries[0]));
+        success = new_entries != NULL;
+        if (success)
+        {
+            entries = new_entries;
+            if (shard->num_entries > 0)
+            {
+                memcpy (&entries[num_entries], shard->entries, shard->num_entries * sizeof (entries[0]));
+            }
+            num_entries += shard->num_entries;
+            header.shards[shard_index].num_entries = shard->num_entries;
+            header.shards[shard_index].records_since_entry = shard->records_since_entry;
+            header.shards[shard_index].end_offset = shard->end_offset;
+            header.shards[shard_index].last_sequence = shard->last_sequence;
+        }
+        pthread_mutex_unlock (&shard->lock);
+    }
+
+    success = success && ((sizeof (header) + (num_entries * sizeof (entries[0]))) <= checkpoint_size);
+    if (success)
+    {
+        header.check = checkpoint_check (checkpoint_check (SEEK_INDEX_MAGIC, header.shards, sizeof (header.shards)),
+                                         entries, num_entries * sizeof (entries[0]));
+        success = dma_write_from_host (context, checkpoint_offset + sizeof (header), entries,
+                                       num_entries * sizeof (entries[0])) &&
+                dma_write_from_host (context, checkpoint_offset, &header, sizeof (header));
+    }
+    free (entries);
+
+    return success;
+}
+
+/**
+ * @brief Check that the records of the last interval of a shard in a checkpoint are still in the journal
+ * @details The records following the last entry must be valid and end at the end offset of the checkpoint. After a
+ *          crash the journal is recovered up to its first invalid record, so this limits the checkpoint to the
+ *          recovered tail without scanning the whole shard.
+ * @param[in] last_entry The last entry of the shard in the checkpoint
+ * @return Returns true if the checkpointed records of the shard are in the journal
+ */
+static bool checkpoint_shard_in_journal (const seek_index *const index, nvram_uio_context *const context,
+                                         const unsigned int shard_index,
+                                         const seek_index_checkpoint_shard *const checkpoint_shard,
+                                         const seek_index_entry *const last_entry)
+{
+    const journal_record_header *header;
+    const uint64_t num_bytes = checkpoint_shard->end_offset - last_entry->shard_offset;
+    uint64_t expected_sequence = last_entry->sequence;
+    uint64_t num_records = 0;
+    uint64_t record_size;
+    uint64_t offset = 0;
+    uint8_t *records;
+    bool valid;
+
+    if ((last_entry->shard_offset >= checkpoint_shard->end_offset) || (num_bytes > index->superblock.shard_size))
+    {
+        return false;
+    }
+    records = malloc (num_bytes);
+    valid = (records != NULL) &&
+            dma_read_to_host (context, shard_card_offset (index, shard_index) + last_entry->shard_offset, records,
+                              num_bytes);
+    while (valid && (offset < num_bytes))
+    {
+        header = (const journal_record_header *) &records[offset];
+        valid = ((offset + sizeof (*header)) <= num_bytes) && (header->length <= num_bytes);
+        record_size = valid ? record_align (sizeof (*header) + header->length) : 0;
+        valid = valid && ((offset + record_size) <= num_bytes) && (header->epoch == index->superblock.epoch) &&
+                (header->sequence >= expected_sequence) &&
+                ((num_records > 0) || (header->sequence == last_entry->sequence)) &&
+                (header->check == journal_record_check (header, &header[1]));
+        if (valid)
+        {
+            expected_sequence = header->sequence + 1;
+            offset += record_size;
+            num_records++;
+        }
+    }
+    free (records);
+
+    return valid && (num_records == checkpoint_shard->records_since_entry) &&
+            ((expected_sequence - 1) == checkpoint_shard->last_sequence);
+}
+
+/**
+ * @brief Load the index from a checkpoint, if it is valid for the current epoch of the journal
+ * @details A shard whose checkpointed records aren't all in the journal is loaded empty, to be rebuilt by the scan.
+ * @return Returns true if the checkpoint was loaded
+ */
+static bool load_checkpoint (seek_index *const index, nvram_uio_context *const context,
+                             const uint64_t checkpoint_offset, const uint64_t checkpoint_size)
+{
+    seek_index_checkpoint_header header;
+    seek_index_entry *entries = NULL;
+    seek_index_entry *shard_entries;
+    seek_index_shard *shard;
+    size_t num_entries = 0;
+    size_t entry_index = 0;
+    size_t capacity;
+    unsigned int shard_index;
+    bool success;
+
+    success = (checkpoint_size >= sizeof (header)) &&
+            dma_read_to_host (context, checkpoint_offset, &header, sizeof (header)) &&
+            (header.magic == SEEK_INDEX_MAGIC) && (header.version == SEEK_INDEX_VERSION) &&
+            (header.journal_epoch == index->superblock.epoch) &&
+            (header.num_shards == index->superblock.num_shards) && (header.interval == index->interval);
+    for (shard_index = 0; success && (shard_index < header.num_shards); shard_index++)
+    {
+        num_entries += header.shards[shard_index].num_entries;
+        success = (header.shards[shard_index].end_offset <= index->superblock.shard_size) &&
+                (num_entries <= (checkpoint_size / sizeof (entries[0])));
+    }
+    if (success && (num_entries > 0))
+    {
+        success = ((sizeof (header) + (num_entries * sizeof (entries[0]))) <= checkpoint_size);
+        entries = success ? malloc (num_entries * sizeof (entries[0])) : NULL;
+        success = (entries != NULL) &&
+                dma_read_to_host (context, checkpoint_offset + sizeof (header), entries, num_entries * sizeof (entries[0]));
+    }
+    success = success &&
+            (header.check == checkpoint_check (checkpoint_check (SEEK_INDEX_MAGIC, header.shards, sizeof (header.shards)),
+                                               entries, num_entries * sizeof (entries[0])));
+
+    for (shard_index = 0; success && (shard_index < header.num_shards); shard_index++)
+    {
+        if ((header.shards[shard_index].num_entries > 0) &&
+            !checkpoint_shard_in_journal (index, context, shard_index, &header.shards[shard_index],
+                                          &entries[entry_index + header.shards[shard_index].num_entries - 1]))
+        {
+            entry_index += header.shards[shard_index].num_entries;
+            memset (&header.shards[shard_index], 0, sizeof (header.shards[shard_index]));
+        }
+
+        /*
+         * The entries are loaded into a new array, as lookups may be searching the existing entries. The capacity
+         * doesn't shrink, so a lookup which read the previous count of entries stays within the new array.
+         */
+        shard = &index->shards[shard_index];
+        pthread_mutex_lock (&shard->lock);
+        capacity = (header.shards[shard_index].num_entries > shard->capacity) ?
+                header.shards[shard_index].num_entries : shard->capacity;
+        shard_entries = calloc ((capacity > 0) ? capacity : 1, sizeof (shard_entries[0]));
+        success = shard_entries != NULL;
+        if (success)
+        {
+            memcpy (shard_entries, &entries[entry_index], header.shards[shard_index].num_entries * sizeof (entries[0]));
+            __atomic_store_n (&shard->last_sequence, 0, __ATOMIC_RELEASE);
+            replace_entries (index, shard, shard_entries, capacity);
+            shard->records_since_entry = header.shards[shard_index].records_since_entry;
+            publish_shard (shard, header.shards[shard_index].num_entries, header.shards[shard_index].end_offset,
+                           header.shards[shard_index].last_sequence);
+            entry_index += header.shards[shard_index].num_entries;
+        }
+        pthread_mutex_unlock (&shard->lock);
+    }
+    free (entries);
+
+    return success;
+}
+
+/**
+ * @brief Thread which extends the index of one shard, by scanning the records following the last one indexed
+ * @details The shard is read in chunks the size of the scan's part of the DMA buffer. The scan stops at the first
+ *          record which isn't valid for the current epoch, which is the tail of the shard.
+ * @param[in,out] arg The shard_index_scan for the shard
+ */
+static void *scan_shard_thread (void *arg)
+{
+    shard_index_scan *const scan = arg;
+    seek_index *const index = scan->index;
+    seek_index_shard *const shard = &index->shards[scan->shard_index];
+    const uint8_t *const buffer = &scan->context->dma_buffer[scan->buffer_offset];
+    const uint64_t card_offset = shard_card_offset (index, scan->shard_index);
+    const journal_record_header *header;
+    uint64_t chunk_offset = shard->end_offset;
+    uint64_t record_size;
+    size_t chunk_bytes;
+    size_t chunk_used;
+    bool at_tail = false;
+
+    scan->success = true;
+    while (!at_tail && scan->success)
+    {
+        chunk_bytes = ((index->superblock.shard_size - chunk_offset) < scan->buffer_size) ?
+                (index->superblock.shard_size - chunk_offset) : scan->buffer_size;
+        if (chunk_bytes < sizeof (journal_record_header))
+        {
+            at_tail = true;
+        }
+        else
+        {
+            scan->success = dma_transfer (scan->context, DMA_WRITE_TO_HOST, card_offset + chunk_offset,
+                                          scan->buffer_offset, chunk_bytes);
+        }
+
+        /* Index the complete records in the chunk */
+        chunk_used = 0;
+        while (!at_tail && scan->success && ((chunk_used + sizeof (*header)) <= chunk_bytes))
+        {
+            header = (const journal_record_header *) &buffer[chunk_used];
+            record_size = (header->length <= index->superblock.shard_size) ?
+                    record_align (sizeof (*header) + header->length) : (index->superblock.shard_size + 1);
+            if ((chunk_used + record_size) > chunk_bytes)
+            {
+                /* The record continues in the next chunk, unless it is too large for a chunk */
+                at_tail = (chunk_used == 0);
+                break;
+            }
+            if ((header->epoch != index->superblock.epoch) || (header->sequence <= shard->last_sequence) ||
+                (header->check != journal_record_check (header, &header[1])))
+            {
+                at_tail = true;
+            }
+            else
+            {
+                pthread_mutex_lock (&shard->lock);
+                scan->success = add_record (index, shard, header->sequence, chunk_offset + chunk_used, record_size);
+                pthread_mutex_unlock (&shard->lock);
+                chunk_used += record_size;
+            }
+        }
+        chunk_offset += chunk_used;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Rebuild the index from the device memory, e.g. after a crash
+ * @details The index is loaded from the checkpoint if valid for the current epoch of the journal, and then
+ *          extended by scanning the shards in parallel from the last record in the checkpoint, each scan using
+ *          its own part of the DMA buffer. Must not be called while records are being appended to the journal.
+ * @param[in,out] index The index to rebuild
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] checkpoint_offset The offset of the checkpoint region
+ * @param[in] checkpoint_size The size of the checkpoint region, or zero to rebuild without a checkpoint
+ * @return Returns true if the index was rebuilt
+ */
+bool seek_index_rebuild (seek_index *const index, nvram_uio_context *const context,
+                         const uint64_t checkpoint_offset, const uint64_t checkpoint_size)
+{
+    shard_index_scan scans[JOURNAL_MAX_SHARDS];
+    const size_t buffer_size = (context->dma_buffer_size / index->superblock.num_shards) &
+            ~(size_t) (JOURNAL_ALIGN - 1);
+    unsigned int shard_index;
+    bool success = true;
+
+    if ((context->dma_mapping == NULL) || (buffer_size < (2 * JOURNAL_ALIGN)))
+    {
+        return false;
+    }
+
+    /* The epoch may have changed since the index was initialised */
+    if (!dma_read_to_host (context, index->journal_offset + offsetof (journal_superblock, epoch),
+                           &index->superblock.epoch, sizeof (index->superblock.epoch)))
+    {
+        return false;
+    }
+    if ((checkpoint_size == 0) || !load_checkpoint (index, context, checkpoint_offset, checkpoint_size))
+    {
+        clear_index (index);
+    }
+
+    memset (scans, 0, sizeof (scans));
+    for (shard_index = 0; shard_index < index->superblock.num_shards; shard_index++)
+    {
+        scans[shard_index].index = index;
+        scans[shard_index].context = context;
+        scans[shard_index].shard_index = shard_index;
+        scans[shard_index].buffer_offset = shard_index * buffer_size;
+        scans[shard_index].buffer_size = buffer_size;
+        scans[shard_index].thread_created =
+                pthread_create (&scans[shard_index].thread, NULL, scan_shard_thread, &scans[shard_index]) == 0;
+        if (!scans[shard_index].thread_created)
+        {
+            scan_shard_thread (&scans[shard_index]);
+        }
+    }
+    for (shard_index = 0; shard_index < index->superblock.num_shards; shard_index++)
+    {
+        if (scans[shard_index].thread_created)
+        {
+            pthread_join (scans[shard_index].thread, NULL);
+        }
+        success = success && scans[shard_index].success;
+    }
+
+    return success;
+}
+
+/**
+ * @brief Search the intervals read into the DMA buffer for a record
+ * @return Returns true if the record was found
+ */
+static bool search_intervals (const seek_index *const index, const nvram_uio_context *const context,
+                              const dma_chain_element *const elements, const unsigned int num_elements,
+                              const uint64_t sequence, void *const data, const size_t max_length,
+                              size_t *const length)
+{
+    const journal_record_header *header;
+    unsigned int element_index;
+    size_t offset;
+
+    for (element_index = 0; element_index < num_elements; element_index++)
+    {
+        offset = 0;
+        while ((offset + sizeof (*header)) <= elements[element_index].num_bytes)
+        {
+            header = (const journal_record_header *) &context->dma_buffer[elements[element_index].buffer_offset + offset];
+            if ((header->length > (elements[element_index].num_bytes - offset - sizeof (*header))) ||
+                (header->epoch != index->superblock.epoch) || (header->sequence > sequence))
+            {
+                break;
+            }
+            if ((header->sequence == sequence) && (header->check == journal_record_check (header, &header[1])))
+            {
+                memcpy (data, &header[1], (header->length < max_length) ? header->length : max_length);
+                *length = header->length;
+                return true;
+            }
+            offset += record_align (sizeof (*header) + header->length);
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Find the record with a sequence number
+ * @details Reads the candidate interval of each shard whose indexed range covers the sequence number, in one DMA
+ *          chain if they fit in the DMA buffer. The entries are searched in an epoch critical section without locking
+ *          the shards, reading the last sequence number first so the count of entries and the end offset read after
+ *          it cover at least the records up to that sequence number.
+ * @param[in,out] index The index of the journal
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer, not used by an open journal
+ * @param[in] sequence The sequence number of the record to find
+ * @param[out] data Where to store the record data
+ * @param[in] max_length The maximum length of record data to store
+ * @param[out] length The length of the record, which may exceed max_length
+ * @return Returns true if the record was found
+ */
+bool seek_index_lookup (seek_index *const index, nvram_uio_context *const context, const uint64_t sequence,
+                        void *const data, const size_t max_length, size_t *const length)
+{
+    dma_chain_element elements[JOURNAL_MAX_SHARDS];
+    epoch_thread *const thread = epoch_thread_self (&index->epoch);
+    const seek_index_entry *entries;
+    seek_index_shard *shard;
+    size_t num_entries;
+    unsigned int num_elements = 0;
+    unsigned int shard_index;
+    size_t buffer_used = 0;
+    size_t low;
+    size_t high;
+    size_t mid;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    bool candidate;
+    bool found = false;
+
+    if (context->dma_mapping == NULL)
+    {
+        return false;
+    }
+
+    for (shard_index = 0; !found && (shard_index < index->superblock.num_shards); shard_index++)
+    {
+        /* Find the last entry at or before the sequence number */
+        shard = &index->shards[shard_index];
+        epoch_enter (&index->epoch, thread);
+        candidate = sequence <= __atomic_load_n (&shard->last_sequence, __ATOMIC_ACQUIRE);
+        /* The entries are read after the count, so are at least the array the count was published for */
+        num_entries = __atomic_load_n (&shard->num_entries, __ATOMIC_ACQUIRE);
+        entries = __atomic_load_n (&shard->entries, __ATOMIC_ACQUIRE);
+        candidate = candidate && (num_entries > 0) && (sequence >= entries[0].sequence);
+        if (candidate)
+        {
+            low = 0;
+            high = num_entries;
+            while ((high - low) > 1)
+            {
+                mid = low + ((high - low) / 2);
+                if (entries[mid].sequence <= sequence)
+                {
+                    low = mid;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+            start = entries[low].shard_offset;
+            end = ((low + 1) < num_entries) ? entries[low + 1].shard_offset :
+                    __atomic_load_n (&shard->end_offset, __ATOMIC_ACQUIRE);
+        }
+        epoch_exit (thread);
+
+        if (candidate)
+        {
+            if ((end - start) > context->dma_buffer_size)
+            {
+                end = start + context->dma_buffer_size;
+            }
+            if (((buffer_used + (end - start)) > context->dma_buffer_size) ||
+                (num_elements == context->max_dma_chain_length))
+            {
+                /* The DMA buffer is full, so search the intervals read so far */
+                found = dma_transfer_chain (context, DMA_WRITE_TO_HOST, elements, num_elements) &&
+                        search_intervals (index, context, elements, num_elements, sequence, data, max_length, length);
+                num_elements = 0;
+                buffer_used = 0;
+            }
+            elements[num_elements].card_offset = shard_card_offset (index, shard_index) + start;
+            elements[num_elements].buffer_offset = buffer_used;
+            elements[num_elements].num_bytes = end - start;
+            buffer_used += end - start;
+            num_elements++;
+        }
+    }
+
+    if (!found && (num_elements > 0))
+    {
+        found = dma_transfer_chain (context, DMA_WRITE_TO_HOST, elements, num_elements) &&
+                search_intervals (index, context, elements, num_elements, sequence, data, max_length, length);
+    }
+
+    return found;
+}
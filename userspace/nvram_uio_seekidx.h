@@ -0,0 +1,113 @@
+/*
+ * @file nvram_uio_seekidx.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Sparse index of the records in a sharded journal, to find a record by sequence number without a scan
+ * @details
+ *   For each journal shard the index holds one entry per interval records, giving the sequence number and shard
+ *   offset of the first record of the interval. A lookup binary searches each shard's entries, and then reads the
+ *   candidate interval of every shard whose indexed range covers the sequence number in one DMA chain, so the read
+ *   is bounded by the interval rather than the size of the journal. The intervals must fit in the DMA buffer of the
+ *   context used for the lookup, which should not be the context of an open journal since the journal uses all
+ *   of its DMA buffer.
+ *
+ *   The index is kept in host memory, either updated as records are written by setting seek_index_note_record()
+ *   as the journal append observer, or rebuilt from the device memory. It can be checkpointed to a separate
+ *   region of the device memory, after which a rebuild only has to scan the records appended since the checkpoint.
+ *   The last interval of each shard in a checkpoint is checked against the journal when loaded, and a shard whose
+ *   checkpoint extends past the recovered tail of the journal is rebuilt from the start. The rebuild scans the
+ *   shards in parallel.
+ *
+ *   Lookups don't take locks. The entries of a shard are only appended to in place, and when they are grown the old
+ *   array is retired to the epoch domain of the index, so a lookup in an epoch critical section can keep searching
+ *   it. The count of entries and the end of the indexed records are published after the entries they cover.
+ */
+
+#ifndef NVRAM_UIO_SEEKIDX_H_
+#define NVRAM_UIO_SEEKIDX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_journal.h"
+#include "nvram_uio_epoch.h"
+
+#define SEEK_INDEX_MAGIC 0x5849454b4553564eULL /* "NVSEEKIX" */
+#define SEEK_INDEX_VERSION 2
+
+/* The most threads which can perform lookups or note records for one index */
+#define SEEK_INDEX_MAX_THREADS 256
+
+/** One index entry, for the first record of an interval */
+typedef struct
+{
+    uint64_t sequence;
+    uint64_t shard_offset;
+} seek_index_entry;
+
+/** The index of one journal shard */
+typedef struct
+{
+    /** Serialises the updates of the shard, as records may be noted by multiple threads. Not taken by lookups. */
+    pthread_mutex_t lock;
+    seek_index_entry *entries;
+    size_t num_entries;
+    size_t capacity;
+    /** The number of records indexed since the last entry was added */
+    uint64_t records_since_entry;
+    /** The shard offset following the last record indexed */
+    uint64_t end_offset;
+    uint64_t last_sequence;
+} seek_index_shard;
+
+/** The index of one journal */
+typedef struct
+{
+    uint64_t journal_offset;
+    journal_superblock superblock;
+    /** The number of records per index entry */
+    unsigned int interval;
+    seek_index_shard shards[JOURNAL_MAX_SHARDS];
+    /** Defers freeing the entries replaced while lookups may be searching them */
+    epoch_domain epoch;
+} seek_index;
+
+/** The state of one shard in a checkpoint */
+typedef struct
+{
+    uint64_t num_entries;
+    uint64_t records_since_entry;
+    uint64_t end_offset;
+    uint64_t last_sequence;
+} seek_index_checkpoint_shard;
+
+/** The header of a checkpoint in the device memory, followed by the entries of each shard in turn */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    /** The epoch of the journal when the checkpoint was written */
+    uint32_t journal_epoch;
+    uint32_t num_shards;
+    uint32_t interval;
+    /** Check word of the shards and entries, so a checkpoint interrupted by a crash isn't used */
+    uint64_t check;
+    seek_index_checkpoint_shard shards[JOURNAL_MAX_SHARDS];
+} seek_index_checkpoint_header;
+
+bool seek_index_init (seek_index *const index, nvram_uio_context *const context, const uint64_t journal_offset,
+                      const unsigned int interval);
+void seek_index_free (seek_index *const index);
+void seek_index_note_record (void *const arg, const unsigned int shard_index, const uint64_t sequence,
+                             const uint64_t shard_offset, const uint64_t record_size);
+bool seek_index_checkpoint (seek_index *const index, nvram_uio_context *const context,
+                            const uint64_t checkpoint_offset, const uint64_t checkpoint_size);
+bool seek_index_rebuild (seek_index *const index, nvram_uio_context *const context,
+                         const uint64_t checkpoint_offset, const uint64_t checkpoint_size);
+bool seek_index_lookup (seek_index *const index, nvram_uio_context *const context, const uint64_t sequence,
+                        void *const data, const size_t max_length, size_t *const length);
+
+#endif /* NVRAM_UIO_SEEKIDX_H_ */
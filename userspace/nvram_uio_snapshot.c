@@ -0,0 +1,831 @@
+/*
+ * @file nvram_uio_snapshot.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Page-mapped region of the NVRAM device memory with point-in-time snapshots using redirect-on-write
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "nvram_uio_snapshot.h"
+#include "nvram_uio_dma.h"
+
+/* The number of map block entries written as one line when a map block entry changes */
+#define MAP_ENTRIES_PER_LINE (64 / sizeof (uint32_t))
+
+/**
+ * @brief Return the size of the metadata, for a number of root entries
+ */
+static inline size_t metadata_size (const uint32_t num_root_entries)
+{
+    return sizeof (snap_metadata_header) + (SNAP_MAX_SNAPSHOTS * sizeof (snap_snapshot_entry)) +
+            ((1 + SNAP_MAX_SNAPSHOTS) * num_root_entries * sizeof (uint32_t));
+}
+
+/**
+ * @brief Return the size of a metadata slot, which is the metadata for SNAP_MAX_ROOT_ENTRIES rounded up to a page,
+ *        so that the offsets of the slots don't depend upon the metadata
+ */
+static inline uint64_t metadata_slot_size (void)
+{
+    return (metadata_size (SNAP_MAX_ROOT_ENTRIES) + (SNAP_PAGE_SIZE - 1)) & ~(uint64_t) (SNAP_PAGE_SIZE - 1);
+}
+
+static inline snap_metadata_header *metadata_header (const snap_region *const region)
+{
+    return (snap_metadata_header *) region->metadata;
+}
+
+static inline snap_snapshot_entry *snapshot_table (const snap_region *const region)
+{
+    return (snap_snapshot_entry *) &region->metadata[sizeof (snap_metadata_header)];
+}
+
+/**
+ * @brief Return one root in the metadata, where root zero is the live map and root 1+n is snapshot table entry n
+ */
+static inline uint32_t *map_root (const snap_region *const region, const unsigned int root_index)
+{
+    uint32_t *const roots = (uint32_t *) &region->metadata[sizeof (snap_metadata_header) +
+                                                           (SNAP_MAX_SNAPSHOTS * sizeof (snap_snapshot_entry))];
+
+    return &roots[root_index * metadata_header (region)->num_root_entries];
+}
+
+/**
+ * @brief Return the device offset of a physical page
+ */
+static inline uint64_t page_card_offset (const snap_region *const region, const uint32_t page)
+{
+    return region->pages_offset + ((uint64_t) (page - 1) * SNAP_PAGE_SIZE);
+}
+
+/**
+ * @brief Format a snapshot region, with the logical pages unmapped and no snapshots
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the region in the device memory, a multiple of 64 bytes
+ * @param[in] region_size The size of the region, including the metadata and the physical pages
+ * @param[in] logical_size The size of the logical pages, a multiple of SNAP_PAGE_SIZE. The region must have enough
+ *                         physical pages to map every logical page; the physical pages beyond that are available
+ *                         for redirected writes while snapshots exist.
+ * @return Returns true if the region was formatted
+ */
+bool snap_format (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                  const uint64_t logical_size)
+{
+    const uint64_t num_logical_pages = logical_size / SNAP_PAGE_SIZE;
+    const uint32_t num_root_entries = (uint32_t) ((num_logical_pages + SNAP_MAP_ENTRIES - 1) / SNAP_MAP_ENTRIES);
+    const uint64_t slot_size = metadata_slot_size ();
+    snap_metadata_header *header;
+    uint8_t *metadata;
+    bool success;
+
+    if (((region_offset % 64) != 0) || (logical_size == 0) || ((logical_size % SNAP_PAGE_SIZE) != 0) ||
+        (num_root_entries > SNAP_MAX_ROOT_ENTRIES) ||
+        (region_size < ((2 * slot_size) + ((num_logical_pages + num_root_entries) * SNAP_PAGE_SIZE))))
+    {
+        return false;
+    }
+    metadata = calloc (1, slot_size);
+    if (metadata == NULL)
+    {
+        return false;
+    }
+
+    header = (snap_metadata_header *) metadata;
+    header->magic = SNAP_MAGIC;
+    header->version = SNAP_VERSION;
+    header->num_root_entries = num_root_entries;
+    header->generation = 1;
+    header->logical_size = logical_size;
+    header->num_physical_pages = (uint32_t) ((region_size - (2 * slot_size)) / SNAP_PAGE_SIZE);
+    header->next_snapshot_id = 1;
+    header->check = compute_check_word (metadata, metadata_size (num_root_entries),
+                                        offsetof (snap_metadata_header, check));
+
+    /* Write the metadata to slot zero, and invalidate slot one */
+    success = dma_write_from_host (context, region_offset, metadata, metadata_size (num_root_entries));
+    memset (metadata, 0, sizeof (snap_metadata_header));
+    success = success && dma_write_from_host (context, region_offset + slot_size, metadata,
+                                              sizeof (snap_metadata_header));
+    free (metadata);
+
+    return success;
+}
+
+/**
+ * @brief Read a metadata slot, returning true if it is valid
+ */
+static bool read_metadata_slot (nvram_uio_context *const context, const uint64_t slot_offset,
+                                const uint32_t num_root_entries, uint8_t *const metadata)
+{
+    snap_metadata_header header;
+
+    if (!dma_read_to_host (context, slot_offset, metadata, metadata_size (num_root_entries)))
+    {
+        return false;
+    }
+    memcpy (&header, metadata, sizeof (header));
+
+    return (header.magic == SNAP_MAGIC) && (header.version == SNAP_VERSION) &&
+            (header.num_root_entries == num_root_entries) &&
+            (header.check == compute_check_word (metadata, metadata_size (num_root_entries),
+                                                 offsetof (snap_metadata_header, check)));
+}
+
+/**
+ * @brief Count the references to the pages from one root, loading the map blocks not already loaded
+ * @return Returns false if a map block couldn't be read, or a page number is out of range
+ */
+static bool reference_root_pages (snap_region *const region, const uint32_t *const root)
+{
+    const uint32_t num_root_entries = metadata_header (region)->num_root_entries;
+    uint32_t root_entry;
+    uint32_t map_block;
+    uint32_t entry;
+    uint32_t *block;
+
+    for (root_entry = 0; root_entry < num_root_entries; root_entry++)
+    {
+        map_block = root[root_entry];
+        if (map_block == 0)
+        {
+            continue;
+        }
+        if (map_block > region->num_physical_pages)
+        {
+            return false;
+        }
+        if (region->map_blocks[map_block] == NULL)
+        {
+            block = malloc (SNAP_PAGE_SIZE);
+            if ((block == NULL) || !dma_read_to_host (region->context, page_card_offset (region, map_block), block,
+                                                      SNAP_PAGE_SIZE))
+            {
+                free (block);
+                return false;
+            }
+            region->map_blocks[map_block] = block;
+            for (entry = 0; entry < SNAP_MAP_ENTRIES; entry++)
+            {
+                if (block[entry] > region->num_physical_pages)
+                {
+                    return false;
+                }
+                if (block[entry] != 0)
+                {
+                    region->refcounts[block[entry]]++;
+                }
+            }
+        }
+        region->refcounts[map_block]++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Open a snapshot region, loading the current metadata and the map blocks
+ * @param[out] region The region to open
+ * @param[in,out] context The open NVRAM UIO device with a mapped DMA buffer
+ * @param[in] region_offset The offset of the formatted region
+ * @return Returns true if the region was opened
+ */
+bool snap_open (snap_region *const region, nvram_uio_context *const context, const uint64_t region_offset)
+{
+    snap_metadata_header header;
+    uint8_t *slot_metadata[2] = {NULL, NULL};
+    bool slot_valid[2] = {false, false};
+    uint32_t num_root_entries;
+    unsigned int slot;
+    unsigned int snapshot;
+    uint32_t page;
+    bool success;
+
+    memset (region, 0, sizeof (*region));
+    region->context = context;
+    region->region_offset = region_offset;
+    pthread_mutex_init (&region->lock, NULL);
+
+    /* Find the number of root entries from either slot, to size the metadata */
+    region->slot_size = metadata_slot_size ();
+    for (slot = 0; slot < 2; slot++)
+    {
+        if (dma_read_to_host (context, region_offset + (slot * region->slot_size), &header, sizeof (header)) &&
+            (header.magic == SNAP_MAGIC))
+        {
+            break;
+        }
+    }
+    num_root_entries = header.num_root_entries;
+    if ((slot == 2) || (num_root_entries == 0) || (num_root_entries > SNAP_MAX_ROOT_ENTRIES))
+    {
+        snap_close (region);
+        return false;
+    }
+
+    /* Use the valid slot with the greatest generation */
+    for (slot = 0; slot < 2; slot++)
+    {
+        slot_metadata[slot] = calloc (1, region->slot_size);
+        slot_valid[slot] = (slot_metadata[slot] != NULL) &&
+                read_metadata_slot (context, region_offset + (slot * region->slot_size), num_root_entries,
+                                    slot_metadata[slot]);
+    }
+    if (slot_valid[0] && slot_valid[1])
+    {
+        region->committed_slot = (((snap_metadata_header *) slot_metadata[1])->generation >
+                                  ((snap_metadata_header *) slot_metadata[0])->generation) ? 1 : 0;
+    }
+    else
+    {
+        region->committed_slot = slot_valid[1] ? 1 : 0;
+    }
+    success = slot_valid[region->committed_slot];
+    region->metadata = slot_metadata[region->committed_slot];
+    free (slot_metadata[region->committed_slot ^ 1]);
+
+    if (success)
+    {
+        region->pages_offset = region_offset + (2 * region->slot_size);
+        region->num_physical_pages = metadata_header (region)->num_physical_pages;
+        region->refcounts = calloc ((size_t) region->num_physical_pages + 1, sizeof (region->refcounts[0]));
+        region->map_blocks = calloc ((size_t) region->num_physical_pages + 1, sizeof (region->map_blocks[0]));
+        region->page_buffer = malloc (SNAP_PAGE_SIZE);
+        success = (region->refcounts != NULL) && (region->map_blocks != NULL) && (region->page_buffer != NULL);
+    }
+
+    /* Derive the reference counts from the live map and the snapshots */
+    success = success && reference_root_pages (region, map_root (region, 0));
+    for (snapshot = 0; success && (snapshot < SNAP_MAX_SNAPSHOTS); snapshot++)
+    {
+        if (snapshot_table (region)[snapshot].snapshot_id != 0)
+        {
+            success = reference_root_pages (region, map_root (region, 1 + snapshot));
+        }
+    }
+    if (!success)
+    {
+        snap_close (region);
+        return false;
+    }
+    for (page = 1; page <= region->num_physical_pages; page++)
+    {
+        if (region->refcounts[page] == 0)
+        {
+            region->num_free_pages++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Close a snapshot region, freeing the host state
+ */
+void snap_close (snap_region *const region)
+{
+    uint32_t page;
+
+    if (region->map_blocks != NULL)
+    {
+        for (page = 1; page <= region->num_physical_pages; page++)
+        {
+            free (region->map_blocks[page]);
+        }
+    }
+    free (region->map_blocks);
+    free (region->refcounts);
+    free (region->metadata);
+    free (region->page_buffer);
+    region->map_blocks = NULL;
+    region->refcounts = NULL;
+    region->metadata = NULL;
+    region->page_buffer = NULL;
+    pthread_mutex_destroy (&region->lock);
+}
+
+/**
+ * @brief Commit the metadata to the slot not last committed. Called with the region locked.
+ */
+static bool commit_metadata (snap_region *const region)
+{
+    snap_metadata_header *const header = metadata_header (region);
+    const size_t num_bytes = metadata_size (header->num_root_entries);
+    const unsigned int slot = region->committed_slot ^ 1;
+
+    header->generation++;
+    header->check = compute_check_word (region->metadata, num_bytes, offsetof (snap_metadata_header, check));
+    if (!dma_write_from_host (region->context, region->region_offset + (slot * region->slot_size), region->metadata,
+                              num_bytes))
+    {
+        header->generation--;
+        return false;
+    }
+    region->committed_slot = slot;
+
+    return true;
+}
+
+/**
+ * @brief Allocate a free physical page, with a reference count of one
+ * @return The page allocated, or zero if there are no free pages
+ */
+static uint32_t alloc_page (snap_region *const region)
+{
+    uint32_t index;
+    uint32_t page;
+
+    for (index = 0; index < region->num_physical_pages; index++)
+    {
+        page = 1 + ((region->next_free_hint + index) % region->num_physical_pages);
+        if (region->refcounts[page] == 0)
+        {
+            region->refcounts[page] = 1;
+            region->num_free_pages--;
+            region->next_free_hint = page;
+            return page;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Release one reference to a physical page. When a map block is freed, the references to its pages are
+ *        released.
+ */
+static void release_page (snap_region *const region, const uint32_t page)
+{
+    uint32_t entry;
+
+    region->refcounts[page]--;
+    if (region->refcounts[page] == 0)
+    {
+        region->num_free_pages++;
+        if (region->map_blocks[page] != NULL)
+        {
+            for (entry = 0; entry < SNAP_MAP_ENTRIES; entry++)
+            {
+                if (region->map_blocks[page][entry] != 0)
+                {
+                    release_page (region, region->map_blocks[page][entry]);
+                }
+            }
+            free (region->map_blocks[page]);
+            region->map_blocks[page] = NULL;
+        }
+    }
+}
+
+/**
+ * @brief Return the map block of the live map for a root entry, allocating or copying it if not already private
+ * @param[in,out] region The region, which is locked
+ * @param[in] root_entry The root entry of the live map
+ * @param[in,out] root_changed Set when the live root is changed, which requires a metadata commit
+ * @return The map block, or zero if a page couldn't be allocated or written
+ */
+static uint32_t private_map_block (snap_region *const region, const uint32_t root_entry, bool *const root_changed)
+{
+    uint32_t *const live_root = map_root (region, 0);
+    const uint32_t map_block = live_root[root_entry];
+    uint32_t new_block;
+    uint32_t entry;
+    uint32_t *block;
+
+    if ((map_block != 0) && (region->refcounts[map_block] == 1))
+    {
+        return map_block;
+    }
+
+    new_block = alloc_page (region);
+    block = malloc (SNAP_PAGE_SIZE);
+    if ((new_block == 0) || (block == NULL))
+    {
+        free (block);
+        if (new_block != 0)
+        {
+            release_page (region, new_block);
+        }
+        return 0;
+    }
+    if (map_block == 0)
+    {
+        memset (block, 0, SNAP_PAGE_SIZE);
+    }
+    else
+    {
+        /* The copy shares the data pages of the map block it was copied from */
+        memcpy (block, region->map_blocks[map_block], SNAP_PAGE_SIZE);
+        for (entry = 0; entry < SNAP_MAP_ENTRIES; entry++)
+        {
+            if (block[entry] != 0)
+            {
+                region->refcounts[block[entry]]++;
+            }
+        }
+    }
+    region->map_blocks[new_block] = block;
+    if (!dma_write_from_host (region->context, page_card_offset (region, new_block), block, SNAP_PAGE_SIZE))
+    {
+        release_page (region, new_block);
+        return 0;
+    }
+
+    if (map_block != 0)
+    {
+        release_page (region, map_block);
+    }
+    live_root[root_entry] = new_block;
+    *root_changed = true;
+
+    return new_block;
+}
+
+/**
+ * @brief Write within one logical page of the live map, redirecting the write if the data page is shared
+ * @param[in,out] region The region, which is locked
+ * @param[in] logical_page The logical page to write
+ * @param[in] page_offset The offset within the page
+ * @param[in] data The data to write
+ * @param[in] num_bytes The number of bytes to write, which don't cross the end of the page
+ * @param[in,out] root_changed Set when the live root is changed, which requires a metadata commit
+ * @return Returns true if the write succeeded
+ */
+static bool write_page (snap_region *const region, const uint64_t logical_page, const size_t page_offset,
+                        const uint8_t *const data, const size_t num_bytes, bool *const root_changed)
+{
+    const uint32_t map_block = private_map_block (region, (uint32_t) (logical_page / SNAP_MAP_ENTRIES), root_changed);
+    const uint32_t entry = (uint32_t) (logical_page % SNAP_MAP_ENTRIES);
+    const uint32_t line = entry & ~(uint32_t) (MAP_ENTRIES_PER_LINE - 1);
+    uint32_t old_page;
+    uint32_t new_page;
+    const uint8_t *src;
+
+    if (map_block == 0)
+    {
+        return false;
+    }
+    old_page = region->map_blocks[map_block][entry];
+    if ((old_page != 0) && (region->refcounts[old_page] == 1))
+    {
+        return dma_write_from_host (region->context, page_card_offset (region, old_page) + page_offset, data,
+                                    num_bytes);
+    }
+
+    /* Redirect the write to a new page, merging a partial write with the previous contents of the page */
+    new_page = alloc_page (region);
+    if (new_page == 0)
+    {
+        return false;
+    }
+    if (num_bytes == SNAP_PAGE_SIZE)
+    {
+        src = data;
+    }
+    else
+    {
+        if (old_page == 0)
+        {
+            memset (region->page_buffer, 0, SNAP_PAGE_SIZE);
+        }
+        else if (!dma_read_to_host (region->context, page_card_offset (region, old_page), region->page_buffer,
+                                    SNAP_PAGE_SIZE))
+        {
+            release_page (region, new_page);
+            return false;
+        }
+        memcpy (&region->page_buffer[page_offset], data, num_bytes);
+        src = region->page_buffer;
+    }
+    if (!dma_write_from_host (region->context, page_card_offset (region, new_page), src, SNAP_PAGE_SIZE))
+    {
+        release_page (region, new_page);
+        return false;
+    }
+
+    /* Once the new page is written, update the line of the map block which maps it */
+    region->map_blocks[map_block][entry] = new_page;
+    if (!dma_write_from_host (region->context, page_card_offset (region, map_block) + (line * sizeof (uint32_t)),
+                              &region->map_blocks[map_block][line], MAP_ENTRIES_PER_LINE * sizeof (uint32_t)))
+    {
+        region->map_blocks[map_block][entry] = old_page;
+        release_page (region, new_page);
+        return false;
+    }
+    if (old_page != 0)
+    {
+        release_page (region, old_page);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write to the live map of a region
+ * @details Pages not shared with a snapshot are written in place. The metadata is committed only if a map block
+ *          had to be allocated or copied.
+ * @param[in,out] region The open region
+ * @param[in] offset The logical offset to write at
+ * @param[in] data The data to write
+ * @param[in] num_bytes The number of bytes to write
+ * @return Returns true if the write succeeded, or false if out of free pages or a transfer failed
+ */
+bool snap_write (snap_region *const region, const uint64_t offset, const void *const data, const size_t num_bytes)
+{
+    const uint8_t *const bytes = data;
+    size_t bytes_done;
+    size_t page_offset;
+    size_t page_bytes;
+    bool root_changed = false;
+    bool success = true;
+
+    if ((offset + num_bytes) > metadata_header (region)->logical_size)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&region->lock);
+    for (bytes_done = 0; success && (bytes_done < num_bytes); bytes_done += page_bytes)
+    {
+        page_offset = (size_t) ((offset + bytes_done) % SNAP_PAGE_SIZE);
+        page_bytes = ((num_bytes - bytes_done) < (SNAP_PAGE_SIZE - page_offset)) ? (num_bytes - bytes_done) :
+                (SNAP_PAGE_SIZE - page_offset);
+        success = write_page (region, (offset + bytes_done) / SNAP_PAGE_SIZE, page_offset, &bytes[bytes_done],
+                              page_bytes, &root_changed);
+    }
+    if (root_changed)
+    {
+        success = commit_metadata (region) && success;
+    }
+    pthread_mutex_unlock (&region->lock);
+
+    return success;
+}
+
+/**
+ * @brief Return the root index of the live map or a snapshot, or -1 if the snapshot doesn't exist
+ */
+static int find_root (const snap_region *const region, const uint32_t snapshot_id)
+{
+    unsigned int snapshot;
+
+    if (snapshot_id == SNAP_LIVE)
+    {
+        return 0;
+    }
+    for (snapshot = 0; snapshot < SNAP_MAX_SNAPSHOTS; snapshot++)
+    {
+        if (snapshot_table (region)[snapshot].snapshot_id == snapshot_id)
+        {
+            return (int) (1 + snapshot);
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Read from the live map or a snapshot of a region
+ * @details The mapped pages are read with DMA chains of one element per page. Unmapped pages read as zeros.
+ * @param[in,out] region The open region
+ * @param[in] snapshot_id The snapshot to read, or SNAP_LIVE
+ * @param[in] offset The logical offset to read from
+ * @param[out] data Where to store the data read
+ * @param[in] num_bytes The number of bytes to read
+ * @return Returns true if the snapshot exists and the read succeeded
+ */
+bool snap_read (snap_region *const region, const uint32_t snapshot_id, const uint64_t offset, void *const data,
+                const size_t num_bytes)
+{
+    nvram_uio_context *const context = region->context;
+    uint8_t *const bytes = data;
+    unsigned int max_elements = context->max_dma_chain_length;
+    dma_chain_element *elements;
+    size_t *destinations;
+    const uint32_t *root;
+    unsigned int num_elements;
+    unsigned int element;
+    uint64_t logical_page;
+    uint32_t map_block;
+    uint32_t page;
+    size_t bytes_done = 0;
+    size_t page_offset;
+    size_t page_bytes;
+    int root_index;
+    bool success = true;
+
+    if (max_elements > (context->dma_buffer_size / SNAP_PAGE_SIZE))
+    {
+        max_elements = (unsigned int) (context->dma_buffer_size / SNAP_PAGE_SIZE);
+    }
+    if ((max_elements == 0) || ((offset + num_bytes) > metadata_header (region)->logical_size))
+    {
+        return false;
+    }
+    elements = calloc (max_elements, sizeof (elements[0]));
+    destinations = calloc (max_elements, sizeof (destinations[0]));
+    if ((elements == NULL) || (destinations == NULL))
+    {
+        free (elements);
+        free (destinations);
+        return false;
+    }
+
+    pthread_mutex_lock (&region->lock);
+    root_index = find_root (region, snapshot_id);
+    success = root_index >= 0;
+    while (success && (bytes_done < num_bytes))
+    {
+        root = map_root (region, (unsigned int) root_index);
+        for (num_elements = 0; (num_elements < max_elements) && (bytes_done < num_bytes); bytes_done += page_bytes)
+        {
+            logical_page = (offset + bytes_done) / SNAP_PAGE_SIZE;
+            page_offset = (size_t) ((offset + bytes_done) % SNAP_PAGE_SIZE);
+            page_bytes = ((num_bytes - bytes_done) < (SNAP_PAGE_SIZE - page_offset)) ? (num_bytes - bytes_done) :
+                    (SNAP_PAGE_SIZE - page_offset);
+            map_block = root[logical_page / SNAP_MAP_ENTRIES];
+            page = (map_block != 0) ? region->map_blocks[map_block][logical_page % SNAP_MAP_ENTRIES] : 0;
+            if (page == 0)
+            {
+                memset (&bytes[bytes_done], 0, page_bytes);
+            }
+            else
+            {
+                elements[num_elements].card_offset = page_card_offset (region, page) + page_offset;
+                elements[num_elements].buffer_offset = num_elements * SNAP_PAGE_SIZE;
+                elements[num_elements].num_bytes = page_bytes;
+                destinations[num_elements] = bytes_done;
+                num_elements++;
+            }
+        }
+
+        if (num_elements > 0)
+        {
+            success = dma_transfer_chain (context, DMA_WRITE_TO_HOST, elements, num_elements);
+            for (element = 0; success && (element < num_elements); element++)
+            {
+                memcpy (&bytes[destinations[element]], &context->dma_buffer[elements[element].buffer_offset],
+                        elements[element].num_bytes);
+            }
+        }
+    }
+    pthread_mutex_unlock (&region->lock);
+    free (elements);
+    free (destinations);
+
+    return success;
+}
+
+/**
+ * @brief Create a snapshot of the live map, with one metadata commit
+ * @param[in,out] region The open region
+ * @param[out] snapshot_id The identity of the snapshot created
+ * @return Returns true if the snapshot was created, or false if the snapshot table is full or the commit failed
+ */
+bool snap_create (snap_region *const region, uint32_t *const snapshot_id)
+{
+    snap_metadata_header *const header = metadata_header (region);
+    const uint32_t *const live_root = map_root (region, 0);
+    snap_snapshot_entry *entry = NULL;
+    unsigned int snapshot;
+    uint32_t root_entry;
+    bool success = false;
+
+    pthread_mutex_lock (&region->lock);
+    for (snapshot = 0; (entry == NULL) && (snapshot < SNAP_MAX_SNAPSHOTS); snapshot++)
+    {
+        if (snapshot_table (region)[snapshot].snapshot_id == 0)
+        {
+            entry = &snapshot_table (region)[snapshot];
+        }
+    }
+
+    if (entry != NULL)
+    {
+        /* The snapshot shares the map blocks of the live map */
+        snapshot = (unsigned int) (entry - snapshot_table (region));
+        memcpy (map_root (region, 1 + snapshot), live_root, header->num_root_entries * sizeof (uint32_t));
+        for (root_entry = 0; root_entry < header->num_root_entries; root_entry++)
+        {
+            if (live_root[root_entry] != 0)
+            {
+                region->refcounts[live_root[root_entry]]++;
+            }
+        }
+        entry->snapshot_id = header->next_snapshot_id;
+        entry->created_time = (uint64_t) time (NULL);
+        header->next_snapshot_id = (header->next_snapshot_id == UINT32_MAX) ? 1 : (header->next_snapshot_id + 1);
+
+        success = commit_metadata (region);
+        if (success)
+        {
+            *snapshot_id = entry->snapshot_id;
+        }
+        else
+        {
+            for (root_entry = 0; root_entry < header->num_root_entries; root_entry++)
+            {
+                if (live_root[root_entry] != 0)
+                {
+                    region->refcounts[live_root[root_entry]]--;
+                }
+            }
+            header->next_snapshot_id = entry->snapshot_id;
+            entry->snapshot_id = 0;
+        }
+    }
+    pthread_mutex_unlock (&region->lock);
+
+    return success;
+}
+
+/**
+ * @brief Delete a snapshot, freeing the pages only it references
+ * @param[in,out] region The open region
+ * @param[in] snapshot_id The snapshot to delete
+ * @return Returns true if the snapshot existed and the deletion was committed
+ */
+bool snap_delete (snap_region *const region, const uint32_t snapshot_id)
+{
+    const uint32_t num_root_entries = metadata_header (region)->num_root_entries;
+    snap_snapshot_entry *entry;
+    uint32_t *root;
+    uint32_t root_entry;
+    int root_index;
+    bool success = false;
+
+    pthread_mutex_lock (&region->lock);
+    root_index = find_root (region, snapshot_id);
+    if (root_index > 0)
+    {
+        /*
+         * The root of a free snapshot entry isn't referenced, so the deletion is committed before the pages are
+         * released. Otherwise a failed commit would leave the snapshot referencing pages which could be reallocated.
+         */
+        entry = &snapshot_table (region)[root_index - 1];
+        entry->snapshot_id = 0;
+        success = commit_metadata (region);
+        if (success)
+        {
+            root = map_root (region, (unsigned int) root_index);
+            for (root_entry = 0; root_entry < num_root_entries; root_entry++)
+            {
+                if (root[root_entry] != 0)
+                {
+                    release_page (region, root[root_entry]);
+                    root[root_entry] = 0;
+                }
+            }
+        }
+        else
+        {
+            entry->snapshot_id = snapshot_id;
+        }
+    }
+    pthread_mutex_unlock (&region->lock);
+
+    return success;
+}
+
+/**
+ * @brief List the snapshots of a region
+ * @param[in,out] region The open region
+ * @param[out] entries The snapshots which exist
+ * @return The number of snapshots
+ */
+unsigned int snap_list (snap_region *const region, snap_snapshot_entry entries[const SNAP_MAX_SNAPSHOTS])
+{
+    unsigned int snapshot;
+    unsigned int num_snapshots = 0;
+
+    pthread_mutex_lock (&region->lock);
+    for (snapshot = 0; snapshot < SNAP_MAX_SNAPSHOTS; snapshot++)
+    {
+        if (snapshot_table (region)[snapshot].snapshot_id != 0)
+        {
+            entries[num_snapshots++] = snapshot_table (region)[snapshot];
+        }
+    }
+    pthread_mutex_unlock (&region->lock);
+
+    return num_snapshots;
+}
+
+/**
+ * @brief Get the number of free physical pages of a region
+ */
+void snap_get_usage (snap_region *const region, uint32_t *const num_free_pages, uint32_t *const num_physical_pages)
+{
+    pthread_mutex_lock (&region->lock);
+    *num_free_pages = region->num_free_pages;
+    *num_physical_pages = region->num_physical_pages;
+    pthread_mutex_unlock (&region->lock);
+}
@@ -0,0 +1,114 @@
+/*
+ * @file nvram_uio_snapshot.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Page-mapped region of the NVRAM device memory with point-in-time snapshots using redirect-on-write
+ * @details
+ *   The region starts with two metadata slots, followed by the physical pages. The logical pages of the region are
+ *   mapped to physical pages by map blocks, each of which is a physical page holding SNAP_MAP_ENTRIES physical page
+ *   numbers. The root of a map is the array of the map blocks covering the logical pages. The metadata holds the
+ *   root of the live map and the roots of the snapshots, and is committed by writing it to the slot other than the
+ *   one last written with an incremented generation; the valid slot with the greatest generation is current.
+ *
+ *   Creating a snapshot copies the live root into the snapshot table, so costs one metadata commit. After that the
+ *   map blocks and data pages are shared between the live map and the snapshot. A write to a shared data page is
+ *   redirected to a newly allocated page, copying the rest of the old page for a partial page write, and a write
+ *   through a shared map block first copies the map block. Pages which aren't shared are written in place.
+ *
+ *   The reference counts of the pages are derived from the maps when the region is opened, so no allocation state
+ *   is stored in the device memory. A page referenced by no map is free. Physical page number zero means unmapped,
+ *   and unmapped logical pages read as zeros.
+ */
+
+#ifndef NVRAM_UIO_SNAPSHOT_H_
+#define NVRAM_UIO_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+
+#define SNAP_MAGIC 0x50414e534d41564eULL /* "NVAMSNAP" */
+#define SNAP_VERSION 1
+
+#define SNAP_PAGE_SIZE 4096
+#define SNAP_MAP_ENTRIES (SNAP_PAGE_SIZE / sizeof (uint32_t))
+
+/* The maximum number of map blocks in a root, which limits the logical size to 1 GB */
+#define SNAP_MAX_ROOT_ENTRIES 256
+
+/* The maximum number of snapshots which can exist at once */
+#define SNAP_MAX_SNAPSHOTS 16
+
+/* The snapshot identity used to access the live map */
+#define SNAP_LIVE 0
+
+/** The header at the start of each metadata slot, followed by the snapshot table and the roots */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_root_entries;
+    /** Incremented by each commit */
+    uint64_t generation;
+    uint64_t logical_size;
+    uint32_t num_physical_pages;
+    /** The identity given to the next snapshot created */
+    uint32_t next_snapshot_id;
+    /** Check word of the metadata, calculated with this field zero */
+    uint64_t check;
+    uint64_t padding[2];
+} snap_metadata_header;
+
+/** One entry of the snapshot table */
+typedef struct
+{
+    /** The identity of the snapshot, or zero if the entry is free */
+    uint32_t snapshot_id;
+    uint32_t reserved;
+    /** CLOCK_REALTIME seconds at which the snapshot was created */
+    uint64_t created_time;
+} snap_snapshot_entry;
+
+_Static_assert (sizeof (snap_metadata_header) == 64, "snap_metadata_header must be one line");
+
+/** An open snapshot region */
+typedef struct
+{
+    nvram_uio_context *context;
+    uint64_t region_offset;
+    /** The size of each metadata slot, and the device offset of physical page one */
+    uint64_t slot_size;
+    uint64_t pages_offset;
+    /** Protects the other fields, and serialises use of the DMA buffer */
+    pthread_mutex_t lock;
+    /** Host copy of the current metadata, and the slot it was last committed to */
+    uint8_t *metadata;
+    unsigned int committed_slot;
+    uint32_t num_physical_pages;
+    /** For each physical page the number of roots referencing it if a map block, or map blocks if a data page */
+    uint32_t *refcounts;
+    /** For each physical page which is a map block, a host copy of the map block */
+    uint32_t **map_blocks;
+    uint32_t num_free_pages;
+    /** Where the search for a free page starts */
+    uint32_t next_free_hint;
+    /** Host buffer used to merge partial page writes */
+    uint8_t *page_buffer;
+} snap_region;
+
+bool snap_format (nvram_uio_context *const context, const uint64_t region_offset, const uint64_t region_size,
+                  const uint64_t logical_size);
+bool snap_open (snap_region *const region, nvram_uio_context *const context, const uint64_t region_offset);
+void snap_close (snap_region *const region);
+bool snap_write (snap_region *const region, const uint64_t offset, const void *const data, const size_t num_bytes);
+bool snap_read (snap_region *const region, const uint32_t snapshot_id, const uint64_t offset, void *const data,
+                const size_t num_bytes);
+bool snap_create (snap_region *const region, uint32_t *const snapshot_id);
+bool snap_delete (snap_region *const region, const uint32_t snapshot_id);
+unsigned int snap_list (snap_region *const region, snap_snapshot_entry entries[const SNAP_MAX_SNAPSHOTS]);
+void snap_get_usage (snap_region *const region, uint32_t *const num_free_pages, uint32_t *const num_physical_pages);
+
+#endif /* NVRAM_UIO_SNAPSHOT_H_ */
@@ -0,0 +1,227 @@
+/*
+ * @file nvram_uio_stats.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Shared-memory statistics published by clients of a NVRAM UIO device
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "nvram_uio_stats.h"
+
+/**
+ * @brief Map the shared memory statistics segment for a NVRAM UIO device
+ * @param[in] device_name The name of the UIO device to map the statistics for
+ * @param[in] create When true the segment is created if doesn't exist, and is mapped writeable.
+ *                   When false the segment must already exist, and is mapped read-only.
+ * @return Returns the mapped segment, or NULL if the segment couldn't be mapped
+ */
+nvram_uio_stats_segment *map_stats_segment (const char *device_name, const bool create)
+{
+    char segment_name[NAME_MAX];
+    int segment_fd;
+    struct stat segment_stat;
+    void *mapping;
+    nvram_uio_stats_segment *segment;
+    uint32_t expected_magic;
+    int rc;
+
+    snprintf (segment_name, sizeof (segment_name), "/nvram_uio_stats_%s", device_name);
+    segment_fd = shm_open (segment_name, create ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+    if (segment_fd == -1)
+    {
+        return NULL;
+    }
+
+    if (create)
+    {
+        /* The segment is shared by all users of the device, so ignore the process umask */
+        (void) fchmod (segment_fd, 0666);
+        rc = ftruncate (segment_fd, sizeof (nvram_uio_stats_segment));
+    }
+    else
+    {
+        rc = fstat (segment_fd, &segment_stat);
+        if ((rc == 0) && (segment_stat.st_size < (off_t) sizeof (nvram_uio_stats_segment)))
+        {
+            rc = -1;
+        }
+    }
+    if (rc != 0)
+    {
+        close (segment_fd);
+        return NULL;
+    }
+
+    mapping = mmap (NULL, sizeof (nvram_uio_stats_segment), create ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                    MAP_SHARED, segment_fd, 0);
+    close (segment_fd);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+    segment = mapping;
+
+    if (create)
+    {
+        expected_magic = 0;
+        if (__atomic_compare_exchange_n (&segment->magic, &expected_magic, NVRAM_UIO_STATS_MAGIC, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n (&segment->version, NVRAM_UIO_STATS_VERSION, __ATOMIC_RELEASE);
+        }
+    }
+    else if ((__atomic_load_n (&segment->magic, __ATOMIC_ACQUIRE) != NVRAM_UIO_STATS_MAGIC) ||
+             (__atomic_load_n (&segment->version, __ATOMIC_ACQUIRE) != NVRAM_UIO_STATS_VERSION))
+    {
+        munmap (mapping, sizeof (nvram_uio_stats_segment));
+        return NULL;
+    }
+
+    return segment;
+}
+
+/**
+ * @brief Unmap a statistics segment previously mapped by map_stats_segment()
+ * @param[in] segment The segment to unmap
+ */
+void unmap_stats_segment (nvram_uio_stats_segment *const segment)
+{
+    munmap (segment, sizeof (nvram_uio_stats_segment));
+}
+
+/**
+ * @brief Claim a client slot in a statistics segment for the calling process
+ * @details Slots left claimed by processes which exited without releasing them are reclaimed.
+ * @param[in,out] segment The writeable statistics segment to claim a slot in
+ * @return Returns the claimed slot with its statistics zeroed, or NULL if all slots are in use
+ */
+nvram_uio_client_stats *claim_client_stats (nvram_uio_stats_segment *const segment)
+{
+    const pid_t pid = getpid ();
+    unsigned int client_index;
+    nvram_uio_client_stats *stats;
+    pid_t owner;
+
+    for (client_index = 0; client_index < NVRAM_UIO_STATS_MAX_CLIENTS; client_index++)
+    {
+        stats = &segment->clients[client_index];
+        owner = __atomic_load_n (&stats->pid, __ATOMIC_ACQUIRE);
+        if ((owner != 0) && (kill (owner, 0) != 0) && (errno == ESRCH))
+        {
+            /* Attempt to reclaim the slot of a process which has exited */
+            (void) __atomic_compare_exchange_n (&stats->pid, &owner, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            owner = __atomic_load_n (&stats->pid, __ATOMIC_ACQUIRE);
+        }
+
+        if ((owner == 0) && __atomic_compare_exchange_n (&stats->pid, &owner, pid, false,
+                                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            memset (stats->comm, 0, sizeof (stats->comm));
+            (void) prctl (PR_GET_NAME, stats->comm, 0, 0, 0);
+            memset (stats->ops, 0, sizeof (stats->ops));
+            memset (stats->bytes, 0, sizeof (stats->bytes));
+            stats->errors = 0;
+            stats->in_flight = 0;
+            stats->completion_mode = NVRAM_UIO_COMPLETION_NONE;
+            memset (stats->latency_histogram, 0, sizeof (stats->latency_histogram));
+            return stats;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Release a client slot claimed by claim_client_stats()
+ * @param[in,out] stats The slot to release
+ */
+void release_client_stats (nvram_uio_client_stats *const stats)
+{
+    __atomic_store_n (&stats->pid, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Return the latency histogram bucket for one latency
+ * @param[in] latency_ns The latency to return the bucket for
+ * @return The histogram bucket index
+ */
+unsigned int latency_bucket (const uint64_t latency_ns)
+{
+    unsigned int bucket;
+
+    bucket = (latency_ns > 0) ? (63 - (unsigned int) __builtin_clzll (latency_ns)) : 0;
+
+    return (bucket < NVRAM_UIO_LATENCY_BUCKETS) ? bucket : (NVRAM_UIO_LATENCY_BUCKETS - 1);
+}
+
+/**
+ * @brief Return the latency at a percentile from a histogram of latencies
+ * @details Reports the upper bound of the histogram bucket which contains the percentile
+ * @param[in] histogram The latency histogram
+ * @param[in] percentile The percentile to report
+ * @return The latency in nanoseconds, or zero if the histogram is empty
+ */
+uint64_t latency_histogram_percentile_ns (const uint64_t histogram[const NVRAM_UIO_LATENCY_BUCKETS],
+                                         const double percentile)
+{
+    uint64_t total = 0;
+    uint64_t cumulative = 0;
+    unsigned int bucket;
+
+    for (bucket = 0; bucket < NVRAM_UIO_LATENCY_BUCKETS; bucket++)
+    {
+        total += histogram[bucket];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    for (bucket = 0; bucket < NVRAM_UIO_LATENCY_BUCKETS; bucket++)
+    {
+        cumulative += histogram[bucket];
+        if (((double) cumulative * 100.0) >= ((double) total * percentile))
+        {
+            break;
+        }
+    }
+
+    return 2ULL << ((bucket < NVRAM_UIO_LATENCY_BUCKETS) ? bucket : (NVRAM_UIO_LATENCY_BUCKETS - 1));
+}
+
+/**
+ * @brief Record the completion of one operation in the client statistics
+ * @param[in,out] stats The client statistics to update, which may be NULL if statistics are not being published
+ * @param[in] direction The direction of the operation
+ * @param[in] num_bytes The number of bytes transferred by the operation
+ * @param[in] latency_ns The latency of the operation
+ * @param[in] error When true the operation failed
+ */
+void record_client_operation (nvram_uio_client_stats *const stats, const nvram_uio_stats_direction direction,
+                              const uint64_t num_bytes, const uint64_t latency_ns, const bool error)
+{
+    if (stats != NULL)
+    {
+        __atomic_fetch_add (&stats->ops[direction], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&stats->bytes[direction], num_bytes, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&stats->latency_histogram[latency_bucket (latency_ns)], 1, __ATOMIC_RELAXED);
+        if (error)
+        {
+            __atomic_fetch_add (&stats->errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * @file nvram_uio_stats.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Shared-memory statistics published by clients of a NVRAM UIO device
+ * @details
+ *   Each NVRAM UIO device has one POSIX shared memory segment, in which each process using the device claims a
+ *   client slot. A client only writes its own slot, and monitors read the segment without accessing the device.
+ *   Counters are updated with relaxed atomics, so readers see consistent individual values but not a consistent
+ *   snapshot across values.
+ */
+
+#ifndef NVRAM_UIO_STATS_H_
+#define NVRAM_UIO_STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define NVRAM_UIO_STATS_MAGIC 0x4e565354
+#define NVRAM_UIO_STATS_VERSION 1
+
+/* The maximum number of processes which can concurrently publish statistics for one device */
+#define NVRAM_UIO_STATS_MAX_CLIENTS 32
+
+/* Latency histogram bucket i counts latencies in the range [2^i, 2^(i+1)) ns, with bucket 0 also counting 0 ns */
+#define NVRAM_UIO_LATENCY_BUCKETS 40
+
+/** How a client detects completion of its transfers */
+typedef enum
+{
+    NVRAM_UIO_COMPLETION_NONE,
+    NVRAM_UIO_COMPLETION_POLLED,
+    NVRAM_UIO_COMPLETION_INTERRUPT,
+    NVRAM_UIO_COMPLETION_NUM_MODES
+} nvram_uio_completion_mode;
+
+/** The direction of a transfer counted in the statistics */
+typedef enum
+{
+    NVRAM_UIO_STATS_READ,
+    NVRAM_UIO_STATS_WRITE,
+    NVRAM_UIO_STATS_NUM_DIRECTIONS
+} nvram_uio_stats_direction;
+
+/** The statistics for one client process */
+typedef struct
+{
+    /** The process which owns the slot, or zero when the slot is free */
+    pid_t pid;
+    /** The name of the client process */
+    char comm[16];
+    /** The number of completed operations and bytes transferred, indexed by nvram_uio_stats_direction */
+    uint64_t ops[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    uint64_t bytes[NVRAM_UIO_STATS_NUM_DIRECTIONS];
+    /** The number of operations which completed with an error */
+    uint64_t errors;
+    /** The number of operations currently submitted but not complete */
+    uint32_t in_flight;
+    /** A nvram_uio_completion_mode */
+    uint32_t completion_mode;
+    /** Histogram of operation latencies */
+    uint64_t latency_histogram[NVRAM_UIO_LATENCY_BUCKETS];
+} nvram_uio_client_stats;
+
+/** The contents of the shared memory segment for one device */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    /** The most recent values of the device status registers, refreshed periodically by clients using the device */
+    uint8_t memctrlstatus_memory;
+    uint8_t memctrlstatus_battery;
+    uint8_t memctrlcmd_errctrl;
+    uint8_t memctrlcmd_errcnt;
+    /** CLOCK_MONOTONIC time at which the status registers were sampled, or zero if never sampled */
+    uint64_t status_sample_time_ns;
+    nvram_uio_client_stats clients[NVRAM_UIO_STATS_MAX_CLIENTS];
+} nvram_uio_stats_segment;
+
+nvram_uio_stats_segment *map_stats_segment (const char *device_name, const bool create);
+void unmap_stats_segment (nvram_uio_stats_segment *const segment);
+nvram_uio_client_stats *claim_client_stats (nvram_uio_stats_segment *const segment);
+void release_client_stats (nvram_uio_client_stats *const stats);
+unsigned int latency_bucket (const uint64_t latency_ns);
+uint64_t latency_histogram_percentile_ns (const uint64_t histogram[const NVRAM_UIO_LATENCY_BUCKETS],
+                                         const double percentile);
+void record_client_operation (nvram_uio_client_stats *const stats, const nvram_uio_stats_direction direction,
+                              const uint64_t num_bytes, const uint64_t latency_ns, const bool error);
+
+/**
+ * @brief Adjust the number of in-flight operations for a client
+ * @param[in,out] stats The client statistics to update, which may be NULL if statistics are not being published
+ * @param[in] delta The change in the number of in-flight operations
+ */
+static inline void adjust_client_in_flight (nvram_uio_client_stats *const stats, const int32_t delta)
+{
+    if (stats != NULL)
+    {
+        __atomic_fetch_add (&stats->in_flight, (uint32_t) delta, __ATOMIC_RELAXED);
+    }
+}
+
+#endif /* NVRAM_UIO_STATS_H_ */
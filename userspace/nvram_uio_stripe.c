@@ -0,0 +1,940 @@
+/*
+ * @file nvram_uio_stripe.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Striping with XOR parity over a region at the same offset of three or more NVRAM devices
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "nvram_uio_stripe.h"
+
+/* The alignment of the chunk size, so that the parity loops work on whole 64 byte blocks of a chunk */
+#define STRIPE_CHUNK_ALIGN 64
+
+/**
+ * Copy src to dst, which may be NULL to skip the copy, and accumulate src into parity.
+ * When first is set parity is set to src, rather than combined with its previous contents.
+ */
+typedef void (*parity_copy_fn) (uint8_t *const dst, uint8_t *const parity, const uint8_t *const src,
+                                const size_t num_bytes, const bool first);
+
+/**
+ * @brief Copy and accumulate parity for the bytes which don't fill a 64 byte block
+ */
+static void parity_copy_tail (uint8_t *const dst, uint8_t *const parity, const uint8_t *const src,
+                              const size_t num_bytes, const bool first)
+{
+    size_t index;
+
+    for (index = 0; index < num_bytes; index++)
+    {
+        parity[index] = first ? src[index] : (uint8_t) (parity[index] ^ src[index]);
+        if (dst != NULL)
+        {
+            dst[index] = src[index];
+        }
+    }
+}
+
+/**
+ * @brief Copy and accumulate parity 64 bits at a time
+ */
+static void parity_copy_scalar (uint8_t *const dst, uint8_t *const parity, const uint8_t *const src,
+                                const size_t num_bytes, const bool first)
+{
+    uint64_t word;
+    uint64_t parity_word;
+    size_t index;
+
+    for (index = 0; (index + sizeof (word)) <= num_bytes; index += sizeof (word))
+    {
+        memcpy (&word, &src[index], sizeof (word));
+        if (!first)
+        {
+            memcpy (&parity_word, &parity[index], sizeof (parity_word));
+            word ^= parity_word;
+        }
+        memcpy (&parity[index], &word, sizeof (word));
+        if (dst != NULL)
+        {
+            memcpy (&dst[index], &src[index], sizeof (word));
+        }
+    }
+    parity_copy_tail ((dst != NULL) ? &dst[index] : NULL, &parity[index], &src[index], num_bytes - index, first);
+}
+
+/**
+ * @brief Copy and accumulate parity using SSE2, one 64 byte block per iteration
+ */
+static void parity_copy_sse2 (uint8_t *const dst, uint8_t *const parity, const uint8_t *const src,
+                              const size_t num_bytes, const bool first)
+{
+    __m128i data[4];
+    size_t index;
+    unsigned int vec;
+
+    for (index = 0; (index + 64) <= num_bytes; index += 64)
+    {
+        for (vec = 0; vec < 4; vec++)
+        {
+            data[vec] = _mm_loadu_si128 ((const __m128i *) &src[index + (vec * 16)]);
+            if (dst != NULL)
+            {
+                _mm_storeu_si128 ((__m128i *) &dst[index + (vec * 16)], data[vec]);
+            }
+            if (!first)
+            {
+                data[vec] = _mm_xor_si128 (data[vec], _mm_loadu_si128 ((const __m128i *) &parity[index + (vec * 16)]));
+            }
+            _mm_storeu_si128 ((__m128i *) &parity[index + (vec * 16)], data[vec]);
+        }
+    }
+    parity_copy_tail ((dst != NULL) ? &dst[index] : NULL, &parity[index], &src[index], num_bytes - index, first);
+}
+
+/**
+ * @brief Copy and accumulate parity using AVX2, one 64 byte block per iteration
+ */
+__attribute__((target("avx2")))
+static void parity_copy_avx2 (uint8_t *const dst, uint8_t *const parity, const uint8_t *const src,
+                              const size_t num_bytes, const bool first)
+{
+    __m256i data[2];
+    size_t index;
+    unsigned int vec;
+
+    for (index = 0; (index + 64) <= num_bytes; index += 64)
+    {
+        for (vec = 0; vec < 2; vec++)
+        {
+            data[vec] = _mm256_loadu_si256 ((const __m256i *) &src[index + (vec * 32)]);
+            if (dst != NULL)
+            {
+                _mm256_storeu_si256 ((__m256i *) &dst[index + (vec * 32)], data[vec]);
+            }
+            if (!first)
+            {
+                data[vec] = _mm256_xor_si256 (data[vec],
+                                              _mm256_loadu_si256 ((const __m256i *) &parity[index + (vec * 32)]));
+            }
+            _mm256_storeu_si256 ((__m256i *) &parity[index + (vec * 32)], data[vec]);
+        }
+    }
+    parity_copy_tail ((dst != NULL) ? &dst[index] : NULL, &parity[index], &src[index], num_bytes - index, first);
+}
+
+/**
+ * @brief Copy and accumulate parity using AVX-512, one 64 byte block per iteration
+ */
+__attribute__((target("avx512f")))
+static void parity_copy_avx512 (uint8_t *const dst, uint8_t *const parity, const uint8_t *const src,
+                                const size_t num_bytes, const bool first)
+{
+    __m512i data;
+    size_t index;
+
+    for (index = 0; (index + 64) <= num_bytes; index += 64)
+    {
+        data = _mm512_loadu_si512 (&src[index]);
+        if (dst != NULL)
+        {
+            _mm512_storeu_si512 (&dst[index], data);
+        }
+        if (!first)
+        {
+            data = _mm512_xor_si512 (data, _mm512_loadu_si512 (&parity[index]));
+        }
+        _mm512_storeu_si512 (&parity[index], data);
+    }
+    parity_copy_tail ((dst != NULL) ? &dst[index] : NULL, &parity[index], &src[index], num_bytes - index, first);
+}
+
+/**
+ * @brief Select the widest parity implementation supported by the CPU
+ * @details The NVRAM_UIO_PARITY environment variable may select "scalar", "sse2" or "avx2" instead, to compare the
+ *          implementations.
+ */
+static parity_copy_fn select_parity_copy (const char **const name)
+{
+    const char *const override = getenv ("NVRAM_UIO_PARITY");
+
+    if ((override != NULL) && (strcmp (override, "scalar") == 0))
+    {
+        *name = "scalar";
+        return parity_copy_scalar;
+    }
+    if ((override != NULL) && (strcmp (override, "sse2") == 0))
+    {
+        *name = "SSE2";
+        return parity_copy_sse2;
+    }
+    if (((override == NULL) || (strcmp (override, "avx2") != 0)) && __builtin_cpu_supports ("avx512f"))
+    {
+        *name = "AVX-512";
+        return parity_copy_avx512;
+    }
+    if (__builtin_cpu_supports ("avx2"))
+    {
+        *name = "AVX2";
+        return parity_copy_avx2;
+    }
+    *name = "SSE2";
+    return parity_copy_sse2;
+}
+
+static const char *parity_copy_name;
+static parity_copy_fn parity_copy;
+
+/**
+ * @brief Return the name of the parity implementation selected for the CPU
+ */
+const char *stripe_parity_implementation (void)
+{
+    if (parity_copy == NULL)
+    {
+        parity_copy = select_parity_copy (&parity_copy_name);
+    }
+
+    return parity_copy_name;
+}
+
+/**
+ * @brief Return the member which holds the parity chunk of a stripe
+ */
+static uint32_t parity_member (const stripe_set *const set, const uint64_t stripe)
+{
+    return (set->num_members - 1) - (uint32_t) (stripe % set->num_members);
+}
+
+/**
+ * @brief Return the member which holds a data chunk of a stripe
+ */
+static uint32_t data_member (const stripe_set *const set, const uint64_t stripe, const uint32_t data_index)
+{
+    return (parity_member (set, stripe) + 1 + data_index) % set->num_members;
+}
+
+/**
+ * @brief Return the device memory offset of the chunk of a stripe, which is the same on every member
+ */
+static uint64_t chunk_card_offset (const stripe_set *const set, const uint64_t stripe)
+{
+    return set->region_offset + STRIPE_HEADER_SIZE + (stripe * set->chunk_size);
+}
+
+/**
+ * @brief Return the DMA buffer of a member
+ */
+static uint8_t *member_buffer (const stripe_set *const set, const uint32_t member_index)
+{
+    return set->members[member_index].context->dma_buffer;
+}
+
+/**
+ * @brief Add a DMA transfer to the next job of a member
+ */
+static void add_element (stripe_set *const set, const uint32_t member_index, const uint64_t card_offset,
+                         const size_t buffer_offset, const size_t num_bytes)
+{
+    stripe_member *const member = &set->members[member_index];
+    dma_chain_element *const element = &member->elements[member->num_elements];
+
+    element->card_offset = card_offset;
+    element->buffer_offset = buffer_offset;
+    element->num_bytes = num_bytes;
+    member->num_elements++;
+}
+
+/**
+ * @brief Thread for a member, which performs the DMA of the member for each job posted
+ */
+static void *member_thread (void *const arg)
+{
+    stripe_member *const member = arg;
+    stripe_set *const set = member->set;
+    uint64_t generation = 0;
+    bool success;
+
+    pthread_mutex_lock (&set->job_lock);
+    for (;;)
+    {
+        while (!set->stopping && (set->job_generation == generation))
+        {
+            pthread_cond_wait (&set->job_posted, &set->job_lock);
+        }
+        if (set->stopping)
+        {
+            break;
+        }
+        generation = set->job_generation;
+        pthread_mutex_unlock (&set->job_lock);
+
+        success = (member->num_elements == 0) ||
+                dma_transfer_chain (member->context, member->direction, member->elements, member->num_elements);
+
+        pthread_mutex_lock (&set->job_lock);
+        member->job_success = success;
+        set->jobs_outstanding--;
+        if (set->jobs_outstanding == 0)
+        {
+            pthread_cond_signal (&set->job_done);
+        }
+    }
+    pthread_mutex_unlock (&set->job_lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Run the DMA transfers added to the members, in parallel across the members, and wait for them to complete
+ * @details If a member fails when no member had failed before, the member is marked as failed so that the caller can
+ *          retry the operation without it.
+ * @param[in,out] set The open set with the transfers added
+ * @param[in] direction The direction of all the transfers
+ * @param[out] retry Set true if the operation should be retried in degraded mode
+ * @return Returns true if all the transfers completed without error
+ */
+static bool run_jobs (stripe_set *const set, const uint32_t direction, bool *const retry)
+{
+    uint32_t member_index;
+    uint32_t newly_failed = STRIPE_NO_FAILED_MEMBER;
+    bool success = true;
+
+    pthread_mutex_lock (&set->job_lock);
+    for (member_index = 0; member_index < set->num_members; member_index++)
+    {
+        if (set->members[member_index].thread_started)
+        {
+            set->members[member_index].direction = direction;
+            set->jobs_outstanding++;
+        }
+    }
+    set->job_generation++;
+    pthread_cond_broadcast (&set->job_posted);
+    while (set->jobs_outstanding > 0)
+    {
+        pthread_cond_wait (&set->job_done, &set->job_lock);
+    }
+    pthread_mutex_unlock (&set->job_lock);
+
+    for (member_index = 0; member_index < set->num_members; member_index++)
+    {
+        stripe_member *const member = &set->members[member_index];
+
+        if (member->thread_started && !member->job_success)
+        {
+            success = false;
+            if (newly_failed == STRIPE_NO_FAILED_MEMBER)
+            {
+                newly_failed = member_index;
+            }
+        }
+        member->num_elements = 0;
+    }
+
+    *retry = false;
+    if (!success && (set->failed_member == STRIPE_NO_FAILED_MEMBER))
+    {
+        printf ("DMA to stripe member %u failed, continuing without it\n", newly_failed);
+        set->failed_member = newly_failed;
+        *retry = true;
+    }
+
+    return success;
+}
+
+/**
+ * @brief Read a range of the data which spans at most stripes_per_batch stripes
+ * @details In degraded mode the chunks of the failed member are reconstructed from the same range of the chunks of
+ *          the other members in the stripe.
+ */
+static bool read_batch (stripe_set *const set, const uint64_t offset, uint8_t *const dst, const size_t num_bytes)
+{
+    const uint64_t first_stripe = offset / set->stripe_data_size;
+    const uint64_t last_stripe = (offset + num_bytes - 1) / set->stripe_data_size;
+    const uint64_t end = offset + num_bytes;
+    uint64_t range_lo[STRIPE_MAX_MEMBERS];
+    uint64_t range_hi[STRIPE_MAX_MEMBERS];
+    uint64_t stripe;
+    uint64_t stripe_start;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t chunk_lo;
+    uint64_t chunk_hi;
+    size_t slot;
+    uint32_t data_index;
+    uint32_t member_index;
+    uint32_t other;
+    uint8_t *out;
+    bool first;
+    bool success = false;
+    bool retry = true;
+
+    while (!success && retry)
+    {
+        for (stripe = first_stripe; stripe <= last_stripe; stripe++)
+        {
+            stripe_start = stripe * set->stripe_data_size;
+            lo = ((offset > stripe_start) ? offset : stripe_start) - stripe_start;
+            hi = ((end < (stripe_start + set->stripe_data_size)) ? end : (stripe_start + set->stripe_data_size)) -
+                    stripe_start;
+            slot = (size_t) (stripe - first_stripe) * set->chunk_size;
+            for (member_index = 0; member_index < set->num_members; member_index++)
+            {
+                range_lo[member_index] = set->chunk_size;
+                range_hi[member_index] = 0;
+            }
+
+            /* Each member reads one range of its chunk, which in degraded mode covers what is needed to
+             * reconstruct the chunk of the failed member */
+            for (data_index = (uint32_t) (lo / set->chunk_size); (data_index * set->chunk_size) < hi; data_index++)
+            {
+                chunk_lo = ((lo > (data_index * set->chunk_size)) ? lo : (data_index * set->chunk_size)) -
+                        (data_index * set->chunk_size);
+                chunk_hi = ((hi < ((data_index + 1) * set->chunk_size)) ? hi : ((data_index + 1) * set->chunk_size)) -
+                        (data_index * set->chunk_size);
+                member_index = data_member (set, stripe, data_index);
+                for (other = 0; other < set->num_members; other++)
+                {
+                    if ((member_index == set->failed_member) ? (other != member_index) : (other == member_index))
+                    {
+                        range_lo[other] = (chunk_lo < range_lo[other]) ? chunk_lo : range_lo[other];
+                        range_hi[other] = (chunk_hi > range_hi[other]) ? chunk_hi : range_hi[other];
+                    }
+                }
+            }
+            for (member_index = 0; member_index < set->num_members; member_index++)
+            {
+                if (range_hi[member_index] > range_lo[member_index])
+                {
+                    add_element (set, member_index, chunk_card_offset (set, stripe) + range_lo[member_index],
+                                 slot + range_lo[member_index], range_hi[member_index] - range_lo[member_index]);
+                }
+            }
+        }
+        success = run_jobs (set, DMA_WRITE_TO_HOST, &retry);
+    }
+    if (!success)
+    {
+        return false;
+    }
+
+    for (stripe = first_stripe; stripe <= last_stripe; stripe++)
+    {
+        stripe_start = stripe * set->stripe_data_size;
+        lo = ((offset > stripe_start) ? offset : stripe_start) - stripe_start;
+        hi = ((end < (stripe_start + set->stripe_data_size)) ? end : (stripe_start + set->stripe_data_size)) -
+                stripe_start;
+        slot = (size_t) (stripe - first_stripe) * set->chunk_size;
+        for (data_index = (uint32_t) (lo / set->chunk_size); (data_index * set->chunk_size) < hi; data_index++)
+        {
+            chunk_lo = ((lo > (data_index * set->chunk_size)) ? lo : (data_index * set->chunk_size)) -
+                    (data_index * set->chunk_size);
+            chunk_hi = ((hi < ((data_index + 1) * set->chunk_size)) ? hi : ((data_index + 1) * set->chunk_size)) -
+                    (data_index * set->chunk_size);
+            member_index = data_member (set, stripe, data_index);
+            out = &dst[stripe_start + (data_index * set->chunk_size) + chunk_lo - offset];
+            if (member_index != set->failed_member)
+            {
+                memcpy (out, &member_buffer (set, member_index)[slot + chunk_lo], chunk_hi - chunk_lo);
+            }
+            else
+            {
+                first = true;
+                for (other = 0; other < set->num_members; other++)
+                {
+                    if (other != member_index)
+                    {
+                        parity_copy (NULL, out, &member_buffer (set, other)[slot + chunk_lo], chunk_hi - chunk_lo,
+                                     first);
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write whole stripes, at most stripes_per_batch of them
+ * @details The data is copied to the DMA buffers of the data members in the same pass as the parity is accumulated
+ *          in the DMA buffer of the parity member, so no stripe needs to be read.
+ */
+static bool write_full_stripes (stripe_set *const set, const uint64_t first_stripe, const unsigned int num_stripes,
+                                const uint8_t *const src)
+{
+    uint64_t stripe;
+    size_t slot;
+    uint32_t parity_index;
+    uint32_t data_index;
+    uint32_t member_index;
+    uint8_t *parity;
+    bool success = false;
+    bool retry = true;
+
+    while (!success && retry)
+    {
+        for (stripe = first_stripe; stripe < (first_stripe + num_stripes); stripe++)
+        {
+            slot = (size_t) (stripe - first_stripe) * set->chunk_size;
+            parity_index = parity_member (set, stripe);
+            parity = (parity_index != set->failed_member) ? &member_buffer (set, parity_index)[slot] :
+                    set->parity_scratch;
+            for (data_index = 0; data_index < (set->num_members - 1); data_index++)
+            {
+                member_index = data_member (set, stripe, data_index);
+                parity_copy ((member_index != set->failed_member) ? &member_buffer (set, member_index)[slot] : NULL,
+                             parity, &src[((stripe - first_stripe) * set->stripe_data_size) +
+                                          (data_index * set->chunk_size)],
+                             set->chunk_size, data_index == 0);
+            }
+            for (member_index = 0; member_index < set->num_members; member_index++)
+            {
+                if (member_index != set->failed_member)
+                {
+                    add_element (set, member_index, chunk_card_offset (set, stripe), slot, set->chunk_size);
+                }
+            }
+        }
+        success = run_jobs (set, DMA_READ_FROM_HOST, &retry);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Write part of one stripe by read-modify-write of the data chunks written and the parity chunk
+ * @details The parity is updated with the XOR of the old and new data, so only the ranges written and the
+ *          corresponding range of the parity are transferred. Each member holds one chunk of the stripe, so each
+ *          member's range is placed at its offset within the chunk in the DMA buffer.
+ * @param[out] retry Set true if a member failed, and the write should be retried in degraded mode
+ */
+static bool read_modify_write (stripe_set *const set, const uint64_t stripe, const uint64_t lo, const uint64_t hi,
+                               const uint8_t *const src, bool *const retry)
+{
+    const uint32_t parity_index = parity_member (set, stripe);
+    const uint64_t card_offset = chunk_card_offset (set, stripe);
+    uint8_t *const parity = member_buffer (set, parity_index);
+    uint64_t parity_lo = set->chunk_size;
+    uint64_t parity_hi = 0;
+    uint64_t chunk_lo;
+    uint64_t chunk_hi;
+    uint32_t data_index;
+    uint32_t member_index;
+    uint32_t direction;
+    unsigned int pass;
+
+    /* The first pass reads the old contents, and the second writes the new contents of the same ranges */
+    for (pass = 0; pass < 2; pass++)
+    {
+        direction = (pass == 0) ? DMA_WRITE_TO_HOST : DMA_READ_FROM_HOST;
+        for (data_index = (uint32_t) (lo / set->chunk_size); (data_index * set->chunk_size) < hi; data_index++)
+        {
+            chunk_lo = ((lo > (data_index * set->chunk_size)) ? lo : (data_index * set->chunk_size)) -
+                    (data_index * set->chunk_size);
+            chunk_hi = ((hi < ((data_index + 1) * set->chunk_size)) ? hi : ((data_index + 1) * set->chunk_size)) -
+                    (data_index * set->chunk_size);
+            member_index = data_member (set, stripe, data_index);
+            add_element (set, member_index, card_offset + chunk_lo, chunk_lo, chunk_hi - chunk_lo);
+            parity_lo = (chunk_lo < parity_lo) ? chunk_lo : parity_lo;
+            parity_hi = (chunk_hi > parity_hi) ? chunk_hi : parity_hi;
+            if (pass == 1)
+            {
+                uint8_t *const data = member_buffer (set, member_index);
+
+                parity_copy (NULL, &parity[chunk_lo], &data[chunk_lo], chunk_hi - chunk_lo, false);
+                parity_copy (&data[chunk_lo], &parity[chunk_lo],
+                             &src[(data_index * set->chunk_size) + chunk_lo - lo], chunk_hi - chunk_lo, false);
+            }
+        }
+        add_element (set, parity_index, card_offset + parity_lo, parity_lo, parity_hi - parity_lo);
+        if (!run_jobs (set, direction, retry))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write part of one stripe
+ * @details In degraded mode the old contents of the failed member can't be read, so the whole stripe is read,
+ *          which reconstructs the chunk of the failed member, merged with the new data and written as a whole stripe.
+ */
+static bool write_partial_stripe (stripe_set *const set, const uint64_t stripe, const uint64_t lo, const uint64_t hi,
+                                  const uint8_t *const src)
+{
+    bool retry = true;
+
+    if (set->failed_member == STRIPE_NO_FAILED_MEMBER)
+    {
+        if (read_modify_write (set, stripe, lo, hi, src, &retry))
+        {
+            return true;
+        }
+        if (!retry)
+        {
+            return false;
+        }
+    }
+
+    if (!read_batch (set, stripe * set->stripe_data_size, set->stripe_buffer, set->stripe_data_size))
+    {
+        return false;
+    }
+    memcpy (&set->stripe_buffer[lo], src, hi - lo);
+
+    return write_full_stripes (set, stripe, 1, set->stripe_buffer);
+}
+
+/**
+ * @brief Format a region at the same offset of each device as the members of a set
+ * @details The regions are zeroed, which makes the parity of every stripe consistent with its data.
+ * @param[in,out] contexts The open NVRAM UIO devices with mapped DMA buffers, in the order of the member indices
+ * @param[in] num_members The number of members, between STRIPE_MIN_MEMBERS and STRIPE_MAX_MEMBERS
+ * @param[in] region_offset The offset of the region in the device memory of each member
+ * @param[in] region_size The size of the region on each member
+ * @param[in] chunk_size The size of the chunk of each stripe on each member, which must be a multiple of
+ *                       STRIPE_CHUNK_ALIGN and fit in the DMA buffer of each member
+ * @return Returns true if the set was formatted
+ */
+bool stripe_format (nvram_uio_context *const contexts[], const unsigned int num_members,
+                    const uint64_t region_offset, const uint64_t region_size, const uint32_t chunk_size)
+{
+    stripe_superblock superblock;
+    uint64_t set_id;
+    uint64_t bytes_done;
+    size_t chunk_bytes;
+    unsigned int member_index;
+
+    if ((num_members < STRIPE_MIN_MEMBERS) || (num_members > STRIPE_MAX_MEMBERS) || (chunk_size == 0) ||
+        ((chunk_size % STRIPE_CHUNK_ALIGN) != 0) || (region_size < (STRIPE_HEADER_SIZE + chunk_size)))
+    {
+        return false;
+    }
+    for (member_index = 0; member_index < num_members; member_index++)
+    {
+        if ((contexts[member_index]->dma_mapping == NULL) || (contexts[member_index]->dma_buffer_size < chunk_size))
+        {
+            return false;
+        }
+    }
+
+    set_id = generate_set_id ();
+
+    for (member_index = 0; member_index < num_members; member_index++)
+    {
+        nvram_uio_context *const context = contexts[member_index];
+
+        memset (context->dma_buffer, 0, context->dma_buffer_size);
+        for (bytes_done = STRIPE_HEADER_SIZE; bytes_done < region_size; bytes_done += chunk_bytes)
+        {
+            chunk_bytes = ((region_size - bytes_done) < context->dma_buffer_size) ?
+                    (size_t) (region_size - bytes_done) : context->dma_buffer_size;
+            if (!dma_transfer (context, DMA_READ_FROM_HOST, region_offset + bytes_done, 0, chunk_bytes))
+            {
+                return false;
+            }
+        }
+
+        memset (&superblock, 0, sizeof (superblock));
+        superblock.magic = STRIPE_MAGIC;
+        superblock.version = STRIPE_VERSION;
+        superblock.num_members = num_members;
+        superblock.set_id = set_id;
+        superblock.member_index = member_index;
+        superblock.chunk_size = chunk_size;
+        superblock.num_stripes = (region_size - STRIPE_HEADER_SIZE) / chunk_size;
+        superblock.check = compute_check_word (&superblock, sizeof (superblock), offsetof (stripe_superblock, check));
+        if (!dma_write_from_host (context, region_offset, &superblock, sizeof (superblock)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Open a set from the devices which are members of it
+ * @details The devices may be given in any order, and devices which aren't members of the same set as the first
+ *          member found are ignored. If one member is missing the set is opened in degraded mode.
+ * @param[out] set The set to open
+ * @param[in,out] contexts The open NVRAM UIO devices with mapped DMA buffers. Their DMA buffers are used by the set
+ *                         until it is closed.
+ * @param[in] num_contexts The number of devices
+ * @param[in] region_offset The offset of the region in the device memory of each member
+ * @return Returns true if the set was opened
+ */
+bool stripe_open (stripe_set *const set, nvram_uio_context *const contexts[], const unsigned int num_contexts,
+                  const uint64_t region_offset)
+{
+    stripe_superblock reference;
+    stripe_superblock superblock;
+    unsigned int context_index;
+    unsigned int num_present = 0;
+    uint32_t member_index;
+    unsigned int member_batch;
+    bool found_reference = false;
+    bool success = true;
+
+    memset (set, 0, sizeof (*set));
+    memset (&reference, 0, sizeof (reference));
+    for (context_index = 0; success && (context_index < num_contexts); context_index++)
+    {
+        if (!dma_read_to_host (contexts[context_index], region_offset, &superblock, sizeof (superblock)) ||
+            (superblock.magic != STRIPE_MAGIC) || (superblock.version != STRIPE_VERSION) ||
+            (superblock.check !=
+             compute_check_word (&superblock, sizeof (superblock), offsetof (stripe_superblock, check))))
+        {
+            continue;
+        }
+        if (!found_reference)
+        {
+            reference = superblock;
+            found_reference = true;
+        }
+        if ((superblock.set_id != reference.set_id) || (superblock.num_members != reference.num_members) ||
+            (superblock.chunk_size != reference.chunk_size) || (superblock.num_stripes != reference.num_stripes))
+        {
+            continue;
+        }
+        success = (superblock.member_index < superblock.num_members) &&
+                (superblock.num_members <= STRIPE_MAX_MEMBERS) &&
+                (set->members[superblock.member_index].context == NULL) &&
+                (contexts[context_index]->dma_buffer_size >= superblock.chunk_size);
+        if (success)
+        {
+            set->members[superblock.member_index].context = contexts[context_index];
+            num_present++;
+        }
+    }
+    if (!success || !found_reference || ((num_present + 1) < reference.num_members))
+    {
+        return false;
+    }
+
+    set->num_members = reference.num_members;
+    set->region_offset = region_offset;
+    set->chunk_size = reference.chunk_size;
+    set->num_stripes = reference.num_stripes;
+    set->stripe_data_size = (uint64_t) reference.chunk_size * (reference.num_members - 1);
+    set->data_size = set->stripe_data_size * set->num_stripes;
+    set->failed_member = STRIPE_NO_FAILED_MEMBER;
+    set->stripes_per_batch = UINT32_MAX;
+    for (member_index = 0; member_index < set->num_members; member_index++)
+    {
+        const nvram_uio_context *const context = set->members[member_index].context;
+
+        if (context == NULL)
+        {
+            printf ("Stripe member %u is missing, opening degraded\n", member_index);
+            set->failed_member = member_index;
+        }
+        else
+        {
+            member_batch = (unsigned int) (context->dma_buffer_size / set->chunk_size);
+            member_batch = (context->max_dma_chain_length < member_batch) ? context->max_dma_chain_length :
+                    member_batch;
+            set->stripes_per_batch = (member_batch < set->stripes_per_batch) ? member_batch : set->stripes_per_batch;
+        }
+    }
+
+    set->parity_scratch = malloc (set->chunk_size);
+    set->stripe_buffer = malloc (set->stripe_data_size);
+    for (member_index = 0; member_index < set->num_members; member_index++)
+    {
+        set->members[member_index].set = set;
+        set->members[member_index].elements = calloc (set->stripes_per_batch, sizeof (dma_chain_element));
+        success = success && (set->members[member_index].elements != NULL);
+    }
+    if (!success || (set->parity_scratch == NULL) || (set->stripe_buffer == NULL) || (set->stripes_per_batch == 0))
+    {
+        stripe_close (set);
+        return false;
+    }
+
+    (void) stripe_parity_implementation ();
+    pthread_mutex_init (&set->lock, NULL);
+    pthread_mutex_init (&set->job_lock, NULL);
+    pthread_cond_init (&set->job_posted, NULL);
+    pthread_cond_init (&set->job_done, NULL);
+    for (member_index = 0; member_index < set->num_members; member_index++)
+    {
+        stripe_member *const member = &set->members[member_index];
+
+        if (member->context != NULL)
+        {
+            member->thread_started =
+                    pthread_create (&member->thread, NULL, member_thread, member) == 0;
+            success = success && member->thread_started;
+        }
+    }
+    if (!success)
+    {
+        stripe_close (set);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Close a set, stopping the member threads. The devices are left open.
+ */
+void stripe_close (stripe_set *const set)
+{
+    uint32_t member_index;
+    bool threads_started = false;
+
+    for (member_index = 0; member_index < set->num_members; member_index++)
+    {
+        threads_started = threads_started || set->members[member_index].thread_started;
+    }
+    if (threads_started)
+    {
+        pthread_mutex_lock (&set->job_lock);
+        set->stopping = true;
+        pthread_cond_broadcast (&set->job_posted);
+        pthread_mutex_unlock (&set->job_lock);
+    }
+    for (member_index = 0; member_index < STRIPE_MAX_MEMBERS; member_index++)
+    {
+        stripe_member *const member = &set->members[member_index];
+
+        if (member->thread_started)
+        {
+            pthread_join (member->thread, NULL);
+            member->thread_started = false;
+        }
+        free (member->elements);
+        member->elements = NULL;
+    }
+    free (set->parity_scratch);
+    free (set->stripe_buffer);
+    set->parity_scratch = NULL;
+    set->stripe_buffer = NULL;
+}
+
+/**
+ * @brief Write data to the set
+ * @details Runs of whole stripes are written in batches without reading, and the partial stripes at either end of
+ *          the range by read-modify-write.
+ * @param[in,out] set The open set
+ * @param[in] offset The offset in the data of the set to write to
+ * @param[in] data The data to write
+ * @param[in] num_bytes The number of bytes to write
+ * @return Returns true if the data was written, which may be in degraded mode
+ */
+bool stripe_write (stripe_set *const set, const uint64_t offset, const void *const data, const size_t num_bytes)
+{
+    const uint8_t *const src = data;
+    uint64_t position;
+    uint64_t stripe;
+    uint64_t lo;
+    uint64_t length;
+    uint64_t num_stripes;
+    size_t bytes_done = 0;
+    bool success = true;
+
+    if ((offset + num_bytes) > set->data_size)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&set->lock);
+    while (success && (bytes_done < num_bytes))
+    {
+        position = offset + bytes_done;
+        stripe = position / set->stripe_data_size;
+        lo = position % set->stripe_data_size;
+        length = set->stripe_data_size - lo;
+        if (length > (num_bytes - bytes_done))
+        {
+            length = num_bytes - bytes_done;
+        }
+        if (length == set->stripe_data_size)
+        {
+            num_stripes = (num_bytes - bytes_done) / set->stripe_data_size;
+            num_stripes = (num_stripes < set->stripes_per_batch) ? num_stripes : set->stripes_per_batch;
+            length = num_stripes * set->stripe_data_size;
+            success = write_full_stripes (set, stripe, (unsigned int) num_stripes, &src[bytes_done]);
+        }
+        else
+        {
+            success = write_partial_stripe (set, stripe, lo, lo + length, &src[bytes_done]);
+        }
+        bytes_done += length;
+    }
+    pthread_mutex_unlock (&set->lock);
+
+    return success;
+}
+
+/**
+ * @brief Read data from the set, reconstructing the data of a failed member
+ * @param[in,out] set The open set
+ * @param[in] offset The offset in the data of the set to read from
+ * @param[out] data Where to store the data read
+ * @param[in] num_bytes The number of bytes to read
+ * @return Returns true if the data was read
+ */
+bool stripe_read (stripe_set *const set, const uint64_t offset, void *const data, const size_t num_bytes)
+{
+    uint8_t *const dst = data;
+    uint64_t position;
+    uint64_t batch_end;
+    size_t bytes_done = 0;
+    bool success = true;
+
+    if ((offset + num_bytes) > set->data_size)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&set->lock);
+    while (success && (bytes_done < num_bytes))
+    {
+        position = offset + bytes_done;
+        batch_end = ((position / set->stripe_data_size) + set->stripes_per_batch) * set->stripe_data_size;
+        if (batch_end > (offset + num_bytes))
+        {
+            batch_end = offset + num_bytes;
+        }
+        success = read_batch (set, position, &dst[bytes_done], (size_t) (batch_end - position));
+        bytes_done += (size_t) (batch_end - position);
+    }
+    pthread_mutex_unlock (&set->lock);
+
+    return success;
+}
+
+/**
+ * @brief Mark a member as failed, so that the set continues in degraded mode without it
+ * @details The member is only failed in the open set; its superblock isn't changed.
+ * @return Returns false if a different member has already failed
+ */
+bool stripe_fail_member (stripe_set *const set, const uint32_t member_index)
+{
+    bool success;
+
+    pthread_mutex_lock (&set->lock);
+    success = (member_index < set->num_members) &&
+            ((set->failed_member == STRIPE_NO_FAILED_MEMBER) || (set->failed_member == member_index));
+    if (success)
+    {
+        set->failed_member = member_index;
+    }
+    pthread_mutex_unlock (&set->lock);
+
+    return success;
+}
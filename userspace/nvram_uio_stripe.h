@@ -0,0 +1,123 @@
+/*
+ * @file nvram_uio_stripe.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Striping with XOR parity over a region at the same offset of three or more NVRAM devices
+ * @details
+ *   The layout is RAID-5 left-symmetric: each stripe has one chunk on every member, one of which holds the XOR parity
+ *   of the others. The parity chunk rotates between members from stripe to stripe, and the data chunks of a stripe
+ *   start on the member following the parity chunk. Each member starts with a superblock which records the identity
+ *   of the set and the index of the member in it, so the order of the devices found in the host doesn't matter.
+ *
+ *   Writes of whole stripes are staged directly in the DMA buffers of the members, with the parity generated in the
+ *   same pass as the copy of the data to staging using the widest of SSE2, AVX2 or AVX-512 supported by the CPU.
+ *   Writes of part of a stripe read the old data and parity, and update the parity with the difference. Each member
+ *   has a worker thread which issues its DMA, so the DMA engines of all the members run in parallel.
+ *
+ *   When one member has failed, reads of its chunks are reconstructed from the XOR of the chunks of the other members,
+ *   and writes of part of a stripe reconstruct the whole stripe and write it back without the failed member. A member
+ *   is failed when it is missing at open, when its DMA fails, or by stripe_fail_member().
+ *
+ *   As with RAID-5 there is a write hole: if the host stops part way through a write, the parity of the stripes being
+ *   written may not match their data. Callers which need atomic updates must provide them above this layer.
+ */
+
+#ifndef NVRAM_UIO_STRIPE_H_
+#define NVRAM_UIO_STRIPE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+
+#define STRIPE_MAGIC 0x455049525453564eULL /* "NVSTRIPE" */
+#define STRIPE_VERSION 1
+
+#define STRIPE_MIN_MEMBERS 3
+#define STRIPE_MAX_MEMBERS 16
+
+/* The space at the start of the region on each member reserved for the superblock */
+#define STRIPE_HEADER_SIZE 4096
+
+/* The value of failed_member when all members are working */
+#define STRIPE_NO_FAILED_MEMBER UINT32_MAX
+
+/** The superblock at the start of the region on each member */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_members;
+    /** Chosen when the set is formatted, so members of different sets aren't mixed */
+    uint64_t set_id;
+    uint32_t member_index;
+    uint32_t chunk_size;
+    uint64_t num_stripes;
+    /** Check word of the superblock, calculated with this field zero */
+    uint64_t check;
+    uint64_t padding[2];
+} stripe_superblock;
+
+_Static_assert (sizeof (stripe_superblock) == 64, "stripe_superblock must be one line");
+
+struct stripe_set;
+
+/** One member of an open set */
+typedef struct
+{
+    /** The device of the member, or NULL if the member was missing at open */
+    nvram_uio_context *context;
+    struct stripe_set *set;
+    pthread_t thread;
+    bool thread_started;
+    /** The DMA transfers for the member in the current job, with the direction and result of the job */
+    dma_chain_element *elements;
+    unsigned int num_elements;
+    uint32_t direction;
+    bool job_success;
+} stripe_member;
+
+/** An open set */
+typedef struct stripe_set
+{
+    unsigned int num_members;
+    uint64_t region_offset;
+    uint32_t chunk_size;
+    uint64_t num_stripes;
+    /** The number of data bytes in each stripe, and in the set */
+    uint64_t stripe_data_size;
+    uint64_t data_size;
+    /** The member which has failed, or STRIPE_NO_FAILED_MEMBER */
+    uint32_t failed_member;
+    /** The maximum number of stripes transferred by one job, limited by the DMA buffers and chain lengths */
+    unsigned int stripes_per_batch;
+    /** Serialises reads and writes, which use the DMA buffers of all members */
+    pthread_mutex_t lock;
+    /** Used to post jobs to the member threads, and wait for them to complete */
+    pthread_mutex_t job_lock;
+    pthread_cond_t job_posted;
+    pthread_cond_t job_done;
+    uint64_t job_generation;
+    unsigned int jobs_outstanding;
+    bool stopping;
+    stripe_member members[STRIPE_MAX_MEMBERS];
+    /** Receives the parity of a stripe when the parity member has failed */
+    uint8_t *parity_scratch;
+    /** Holds a whole stripe of data when a partial stripe write is reconstructed */
+    uint8_t *stripe_buffer;
+} stripe_set;
+
+bool stripe_format (nvram_uio_context *const contexts[], const unsigned int num_members,
+                    const uint64_t region_offset, const uint64_t region_size, const uint32_t chunk_size);
+bool stripe_open (stripe_set *const set, nvram_uio_context *const contexts[], const unsigned int num_contexts,
+                  const uint64_t region_offset);
+void stripe_close (stripe_set *const set);
+bool stripe_write (stripe_set *const set, const uint64_t offset, const void *const data, const size_t num_bytes);
+bool stripe_read (stripe_set *const set, const uint64_t offset, void *const data, const size_t num_bytes);
+bool stripe_fail_member (stripe_set *const set, const uint32_t member_index);
+const char *stripe_parity_implementation (void);
+
+#endif /* NVRAM_UIO_STRIPE_H_ */
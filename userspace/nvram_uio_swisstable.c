@@ -0,0 +1,322 @@
+/*
+ * @file nvram_uio_swisstable.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Open addressing hash table in host memory with SIMD probing of per-slot tags, in the style of a Swiss table
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "nvram_uio_swisstable.h"
+
+/**
+ * @brief Return the tag of a hash stored in the control bytes, which never has the top bit set
+ */
+static inline uint8_t hash_tag (const uint64_t hash)
+{
+    return (uint8_t) (hash & 0x7f);
+}
+
+/**
+ * @brief Return the first group probed for a hash
+ */
+static inline size_t hash_group (const swiss_table *const table, const uint64_t hash)
+{
+    return (size_t) (hash >> 7) & (table->num_groups - 1);
+}
+
+/**
+ * @brief Return a bit mask of the slots of a group whose control bytes equal a value
+ */
+static inline unsigned int match_group (const swiss_table *const table, const size_t group, const __m128i value)
+{
+    const __m128i ctrl = _mm_load_si128 ((const __m128i *) &table->ctrl[group * SWISS_GROUP_SIZE]);
+
+    return (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (ctrl, value));
+}
+
+/**
+ * @brief Allocate an empty table with a number of groups
+ */
+static bool alloc_table (swiss_table *const table, const size_t num_groups)
+{
+    const size_t num_slots = num_groups * SWISS_GROUP_SIZE;
+
+    table->ctrl = aligned_alloc (SWISS_GROUP_SIZE, num_slots);
+    table->slots = malloc (num_slots * sizeof (table->slots[0]));
+    if ((table->ctrl == NULL) || (table->slots == NULL))
+    {
+        free (table->ctrl);
+        free (table->slots);
+        table->ctrl = NULL;
+        table->slots = NULL;
+        return false;
+    }
+    memset (table->ctrl, SWISS_CTRL_EMPTY, num_slots);
+    table->num_groups = num_groups;
+    table->count = 0;
+    table->growth_limit = (num_slots / 8) * 7;
+
+    return true;
+}
+
+/**
+ * @brief Initialise an empty table
+ * @param[out] table The table to initialise
+ * @param[in] expected_count The number of keys expected, used to size the table to avoid it having to grow
+ * @return Returns true if the table was allocated
+ */
+bool swiss_table_init (swiss_table *const table, const size_t expected_count)
+{
+    size_t num_groups = 1;
+
+    while (((num_groups * SWISS_GROUP_SIZE) / 8) * 7 < expected_count)
+    {
+        num_groups *= 2;
+    }
+
+    return alloc_table (table, num_groups);
+}
+
+/**
+ * @brief Free a table
+ */
+void swiss_table_free (swiss_table *const table)
+{
+    free (table->ctrl);
+    free (table->slots);
+    table->ctrl = NULL;
+    table->slots = NULL;
+    table->num_groups = 0;
+    table->count = 0;
+}
+
+/**
+ * @brief Find the value of a key
+ * @param[in] table The table to search
+ * @param[in] key The key to find
+ * @param[in] hash The swiss_hash() of the key
+ * @param[out] value The value of the key, if found
+ * @return Returns true if the key was found
+ */
+bool swiss_table_find (const swiss_table *const table, const uint64_t key, const uint64_t hash, uint64_t *const value)
+{
+    const __m128i tag = _mm_set1_epi8 ((char) hash_tag (hash));
+    const __m128i empty = _mm_set1_epi8 ((char) SWISS_CTRL_EMPTY);
+    const size_t group_mask = table->num_groups - 1;
+    size_t group = hash_group (table, hash);
+    unsigned int matches;
+    size_t slot;
+    size_t step;
+
+    for (step = 0; step < table->num_groups; step++)
+    {
+        for (matches = match_group (table, group, tag); matches != 0; matches &= matches - 1)
+        {
+            slot = (group * SWISS_GROUP_SIZE) + (size_t) __builtin_ctz (matches);
+            if (table->slots[slot].key == key)
+            {
+                *value = table->slots[slot].value;
+                return true;
+            }
+        }
+        if (match_group (table, group, empty) != 0)
+        {
+            return false;
+        }
+        group = (group + step + 1) & group_mask;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Insert a key into the first empty slot of its probe sequence. The key must not be in the table.
+ */
+static void insert_new (swiss_table *const table, const uint64_t key, const uint64_t hash, const uint64_t value)
+{
+    const __m128i empty = _mm_set1_epi8 ((char) SWISS_CTRL_EMPTY);
+    const size_t group_mask = table->num_groups - 1;
+    size_t group = hash_group (table, hash);
+    unsigned int empties;
+    size_t slot;
+    size_t step = 0;
+
+    while ((empties = match_group (table, group, empty)) == 0)
+    {
+        step++;
+        group = (group + step) & group_mask;
+    }
+    slot = (group * SWISS_GROUP_SIZE) + (size_t) __builtin_ctz (empties);
+    table->ctrl[slot] = hash_tag (hash);
+    table->slots[slot].key = key;
+    table->slots[slot].value = value;
+    table->count++;
+}
+
+/**
+ * @brief Double the number of groups in a table, rehashing the keys
+ */
+static bool grow_table (swiss_table *const table)
+{
+    swiss_table grown;
+    size_t slot;
+
+    if (!alloc_table (&grown, table->num_groups * 2))
+    {
+        return false;
+    }
+    for (slot = 0; slot < (table->num_groups * SWISS_GROUP_SIZE); slot++)
+    {
+        if (table->ctrl[slot] != SWISS_CTRL_EMPTY)
+        {
+            insert_new (&grown, table->slots[slot].key, swiss_hash (table->slots[slot].key), table->slots[slot].value);
+        }
+    }
+    swiss_table_free (table);
+    *table = grown;
+
+    return true;
+}
+
+/**
+ * @brief Insert a key, or if the key is already present keep the greater of the existing and new values
+ * @details Keeping the greater value makes the result independent of the order of insertion, e.g. when the value
+ *          is the offset of an object in a log-structured store the most recent object is kept.
+ * @param[in,out] table The table to insert into
+ * @param[in] key The key to insert
+ * @param[in] hash The swiss_hash() of the key
+ * @param[in] value The value of the key
+ * @return Returns false if the table had to grow, and couldn't be allocated
+ */
+bool swiss_table_insert_max (swiss_table *const table, const uint64_t key, const uint64_t hash, const uint64_t value)
+{
+    const __m128i tag = _mm_set1_epi8 ((char) hash_tag (hash));
+    const __m128i empty = _mm_set1_epi8 ((char) SWISS_CTRL_EMPTY);
+    const size_t group_mask = table->num_groups - 1;
+    size_t group = hash_group (table, hash);
+    unsigned int matches;
+    unsigned int empties;
+    size_t slot;
+    size_t step = 0;
+
+    for (;;)
+    {
+        for (matches = match_group (table, group, tag); matches != 0; matches &= matches - 1)
+        {
+            slot = (group * SWISS_GROUP_SIZE) + (size_t) __builtin_ctz (matches);
+            if (table->slots[slot].key == key)
+            {
+                if (value > table->slots[slot].value)
+                {
+                    table->slots[slot].value = value;
+                }
+                return true;
+            }
+        }
+        empties = match_group (table, group, empty);
+        if (empties != 0)
+        {
+            break;
+        }
+        step++;
+        group = (group + step) & group_mask;
+    }
+
+    /* The key isn't present. Insert it in the empty slot found, unless the table has to grow first. */
+    if (table->count >= table->growth_limit)
+    {
+        if (!grow_table (table))
+        {
+            return false;
+        }
+        insert_new (table, key, hash, value);
+    }
+    else
+    {
+        slot = (group * SWISS_GROUP_SIZE) + (size_t) __builtin_ctz (empties);
+        table->ctrl[slot] = hash_tag (hash);
+        table->slots[slot].key = key;
+        table->slots[slot].value = value;
+        table->count++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Initialise an empty index
+ * @param[out] index The index to initialise
+ * @param[in] table_bits The number of top bits of the hash which select the table, no more than
+ *                       SWISS_INDEX_MAX_TABLE_BITS
+ * @param[in] expected_count The number of keys expected in the index
+ * @return Returns true if the tables were allocated, or false if table_bits is too large or allocation failed
+ */
+bool swiss_index_init (swiss_index *const index, const unsigned int table_bits, const size_t expected_count)
+{
+    unsigned int table_num;
+
+    memset (index, 0, sizeof (*index));
+    if (table_bits > SWISS_INDEX_MAX_TABLE_BITS)
+    {
+        return false;
+    }
+    index->table_bits = table_bits;
+    index->num_tables = 1U << table_bits;
+    for (table_num = 0; table_num < index->num_tables; table_num++)
+    {
+        if (!swiss_table_init (&index->tables[table_num], expected_count / index->num_tables))
+        {
+            swiss_index_free (index);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Free the tables of an index
+ */
+void swiss_index_free (swiss_index *const index)
+{
+    unsigned int table_num;
+
+    for (table_num = 0; table_num < index->num_tables; table_num++)
+    {
+        swiss_table_free (&index->tables[table_num]);
+    }
+    index->num_tables = 0;
+}
+
+/**
+ * @brief Find the value of a key in an index
+ * @return Returns true if the key was found
+ */
+bool swiss_index_find (const swiss_index *const index, const uint64_t key, uint64_t *const value)
+{
+    const uint64_t hash = swiss_hash (key);
+
+    return swiss_table_find (&index->tables[swiss_index_table (index, hash)], key, hash, value);
+}
+
+/**
+ * @brief Return the number of keys in an index
+ */
+size_t swiss_index_count (const swiss_index *const index)
+{
+    unsigned int table_num;
+    size_t count = 0;
+
+    for (table_num = 0; table_num < index->num_tables; table_num++)
+    {
+        count += index->tables[table_num].count;
+    }
+
+    return count;
+}
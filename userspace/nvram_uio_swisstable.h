@@ -0,0 +1,93 @@
+/*
+ * @file nvram_uio_swisstable.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Open addressing hash table in host memory with SIMD probing of per-slot tags, in the style of a Swiss table
+ * @details
+ *   The slots are divided into groups of SWISS_GROUP_SIZE, each with a control byte per slot holding either
+ *   SWISS_CTRL_EMPTY or a 7 bit tag from the hash of the key in the slot. A probe compares the tag against all the
+ *   control bytes of a group with one SSE2 compare, so the keys of only the slots whose tags match are compared.
+ *   Groups are probed quadratically, and a probe ends at the first group with an empty slot. Slots can't be
+ *   deleted, which keeps the probe simple for the rebuild of an index.
+ *
+ *   The keys and values are 64-bit, with the value typically the offset of an object in the device memory.
+ *   A table isn't thread safe; a swiss_index divides the keys between a power of two number of tables by the top
+ *   bits of the hash, so that each table can be filled by a different thread.
+ */
+
+#ifndef NVRAM_UIO_SWISSTABLE_H_
+#define NVRAM_UIO_SWISSTABLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SWISS_GROUP_SIZE 16
+#define SWISS_CTRL_EMPTY 0x80
+
+/** The maximum number of top bits of the hash which select the table, and so the number of tables, in an index */
+#define SWISS_INDEX_MAX_TABLE_BITS 10
+#define SWISS_INDEX_MAX_TABLES (1U << SWISS_INDEX_MAX_TABLE_BITS)
+
+/** One key and value */
+typedef struct
+{
+    uint64_t key;
+    uint64_t value;
+} swiss_slot;
+
+/** One hash table */
+typedef struct
+{
+    /** The control bytes, aligned so that each group is one aligned SSE2 load */
+    uint8_t *ctrl;
+    swiss_slot *slots;
+    /** The number of groups, which is a power of two */
+    size_t num_groups;
+    size_t count;
+    /** The count at which the table is grown */
+    size_t growth_limit;
+} swiss_table;
+
+/** A number of tables selected by the top bits of the hash of the key */
+typedef struct
+{
+    unsigned int table_bits;
+    unsigned int num_tables;
+    swiss_table tables[SWISS_INDEX_MAX_TABLES];
+} swiss_index;
+
+/**
+ * @brief Return the hash of a key, which is the finaliser of MurmurHash3
+ * @details The hash passed to the table functions must be the swiss_hash() of the key, as it is recomputed when
+ *          a table grows.
+ */
+static inline uint64_t swiss_hash (uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
+/**
+ * @brief Return the table of an index which holds a key with a hash
+ */
+static inline unsigned int swiss_index_table (const swiss_index *const index, const uint64_t hash)
+{
+    return (index->table_bits == 0) ? 0 : (unsigned int) (hash >> (64 - index->table_bits));
+}
+
+bool swiss_table_init (swiss_table *const table, const size_t expected_count);
+void swiss_table_free (swiss_table *const table);
+bool swiss_table_find (const swiss_table *const table, const uint64_t key, const uint64_t hash, uint64_t *const value);
+bool swiss_table_insert_max (swiss_table *const table, const uint64_t key, const uint64_t hash, const uint64_t value);
+bool swiss_index_init (swiss_index *const index, const unsigned int table_bits, const size_t expected_count);
+void swiss_index_free (swiss_index *const index);
+bool swiss_index_find (const swiss_index *const index, const uint64_t key, uint64_t *const value);
+size_t swiss_index_count (const swiss_index *const index);
+
+#endif /* NVRAM_UIO_SWISSTABLE_H_ */
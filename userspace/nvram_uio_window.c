@@ -0,0 +1,259 @@
+/*
+ * @file nvram_uio_window.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Programmed I/O access to the NVRAM device memory through the write-combining memory window
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <immintrin.h>
+
+#include "nvram_uio_window.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_copy.h"
+#include "nvram_uio_probes.h"
+#include "nvram_uio_heatmap.h"
+
+/* The maximum amount of the window used to calibrate the copy kernels */
+#define WINDOW_CALIBRATION_SIZE (1024 * 1024)
+
+/**
+ * @brief Map the write-combining memory window, if the driver provides one
+ * @details If NVRAM_UIO_WINDOW_SCRATCH gives the offset of a scratch area of the device memory, the copy kernels for
+ *          the window are calibrated on it the first time a window is mapped in the process.
+ * @param[in,out] context The open NVRAM UIO device to map the window for
+ * @return Returns true if the window was mapped, or false if the device has no window
+ */
+bool map_window (nvram_uio_context *const context)
+{
+    const char *const scratch_text = getenv ("NVRAM_UIO_WINDOW_SCRATCH");
+    void *mapping;
+
+    if (!uio_mapping_exists (context->device_name, WINDOW_MAPPING_INDEX))
+    {
+        return false;
+    }
+
+    context->window_size = read_uio_mapping_param (context->device_name, WINDOW_MAPPING_INDEX, "size");
+    mapping = mmap (NULL, context->window_size, PROT_READ | PROT_WRITE, MAP_SHARED, context->device_fd,
+                    WINDOW_MAPPING_INDEX * getpagesize ());
+    if (mapping == MAP_FAILED)
+    {
+        printf ("Failed to map memory window for %s\n", context->device_name);
+        perror (NULL);
+        exit (EXIT_FAILURE);
+    }
+    context->window = mapping;
+    context->selected_window = -1;
+
+    if ((scratch_text != NULL) && !calibrate_window_copy (context, strtoull (scratch_text, NULL, 0)))
+    {
+        printf ("NVRAM_UIO_WINDOW_SCRATCH=%s isn't a valid scratch area for calibrating the window copy kernels\n",
+                scratch_text);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Unmap the memory window, if mapped
+ * @param[in,out] context The open NVRAM UIO device to unmap the window for
+ */
+void unmap_window (nvram_uio_context *const context)
+{
+    if (context->window != NULL)
+    {
+        munmap (context->window, context->window_size);
+        context->window = NULL;
+        context->window_size = 0;
+    }
+}
+
+/**
+ * @brief Wait for posted writes through the window to reach the device
+ * @details The sfence drains the write-combining buffers, and the read of a CSR can't complete until the
+ *          preceding posted writes to the device have.
+ * @param[in] context The open NVRAM UIO device
+ */
+void window_flush (nvram_uio_context *const context)
+{
+    _mm_sfence ();
+    (void) *context->windowmap_winnum;
+}
+
+/**
+ * @brief Select the window which contains a device memory offset. Must be called with lock_device() held.
+ * @param[in,out] context The open NVRAM UIO device with a mapped window
+ * @param[in] card_offset The device memory offset to make visible
+ * @return The offset of card_offset within the window
+ */
+size_t select_window (nvram_uio_context *const context, const uint64_t card_offset)
+{
+    const int64_t window_number = (int64_t) (card_offset / context->window_size);
+
+    /* Re-read the selection from the device, since another process may have changed it */
+    context->selected_window = *context->windowmap_winnum;
+    if (context->selected_window != window_number)
+    {
+        /* Writes to the previous window must reach the device before the selection changes */
+        window_flush (context);
+        *context->windowmap_winnum = (uint8_t) window_number;
+        (void) *context->windowmap_winnum;
+        context->selected_window = window_number;
+    }
+
+    return (size_t) (card_offset % context->window_size);
+}
+
+/**
+ * @brief Check that an access through the window is possible
+ */
+static bool window_access_valid (const nvram_uio_context *const context, const uint64_t card_offset,
+                                 const size_t num_bytes)
+{
+    return (context->window != NULL) &&
+            ((context->memory_size_bytes == 0) || ((card_offset + num_bytes) <= context->memory_size_bytes));
+}
+
+/**
+ * @brief Write to the device memory through the window, using the copy kernel selected for write-combining memory
+ * @details The writes are posted, and have left the write-combining buffers but may not have reached the device
+ *          on return.
+ * @param[in,out] context The open NVRAM UIO device with a mapped window
+ * @param[in] card_offset The offset in the device memory to write to
+ * @param[in] src The data to write
+ * @param[in] num_bytes The number of bytes to write
+ * @return Returns true if the write was performed
+ */
+bool window_write (nvram_uio_context *const context, const uint64_t card_offset,
+                   const void *const src, const size_t num_bytes)
+{
+    const uint8_t *const src_bytes = src;
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    uint64_t latency_ns;
+    size_t bytes_done = 0;
+    size_t window_offset;
+    size_t chunk_bytes;
+
+    if (!window_access_valid (context, card_offset, num_bytes))
+    {
+        return false;
+    }
+
+    lock_device (context);
+    while (bytes_done < num_bytes)
+    {
+        window_offset = select_window (context, card_offset + bytes_done);
+        chunk_bytes = context->window_size - window_offset;
+        if (chunk_bytes > (num_bytes - bytes_done))
+        {
+            chunk_bytes = num_bytes - bytes_done;
+        }
+        copy_to_destination (COPY_DEST_WC_WINDOW, &context->window[window_offset], &src_bytes[bytes_done], chunk_bytes);
+        bytes_done += chunk_bytes;
+    }
+
+    /*
+     * Drain the write-combining buffers before releasing the lock, as the flush by another process before changing
+     * the selection only drains the buffers of that process
+     */
+    _mm_sfence ();
+    unlock_device (context);
+
+    latency_ns = get_monotonic_time_ns () - start_ns;
+    NVRAM_UIO_PROBE3 (pio_write, card_offset, num_bytes, latency_ns);
+    record_client_operation (context->stats, NVRAM_UIO_STATS_WRITE, num_bytes, latency_ns, false);
+    heatmap_sample_access (context->heatmap_sampled, card_offset, num_bytes, HEATMAP_WRITE);
+
+    return true;
+}
+
+/**
+ * @brief Read from the device memory through the window
+ * @details Reads from write-combining memory are uncached, so DMA is faster for all but small reads.
+ * @param[in,out] context The open NVRAM UIO device with a mapped window
+ * @param[in] card_offset The offset in the device memory to read from
+ * @param[out] dst Where to store the data read
+ * @param[in] num_bytes The number of bytes to read
+ * @return Returns true if the read was performed
+ */
+bool window_read (nvram_uio_context *const context, const uint64_t card_offset,
+                  void *const dst, const size_t num_bytes)
+{
+    uint8_t *const dst_bytes = dst;
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    size_t bytes_done = 0;
+    size_t window_offset;
+    size_t chunk_bytes;
+
+    if (!window_access_valid (context, card_offset, num_bytes))
+    {
+        return false;
+    }
+
+    lock_device (context);
+    while (bytes_done < num_bytes)
+    {
+        window_offset = select_window (context, card_offset + bytes_done);
+        chunk_bytes = context->window_size - window_offset;
+        if (chunk_bytes > (num_bytes - bytes_done))
+        {
+            chunk_bytes = num_bytes - bytes_done;
+        }
+        memcpy (&dst_bytes[bytes_done], &context->window[window_offset], chunk_bytes);
+        bytes_done += chunk_bytes;
+    }
+    unlock_device (context);
+
+    record_client_operation (context->stats, NVRAM_UIO_STATS_READ, num_bytes, get_monotonic_time_ns () - start_ns, false);
+    heatmap_sample_access (context->heatmap_sampled, card_offset, num_bytes, HEATMAP_READ);
+
+    return true;
+}
+
+/**
+ * @brief Select the copy kernels for the window by timing writes through it to a scratch area of the device memory
+ * @details Only the first call in a process performs the calibration. The device lock is held throughout, so the
+ *          window selection isn't changed by other accesses while the kernels are timed. The contents of the scratch
+ *          area are overwritten.
+ * @param[in,out] context The open NVRAM UIO device with a mapped window
+ * @param[in] card_offset The offset in the device memory of the scratch area, which must not cross a window
+ * @return Returns true if the calibration has been performed
+ */
+bool calibrate_window_copy (nvram_uio_context *const context, const uint64_t card_offset)
+{
+    static bool calibration_started;
+    size_t calibration_size = WINDOW_CALIBRATION_SIZE;
+    size_t window_offset;
+
+    if (context->window == NULL)
+    {
+        return false;
+    }
+    if (calibration_size > context->window_size)
+    {
+        calibration_size = context->window_size;
+    }
+    if ((((card_offset % context->window_size) + calibration_size) > context->window_size) ||
+        ((context->memory_size_bytes != 0) && ((card_offset + calibration_size) > context->memory_size_bytes)))
+    {
+        return false;
+    }
+
+    if (!__atomic_exchange_n (&calibration_started, true, __ATOMIC_ACQ_REL))
+    {
+        lock_device (context);
+        window_offset = select_window (context, card_offset);
+        copy_calibrate (COPY_DEST_WC_WINDOW, &context->window[window_offset], calibration_size);
+        window_flush (context);
+        unlock_device (context);
+    }
+
+    return true;
+}
@@ -0,0 +1,33 @@
+/*
+ * @file nvram_uio_window.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Programmed I/O access to the NVRAM device memory through the write-combining memory window
+ * @details
+ *   The window is an alternative to DMA for small transfers, since a write is only a copy with no descriptor
+ *   setup or completion polling. The window shows one window-sized part of the device memory at a time, selected by
+ *   WINDOWMAP_WINNUM which is device-wide, so accesses hold lock_device() while the selection is in use.
+ *
+ *   Writes to the window are posted, so window_flush() must be used when the data has to have reached the device.
+ */
+
+#ifndef NVRAM_UIO_WINDOW_H_
+#define NVRAM_UIO_WINDOW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "nvram_uio_access.h"
+
+bool map_window (nvram_uio_context *const context);
+void unmap_window (nvram_uio_context *const context);
+bool window_write (nvram_uio_context *const context, const uint64_t card_offset,
+                   const void *const src, const size_t num_bytes);
+bool window_read (nvram_uio_context *const context, const uint64_t card_offset,
+                  void *const dst, const size_t num_bytes);
+void window_flush (nvram_uio_context *const context);
+size_t select_window (nvram_uio_context *const context, const uint64_t card_offset);
+bool calibrate_window_copy (nvram_uio_context *const context, const uint64_t card_offset);
+
+#endif /* NVRAM_UIO_WINDOW_H_ */
@@ -0,0 +1,692 @@
+/*
+ * @file nvram_uio_xcommit.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief All-or-nothing updates across several NVRAM devices, using two-phase commit with redo logging
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "nvram_uio_xcommit.h"
+
+/**
+ * @brief Return the offset in the DMA buffer used to stage headers and commit records, after any prepare record
+ */
+static size_t staging_offset (const nvram_uio_context *const context)
+{
+    return context->dma_buffer_size - XCOMMIT_ALIGN;
+}
+
+/**
+ * @brief Write one line to the device memory from the staging area of the DMA buffer
+ */
+static bool write_line (nvram_uio_context *const context, const uint64_t card_offset, const void *const line)
+{
+    memcpy (&context->dma_buffer[staging_offset (context)], line, XCOMMIT_ALIGN);
+
+    return dma_transfer (context, DMA_READ_FROM_HOST, card_offset, staging_offset (context), XCOMMIT_ALIGN);
+}
+
+/**
+ * @brief Write the checkpoint to the coordinator's header
+ */
+static bool write_checkpoint (xcommit_set *const set, const uint64_t checkpoint)
+{
+    xcommit_header header;
+
+    memset (&header, 0, sizeof (header));
+    header.magic = XCOMMIT_MAGIC;
+    header.version = XCOMMIT_VERSION;
+    header.num_participants = set->num_participants;
+    header.set_id = set->set_id;
+    header.participant_index = XCOMMIT_COORDINATOR;
+    header.num_commit_slots = set->num_commit_slots;
+    header.log_size = set->log_size;
+    header.checkpoint = checkpoint;
+    header.check = compute_check_word (&header, sizeof (header), offsetof (xcommit_header, check));
+    if (!write_line (set->participants[XCOMMIT_COORDINATOR].context, set->log_offset, &header))
+    {
+        return false;
+    }
+    set->checkpoint = checkpoint;
+
+    return true;
+}
+
+/**
+ * @brief Thread for a participant, which performs the job function for each job the participant takes part in
+ */
+static void *participant_thread (void *const arg)
+{
+    xcommit_participant *const participant = arg;
+    xcommit_set *const set = participant->set;
+    const unsigned int participant_index = (unsigned int) (participant - set->participants);
+    uint64_t generation = 0;
+    uint64_t start_ns;
+    bool success;
+
+    pthread_mutex_lock (&set->job_lock);
+    for (;;)
+    {
+        while (!set->stopping && (set->job_generation == generation))
+        {
+            pthread_cond_wait (&set->job_posted, &set->job_lock);
+        }
+        if (set->stopping)
+        {
+            break;
+        }
+        generation = set->job_generation;
+        if (set->job_participants[participant_index])
+        {
+            pthread_mutex_unlock (&set->job_lock);
+            start_ns = get_monotonic_time_ns ();
+            success = set->job (set, participant_index);
+            participant->job_ns = get_monotonic_time_ns () - start_ns;
+            pthread_mutex_lock (&set->job_lock);
+            participant->job_success = success;
+            set->jobs_outstanding--;
+            if (set->jobs_outstanding == 0)
+            {
+                pthread_cond_signal (&set->job_done);
+            }
+        }
+    }
+    pthread_mutex_unlock (&set->job_lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Run a job on the participants selected in job_participants in parallel, and wait for it to complete
+ * @return Returns true if the job succeeded on all the selected participants
+ */
+static bool run_jobs (xcommit_set *const set, const xcommit_job_fn job)
+{
+    unsigned int participant_index;
+    bool success = true;
+
+    pthread_mutex_lock (&set->job_lock);
+    set->job = job;
+    for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+    {
+        if (set->job_participants[participant_index])
+        {
+            set->jobs_outstanding++;
+        }
+    }
+    set->job_generation++;
+    pthread_cond_broadcast (&set->job_posted);
+    while (set->jobs_outstanding > 0)
+    {
+        pthread_cond_wait (&set->job_done, &set->job_lock);
+    }
+    pthread_mutex_unlock (&set->job_lock);
+
+    for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+    {
+        if (set->job_participants[participant_index] && !set->participants[participant_index].job_success)
+        {
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+/**
+ * @brief Job which writes the prepare record staged at the start of the participant's DMA buffer to its log
+ */
+static bool prepare_job (xcommit_set *const set, const unsigned int participant_index)
+{
+    xcommit_participant *const participant = &set->participants[participant_index];
+
+    return dma_transfer (participant->context, DMA_READ_FROM_HOST,
+                         set->log_offset + set->records_offset + participant->write_position, 0,
+                         participant->record_size);
+}
+
+/**
+ * @brief Job which applies the writes of the participant, from the data of the prepare record in the DMA buffer
+ */
+static bool apply_job (xcommit_set *const set, const unsigned int participant_index)
+{
+    xcommit_participant *const participant = &set->participants[participant_index];
+
+    return dma_transfer_chain (participant->context, DMA_READ_FROM_HOST, participant->apply_elements,
+                               participant->num_apply_elements);
+}
+
+/**
+ * @brief Determine if a transaction has a commit record in the coordinator's commit table read at open
+ */
+static bool transaction_committed (const xcommit_set *const set, const uint64_t txn_id)
+{
+    const xcommit_commit_record *const commit = &set->commit_table[txn_id % set->num_commit_slots];
+
+    return (commit->magic == XCOMMIT_COMMIT_MAGIC) && (commit->txn_id == txn_id) &&
+            (commit->check == compute_check_word (commit, sizeof (*commit), offsetof (xcommit_commit_record, check)));
+}
+
+/**
+ * @brief Job which scans the log of a participant at open, and redoes the writes of the committed transactions
+ * @details Records following the checkpoint were all written since the log last wrapped, so are in order of their
+ *          transaction identities. The scan stops at the first record which isn't valid, which is either unused
+ *          space, a record torn by a failure part way through a prepare, or the remains of older records.
+ */
+static bool recover_job (xcommit_set *const set, const unsigned int participant_index)
+{
+    xcommit_participant *const participant = &set->participants[participant_index];
+    const uint64_t records_size = set->log_size - set->records_offset;
+    xcommit_record_header header;
+    xcommit_write_descriptor descriptor;
+    uint8_t *log;
+    uint64_t position = 0;
+    size_t data_offset;
+    uint32_t write_index;
+    bool success;
+
+    participant->records_redone = 0;
+    participant->highest_txn_id = 0;
+    log = malloc (records_size);
+    if (log == NULL)
+    {
+        return false;
+    }
+    success = dma_read_to_host (participant->context, set->log_offset + set->records_offset, log, records_size);
+
+    while (success && ((position + sizeof (header)) <= records_size))
+    {
+        memcpy (&header, &log[position], sizeof (header));
+        if ((header.magic != XCOMMIT_RECORD_MAGIC) || (header.record_size < sizeof (header)) ||
+            ((header.record_size % XCOMMIT_ALIGN) != 0) || (header.record_size > (records_size - position)) ||
+            (header.num_writes > XCOMMIT_MAX_WRITES) ||
+            (header.check != compute_check_word (&log[position], header.record_size,
+                                            offsetof (xcommit_record_header, check))))
+        {
+            break;
+        }
+        if (header.txn_id > participant->highest_txn_id)
+        {
+            participant->highest_txn_id = header.txn_id;
+        }
+
+        if ((header.txn_id > set->checkpoint) && transaction_committed (set, header.txn_id))
+        {
+            data_offset = sizeof (header) + (header.num_writes * sizeof (descriptor));
+            for (write_index = 0; success && (write_index < header.num_writes); write_index++)
+            {
+                memcpy (&descriptor, &log[position + sizeof (header) + (write_index * sizeof (descriptor))],
+                        sizeof (descriptor));
+                success = ((data_offset + descriptor.num_bytes) <= header.record_size) &&
+                        dma_write_from_host (participant->context, descriptor.card_offset,
+                                             &log[position + data_offset], descriptor.num_bytes);
+                data_offset += descriptor.num_bytes;
+            }
+            participant->records_redone++;
+        }
+        position += header.record_size;
+    }
+    free (log);
+
+    return success;
+}
+
+/**
+ * @brief Format the log areas of a set of participants
+ * @details The commit table of the coordinator is zeroed, and the start of the log records of every participant, so
+ *          no record or commit record from before the format is recognised.
+ * @param[in,out] contexts The open NVRAM UIO devices with mapped DMA buffers, in participant order with the
+ *                         coordinator first
+ * @param[in] num_participants The number of participants, up to XCOMMIT_MAX_PARTICIPANTS
+ * @param[in] log_offset The offset of the log area in the device memory of each participant
+ * @param[in] log_size The size of the log area of each participant
+ * @param[in] num_commit_slots The number of commit slots, which limits the transactions between checkpoints
+ * @return Returns true if the set was formatted
+ */
+bool xcommit_format (nvram_uio_context *const contexts[], const unsigned int num_participants,
+                     const uint64_t log_offset, const uint64_t log_size, const uint32_t num_commit_slots)
+{
+    const uint64_t records_offset = XCOMMIT_HEADER_SIZE + ((uint64_t) num_commit_slots * XCOMMIT_ALIGN);
+    xcommit_header header;
+    uint64_t set_id;
+    uint64_t bytes_done;
+    size_t chunk_bytes;
+    unsigned int participant_index;
+
+    if ((num_participants == 0) || (num_participants > XCOMMIT_MAX_PARTICIPANTS) || (num_commit_slots < 2) ||
+        (log_size < (records_offset + XCOMMIT_ALIGN)) || ((log_size % XCOMMIT_ALIGN) != 0))
+    {
+        return false;
+    }
+
+    set_id = generate_set_id ();
+
+    for (participant_index = 0; participant_index < num_participants; participant_index++)
+    {
+        nvram_uio_context *const context = contexts[participant_index];
+
+        if ((context->dma_mapping == NULL) || (context->dma_buffer_size < (2 * XCOMMIT_ALIGN)))
+        {
+            return false;
+        }
+        memset (context->dma_buffer, 0, context->dma_buffer_size);
+        for (bytes_done = XCOMMIT_HEADER_SIZE; bytes_done < (records_offset + XCOMMIT_ALIGN); bytes_done += chunk_bytes)
+        {
+            chunk_bytes = ((records_offset + XCOMMIT_ALIGN - bytes_done) < context->dma_buffer_size) ?
+                    (size_t) (records_offset + XCOMMIT_ALIGN - bytes_done) : context->dma_buffer_size;
+            if (!dma_transfer (context, DMA_READ_FROM_HOST, log_offset + bytes_done, 0, chunk_bytes))
+            {
+                return false;
+            }
+        }
+
+        memset (&header, 0, sizeof (header));
+        header.magic = XCOMMIT_MAGIC;
+        header.version = XCOMMIT_VERSION;
+        header.num_participants = num_participants;
+        header.set_id = set_id;
+        header.participant_index = participant_index;
+        header.num_commit_slots = num_commit_slots;
+        header.log_size = log_size;
+        header.checkpoint = 0;
+        header.check = compute_check_word (&header, sizeof (header), offsetof (xcommit_header, check));
+        if (!write_line (context, log_offset, &header))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Open a set, redoing the committed transactions found in the logs of the participants
+ * @details The devices may be given in any order. All the participants must be present, since a transaction can't
+ *          be resolved without the prepare records of all of its participants.
+ * @param[out] set The set to open
+ * @param[in,out] contexts The open NVRAM UIO devices with mapped DMA buffers. Their DMA buffers are used by the set
+ *                         until it is closed.
+ * @param[in] num_contexts The number of devices
+ * @param[in] log_offset The offset of the log area in the device memory of each participant
+ * @param[out] num_redone If not NULL, where to return the number of prepare records redone
+ * @return Returns true if the set was opened
+ */
+bool xcommit_open (xcommit_set *const set, nvram_uio_context *const contexts[], const unsigned int num_contexts,
+                   const uint64_t log_offset, uint64_t *const num_redone)
+{
+    xcommit_header reference;
+    xcommit_header header;
+    unsigned int context_index;
+    unsigned int participant_index;
+    unsigned int num_present = 0;
+    uint64_t highest_txn_id;
+    uint64_t total_redone = 0;
+    uint32_t slot;
+    bool success = true;
+
+    memset (set, 0, sizeof (*set));
+    memset (&reference, 0, sizeof (reference));
+    for (context_index = 0; success && (context_index < num_contexts); context_index++)
+    {
+        if (!dma_read_to_host (contexts[context_index], log_offset, &header, sizeof (header)) ||
+            (header.magic != XCOMMIT_MAGIC) || (header.version != XCOMMIT_VERSION) ||
+            (header.check != compute_check_word (&header, sizeof (header), offsetof (xcommit_header, check))))
+        {
+            continue;
+        }
+        if (num_present == 0)
+        {
+            reference = header;
+        }
+        if ((header.set_id != reference.set_id) || (header.num_participants != reference.num_participants) ||
+            (header.num_commit_slots != reference.num_commit_slots) || (header.log_size != reference.log_size))
+        {
+            continue;
+        }
+        success = (header.participant_index < header.num_participants) &&
+                (header.num_participants <= XCOMMIT_MAX_PARTICIPANTS) &&
+                (set->participants[header.participant_index].context == NULL);
+        if (success)
+        {
+            set->participants[header.participant_index].context = contexts[context_index];
+            if (header.participant_index == XCOMMIT_COORDINATOR)
+            {
+                set->checkpoint = header.checkpoint;
+            }
+            num_present++;
+        }
+    }
+    if (!success || (num_present == 0) || (num_present != reference.num_participants))
+    {
+        return false;
+    }
+
+    set->num_participants = reference.num_participants;
+    set->log_offset = log_offset;
+    set->log_size = reference.log_size;
+    set->num_commit_slots = reference.num_commit_slots;
+    set->set_id = reference.set_id;
+    set->records_offset = XCOMMIT_HEADER_SIZE + ((uint64_t) set->num_commit_slots * XCOMMIT_ALIGN);
+    set->commit_table = malloc ((size_t) set->num_commit_slots * sizeof (xcommit_commit_record));
+    if ((set->commit_table == NULL) ||
+        !dma_read_to_host (set->participants[XCOMMIT_COORDINATOR].context, log_offset + XCOMMIT_HEADER_SIZE,
+                           set->commit_table, (size_t) set->num_commit_slots * sizeof (xcommit_commit_record)))
+    {
+        free (set->commit_table);
+        return false;
+    }
+
+    pthread_mutex_init (&set->lock, NULL);
+    pthread_mutex_init (&set->job_lock, NULL);
+    pthread_cond_init (&set->job_posted, NULL);
+    pthread_cond_init (&set->job_done, NULL);
+    for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+    {
+        xcommit_participant *const participant = &set->participants[participant_index];
+
+        participant->set = set;
+        participant->thread_started = pthread_create (&participant->thread, NULL, participant_thread, participant) == 0;
+        success = success && participant->thread_started;
+        set->job_participants[participant_index] = true;
+    }
+
+    /* Every participant scans its own log in parallel */
+    success = success && run_jobs (set, recover_job);
+
+    /* Everything up to the highest identity found has now been resolved, by being redone or by having no commit
+     * record, so the logs can be reused from their start */
+    highest_txn_id = set->checkpoint;
+    for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+    {
+        const xcommit_participant *const participant = &set->participants[participant_index];
+
+        if (participant->highest_txn_id > highest_txn_id)
+        {
+            highest_txn_id = participant->highest_txn_id;
+        }
+        total_redone += participant->records_redone;
+    }
+    for (slot = 0; slot < set->num_commit_slots; slot++)
+    {
+        if ((set->commit_table[slot].magic == XCOMMIT_COMMIT_MAGIC) &&
+            (set->commit_table[slot].txn_id > highest_txn_id))
+        {
+            highest_txn_id = set->commit_table[slot].txn_id;
+        }
+    }
+    free (set->commit_table);
+    set->commit_table = NULL;
+    success = success && write_checkpoint (set, highest_txn_id);
+    set->next_txn_id = highest_txn_id + 1;
+    if (num_redone != NULL)
+    {
+        *num_redone = total_redone;
+    }
+
+    if (!success)
+    {
+        xcommit_close (set);
+    }
+
+    return success;
+}
+
+/**
+ * @brief Close a set, stopping the participant threads. The devices are left open.
+ * @details Nothing is written, since the next open resolves any transaction left part way through.
+ */
+void xcommit_close (xcommit_set *const set)
+{
+    unsigned int participant_index;
+
+    pthread_mutex_lock (&set->job_lock);
+    set->stopping = true;
+    pthread_cond_broadcast (&set->job_posted);
+    pthread_mutex_unlock (&set->job_lock);
+    for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+    {
+        xcommit_participant *const participant = &set->participants[participant_index];
+
+        if (participant->thread_started)
+        {
+            pthread_join (participant->thread, NULL);
+            participant->thread_started = false;
+        }
+    }
+}
+
+/**
+ * @brief Stage the prepare record of a participant at the start of its DMA buffer
+ * @return Returns false if the writes of the participant don't fit in one record
+ */
+static bool build_prepare_record (xcommit_set *const set, const unsigned int participant_index,
+                                  const uint64_t txn_id, const xcommit_write *const writes,
+                                  const unsigned int num_writes)
+{
+    xcommit_participant *const participant = &set->participants[participant_index];
+    nvram_uio_context *const context = participant->context;
+    xcommit_record_header header;
+    xcommit_write_descriptor descriptor;
+    unsigned int write_index;
+    size_t data_offset;
+    size_t record_size;
+    unsigned int num_participant_writes = 0;
+    size_t data_bytes = 0;
+
+    for (write_index = 0; write_index < num_writes; write_index++)
+    {
+        if (writes[write_index].participant == participant_index)
+        {
+            num_participant_writes++;
+            data_bytes += writes[write_index].num_bytes;
+        }
+    }
+    record_size = sizeof (header) + (num_participant_writes * sizeof (descriptor)) + data_bytes;
+    record_size = (record_size + XCOMMIT_ALIGN - 1) & ~(size_t) (XCOMMIT_ALIGN - 1);
+    if ((num_participant_writes > XCOMMIT_MAX_WRITES) || (num_participant_writes > context->max_dma_chain_length) ||
+        (record_size > staging_offset (context)) || (record_size > (set->log_size - set->records_offset)))
+    {
+        return false;
+    }
+
+    memset (context->dma_buffer, 0, record_size);
+    participant->num_apply_elements = 0;
+    data_offset = sizeof (header) + (num_participant_writes * sizeof (descriptor));
+    for (write_index = 0; write_index < num_writes; write_index++)
+    {
+        const xcommit_write *const write = &writes[write_index];
+
+        if (write->participant == participant_index)
+        {
+            dma_chain_element *const element = &participant->apply_elements[participant->num_apply_elements];
+
+            descriptor.card_offset = write->card_offset;
+            descriptor.num_bytes = write->num_bytes;
+            memcpy (&context->dma_buffer[sizeof (header) + (participant->num_apply_elements * sizeof (descriptor))],
+                    &descriptor, sizeof (descriptor));
+            memcpy (&context->dma_buffer[data_offset], write->data, write->num_bytes);
+            element->card_offset = write->card_offset;
+            element->buffer_offset = data_offset;
+            element->num_bytes = write->num_bytes;
+            participant->num_apply_elements++;
+            data_offset += write->num_bytes;
+        }
+    }
+
+    memset (&header, 0, sizeof (header));
+    header.magic = XCOMMIT_RECORD_MAGIC;
+    header.txn_id = txn_id;
+    header.record_size = (uint32_t) record_size;
+    header.num_writes = num_participant_writes;
+    memcpy (context->dma_buffer, &header, sizeof (header));
+    header.check = compute_check_word (context->dma_buffer, record_size, offsetof (xcommit_record_header, check));
+    memcpy (context->dma_buffer, &header, sizeof (header));
+    participant->record_size = (uint32_t) record_size;
+
+    return true;
+}
+
+/**
+ * @brief Check that a write is to a valid location outside of the log area of its participant
+ */
+static bool write_valid (const xcommit_set *const set, const xcommit_write *const write)
+{
+    const nvram_uio_context *context;
+
+    if ((write->participant >= set->num_participants) || (write->num_bytes == 0))
+    {
+        return false;
+    }
+    context = set->participants[write->participant].context;
+
+    if ((context->memory_size_bytes != 0) && ((write->card_offset + write->num_bytes) > context->memory_size_bytes))
+    {
+        return false;
+    }
+
+    return ((write->card_offset + write->num_bytes) <= set->log_offset) ||
+            (write->card_offset >= (set->log_offset + set->log_size));
+}
+
+/**
+ * @brief Commit a transaction, so that either all or none of its writes are made across the participants
+ * @details If false is returned after the commit record write has been attempted, the outcome isn't known until
+ *          the set is opened again, and until then further commits are rejected.
+ * @param[in,out] set The open set
+ * @param[in] writes The writes of the transaction, to locations outside of the log areas
+ * @param[in] num_writes The number of writes
+ * @param[out] timing If not NULL, where to return the time taken by the phases of the commit
+ * @return Returns true if the transaction was committed and applied
+ */
+bool xcommit_commit (xcommit_set *const set, const xcommit_write *const writes, const unsigned int num_writes,
+                     xcommit_timing *const timing)
+{
+    const uint64_t records_size = set->log_size - set->records_offset;
+    xcommit_commit_record commit;
+    xcommit_timing phases;
+    bool wraps[XCOMMIT_MAX_PARTICIPANTS];
+    unsigned int write_index;
+    unsigned int participant_index;
+    uint64_t txn_id;
+    uint64_t start_ns;
+    bool need_checkpoint;
+    bool success = true;
+
+    memset (&phases, 0, sizeof (phases));
+    for (write_index = 0; success && (write_index < num_writes); write_index++)
+    {
+        success = write_valid (set, &writes[write_index]);
+    }
+    if (!success || (num_writes == 0))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock (&set->lock);
+    if (set->failed)
+    {
+        pthread_mutex_unlock (&set->lock);
+        return false;
+    }
+    txn_id = set->next_txn_id;
+    memset (set->job_participants, 0, sizeof (set->job_participants));
+    for (write_index = 0; write_index < num_writes; write_index++)
+    {
+        set->job_participants[writes[write_index].participant] = true;
+    }
+
+    /* Stage the prepare records, and determine if a log would wrap or the commit slot is still needed */
+    need_checkpoint = (txn_id - set->checkpoint) >= set->num_commit_slots;
+    for (participant_index = 0; success && (participant_index < set->num_participants); participant_index++)
+    {
+        xcommit_participant *const participant = &set->participants[participant_index];
+
+        if (set->job_participants[participant_index])
+        {
+            success = build_prepare_record (set, participant_index, txn_id, writes, num_writes);
+            wraps[participant_index] = (participant->write_position + participant->record_size) > records_size;
+            need_checkpoint = need_checkpoint || wraps[participant_index];
+        }
+    }
+
+    /* As transactions are serialised, all before this one have been resolved. A log is only wrapped once the
+     * checkpoint covers all of its records. */
+    if (success && need_checkpoint)
+    {
+        success = write_checkpoint (set, txn_id - 1);
+        for (participant_index = 0; success && (participant_index < set->num_participants); participant_index++)
+        {
+            if (set->job_participants[participant_index] && wraps[participant_index])
+            {
+                set->participants[participant_index].write_position = 0;
+            }
+        }
+    }
+
+    if (success)
+    {
+        start_ns = get_monotonic_time_ns ();
+        success = run_jobs (set, prepare_job);
+        phases.prepare_ns = get_monotonic_time_ns () - start_ns;
+        for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+        {
+            if (set->job_participants[participant_index])
+            {
+                const uint64_t job_ns = set->participants[participant_index].job_ns;
+
+                phases.sum_prepare_ns += job_ns;
+                phases.slowest_prepare_ns = (job_ns > phases.slowest_prepare_ns) ? job_ns : phases.slowest_prepare_ns;
+            }
+        }
+    }
+    set->next_txn_id++;
+
+    if (success && (set->stop_point != XCOMMIT_STOP_AFTER_PREPARE))
+    {
+        memset (&commit, 0, sizeof (commit));
+        commit.magic = XCOMMIT_COMMIT_MAGIC;
+        commit.txn_id = txn_id;
+        commit.check = compute_check_word (&commit, sizeof (commit), offsetof (xcommit_commit_record, check));
+        start_ns = get_monotonic_time_ns ();
+        success = write_line (set->participants[XCOMMIT_COORDINATOR].context,
+                              set->log_offset + XCOMMIT_HEADER_SIZE +
+                              ((txn_id % set->num_commit_slots) * XCOMMIT_ALIGN), &commit);
+        phases.commit_record_ns = get_monotonic_time_ns () - start_ns;
+
+        if (success)
+        {
+            for (participant_index = 0; participant_index < set->num_participants; participant_index++)
+            {
+                if (set->job_participants[participant_index])
+                {
+                    set->participants[participant_index].write_position +=
+                            set->participants[participant_index].record_size;
+                }
+            }
+        }
+
+        if (success && (set->stop_point != XCOMMIT_STOP_AFTER_COMMIT))
+        {
+            start_ns = get_monotonic_time_ns ();
+            success = run_jobs (set, apply_job);
+            phases.apply_ns = get_monotonic_time_ns () - start_ns;
+        }
+
+        /* A transaction which may be committed but wasn't applied has to be left for recovery to resolve */
+        set->failed = !success || (set->stop_point == XCOMMIT_STOP_AFTER_COMMIT);
+    }
+    pthread_mutex_unlock (&set->lock);
+
+    if (timing != NULL)
+    {
+        *timing = phases;
+    }
+
+    return success;
+}
@@ -0,0 +1,212 @@
+/*
+ * @file nvram_uio_xcommit.h
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief All-or-nothing updates across several NVRAM devices, using two-phase commit with redo logging
+ * @details
+ *   Each participant device has a log area at the same offset, starting with a header which records the identity of
+ *   the set and the index of the participant, followed by a table of commit slots and then the log records.
+ *   Participant zero is the coordinator, and only its commit slots and checkpoint are used.
+ *
+ *   A transaction is a set of writes to locations outside of the log areas of the participants. It is committed by:
+ *   1. Prepare: each participant with writes in the transaction writes a prepare record to its log, holding the
+ *      locations and new data of its writes. The prepare records are written by DMA in parallel.
+ *   2. Commit: once all the prepare records are durable, a commit record for the transaction is written to the
+ *      coordinator's commit slot for the transaction. This is the commit point.
+ *   3. Apply: each participant writes the new data to the locations, in parallel, by DMA directly from the prepare
+ *      record still in its DMA buffer.
+ *   So the latency is that of the slowest participant's prepare plus one small write, rather than the sum over the
+ *   participants. If any prepare fails no commit record is written, and the transaction is aborted.
+ *
+ *   When the set is opened each participant scans its log in parallel, and redoes in order the prepare records of the
+ *   transactions which have a commit record. The checkpoint in the coordinator's header is the transaction identity
+ *   below which all transactions have been resolved, and is advanced before a log wraps or a commit slot is reused,
+ *   so that recovery never needs a record or commit slot which has been overwritten.
+ *
+ *   If writing the commit record or applying the writes fails, the transaction can only be resolved by recovery, so
+ *   no further transactions are committed until the set is opened again. Otherwise a later checkpoint would cover the
+ *   unresolved transaction, and its prepare records could be overwritten.
+ *
+ *   Locations written by transactions must not be written by other means while a transaction which wrote them may
+ *   be redone, i.e. until the set has been opened again.
+ */
+
+#ifndef NVRAM_UIO_XCOMMIT_H_
+#define NVRAM_UIO_XCOMMIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+
+#define XCOMMIT_MAGIC 0x54494d4d4f43584eULL /* "NXCOMMIT" */
+#define XCOMMIT_RECORD_MAGIC 0x524150455250584eULL /* "NXPREPAR" */
+#define XCOMMIT_COMMIT_MAGIC 0x434552544d43584eULL /* "NXCMTREC" */
+#define XCOMMIT_VERSION 1
+
+#define XCOMMIT_MAX_PARTICIPANTS 16
+
+/* The coordinator, which holds the commit records and the checkpoint */
+#define XCOMMIT_COORDINATOR 0
+
+/* The size of the header at the start of each log area */
+#define XCOMMIT_HEADER_SIZE 4096
+
+/* The alignment of the log records, and the size of a commit slot */
+#define XCOMMIT_ALIGN 64
+
+/* The maximum number of writes of one participant in a transaction */
+#define XCOMMIT_MAX_WRITES 64
+
+/** The header at the start of the log area of each participant */
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_participants;
+    /** Chosen when the set is formatted, so participants of different sets aren't mixed */
+    uint64_t set_id;
+    uint32_t participant_index;
+    uint32_t num_commit_slots;
+    uint64_t log_size;
+    /** Only used in the coordinator: all transactions with identities up to this have been resolved */
+    uint64_t checkpoint;
+    /** Check word of the header, calculated with this field zero */
+    uint64_t check;
+    uint64_t padding;
+} xcommit_header;
+
+/** The start of a prepare record, which is followed by the write descriptors and then the data of the writes */
+typedef struct
+{
+    uint64_t magic;
+    uint64_t txn_id;
+    /** The total size of the record, a multiple of XCOMMIT_ALIGN */
+    uint32_t record_size;
+    uint32_t num_writes;
+    /** Check word of the whole record, calculated with this field zero */
+    uint64_t check;
+    uint64_t padding[4];
+} xcommit_record_header;
+
+/** Describes one write in a prepare record */
+typedef struct
+{
+    uint64_t card_offset;
+    uint64_t num_bytes;
+} xcommit_write_descriptor;
+
+/** A commit record in the coordinator's commit table */
+typedef struct
+{
+    uint64_t magic;
+    uint64_t txn_id;
+    /** Check word of the commit record, calculated with this field zero */
+    uint64_t check;
+    uint64_t padding[5];
+} xcommit_commit_record;
+
+_Static_assert (sizeof (xcommit_header) == 64, "xcommit_header must be one line");
+_Static_assert (sizeof (xcommit_record_header) == XCOMMIT_ALIGN, "xcommit_record_header must be one line");
+_Static_assert (sizeof (xcommit_commit_record) == XCOMMIT_ALIGN, "xcommit_commit_record must fill a commit slot");
+
+/** One write of a transaction */
+typedef struct
+{
+    unsigned int participant;
+    uint64_t card_offset;
+    const void *data;
+    size_t num_bytes;
+} xcommit_write;
+
+/** The time taken by the phases of a commit */
+typedef struct
+{
+    /** The time for all the prepare records to be written, and the time of the slowest and sum of all of them */
+    uint64_t prepare_ns;
+    uint64_t slowest_prepare_ns;
+    uint64_t sum_prepare_ns;
+    uint64_t commit_record_ns;
+    uint64_t apply_ns;
+} xcommit_timing;
+
+/** Where xcommit_commit() stops, to test recovery */
+typedef enum
+{
+    XCOMMIT_STOP_NONE,
+    /** Stop after the prepare records are written, as if the host failed before the commit point */
+    XCOMMIT_STOP_AFTER_PREPARE,
+    /** Stop after the commit record is written, as if the host failed before the writes were applied */
+    XCOMMIT_STOP_AFTER_COMMIT
+} xcommit_stop_point;
+
+struct xcommit_set;
+
+/** The operation a participant thread performs for the current job */
+typedef bool (*xcommit_job_fn) (struct xcommit_set *const set, const unsigned int participant_index);
+
+/** One participant of an open set */
+typedef struct
+{
+    nvram_uio_context *context;
+    struct xcommit_set *set;
+    pthread_t thread;
+    bool thread_started;
+    /** Where the next prepare record is written in the log, relative to the start of the log records */
+    uint64_t write_position;
+    /** The prepare record of the current transaction in the DMA buffer, and the DMA to apply its writes */
+    uint32_t record_size;
+    dma_chain_element apply_elements[XCOMMIT_MAX_WRITES];
+    unsigned int num_apply_elements;
+    /** The result and duration of the current job */
+    bool job_success;
+    uint64_t job_ns;
+    /** During recovery the number of records redone, and the highest transaction identity found in the log */
+    uint64_t records_redone;
+    uint64_t highest_txn_id;
+} xcommit_participant;
+
+/** An open set of participants */
+typedef struct xcommit_set
+{
+    unsigned int num_participants;
+    uint64_t log_offset;
+    uint64_t log_size;
+    uint32_t num_commit_slots;
+    uint64_t set_id;
+    /** The offset of the log records in each log area */
+    uint64_t records_offset;
+    uint64_t checkpoint;
+    uint64_t next_txn_id;
+    /** Serialises transactions */
+    pthread_mutex_t lock;
+    /** Used to post jobs to the participant threads, and wait for them to complete */
+    pthread_mutex_t job_lock;
+    pthread_cond_t job_posted;
+    pthread_cond_t job_done;
+    uint64_t job_generation;
+    unsigned int jobs_outstanding;
+    xcommit_job_fn job;
+    /** Set for each participant which takes part in the current job */
+    bool job_participants[XCOMMIT_MAX_PARTICIPANTS];
+    bool stopping;
+    /** Set when a transaction is left for recovery to resolve, after which commits are rejected */
+    bool failed;
+    xcommit_participant participants[XCOMMIT_MAX_PARTICIPANTS];
+    /** During recovery the coordinator's commit table */
+    xcommit_commit_record *commit_table;
+    xcommit_stop_point stop_point;
+} xcommit_set;
+
+bool xcommit_format (nvram_uio_context *const contexts[], const unsigned int num_participants,
+                     const uint64_t log_offset, const uint64_t log_size, const uint32_t num_commit_slots);
+bool xcommit_open (xcommit_set *const set, nvram_uio_context *const contexts[], const unsigned int num_contexts,
+                   const uint64_t log_offset, uint64_t *const num_redone);
+void xcommit_close (xcommit_set *const set);
+bool xcommit_commit (xcommit_set *const set, const xcommit_write *const writes, const unsigned int num_writes,
+                     xcommit_timing *const timing);
+
+#endif /* NVRAM_UIO_XCOMMIT_H_ */
@@ -0,0 +1,565 @@
+/*
+ * @file nvram_workload.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Mixed-workload generator for a NVRAM UIO device, reporting per-stream SLO attainment and tail latency
+ * @details
+ *   Runs a number of concurrent streams, each in its own thread, at a configured rate. The stream types are:
+ *   - write     : Writes of a fixed size to the write area, e.g. latency-critical commit records
+ *   - seqread   : Sequential reads through the read area, e.g. a backup or scrub
+ *   - randread  : Reads at random aligned offsets in the read area
+ *   - status    : Polling of the MEMCTRLSTATUS registers
+ *
+ *   Streams with a non-zero rate are open-loop: operations are scheduled at fixed intervals and latency is measured
+ *   from the scheduled time, so a stalled stream is charged for the operations it should have issued. Streams with
+ *   a zero rate are closed-loop, issuing the next operation as soon as the previous completes.
+ *
+ *   The workload runs against either the card, or a software model with a single serialised DMA engine. With the
+ *   card the write area is saved before the run and restored afterwards. Usage:
+ *     nvram_workload [-m] [-t <seconds>] [-r <read_offset>:<read_size>] [-w <write_offset>:<write_size>]
+ *                    [-S <type>:<transfer_size>:<rate_per_sec>:<slo_us>] ...
+ *   -m uses the software model. Each -S adds a stream, replacing the default streams.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_bench.h"
+
+#define MAX_STREAMS 16
+
+/* Parameters of the software model */
+#define MODEL_MEMORY_SIZE (256ULL * 1024 * 1024)
+#define MODEL_DMA_SETUP_NS 2000
+#define MODEL_DMA_BYTES_PER_US 500
+#define MODEL_MMIO_READ_NS 800
+
+typedef enum
+{
+    STREAM_WRITE,
+    STREAM_SEQ_READ,
+    STREAM_RAND_READ,
+    STREAM_STATUS,
+    STREAM_NUM_TYPES
+} stream_type;
+
+static const char *const stream_type_names[STREAM_NUM_TYPES] =
+{
+    [STREAM_WRITE    ] = "write",
+    [STREAM_SEQ_READ ] = "seqread",
+    [STREAM_RAND_READ] = "randread",
+    [STREAM_STATUS   ] = "status"
+};
+
+/** The configuration and results of one stream */
+typedef struct
+{
+    stream_type type;
+    size_t transfer_size;
+    /** Target operations per second, or zero for closed-loop */
+    double rate_per_sec;
+    uint64_t slo_ns;
+    /** The part of the DMA buffer used by this stream */
+    size_t buffer_offset;
+    unsigned int stream_index;
+    pthread_t thread;
+    /** The latency of each operation */
+    uint64_t *latencies_ns;
+    size_t num_latencies;
+    size_t latencies_allocated;
+    uint64_t num_errors;
+    uint64_t elapsed_ns;
+} workload_stream;
+
+/** The operations which a backend provides to the streams */
+typedef struct
+{
+    const char *name;
+    bool (*read) (workload_stream *const stream, const uint64_t card_offset);
+    bool (*write) (workload_stream *const stream, const uint64_t card_offset);
+    void (*poll_status) (workload_stream *const stream);
+} workload_backend;
+
+/** Set by the main thread to stop the streams */
+static volatile bool stop_streams;
+
+static nvram_uio_context card_context;
+
+/** The software model of the card */
+static uint8_t *model_memory;
+static uint8_t *model_dma_buffer;
+static pthread_mutex_t model_dma_engine = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint8_t model_memctrlstatus[3];
+
+static uint64_t read_offset;
+static uint64_t read_size = 64 * 1024 * 1024;
+static uint64_t write_offset = 64 * 1024 * 1024;
+static uint64_t write_size = 1024 * 1024;
+
+/**
+ * @brief Busy-wait for a duration, to model time the device is busy without giving up the CPU
+ */
+static void model_busy_wait (const uint64_t duration_ns)
+{
+    const uint64_t end_ns = get_monotonic_time_ns () + duration_ns;
+
+    while (get_monotonic_time_ns () < end_ns)
+    {
+    }
+}
+
+/**
+ * @brief Model one DMA transfer, with the single engine held for the setup time plus the transfer time
+ */
+static bool model_dma (workload_stream *const stream, const uint64_t card_offset, const bool to_card)
+{
+    pthread_mutex_lock (&model_dma_engine);
+    model_busy_wait (MODEL_DMA_SETUP_NS + ((stream->transfer_size * 1000) / MODEL_DMA_BYTES_PER_US));
+    if (to_card)
+    {
+        memcpy (&model_memory[card_offset], &model_dma_buffer[stream->buffer_offset], stream->transfer_size);
+    }
+    else
+    {
+        memcpy (&model_dma_buffer[stream->buffer_offset], &model_memory[card_offset], stream->transfer_size);
+    }
+    pthread_mutex_unlock (&model_dma_engine);
+
+    return true;
+}
+
+static bool model_read (workload_stream *const stream, const uint64_t card_offset)
+{
+    return model_dma (stream, card_offset, false);
+}
+
+static bool model_write (workload_stream *const stream, const uint64_t card_offset)
+{
+    return model_dma (stream, card_offset, true);
+}
+
+static void model_poll_status (workload_stream *const stream)
+{
+    unsigned int reg;
+    uint8_t value;
+
+    for (reg = 0; reg < sizeof (model_memctrlstatus); reg++)
+    {
+        model_busy_wait (MODEL_MMIO_READ_NS);
+        value = model_memctrlstatus[reg];
+        (void) value;
+    }
+}
+
+static bool card_read (workload_stream *const stream, const uint64_t card_offset)
+{
+    return dma_transfer (&card_context, DMA_WRITE_TO_HOST, card_offset, stream->buffer_offset, stream->transfer_size);
+}
+
+static bool card_write (workload_stream *const stream, const uint64_t card_offset)
+{
+    return dma_transfer (&card_context, DMA_READ_FROM_HOST, card_offset, stream->buffer_offset, stream->transfer_size);
+}
+
+static void card_poll_status (workload_stream *const stream)
+{
+    uint8_t value;
+
+    value = *card_context.memctrlstatus_magic;
+    value = *card_context.memctrlstatus_memory;
+    value = *card_context.memctrlstatus_battery;
+    (void) value;
+}
+
+static const workload_backend model_backend =
+{
+    .name = "software model",
+    .read = model_read,
+    .write = model_write,
+    .poll_status = model_poll_status
+};
+
+static const workload_backend card_backend =
+{
+    .name = "card",
+    .read = card_read,
+    .write = card_write,
+    .poll_status = card_poll_status
+};
+
+static const workload_backend *backend;
+
+/**
+ * @brief Record the latency of one operation of a stream
+ */
+static void record_latency (workload_stream *const stream, const uint64_t latency_ns)
+{
+    if (stream->num_latencies == stream->latencies_allocated)
+    {
+        stream->latencies_allocated = (stream->latencies_allocated == 0) ? 65536 : (stream->latencies_allocated * 2);
+        stream->latencies_ns = realloc (stream->latencies_ns, stream->latencies_allocated * sizeof (uint64_t));
+        if (stream->latencies_ns == NULL)
+        {
+            printf ("Failed to allocate latencies\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+    stream->latencies_ns[stream->num_latencies++] = latency_ns;
+}
+
+/**
+ * @brief The thread which runs one stream until stopped
+ */
+static void *stream_thread (void *const arg)
+{
+    workload_stream *const stream = arg;
+    const uint64_t interval_ns = (stream->rate_per_sec > 0.0) ? (uint64_t) (1E9 / stream->rate_per_sec) : 0;
+    const uint64_t start_ns = get_monotonic_time_ns ();
+    const uint64_t num_read_slots = (stream->transfer_size > 0) ? (read_size / stream->transfer_size) : 1;
+    const uint64_t num_write_slots = (stream->transfer_size > 0) ? (write_size / stream->transfer_size) : 1;
+    unsigned int random_state = 1 + stream->stream_index;
+    uint64_t operation_index = 0;
+    uint64_t scheduled_ns = start_ns;
+    uint64_t now_ns;
+    uint64_t slot;
+    struct timespec sleep_until;
+    bool success = true;
+
+    while (!stop_streams)
+    {
+        if (interval_ns > 0)
+        {
+            scheduled_ns = start_ns + (operation_index * interval_ns);
+            now_ns = get_monotonic_time_ns ();
+            if (scheduled_ns > now_ns)
+            {
+                sleep_until.tv_sec = (time_t) (scheduled_ns / 1000000000ULL);
+                sleep_until.tv_nsec = (long) (scheduled_ns % 1000000000ULL);
+                clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &sleep_until, NULL);
+            }
+        }
+        else
+        {
+            scheduled_ns = get_monotonic_time_ns ();
+        }
+
+        switch (stream->type)
+        {
+        case STREAM_WRITE:
+            slot = operation_index % num_write_slots;
+            success = backend->write (stream, write_offset + (slot * stream->transfer_size));
+            break;
+
+        case STREAM_SEQ_READ:
+            slot = operation_index % num_read_slots;
+            success = backend->read (stream, read_offset + (slot * stream->transfer_size));
+            break;
+
+        case STREAM_RAND_READ:
+            slot = (uint64_t) rand_r (&random_state) % num_read_slots;
+            success = backend->read (stream, read_offset + (slot * stream->transfer_size));
+            break;
+
+        case STREAM_STATUS:
+        default:
+            backend->poll_status (stream);
+            success = true;
+            break;
+        }
+
+        record_latency (stream, get_monotonic_time_ns () - scheduled_ns);
+        if (!success)
+        {
+            stream->num_errors++;
+        }
+        operation_index++;
+    }
+    stream->elapsed_ns = get_monotonic_time_ns () - start_ns;
+
+    return NULL;
+}
+
+/**
+ * @brief Parse a stream specification of the form <type>:<transfer_size>:<rate_per_sec>:<slo_us>
+ * @return Returns true if the specification is valid
+ */
+static bool parse_stream (const char *const spec, workload_stream *const stream)
+{
+    char type_name[16];
+    unsigned long transfer_size;
+    double rate_per_sec;
+    double slo_us;
+    unsigned int type;
+
+    if (sscanf (spec, "%15[^:]:%lu:%lf:%lf", type_name, &transfer_size, &rate_per_sec, &slo_us) != 4)
+    {
+        return false;
+    }
+    for (type = 0; type < STREAM_NUM_TYPES; type++)
+    {
+        if (strcmp (type_name, stream_type_names[type]) == 0)
+        {
+            memset (stream, 0, sizeof (*stream));
+            stream->type = type;
+            stream->transfer_size = (type == STREAM_STATUS) ? 0 : transfer_size;
+            stream->rate_per_sec = rate_per_sec;
+            stream->slo_ns = (uint64_t) (slo_us * 1E3);
+            return (type == STREAM_STATUS) || (transfer_size > 0);
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Parse an area of device memory of the form <offset>:<size>
+ */
+static bool parse_area (const char *const spec, uint64_t *const offset, uint64_t *const size)
+{
+    unsigned long long parsed_offset;
+    unsigned long long parsed_size;
+
+    if ((sscanf (spec, "%lli:%lli", &parsed_offset, &parsed_size) != 2) || (parsed_size == 0))
+    {
+        return false;
+    }
+    *offset = parsed_offset;
+    *size = parsed_size;
+
+    return true;
+}
+
+/**
+ * @brief Save or restore the write area of the card, in DMA buffer sized chunks
+ * @param[in,out] saved_area The host copy of the write area
+ * @param[in] restore When false save the write area, and when true restore it
+ */
+static void transfer_write_area (uint8_t *const saved_area, const bool restore)
+{
+    uint64_t done;
+    size_t chunk;
+
+    for (done = 0; done < write_size; done += chunk)
+    {
+        chunk = ((write_size - done) < card_context.dma_buffer_size) ? (write_size - done) : card_context.dma_buffer_size;
+        if (restore)
+        {
+            memcpy (card_context.dma_buffer, &saved_area[done], chunk);
+        }
+        if (!dma_transfer (&card_context, restore ? DMA_READ_FROM_HOST : DMA_WRITE_TO_HOST,
+                           write_offset + done, 0, chunk))
+        {
+            printf ("Failed to %s the write area\n", restore ? "restore" : "save");
+            exit (EXIT_FAILURE);
+        }
+        if (!restore)
+        {
+            memcpy (&saved_area[done], card_context.dma_buffer, chunk);
+        }
+    }
+}
+
+/**
+ * @brief Display the results of the streams
+ */
+static void print_results (workload_stream *const streams, const unsigned int num_streams)
+{
+    unsigned int stream_index;
+    size_t latency_index;
+    size_t num_met;
+    double elapsed_secs;
+
+    printf ("\n%-3s %-8s %8s %10s %10s %10s %8s %8s %10s %10s %10s %10s %6s\n", "#", "Type", "Size", "Target/s",
+            "Actual/s", "MB/s", "SLO us", "SLO met", "p50 us", "p99 us", "p99.9 us", "Max us", "Errors");
+    for (stream_index = 0; stream_index < num_streams; stream_index++)
+    {
+        workload_stream *const stream = &streams[stream_index];
+
+        num_met = 0;
+        for (latency_index = 0; latency_index < stream->num_latencies; latency_index++)
+        {
+            if (stream->latencies_ns[latency_index] <= stream->slo_ns)
+            {
+                num_met++;
+            }
+        }
+        elapsed_secs = (double) stream->elapsed_ns / 1E9;
+        printf ("%-3u %-8s %8zu %10.0f %10.0f %10.1f %8.1f %7.3f%% %10.1f %10.1f %10.1f %10.1f %6lu\n",
+                stream_index, stream_type_names[stream->type], stream->transfer_size, stream->rate_per_sec,
+                (double) stream->num_latencies / elapsed_secs,
+                ((double) stream->num_latencies * (double) stream->transfer_size) / (elapsed_secs * 1E6),
+                (double) stream->slo_ns / 1E3,
+                (stream->num_latencies > 0) ? ((100.0 * (double) num_met) / (double) stream->num_latencies) : 0.0,
+                (double) bench_latency_percentile (stream->latencies_ns, stream->num_latencies, 50.0) / 1E3,
+                (double) bench_latency_percentile (stream->latencies_ns, stream->num_latencies, 99.0) / 1E3,
+                (double) bench_latency_percentile (stream->latencies_ns, stream->num_latencies, 99.9) / 1E3,
+                (double) bench_latency_percentile (stream->latencies_ns, stream->num_latencies, 100.0) / 1E3,
+                (unsigned long) stream->num_errors);
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    workload_stream streams[MAX_STREAMS];
+    unsigned int num_streams = 0;
+    unsigned int stream_index;
+    unsigned int duration_secs = 10;
+    bool use_model = false;
+    uint64_t memory_size;
+    size_t buffer_size;
+    size_t buffer_offset;
+    uint8_t *saved_write_area = NULL;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "mt:r:w:S:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            use_model = true;
+            break;
+
+        case 't':
+            duration_secs = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 'r':
+            if (!parse_area (optarg, &read_offset, &read_size))
+            {
+                printf ("Invalid read area %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 'w':
+            if (!parse_area (optarg, &write_offset, &write_size))
+            {
+                printf ("Invalid write area %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 'S':
+            if ((num_streams == MAX_STREAMS) || !parse_stream (optarg, &streams[num_streams]))
+            {
+                printf ("Invalid stream %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            num_streams++;
+            break;
+
+        default:
+            printf ("Usage: %s [-m] [-t <seconds>] [-r <read_offset>:<read_size>] [-w <write_offset>:<write_size>]\n"
+                    "          [-S <write|seqread|randread|status>:<transfer_size>:<rate_per_sec>:<slo_us>] ...\n",
+                    argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    if (num_streams == 0)
+    {
+        /* Commits while a backup and lookups run, with the battery status being monitored */
+        parse_stream ("write:512:10000:50", &streams[num_streams++]);
+        parse_stream ("seqread:262144:0:5000", &streams[num_streams++]);
+        parse_stream ("randread:4096:5000:100", &streams[num_streams++]);
+        parse_stream ("status:0:1000:10", &streams[num_streams++]);
+    }
+
+    if (use_model)
+    {
+        backend = &model_backend;
+        memory_size = MODEL_MEMORY_SIZE;
+        buffer_size = 4 * 1024 * 1024;
+        model_memory = calloc (memory_size, 1);
+        model_dma_buffer = calloc (buffer_size, 1);
+        if ((model_memory == NULL) || (model_dma_buffer == NULL))
+        {
+            printf ("Failed to allocate the software model\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        backend = &card_backend;
+        find_uio_device (&card_context);
+        get_uio_device_parameters (&card_context);
+        open_uio_device (&card_context);
+        map_dma_buffer (&card_context);
+        memory_size = card_context.memory_size_bytes;
+        buffer_size = card_context.dma_buffer_size;
+    }
+
+    if (((read_offset + read_size) > memory_size) || ((write_offset + write_size) > memory_size))
+    {
+        printf ("Read or write area exceeds the device memory size of 0x%llx\n", (unsigned long long) memory_size);
+        exit (EXIT_FAILURE);
+    }
+
+    /* Give each stream its own part of the DMA buffer */
+    buffer_offset = 0;
+    for (stream_index = 0; stream_index < num_streams; stream_index++)
+    {
+        workload_stream *const stream = &streams[stream_index];
+        const uint64_t area_size = (stream->type == STREAM_WRITE) ? write_size : read_size;
+
+        stream->stream_index = stream_index;
+        stream->buffer_offset = buffer_offset;
+        buffer_offset += stream->transfer_size;
+        if ((buffer_offset > buffer_size) || (stream->transfer_size > area_size))
+        {
+            printf ("Stream %u transfer size %zu doesn't fit in the DMA buffer or its area\n",
+                    stream_index, stream->transfer_size);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    if (!use_model)
+    {
+        saved_write_area = malloc (write_size);
+        if (saved_write_area == NULL)
+        {
+            printf ("Failed to allocate saved write area\n");
+            exit (EXIT_FAILURE);
+        }
+        transfer_write_area (saved_write_area, false);
+    }
+
+    printf ("Running %u streams against the %s for %u seconds\n", num_streams, backend->name, duration_secs);
+    for (stream_index = 0; stream_index < num_streams; stream_index++)
+    {
+        if (pthread_create (&streams[stream_index].thread, NULL, stream_thread, &streams[stream_index]) != 0)
+        {
+            printf ("Failed to create stream thread\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+    sleep (duration_secs);
+    stop_streams = true;
+    for (stream_index = 0; stream_index < num_streams; stream_index++)
+    {
+        pthread_join (streams[stream_index].thread, NULL);
+    }
+
+    if (!use_model)
+    {
+        transfer_write_area (saved_write_area, true);
+        free (saved_write_area);
+        close_uio_device (&card_context);
+    }
+
+    print_results (streams, num_streams);
+    for (stream_index = 0; stream_index < num_streams; stream_index++)
+    {
+        free (streams[stream_index].latencies_ns);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,295 @@
+/*
+ * @file nvram_xcommit_bench.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Measure the latency of two-phase commits across all the NVRAM devices in the host, and check recovery
+ * @details
+ *   The log areas are formatted on every NVRAM device found, then transactions of random writes to the data area of
+ *   every device are committed. The mean time of the phases is reported, along with the slowest and the sum of the
+ *   prepare writes of the devices to show the gain from preparing in parallel. The data areas are then checked,
+ *   followed by a transaction stopped before its commit point which must be discarded on reopening, and one stopped
+ *   after its commit point which must be redone on reopening. Usage:
+ *     nvram_xcommit_bench -l <log_offset>:<log_size> -d <data_offset>:<data_size> [-t <transactions>]
+ *                         [-w <writes_per_device>] [-s <max_write_size>] [-n <commit_slots>]
+ *   The log and data areas are at the same offsets of each device, and are overwritten.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_xcommit.h"
+
+/**
+ * @brief Fill a buffer with random bytes
+ */
+static void fill_random (uint8_t *const buffer, const size_t num_bytes)
+{
+    size_t index;
+
+    for (index = 0; index < num_bytes; index++)
+    {
+        buffer[index] = (uint8_t) rand ();
+    }
+}
+
+/**
+ * @brief Generate a transaction of random writes to the data area of each participant
+ * @details The new data is written into the next copy of the data areas, which becomes the expected contents once
+ *          the transaction is known to have been applied.
+ */
+static unsigned int generate_transaction (xcommit_write *const writes, uint8_t *const *const next,
+                                          const unsigned int num_participants, const unsigned int writes_per_device,
+                                          const unsigned long long data_offset, const unsigned long long data_size,
+                                          const size_t max_write_size)
+{
+    unsigned int participant;
+    unsigned int write_index;
+    unsigned int num_writes = 0;
+    size_t offset;
+    size_t length;
+
+    for (participant = 0; participant < num_participants; participant++)
+    {
+        /* Writes of a participant are to separate slots, so they don't overlap within the transaction */
+        for (write_index = 0; write_index < writes_per_device; write_index++)
+        {
+            const size_t slot_size = (size_t) (data_size / writes_per_device);
+
+            length = 1 + ((size_t) rand () % max_write_size);
+            offset = (write_index * slot_size) + ((size_t) rand () % (slot_size - length + 1));
+            fill_random (&next[participant][offset], length);
+            writes[num_writes].participant = participant;
+            writes[num_writes].card_offset = data_offset + offset;
+            writes[num_writes].data = &next[participant][offset];
+            writes[num_writes].num_bytes = length;
+            num_writes++;
+        }
+    }
+
+    return num_writes;
+}
+
+/**
+ * @brief Compare the data area of every participant against its expected contents
+ * @return Returns true if all the data areas match
+ */
+static bool verify_data (nvram_uio_context *const contexts, const unsigned int num_participants,
+                         uint8_t *const *const expected, uint8_t *const actual,
+                         const unsigned long long data_offset, const unsigned long long data_size,
+                         const char *const description)
+{
+    unsigned int participant;
+    bool success = true;
+
+    for (participant = 0; participant < num_participants; participant++)
+    {
+        success = dma_read_to_host (&contexts[participant], data_offset, actual, data_size) &&
+                (memcmp (expected[participant], actual, data_size) == 0) && success;
+    }
+    printf ("%s: data areas %s\n", description, success ? "match" : "DIFFER");
+
+    return success;
+}
+
+int main (int argc, char *argv[])
+{
+    nvram_uio_context contexts[XCOMMIT_MAX_PARTICIPANTS];
+    nvram_uio_context *context_pointers[XCOMMIT_MAX_PARTICIPANTS];
+    uint8_t *expected[XCOMMIT_MAX_PARTICIPANTS];
+    uint8_t *next[XCOMMIT_MAX_PARTICIPANTS];
+    xcommit_set set;
+    xcommit_timing timing;
+    xcommit_timing total;
+    xcommit_write *writes;
+    uint8_t *actual;
+    unsigned long long log_offset = 0;
+    unsigned long long log_size = 0;
+    unsigned long long data_offset = 0;
+    unsigned long long data_size = 0;
+    unsigned long num_transactions = 10000;
+    unsigned int writes_per_device = 4;
+    unsigned long max_write_size = 512;
+    unsigned int num_commit_slots = 1024;
+    unsigned int num_devices;
+    unsigned int device_index;
+    unsigned int num_writes;
+    unsigned long transaction;
+    uint64_t num_redone;
+    bool success = true;
+    int opt;
+
+    while ((opt = getopt (argc, argv, "l:d:t:w:s:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            if (sscanf (optarg, "%lli:%lli", &log_offset, &log_size) != 2)
+            {
+                printf ("Invalid log area %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 'd':
+            if (sscanf (optarg, "%lli:%lli", &data_offset, &data_size) != 2)
+            {
+                printf ("Invalid data area %s\n", optarg);
+                exit (EXIT_FAILURE);
+            }
+            break;
+
+        case 't':
+            num_transactions = strtoul (optarg, NULL, 0);
+            break;
+
+        case 'w':
+            writes_per_device = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        case 's':
+            max_write_size = strtoul (optarg, NULL, 0);
+            break;
+
+        case 'n':
+            num_commit_slots = (unsigned int) strtoul (optarg, NULL, 0);
+            break;
+
+        default:
+            printf ("Usage: %s -l <log_offset>:<log_size> -d <data_offset>:<data_size> [-t <transactions>]\n"
+                    "         [-w <writes_per_device>] [-s <max_write_size>] [-n <commit_slots>]\n", argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if ((log_size == 0) || (writes_per_device == 0) || (writes_per_device > XCOMMIT_MAX_WRITES) ||
+        (max_write_size == 0) || ((data_size / writes_per_device) < max_write_size))
+    {
+        printf ("The log and data areas must be specified, with room for each write\n");
+        exit (EXIT_FAILURE);
+    }
+
+    num_devices = find_uio_devices (contexts, XCOMMIT_MAX_PARTICIPANTS);
+    if (num_devices == 0)
+    {
+        printf ("No NVRAM devices found\n");
+        exit (EXIT_FAILURE);
+    }
+    writes = calloc (num_devices * writes_per_device, sizeof (writes[0]));
+    actual = malloc (data_size);
+    success = (writes != NULL) && (actual != NULL);
+    for (device_index = 0; device_index < num_devices; device_index++)
+    {
+        get_uio_device_parameters (&contexts[device_index]);
+        open_uio_device (&contexts[device_index]);
+        map_dma_buffer (&contexts[device_index]);
+        context_pointers[device_index] = &contexts[device_index];
+        expected[device_index] = malloc (data_size);
+        next[device_index] = malloc (data_size);
+        success = success && (expected[device_index] != NULL) && (next[device_index] != NULL);
+    }
+    if (!success)
+    {
+        printf ("Failed to allocate host copies of the data areas\n");
+        exit (EXIT_FAILURE);
+    }
+
+    /* Start with the existing contents of the data areas as the expected contents */
+    for (device_index = 0; success && (device_index < num_devices); device_index++)
+    {
+        success = dma_read_to_host (&contexts[device_index], data_offset, expected[device_index], data_size);
+        memcpy (next[device_index], expected[device_index], data_size);
+    }
+    if (!success || !xcommit_format (context_pointers, num_devices, log_offset, log_size, num_commit_slots) ||
+        !xcommit_open (&set, context_pointers, num_devices, log_offset, &num_redone))
+    {
+        printf ("Failed to create a set of %u participants\n", num_devices);
+        exit (EXIT_FAILURE);
+    }
+
+    memset (&total, 0, sizeof (total));
+    for (transaction = 0; success && (transaction < num_transactions); transaction++)
+    {
+        num_writes = generate_transaction (writes, next, num_devices, writes_per_device, data_offset, data_size,
+                                           max_write_size);
+        success = xcommit_commit (&set, writes, num_writes, &timing);
+        total.prepare_ns += timing.prepare_ns;
+        total.slowest_prepare_ns += timing.slowest_prepare_ns;
+        total.sum_prepare_ns += timing.sum_prepare_ns;
+        total.commit_record_ns += timing.commit_record_ns;
+        total.apply_ns += timing.apply_ns;
+        for (device_index = 0; device_index < num_devices; device_index++)
+        {
+            memcpy (expected[device_index], next[device_index], data_size);
+        }
+    }
+    if (!success)
+    {
+        printf ("Transaction %lu failed\n", transaction);
+        exit (EXIT_FAILURE);
+    }
+    printf ("%lu transactions over %u devices, mean times in microseconds:\n", num_transactions, num_devices);
+    printf ("  Prepare %.2f (slowest device %.2f, sum of devices %.2f)  Commit record %.2f  Commit latency %.2f"
+            "  Apply %.2f\n",
+            (double) total.prepare_ns / 1E3 / (double) num_transactions,
+            (double) total.slowest_prepare_ns / 1E3 / (double) num_transactions,
+            (double) total.sum_prepare_ns / 1E3 / (double) num_transactions,
+            (double) total.commit_record_ns / 1E3 / (double) num_transactions,
+            (double) (total.prepare_ns + total.commit_record_ns) / 1E3 / (double) num_transactions,
+            (double) total.apply_ns / 1E3 / (double) num_transactions);
+    success = verify_data (contexts, num_devices, expected, actual, data_offset, data_size, "After commits");
+
+    /* A transaction stopped before its commit point must be discarded */
+    num_writes = generate_transaction (writes, next, num_devices, writes_per_device, data_offset, data_size,
+                                       max_write_size);
+    set.stop_point = XCOMMIT_STOP_AFTER_PREPARE;
+    success = xcommit_commit (&set, writes, num_writes, NULL) && success;
+    xcommit_close (&set);
+    for (device_index = 0; device_index < num_devices; device_index++)
+    {
+        memcpy (next[device_index], expected[device_index], data_size);
+    }
+    if (!xcommit_open (&set, context_pointers, num_devices, log_offset, &num_redone))
+    {
+        printf ("Failed to reopen the set\n");
+        exit (EXIT_FAILURE);
+    }
+    printf ("Reopened after stopping before the commit point, %lu records redone\n", (unsigned long) num_redone);
+    success = verify_data (contexts, num_devices, expected, actual, data_offset, data_size, "  Uncommitted") &&
+            success;
+
+    /* A transaction stopped after its commit point must be redone */
+    num_writes = generate_transaction (writes, next, num_devices, writes_per_device, data_offset, data_size,
+                                       max_write_size);
+    set.stop_point = XCOMMIT_STOP_AFTER_COMMIT;
+    success = xcommit_commit (&set, writes, num_writes, NULL) && success;
+    xcommit_close (&set);
+    for (device_index = 0; device_index < num_devices; device_index++)
+    {
+        memcpy (expected[device_index], next[device_index], data_size);
+    }
+    if (!xcommit_open (&set, context_pointers, num_devices, log_offset, &num_redone))
+    {
+        printf ("Failed to reopen the set\n");
+        exit (EXIT_FAILURE);
+    }
+    printf ("Reopened after stopping after the commit point, %lu records redone\n", (unsigned long) num_redone);
+    success = verify_data (contexts, num_devices, expected, actual, data_offset, data_size, "  Committed") &&
+            success && (num_redone == num_devices);
+    xcommit_close (&set);
+
+    for (device_index = 0; device_index < num_devices; device_index++)
+    {
+        close_uio_device (&contexts[device_index]);
+        free (expected[device_index]);
+        free (next[device_index]);
+    }
+    free (writes);
+    free (actual);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
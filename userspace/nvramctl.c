@@ -0,0 +1,839 @@
+/*
+ * @file nvramctl.c
+ * @date 18 Oct 2026
+ * @author Chester Gillon
+ * @brief Control and query a NVRAM device, either one command per run or a batch of commands on one open device
+ * @details
+ *   The device is found and its registers mapped once, and then kept open for all the commands of a batch, so a
+ *   status query only costs the register reads. The DMA buffer is only mapped on the first command which needs it.
+ *   Usage:
+ *     nvramctl [-d <uio_device_name>] <command> [<args>]   Run one command
+ *     nvramctl [-d <uio_device_name>] -b                     Run commands read one per line from stdin
+ *     nvramctl [-d <uio_device_name>] -s <socket_path>       Serve commands from clients of a Unix socket
+ *     nvramctl -c <socket_path> <command> [<args>]           Run one command on a server
+ *   In batch and socket modes the output of each command is followed by a line of either "OK" or "ERROR <reason>".
+ *   The commands are:
+ *     status                                   The device status registers and recovery state
+ *     led <fault|power|remove> <off|on|flash3|flash7|flip>
+ *     errlog [clear]                           The ECC error log, optionally clearing the error count
+ *     dma read <offset> <length>               Hex dump device memory read by DMA
+ *     dma write <offset> <hex_bytes>           Write bytes to the device memory by DMA
+ *     bench <scratch_offset> [<iterations>]    The standard DMA sweeps, using the DMA buffer size of device memory at
+ *                                              scratch_offset, which must not be in use by other clients
+ *     help
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <endian.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nvram_uio_access.h"
+#include "nvram_uio_dma.h"
+#include "nvram_uio_bench.h"
+
+/* The longest command line accepted, and the most arguments in a command */
+#define MAX_COMMAND_LENGTH 4096
+#define MAX_COMMAND_ARGS 8
+
+/* The most bytes a dma read command dumps */
+#define MAX_DUMP_LENGTH 65536
+
+/* The most clients the server handles at once */
+#define MAX_CLIENTS 16
+
+/* The default number of transfers of each size for the bench command */
+#define DEFAULT_BENCH_ITERATIONS 100
+
+/** The state kept across the commands of a run */
+typedef struct
+{
+    nvram_uio_context context;
+    /** Set once the DMA buffer has been mapped by a command which needs it */
+    bool dma_mapped;
+    /** The reason the last command failed */
+    char error[256];
+} ctl_state;
+
+/** The function which performs a command, writing its output to out */
+typedef bool (*command_fn) (ctl_state *const state, const int argc, char *argv[], FILE *const out);
+
+/** One of the commands */
+typedef struct
+{
+    const char *name;
+    const char *usage;
+    command_fn fn;
+} command_definition;
+
+/** A client connected to the server, with the part of a command line received so far */
+typedef struct
+{
+    int fd;
+    char line[MAX_COMMAND_LENGTH];
+    size_t line_length;
+    /** Set when the line being received is too long, so it is discarded up to the next newline */
+    bool discarding;
+} server_client;
+
+/** Set by a signal handler to request the server exits */
+static volatile sig_atomic_t exit_requested;
+
+static const command_definition commands[];
+
+/**
+ * @brief Record the reason a command failed
+ * @return Always false, to be returned by the command
+ */
+static bool command_error (ctl_state *const state, const char *const format, ...)
+{
+    va_list args;
+
+    va_start (args, format);
+    vsnprintf (state->error, sizeof (state->error), format, args);
+    va_end (args);
+
+    return false;
+}
+
+/**
+ * @brief Record the usage of a command as the reason it failed
+ * @return Always false, to be returned by the command
+ */
+static bool usage_error (ctl_state *const state, const char *const name)
+{
+    unsigned int command_index;
+
+    for (command_index = 0; commands[command_index].name != NULL; command_index++)
+    {
+        if (strcmp (name, commands[command_index].name) == 0)
+        {
+            return command_error (state, "usage: %s %s", name, commands[command_index].usage);
+        }
+    }
+
+    return command_error (state, "unknown command %s", name);
+}
+
+/**
+ * @brief Parse an unsigned number in any base accepted by strtoull
+ * @return Returns true if the whole of text is a number
+ */
+static bool parse_number (const char *const text, uint64_t *const value)
+{
+    char *end;
+
+    errno = 0;
+    *value = strtoull (text, &end, 0);
+
+    return (errno == 0) && (end != text) && (*end == '\0');
+}
+
+/**
+ * @brief Map the DMA buffer on the first command which needs it
+ */
+static void require_dma (ctl_state *const state)
+{
+    if (!state->dma_mapped)
+    {
+        map_dma_buffer (&state->context);
+        state->dma_mapped = true;
+    }
+}
+
+/**
+ * @brief Display the device status registers and the PCI error recovery state
+ */
+static bool command_status (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    nvram_uio_context *const context = &state->context;
+    const uint8_t battery = *context->memctrlstatus_battery;
+    unsigned int recovery_state;
+    unsigned int recovery_count;
+
+    if (argc != 1)
+    {
+        return usage_error (state, argv[0]);
+    }
+    fprintf (out, "device=%s\n", context->device_name);
+    fprintf (out, "magic=0x%02x\n", *context->memctrlstatus_magic);
+    fprintf (out, "memory_size=%" PRIu64 "\n", decode_memory_size (*context->memctrlstatus_memory));
+    fprintf (out, "battery1=%s,%s\n", (battery & BATTERY_1_DISABLED) ? "disabled" : "enabled",
+             (battery & BATTERY_1_FAILURE) ? "failure" : "ok");
+    fprintf (out, "battery2=%s,%s\n", (battery & BATTERY_2_DISABLED) ? "disabled" : "enabled",
+             (battery & BATTERY_2_FAILURE) ? "failure" : "ok");
+    fprintf (out, "ledctrl=0x%02x\n", *context->memctrlcmd_ledctrl);
+    fprintf (out, "errctrl=0x%02x\n", *context->memctrlcmd_errctrl);
+    fprintf (out, "errcnt=%u\n", *context->memctrlcmd_errcnt);
+    if (read_device_recovery (context->device_name, &recovery_state, &recovery_count))
+    {
+        fprintf (out, "recovery_state=%u\n", recovery_state);
+        fprintf (out, "recovery_count=%u\n", recovery_count);
+    }
+    publish_device_status (context);
+
+    return true;
+}
+
+/**
+ * @brief Set the state of one of the LEDs
+ */
+static bool command_led (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    int shift;
+    unsigned char led_state;
+
+    if (argc != 3)
+    {
+        return usage_error (state, argv[0]);
+    }
+
+    if (strcmp (argv[1], "fault") == 0)
+    {
+        shift = LED_FAULT;
+    }
+    else if (strcmp (argv[1], "power") == 0)
+    {
+        shift = LED_POWER;
+    }
+    else if (strcmp (argv[1], "remove") == 0)
+    {
+        shift = LED_REMOVE;
+    }
+    else
+    {
+        return command_error (state, "unknown LED %s", argv[1]);
+    }
+
+    if (strcmp (argv[2], "off") == 0)
+    {
+        led_state = (shift == LED_POWER) ? LED_POWER_OFF : LED_OFF;
+    }
+    else if (strcmp (argv[2], "on") == 0)
+    {
+        led_state = (shift == LED_POWER) ? LED_POWER_ON : LED_ON;
+    }
+    else if (strcmp (argv[2], "flash3") == 0)
+    {
+        led_state = LED_FLASH_3_5;
+    }
+    else if (strcmp (argv[2], "flash7") == 0)
+    {
+        led_state = LED_FLASH_7_0;
+    }
+    else if (strcmp (argv[2], "flip") == 0)
+    {
+        led_state = LED_FLIP;
+    }
+    else
+    {
+        return command_error (state, "unknown LED state %s", argv[2]);
+    }
+
+    set_led (&state->context, shift, led_state);
+    fprintf (out, "ledctrl=0x%02x\n", *state->context.memctrlcmd_ledctrl);
+
+    return true;
+}
+
+/**
+ * @brief Display the ECC error log registers, and optionally clear the error count
+ */
+static bool command_errlog (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    volatile char *const csr = state->context.csr;
+    const bool clear = (argc == 2) && (strcmp (argv[1], "clear") == 0);
+    uint64_t data_log;
+    uint64_t addr_log;
+
+    if ((argc > 2) || ((argc == 2) && !clear))
+    {
+        return usage_error (state, argv[0]);
+    }
+
+    data_log = le32toh (*(volatile uint32_t *) &csr[ERROR_DATA_LOG]) |
+            ((uint64_t) le32toh (*(volatile uint32_t *) &csr[ERROR_DATA_LOG + 4]) << 32);
+    addr_log = le32toh (*(volatile uint32_t *) &csr[ERROR_ADDR_LOG]) |
+            ((uint64_t) *(volatile uint8_t *) &csr[ERROR_ADDR_LOG + 4] << 32);
+    fprintf (out, "errstatus=0x%02x\n", *(volatile uint8_t *) &csr[MEMCTRLCMD_ERRSTATUS]);
+    fprintf (out, "error_count=%u\n", *(volatile uint8_t *) &csr[ERROR_COUNT]);
+    fprintf (out, "error_data=0x%016" PRIx64 "\n", data_log);
+    fprintf (out, "error_address=0x%010" PRIx64 "\n", addr_log);
+    fprintf (out, "error_syndrome=0x%02x\n", *(volatile uint8_t *) &csr[ERROR_SYNDROME]);
+    fprintf (out, "error_check=0x%02x\n", *(volatile uint8_t *) &csr[ERROR_CHECK]);
+    if (clear)
+    {
+        *(volatile uint8_t *) &csr[ERROR_COUNT] = 0;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read device memory by DMA and hex dump it, or write bytes given in hex to the device memory by DMA
+ */
+static bool command_dma (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    nvram_uio_context *const context = &state->context;
+    uint8_t bytes[MAX_DUMP_LENGTH];
+    uint64_t offset;
+    uint64_t length;
+    size_t index;
+    unsigned int byte;
+
+    if ((argc != 4) || !parse_number (argv[2], &offset))
+    {
+        return usage_error (state, argv[0]);
+    }
+
+    if (strcmp (argv[1], "read") == 0)
+    {
+        if (!parse_number (argv[3], &length) || (length == 0) || (length > MAX_DUMP_LENGTH))
+        {
+            return command_error (state, "length must be 1 to %u bytes", MAX_DUMP_LENGTH);
+        }
+        require_dma (state);
+        if (!dma_read_to_host (context, offset, bytes, length))
+        {
+            return command_error (state, "DMA read of 0x%" PRIx64 " bytes at 0x%" PRIx64 " failed", length, offset);
+        }
+        for (index = 0; index < length; index++)
+        {
+            if ((index % 16) == 0)
+            {
+                fprintf (out, "%s%010" PRIx64 ":", (index == 0) ? "" : "\n", offset + index);
+            }
+            fprintf (out, " %02x", bytes[index]);
+        }
+        fprintf (out, "\n");
+    }
+    else if (strcmp (argv[1], "write") == 0)
+    {
+        length = strlen (argv[3]) / 2;
+        if (((strlen (argv[3]) % 2) != 0) || (length == 0) || (length > MAX_DUMP_LENGTH))
+        {
+            return command_error (state, "hex_bytes must be pairs of hex digits");
+        }
+        for (index = 0; index < length; index++)
+        {
+            if (sscanf (&argv[3][index * 2], "%2x", &byte) != 1)
+            {
+                return command_error (state, "invalid hex digits at byte %zu", index);
+            }
+            bytes[index] = (uint8_t) byte;
+        }
+        require_dma (state);
+        if (!dma_write_from_host (context, offset, bytes, length))
+        {
+            return command_error (state, "DMA write of 0x%" PRIx64 " bytes at 0x%" PRIx64 " failed", length, offset);
+        }
+        fprintf (out, "wrote %" PRIu64 " bytes at 0x%" PRIx64 "\n", length, offset);
+    }
+    else
+    {
+        return usage_error (state, argv[0]);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Run the standard DMA sweeps
+ * @details The offset of the scratch area is required, rather than defaulting to the start of the device memory,
+ *          since a write made by another client between the read and write-back of a sweep transfer is lost.
+ */
+static bool command_bench (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    bench_sweep_results results;
+    uint64_t offset;
+    uint64_t iterations = DEFAULT_BENCH_ITERATIONS;
+
+    if ((argc < 2) || (argc > 3) || !parse_number (argv[1], &offset) ||
+        ((argc > 2) && (!parse_number (argv[2], &iterations) || (iterations == 0) || (iterations > UINT32_MAX))))
+    {
+        return usage_error (state, argv[0]);
+    }
+
+    require_dma (state);
+    bench_run_sweeps (&state->context, offset, (unsigned int) iterations, &results);
+    bench_print_sweeps (out, &results);
+
+    return true;
+}
+
+/**
+ * @brief List the commands
+ */
+static bool command_help (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    unsigned int command_index;
+
+    for (command_index = 0; commands[command_index].name != NULL; command_index++)
+    {
+        fprintf (out, "%s%s%s\n", commands[command_index].name, (commands[command_index].usage[0] != '\0') ? " " : "",
+                 commands[command_index].usage);
+    }
+
+    return true;
+}
+
+static const command_definition commands[] =
+{
+    {"status", "", command_status},
+    {"led", "<fault|power|remove> <off|on|flash3|flash7|flip>", command_led},
+    {"errlog", "[clear]", command_errlog},
+    {"dma", "read <offset> <length> | write <offset> <hex_bytes>", command_dma},
+    {"bench", "<scratch_offset> [<iterations>]", command_bench},
+    {"help", "", command_help},
+    {NULL, NULL, NULL}
+};
+
+/**
+ * @brief Run one command given as arguments
+ * @param[in,out] state The state of the run, which has the device open
+ * @param[in] argc The number of arguments, including the command name
+ * @param[in] argv The command name and its arguments
+ * @param[in,out] out The stream for the output of the command
+ * @return Returns true if the command succeeded, or false with state->error set
+ */
+static bool run_command (ctl_state *const state, const int argc, char *argv[], FILE *const out)
+{
+    unsigned int command_index;
+
+    if (argc == 0)
+    {
+        return command_error (state, "no command");
+    }
+    for (command_index = 0; commands[command_index].name != NULL; command_index++)
+    {
+        if (strcmp (argv[0], commands[command_index].name) == 0)
+        {
+            return commands[command_index].fn (state, argc, argv, out);
+        }
+    }
+
+    return command_error (state, "unknown command %s", argv[0]);
+}
+
+/**
+ * @brief Run one command line, and return its output followed by the line giving the result
+ * @param[in,out] state The state of the run, which has the device open
+ * @param[in,out] line The command line without the newline, which is split into arguments in place
+ * @param[out] response_size The size of the response
+ * @return The response, to be freed by the caller, or NULL if a blank line
+ */
+static char *run_command_line (ctl_state *const state, char *const line, size_t *const response_size)
+{
+    char *argv[MAX_COMMAND_ARGS + 1];
+    char *saveptr;
+    char *response = NULL;
+    FILE *out;
+    int argc = 0;
+    char *token;
+
+    for (token = strtok_r (line, " \t\r", &saveptr); token != NULL; token = strtok_r (NULL, " \t\r", &saveptr))
+    {
+        if (argc < (MAX_COMMAND_ARGS + 1))
+        {
+            argv[argc] = token;
+        }
+        argc++;
+    }
+    if ((argc == 0) || (argv[0][0] == '#'))
+    {
+        return NULL;
+    }
+
+    out = open_memstream (&response, response_size);
+    if (out == NULL)
+    {
+        printf ("Failed to create a response stream\n");
+        exit (EXIT_FAILURE);
+    }
+    if (argc > MAX_COMMAND_ARGS)
+    {
+        fprintf (out, "ERROR too many arguments\n");
+    }
+    else if (run_command (state, argc, argv, out))
+    {
+        fprintf (out, "OK\n");
+    }
+    else
+    {
+        fprintf (out, "ERROR %s\n", state->error);
+    }
+    fclose (out);
+
+    return response;
+}
+
+/**
+ * @brief Write all of a buffer to a file descriptor
+ * @return Returns true if all the buffer was written
+ */
+static bool write_all (const int fd, const char *const buffer, const size_t num_bytes)
+{
+    size_t bytes_written = 0;
+    ssize_t rc;
+
+    while (bytes_written < num_bytes)
+    {
+        rc = write (fd, &buffer[bytes_written], num_bytes - bytes_written);
+        if (rc > 0)
+        {
+            bytes_written += (size_t) rc;
+        }
+        else if ((rc < 0) && (errno != EINTR))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Run commands read one per line from stdin, until the end of stdin
+ * @return Returns true if all the commands succeeded
+ */
+static bool run_batch (ctl_state *const state)
+{
+    char line[MAX_COMMAND_LENGTH];
+    char *response;
+    size_t response_size;
+    bool success = true;
+
+    while (fgets (line, sizeof (line), stdin) != NULL)
+    {
+        line[strcspn (line, "\n")] = '\0';
+        response = run_command_line (state, line, &response_size);
+        if (response != NULL)
+        {
+            success = (strncmp (&response[response_size - 3], "OK\n", 3) == 0) && success;
+            fwrite (response, 1, response_size, stdout);
+            fflush (stdout);
+            free (response);
+        }
+    }
+
+    return success;
+}
+
+/**
+ * @brief Signal handler to request the server exits
+ */
+static void request_exit (int sig)
+{
+    exit_requested = 1;
+}
+
+/**
+ * @brief Run the command lines received from a client, returning the response to each
+ * @return Returns false if the client has disconnected or a response couldn't be sent, so the client is closed
+ */
+static bool serve_client (ctl_state *const state, server_client *const client)
+{
+    char buffer[MAX_COMMAND_LENGTH];
+    char *response;
+    size_t response_size;
+    ssize_t num_bytes;
+    ssize_t index;
+    bool success = true;
+
+    num_bytes = read (client->fd, buffer, sizeof (buffer));
+    if (num_bytes <= 0)
+    {
+        return (num_bytes < 0) && (errno == EINTR);
+    }
+
+    for (index = 0; success && (index < num_bytes); index++)
+    {
+        if (buffer[index] != '\n')
+        {
+            if (client->line_length < (sizeof (client->line) - 1))
+            {
+                client->line[client->line_length++] = buffer[index];
+            }
+            else
+            {
+                client->discarding = true;
+            }
+        }
+        else if (client->discarding)
+        {
+            static const char too_long[] = "ERROR command too long\n";
+
+            success = write_all (client->fd, too_long, sizeof (too_long) - 1);
+            client->line_length = 0;
+            client->discarding = false;
+        }
+        else
+        {
+            client->line[client->line_length] = '\0';
+            client->line_length = 0;
+            response = run_command_line (state, client->line, &response_size);
+            if (response != NULL)
+            {
+                success = write_all (client->fd, response, response_size);
+                free (response);
+            }
+        }
+    }
+
+    return success;
+}
+
+/**
+ * @brief Serve commands from the clients of a Unix socket, until a signal requests the server to exit
+ * @details The clients are served in turn from one thread, so the commands of different clients don't overlap.
+ */
+static void run_server (ctl_state *const state, const char *const socket_path)
+{
+    server_client clients[MAX_CLIENTS];
+    struct pollfd poll_fds[MAX_CLIENTS + 1];
+    struct sockaddr_un address;
+    struct sigaction action;
+    unsigned int num_clients = 0;
+    unsigned int client_index;
+    int listen_fd;
+    int client_fd;
+    int rc;
+
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = request_exit;
+    sigaction (SIGINT, &action, NULL);
+    sigaction (SIGTERM, &action, NULL);
+    signal (SIGPIPE, SIG_IGN);
+
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    if (strlen (socket_path) >= sizeof (address.sun_path))
+    {
+        printf ("Socket path %s is too long\n", socket_path);
+        exit (EXIT_FAILURE);
+    }
+    strcpy (address.sun_path, socket_path);
+    listen_fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink (socket_path);
+    if ((listen_fd < 0) || (bind (listen_fd, (struct sockaddr *) &address, sizeof (address)) != 0) ||
+        (listen (listen_fd, MAX_CLIENTS) != 0))
+    {
+        printf ("Failed to listen on %s\n", socket_path);
+        perror (NULL);
+        exit (EXIT_FAILURE);
+    }
+
+    while (!exit_requested)
+    {
+        poll_fds[0].fd = listen_fd;
+        poll_fds[0].events = POLLIN;
+        for (client_index = 0; client_index < num_clients; client_index++)
+        {
+            poll_fds[1 + client_index].fd = clients[client_index].fd;
+            poll_fds[1 + client_index].events = POLLIN;
+        }
+        rc = poll (poll_fds, 1 + num_clients, -1);
+        if (rc <= 0)
+        {
+            continue;
+        }
+
+        /* Serve the existing clients before accepting another, so the indices in poll_fds still match */
+        client_index = 0;
+        while (client_index < num_clients)
+        {
+            if ((poll_fds[1 + client_index].revents != 0) && !serve_client (state, &clients[client_index]))
+            {
+                close (clients[client_index].fd);
+                num_clients--;
+                clients[client_index] = clients[num_clients];
+                poll_fds[1 + client_index] = poll_fds[1 + num_clients];
+            }
+            else
+            {
+                client_index++;
+            }
+        }
+
+        if ((poll_fds[0].revents & POLLIN) != 0)
+        {
+            client_fd = accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if ((client_fd >= 0) && (num_clients < MAX_CLIENTS))
+            {
+                clients[num_clients].fd = client_fd;
+                clients[num_clients].line_length = 0;
+                clients[num_clients].discarding = false;
+                num_clients++;
+            }
+            else if (client_fd >= 0)
+            {
+                close (client_fd);
+            }
+        }
+    }
+
+    for (client_index = 0; client_index < num_clients; client_index++)
+    {
+        close (clients[client_index].fd);
+    }
+    close (listen_fd);
+    unlink (socket_path);
+}
+
+/**
+ * @brief Send one command to a server, and display its output
+ * @return Returns true if the command succeeded
+ */
+static bool run_client (const char *const socket_path, const int argc, char *argv[])
+{
+    struct sockaddr_un address;
+    char request[MAX_COMMAND_LENGTH];
+    char response[MAX_COMMAND_LENGTH];
+    size_t request_length = 0;
+    char last_line[MAX_COMMAND_LENGTH];
+    size_t last_line_length = 0;
+    ssize_t num_bytes;
+    ssize_t index;
+    int arg_index;
+    int fd;
+
+    for (arg_index = 0; arg_index < argc; arg_index++)
+    {
+        request_length += (size_t) snprintf (&request[request_length], sizeof (request) - request_length, "%s%s",
+                                             argv[arg_index], (arg_index < (argc - 1)) ? " " : "\n");
+        if (request_length >= sizeof (request))
+        {
+            printf ("Command too long\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strncpy (address.sun_path, socket_path, sizeof (address.sun_path) - 1);
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if ((fd < 0) || (connect (fd, (struct sockaddr *) &address, sizeof (address)) != 0) ||
+        !write_all (fd, request, request_length))
+    {
+        printf ("Failed to send command to %s\n", socket_path);
+        perror (NULL);
+        exit (EXIT_FAILURE);
+    }
+    shutdown (fd, SHUT_WR);
+
+    /* The server closes the connection after the response, whose last line gives the result */
+    last_line[0] = '\0';
+    while ((num_bytes = read (fd, response, sizeof (response))) > 0)
+    {
+        fwrite (response, 1, (size_t) num_bytes, stdout);
+        for (index = 0; index < num_bytes; index++)
+        {
+            if (response[index] == '\n')
+            {
+                last_line_length = 0;
+            }
+            else if (last_line_length < (sizeof (last_line) - 1))
+            {
+                last_line[last_line_length++] = response[index];
+                last_line[last_line_length] = '\0';
+            }
+        }
+    }
+    close (fd);
+
+    return strcmp (last_line, "OK") == 0;
+}
+
+int main (int argc, char *argv[])
+{
+    static ctl_state state;
+    const char *socket_path = NULL;
+    const char *client_socket_path = NULL;
+    const char *device_name = NULL;
+    bool batch = false;
+    bool success;
+    int opt;
+
+    /* Options are only accepted before the command, so the command's arguments aren't parsed as options */
+    while ((opt = getopt (argc, argv, "+d:bs:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            device_name = optarg;
+            break;
+
+        case 'b':
+            batch = true;
+            break;
+
+        case 's':
+            socket_path = optarg;
+            break;
+
+        case 'c':
+            client_socket_path = optarg;
+            break;
+
+        default:
+            printf ("Usage: %s [-d <uio_device_name>] <command> [<args>] | -b | -s <socket_path>\n"
+                    "       %s -c <socket_path> <command> [<args>]\n", argv[0], argv[0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if ((batch || (socket_path != NULL)) == (optind < argc))
+    {
+        printf ("Either a command, or one of -b or -s, must be given\n");
+        exit (EXIT_FAILURE);
+    }
+
+    if (client_socket_path != NULL)
+    {
+        return run_client (client_socket_path, argc - optind, &argv[optind]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (device_name != NULL)
+    {
+        memset (&state.context, 0, sizeof (state.context));
+        snprintf (state.context.device_name, sizeof (state.context.device_name), "%s", device_name);
+    }
+    else
+    {
+        find_uio_device (&state.context);
+    }
+    get_uio_device_parameters (&state.context);
+    open_uio_device (&state.context);
+
+    if (batch)
+    {
+        success = run_batch (&state);
+    }
+    else if (socket_path != NULL)
+    {
+        run_server (&state, socket_path);
+        success = true;
+    }
+    else
+    {
+        success = run_command (&state, argc - optind, &argv[optind], stdout);
+        if (!success)
+        {
+            printf ("%s\n", state.error);
+        }
+    }
+    close_uio_device (&state.context);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}